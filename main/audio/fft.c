@@ -0,0 +1,125 @@
+#include "fft.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+_Static_assert(FFT_SIZE == 1 << (2 * FFT_LOG4_SIZE), "FFT_SIZE must be 4^FFT_LOG4_SIZE");
+
+/* W^k = cos(2 pi k / N) - i sin(2 pi k / N); the butterflies reach k < 3N/4 */
+static int16_t w_re[FFT_SIZE * 3 / 4];
+static int16_t w_im[FFT_SIZE * 3 / 4];
+static int16_t hann[FFT_SIZE];
+static uint8_t digit_rev[FFT_SIZE];
+static bool ready;
+
+_Static_assert(FFT_SIZE <= 256, "digit_rev holds 8-bit indices");
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static int16_t to_q15(double v)
+{
+    long q = lround(v * 32768.0);
+    return q > INT16_MAX ? INT16_MAX : q < INT16_MIN ? INT16_MIN : (int16_t)q;
+}
+
+static inline fft_cpx_t twiddle(fft_cpx_t a, uint32_t k)
+{
+    int32_t wr = w_re[k];
+    int32_t wi = w_im[k];
+    fft_cpx_t r = {
+        .re = (int16_t)((a.re * wr - a.im * wi + (1 << 14)) >> 15),
+        .im = (int16_t)((a.re * wi + a.im * wr + (1 << 14)) >> 15),
+    };
+    return r;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void fft_init(void)
+{
+    if (ready) {
+        return;
+    }
+    for (uint32_t k = 0; k < FFT_SIZE * 3 / 4; k++) {
+        double angle = 2.0 * M_PI * k / FFT_SIZE;
+        w_re[k] = to_q15(cos(angle));
+        w_im[k] = to_q15(-sin(angle));
+    }
+    for (uint32_t k = 0; k < FFT_SIZE; k++) {
+        hann[k] = to_q15(0.5 - 0.5 * cos(2.0 * M_PI * k / FFT_SIZE));
+
+        uint32_t rev = 0;
+        for (uint32_t d = 0; d < FFT_LOG4_SIZE; d++) {
+            rev = (rev << 2) | ((k >> (2 * d)) & 3);
+        }
+        digit_rev[k] = (uint8_t)rev;
+    }
+    ready = true;
+}
+
+/* Apply a Hann window to FFT_SIZE samples, as the real parts of x */
+void fft_window_q15(const int16_t *pcm, fft_cpx_t *x)
+{
+    for (uint32_t k = 0; k < FFT_SIZE; k++) {
+        x[k].re = (int16_t)((pcm[k] * hann[k]) >> 15);
+        x[k].im = 0;
+    }
+}
+
+/* In-place transform of FFT_SIZE points, scaled by 1/FFT_SIZE */
+void fft_q15(fft_cpx_t *x)
+{
+    for (uint32_t k = 0; k < FFT_SIZE; k++) {
+        uint32_t r = digit_rev[k];
+        if (r > k) {
+            fft_cpx_t t = x[k];
+            x[k] = x[r];
+            x[r] = t;
+        }
+    }
+
+    for (uint32_t len = 4; len <= FFT_SIZE; len *= 4) {
+        uint32_t quarter = len / 4;
+        uint32_t step = FFT_SIZE / len;
+
+        for (uint32_t base = 0; base < FFT_SIZE; base += len) {
+            fft_cpx_t *p = &x[base];
+            for (uint32_t j = 0; j < quarter; j++) {
+                fft_cpx_t a = p[j];
+                fft_cpx_t b = p[j + quarter];
+                fft_cpx_t c = p[j + 2 * quarter];
+                fft_cpx_t d = p[j + 3 * quarter];
+
+                // The first butterfly of every group has unit twiddles
+                if (j) {
+                    b = twiddle(b, j * step);
+                    c = twiddle(c, 2 * j * step);
+                    d = twiddle(d, 3 * j * step);
+                }
+
+                int32_t s0r = a.re + c.re, s0i = a.im + c.im;
+                int32_t s1r = a.re - c.re, s1i = a.im - c.im;
+                int32_t s2r = b.re + d.re, s2i = b.im + d.im;
+                int32_t s3r = b.re - d.re, s3i = b.im - d.im;
+
+                // X0 = s0 + s2, X1 = s1 - i s3, X2 = s0 - s2, X3 = s1 + i s3, each / 4
+                p[j].re = (int16_t)((s0r + s2r) >> 2);
+                p[j].im = (int16_t)((s0i + s2i) >> 2);
+                p[j + quarter].re = (int16_t)((s1r + s3i) >> 2);
+                p[j + quarter].im = (int16_t)((s1i - s3r) >> 2);
+                p[j + 2 * quarter].re = (int16_t)((s0r - s2r) >> 2);
+                p[j + 2 * quarter].im = (int16_t)((s0i - s2i) >> 2);
+                p[j + 3 * quarter].re = (int16_t)((s1r - s3i) >> 2);
+                p[j + 3 * quarter].im = (int16_t)((s1i + s3r) >> 2);
+            }
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef struct {
+    int16_t re;
+    int16_t im;
+} fft_cpx_t;
+
+/*
+ * Radix-4, decimation-in-time FFT of FFT_SIZE points in Q15. Every stage
+ * scales by 1/4, so the output is the DFT divided by FFT_SIZE and cannot
+ * overflow as long as no input has a modulus above 1.0 (real samples
+ * never do). fft_init() builds the tables once; the transform itself
+ * allocates nothing and is safe to run from any task.
+ */
+void fft_init(void);
+void fft_window_q15(const int16_t *pcm, fft_cpx_t *x);
+void fft_q15(fft_cpx_t *x);
@@ -0,0 +1,212 @@
+#include "jitter_buf.h"
+
+#include <string.h>
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+#define FRAME_BYTES (2 * sizeof(int16_t))
+#define PHASE_BITS 20
+#define PHASE_ONE (1u << PHASE_BITS)
+
+_Static_assert(JITTER_MAX_PPM < 1000000 / 256, "scratch holds at most 1/256 extra frames per read");
+_Static_assert((uint64_t)JITTER_MAX_READ_FRAMES * (PHASE_ONE + PHASE_ONE / 256) + PHASE_ONE <= UINT32_MAX,
+               "a read's phase advance must fit in 32 bits");
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint32_t frames_to_ms(uint64_t frames, uint32_t rate)
+{
+    return (uint32_t)(frames * 1000 / rate);
+}
+
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+/* Depth to aim for: the measured spread plus a margin, in frames */
+static uint32_t target_frames(jitter_buf_t *jb, uint32_t rate)
+{
+    uint32_t ms = (atomic_load(&jb->jitter_us) + 999) / 1000 + JITTER_MARGIN_MS;
+    if (ms < JITTER_MIN_MS) {
+        ms = JITTER_MIN_MS;
+    }
+    if (ms > JITTER_MAX_MS) {
+        ms = JITTER_MAX_MS;
+    }
+    atomic_store(&jb->target_ms, ms);
+    return (uint32_t)((uint64_t)ms * rate / 1000);
+}
+
+/* Proportional control: correct the depth error over JITTER_CORRECT_S, within JITTER_MAX_PPM */
+static int32_t steer_ppm(int32_t error_frames, uint32_t rate)
+{
+    int64_t ppm = (int64_t)error_frames * 1000000 / ((int64_t)rate * JITTER_CORRECT_S);
+    if (ppm > JITTER_MAX_PPM) {
+        ppm = JITTER_MAX_PPM;
+    }
+    if (ppm < -JITTER_MAX_PPM) {
+        ppm = -JITTER_MAX_PPM;
+    }
+    return (int32_t)ppm;
+}
+
+/* Linear interpolation between cur and nxt, pulling a new input frame each time the phase wraps */
+static void resample(jitter_buf_t *jb, int16_t *out, size_t frames, uint32_t step)
+{
+    const int16_t (*in)[2] = jb->scratch;
+    uint32_t pos = jb->phase;
+
+    for (size_t i = 0; i < frames; i++) {
+        int32_t frac = pos >> (PHASE_BITS - 15);
+        for (int ch = 0; ch < 2; ch++) {
+            out[2 * i + ch] = jb->cur[ch] + (((jb->nxt[ch] - jb->cur[ch]) * frac) >> 15);
+        }
+        pos += step;
+        while (pos >= PHASE_ONE) {
+            memcpy(jb->cur, jb->nxt, sizeof(jb->cur));
+            memcpy(jb->nxt, *in++, sizeof(jb->nxt));
+            pos -= PHASE_ONE;
+        }
+    }
+    jb->phase = pos;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* storage holds size bytes, a power of two; rate is the stream's sample rate in Hz */
+void jitter_buf_init(jitter_buf_t *jb, uint8_t *storage, size_t size, uint32_t rate)
+{
+    memset(jb, 0, sizeof(*jb));
+    ring_buf_init(&jb->ring, storage, size);
+    atomic_store(&jb->rate, rate);
+    jb->buffering = true;
+}
+
+/* Writer side: a new stream format. The arrival estimate starts over; the spread is kept. */
+void jitter_buf_set_rate(jitter_buf_t *jb, uint32_t rate)
+{
+    atomic_store(&jb->rate, rate);
+    jb->streaming = false;
+}
+
+uint32_t jitter_buf_rate(jitter_buf_t *jb)
+{
+    return atomic_load(&jb->rate);
+}
+
+/*
+ * Writer side: queue one packet that arrived at arrival_us and update the
+ * spread. A gap over JITTER_STREAM_GAP_MS starts a new stream, so pauses
+ * on the phone do not read as lateness. Returns frames queued.
+ */
+size_t jitter_buf_write(jitter_buf_t *jb, const int16_t *pcm, size_t frames, int64_t arrival_us)
+{
+    uint32_t rate = atomic_load(&jb->rate);
+
+    if (!jb->streaming || arrival_us - jb->last_arrival_us > JITTER_STREAM_GAP_MS * 1000LL) {
+        jb->streaming = true;
+        jb->base_us = arrival_us;
+        jb->media_frames = 0;
+        jb->offset_min_us = 0;
+    }
+    jb->last_arrival_us = arrival_us;
+
+    // How late this packet is against the stream clock, relative to the earliest one seen
+    int64_t offset = arrival_us - jb->base_us - (int64_t)(jb->media_frames * 1000000 / rate);
+    if (offset < jb->offset_min_us) {
+        jb->offset_min_us = offset;
+    }
+    int64_t spread = offset - jb->offset_min_us;
+    if (spread > jb->spread_us) {
+        jb->spread_us = spread;
+    } else {
+        jb->spread_us -= (jb->spread_us - spread) >> JITTER_DECAY_SHIFT;
+    }
+    // Let the reference creep up, about JITTER_MAX_PPM, so a source slower than us is not read as ever later
+    jb->offset_min_us += (int64_t)frames * JITTER_MAX_PPM / rate;
+    jb->media_frames += frames;
+    atomic_store(&jb->jitter_us, (uint32_t)jb->spread_us);
+
+    size_t written = ring_buf_write(&jb->ring, pcm, frames * FRAME_BYTES) / FRAME_BYTES;
+    atomic_fetch_add(&jb->packets, 1);
+    if (written < frames) {
+        atomic_fetch_add(&jb->overflows, 1);
+    }
+    return written;
+}
+
+/*
+ * Reader side: fill pcm with frames (at most JITTER_MAX_READ_FRAMES) at the
+ * output clock. Returns false and fills silence while buffering.
+ */
+bool jitter_buf_read(jitter_buf_t *jb, int16_t *pcm, size_t frames)
+{
+    uint32_t rate = atomic_load(&jb->rate);
+    uint32_t fill = ring_buf_used(&jb->ring) / FRAME_BYTES;
+    uint32_t target = target_frames(jb, rate);
+
+    store_max(&jb->latency_ms_max, frames_to_ms(fill, rate));
+    if (jb->buffering) {
+        if (fill < target || fill < 2) {
+            memset(pcm, 0, frames * FRAME_BYTES);
+            return false;
+        }
+        // Start exactly on the first buffered frame, interpolating towards the second
+        ring_buf_read(&jb->ring, jb->cur, FRAME_BYTES);
+        ring_buf_read(&jb->ring, jb->nxt, FRAME_BYTES);
+        jb->phase = 0;
+        jb->fill_avg = (int32_t)fill << JITTER_AVG_SHIFT;
+        jb->buffering = false;
+        fill -= 2;
+    }
+
+    jb->fill_avg += (int32_t)fill - (jb->fill_avg >> JITTER_AVG_SHIFT);
+    int32_t ppm = steer_ppm((jb->fill_avg >> JITTER_AVG_SHIFT) - (int32_t)target, rate);
+    uint32_t step = PHASE_ONE + (uint32_t)((int64_t)ppm * PHASE_ONE / 1000000);
+    atomic_store(&jb->ppm, ppm);
+    atomic_store(&jb->latency_ms, frames_to_ms(jb->fill_avg >> JITTER_AVG_SHIFT, rate));
+
+    uint32_t need = (jb->phase + (uint32_t)frames * step) >> PHASE_BITS;
+    if (need > fill) {
+        memset(pcm, 0, frames * FRAME_BYTES);
+        atomic_fetch_add(&jb->underruns, 1);
+        jb->buffering = true;
+        return false;
+    }
+    ring_buf_read(&jb->ring, jb->scratch, need * FRAME_BYTES);
+    resample(jb, pcm, frames, step);
+    return true;
+}
+
+/* Audio queued right now, unsmoothed; safe from any task */
+uint32_t jitter_buf_depth_ms(jitter_buf_t *jb)
+{
+    return frames_to_ms(ring_buf_used(&jb->ring) / FRAME_BYTES, atomic_load(&jb->rate));
+}
+
+uint32_t jitter_buf_target_ms(jitter_buf_t *jb)
+{
+    return atomic_load(&jb->target_ms);
+}
+
+/* Copy the counters and reset them; the max restarts from the current depth */
+void jitter_buf_take_stats(jitter_buf_t *jb, jitter_stats_t *stats)
+{
+    stats->packets = atomic_exchange(&jb->packets, 0);
+    stats->underruns = atomic_exchange(&jb->underruns, 0);
+    stats->overflows = atomic_exchange(&jb->overflows, 0);
+    stats->jitter_us = atomic_load(&jb->jitter_us);
+    stats->target_ms = atomic_load(&jb->target_ms);
+    stats->latency_ms = atomic_load(&jb->latency_ms);
+    stats->latency_ms_max = atomic_exchange(&jb->latency_ms_max, 0);
+    stats->ppm = atomic_load(&jb->ppm);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ring_buf.h"
+#include "system_config.h"
+
+typedef struct {
+    uint32_t packets;
+    uint32_t underruns;         /* reads that ran dry and went back to buffering */
+    uint32_t overflows;         /* packets cut short by a full buffer */
+    uint32_t jitter_us;         /* arrival spread the target is sized for */
+    uint32_t target_ms;
+    uint32_t latency_ms;        /* smoothed buffer depth */
+    uint32_t latency_ms_max;    /* deepest single reading since the last take_stats */
+    int32_t ppm;                /* resampling correction; positive drains faster than the source */
+} jitter_stats_t;
+
+/*
+ * Adaptive jitter buffer for interleaved stereo int16 PCM arriving in
+ * bursts, on top of a ring_buf_t. One task writes packets with their
+ * arrival time, one task reads at the output clock; neither blocks.
+ *
+ * The writer measures how late each packet is against the stream's own
+ * media clock and keeps a peak-hold of that spread, which jumps up at
+ * once and decays over a few seconds. The reader sizes its target depth
+ * from it, waits for that much before playing, and steers the smoothed
+ * depth towards the target by resampling a few hundred ppm faster or
+ * slower instead of dropping or repeating samples, which also absorbs
+ * the drift between the source clock and the DAC. A read that runs dry
+ * plays silence and buffers up to the target again.
+ */
+typedef struct {
+    ring_buf_t ring;
+    atomic_uint rate;
+
+    /* writer side */
+    bool streaming;
+    int64_t base_us;            /* arrival time of the packet that started the stream */
+    int64_t last_arrival_us;
+    uint64_t media_frames;
+    int64_t offset_min_us;
+    int64_t spread_us;
+
+    /* reader side */
+    bool buffering;
+    uint32_t phase;             /* position between cur and nxt, 20 fraction bits */
+    int16_t cur[2];
+    int16_t nxt[2];
+    int32_t fill_avg;           /* frames, JITTER_AVG_SHIFT fraction bits */
+    int16_t scratch[JITTER_MAX_READ_FRAMES + JITTER_MAX_READ_FRAMES / 256 + 2][2];
+
+    atomic_uint jitter_us;
+    atomic_uint packets;
+    atomic_uint underruns;
+    atomic_uint overflows;
+    atomic_uint target_ms;
+    atomic_uint latency_ms;
+    atomic_uint latency_ms_max;
+    atomic_int ppm;
+} jitter_buf_t;
+
+void jitter_buf_init(jitter_buf_t *jb, uint8_t *storage, size_t size, uint32_t rate);
+void jitter_buf_set_rate(jitter_buf_t *jb, uint32_t rate);
+uint32_t jitter_buf_rate(jitter_buf_t *jb);
+size_t jitter_buf_write(jitter_buf_t *jb, const int16_t *pcm, size_t frames, int64_t arrival_us);
+bool jitter_buf_read(jitter_buf_t *jb, int16_t *pcm, size_t frames);
+uint32_t jitter_buf_depth_ms(jitter_buf_t *jb);
+uint32_t jitter_buf_target_ms(jitter_buf_t *jb);
+void jitter_buf_take_stats(jitter_buf_t *jb, jitter_stats_t *stats);
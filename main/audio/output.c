@@ -0,0 +1,292 @@
+#include "output.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "output_sink.h"
+#include "spectrum.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include <sys/lock.h>
+#include "esp_timer.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "OUTPUT";
+
+static const output_sink_t *const sinks[OUTPUT_COUNT] = {
+    [OUTPUT_NULL] = &output_null_sink,
+    [OUTPUT_FILE] = &output_file_sink,
+#if !CONFIG_IDF_TARGET_LINUX
+    [OUTPUT_I2S] = &output_i2s_sink,
+#endif
+};
+
+#if CONFIG_IDF_TARGET_LINUX
+#define DEFAULT_SINK OUTPUT_NULL
+#else
+#define DEFAULT_SINK OUTPUT_I2S
+#endif
+
+static atomic_int wanted_id = DEFAULT_SINK;
+static atomic_uint wanted_rate = A2DP_SINK_DEFAULT_RATE;
+
+/* Writer side only, except current: take_stats() reads it under sink_lock */
+static const output_sink_t *current;
+static output_id_t current_id;
+static uint32_t current_rate;
+static uint64_t current_written;        /* frames since the sink was opened */
+
+static play_clock_t heard_clock;
+
+static atomic_uint writes;
+static atomic_uint frames_out;
+static atomic_uint underruns;
+static atomic_uint switches;
+static atomic_uint switch_us_max;
+static atomic_uint min_headroom = 100;
+static atomic_uint last_headroom = 100;
+static atomic_uint write_seq;   /* never reset, so a poller can tell the output has gone idle */
+
+#if !CONFIG_IDF_TARGET_LINUX
+static _lock_t sink_lock;       /* held while current changes and while another task reads it */
+#endif
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static int64_t now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static void store_min(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value < cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+static void lock_sink(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&sink_lock);
+#endif
+}
+
+static void unlock_sink(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&sink_lock);
+#endif
+}
+
+/* Writer side: close the current sink and open the wanted one at the wanted rate */
+static void switch_sink(output_id_t id, uint32_t rate)
+{
+    int64_t start = now_us();
+
+    lock_sink();
+    if (current) {
+        atomic_fetch_add(&underruns, current->take_underruns());
+        current->close();
+        atomic_fetch_add(&switches, 1);
+    }
+    current = sinks[id];
+    if (!current->open(rate)) {
+        ESP_LOGE(TAG, "Failed to open %s, using null", current->name);
+        id = OUTPUT_NULL;
+        current = sinks[id];
+        current->open(rate);
+    }
+    unlock_sink();
+    current_id = id;
+    current_rate = rate;
+    current_written = 0;
+    play_clock_start(&heard_clock, rate);
+    store_max(&switch_us_max, (uint32_t)(now_us() - start));
+    ESP_LOGI(TAG, "Output %s at %" PRIu32 " Hz, %" PRIu32 " frames queued at most",
+             current->name, rate, current->capacity());
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int output_cmd(int argc, char **argv)
+{
+    output_stats_t s;
+
+    if (argc > 1) {
+        for (int i = 0; i < OUTPUT_COUNT; i++) {
+            if (sinks[i] && strcmp(argv[1], sinks[i]->name) == 0) {
+                output.select(i);
+                return 0;
+            }
+        }
+        printf("unknown output '%s'\n", argv[1]);
+        return 1;
+    }
+    output.take_stats(&s);
+    printf("%s: %" PRIu32 " writes, %" PRIu32 " frames, %" PRIu32 " underruns, min headroom %u%%, %" PRIu32
+           " switches (max %" PRIu32 " us)\n",
+           sinks[output.selected()]->name, s.writes, s.frames, s.underruns, s.min_headroom_pct, s.switches,
+           s.switch_us_max);
+    printf("clock %" PRIu32 " ms, %" PRIu32 " ms pending; drift %" PRId32 " ppm over %" PRIu32 " ms, max error %"
+           PRIu32 " us, %" PRIu32 " resyncs\n",
+           output.clock_ms(), output.pending_ms(), s.clock.drift_ppm, s.clock.drift_ms, s.clock.err_us_max,
+           s.clock.resyncs);
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Periods a sink's ring holds: enough for OUTPUT_LATENCY_MS at rate, and at least two */
+uint32_t output_ring_periods(uint32_t rate)
+{
+    uint32_t frames = (uint32_t)((uint64_t)OUTPUT_LATENCY_MS * rate / 1000);
+    uint32_t periods = (frames + OUTPUT_PERIOD_FRAMES - 1) / OUTPUT_PERIOD_FRAMES;
+    return periods < 2 ? 2 : periods;
+}
+
+/* Register the "output" console command; the first write opens the default sink */
+static void init(void) {
+    play_clock_init(&heard_clock, now_us());
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "output",
+        .help = "Switch the audio output (null, file, i2s) or show its counters since the last call",
+        .hint = "[null|file|i2s]",
+        .func = output_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+}
+
+static void select_sink(output_id_t id) {
+    if (id >= OUTPUT_COUNT || sinks[id] == NULL) {
+        ESP_LOGW(TAG, "Output %d unavailable here, using null", id);
+        id = OUTPUT_NULL;
+    }
+    atomic_store(&wanted_id, id);
+}
+
+static output_id_t selected(void) {
+    return (output_id_t)atomic_load(&wanted_id);
+}
+
+static void set_rate(uint32_t rate) {
+    atomic_store(&wanted_rate, rate);
+}
+
+/* Feed one period; blocks at the sink's pace */
+static void write_pcm(const int16_t *pcm, size_t frames) {
+    output_id_t id = (output_id_t)atomic_load(&wanted_id);
+    uint32_t rate = atomic_load(&wanted_rate);
+
+    if (current == NULL || id != current_id || rate != current_rate) {
+        switch_sink(id, rate);
+    }
+
+    spectrum.tap(pcm, frames, 2);
+    int64_t start = now_us();
+    uint32_t queued = current->write(pcm, frames);
+    play_clock_update(&heard_clock, start, current_written, queued, current->delay());
+    current_written += frames;
+    uint32_t headroom = queued * 100 / current->capacity();
+    spectrum.report_headroom(headroom > 100 ? 100 : headroom);
+    store_min(&min_headroom, headroom);
+    atomic_store(&last_headroom, headroom > 100 ? 100 : headroom);
+    atomic_fetch_add(&write_seq, 1);
+    atomic_fetch_add(&writes, 1);
+    atomic_fetch_add(&frames_out, frames);
+}
+
+/*
+ * Share of the ring queued at the last write, for tasks that should give
+ * way to the audio. Reads 100 once no write has come in for
+ * OUTPUT_IDLE_MS of polling.
+ */
+static uint8_t headroom(void) {
+    static uint32_t polled_seq;
+    static int64_t polled_us;
+    uint32_t seq = atomic_load(&write_seq);
+    int64_t now = now_us();
+
+    if (seq != polled_seq || polled_us == 0) {
+        polled_seq = seq;
+        polled_us = now;
+    } else if (now - polled_us > OUTPUT_IDLE_MS * 1000LL) {
+        return 100;
+    }
+    return (uint8_t)atomic_load(&last_headroom);
+}
+
+/* Presentation position in ms, monotonic; runs on wall time while nothing is written */
+static uint32_t clock_ms(void) {
+    return play_clock_read_ms(&heard_clock, now_us());
+}
+
+static uint32_t pending_ms(void) {
+    return play_clock_pending_ms(&heard_clock, now_us());
+}
+
+/*
+ * Copy and reset the counters; underruns are collected from the sink here
+ * and on switches, under sink_lock so the sink is not closed or replaced
+ * while it is read.
+ */
+static void take_stats(output_stats_t *stats) {
+    lock_sink();
+    if (current) {
+        atomic_fetch_add(&underruns, current->take_underruns());
+    }
+    unlock_sink();
+    stats->writes = atomic_exchange(&writes, 0);
+    stats->frames = atomic_exchange(&frames_out, 0);
+    stats->underruns = atomic_exchange(&underruns, 0);
+    stats->switches = atomic_exchange(&switches, 0);
+    stats->switch_us_max = atomic_exchange(&switch_us_max, 0);
+    stats->min_headroom_pct = (uint8_t)atomic_exchange(&min_headroom, 100);
+    play_clock_take_stats(&heard_clock, &stats->clock);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Output output = {
+    .init = init,
+    .select = select_sink,
+    .selected = selected,
+    .set_rate = set_rate,
+    .write = write_pcm,
+    .headroom = headroom,
+    .clock_ms = clock_ms,
+    .pending_ms = pending_ms,
+    .take_stats = take_stats
+};
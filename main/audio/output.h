@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "play_clock.h"
+#include "system_config.h"
+
+typedef enum {
+    OUTPUT_NULL = 0,
+    OUTPUT_FILE,
+    OUTPUT_I2S,                 /* device only; the host falls back to null */
+    OUTPUT_COUNT
+} output_id_t;
+
+typedef struct {
+    uint32_t writes;
+    uint32_t frames;
+    uint32_t underruns;         /* times the selected sink's ring ran dry */
+    uint32_t switches;
+    uint32_t switch_us_max;     /* closing one sink and opening the next */
+    uint8_t min_headroom_pct;   /* lowest share of the ring still queued when a write came in */
+    play_clock_stats_t clock;
+} output_stats_t;
+
+/*
+ * Where decoded PCM goes. One audio task feeds write() with interleaved
+ * stereo int16 periods; the buffer goes to the selected sink as is, after
+ * a tap for the spectrum, and the sink's headroom is reported to it.
+ * select() and set_rate() are safe from any task and take effect at the
+ * start of the next write, so a switch costs at most the period being
+ * written; audio still queued in the old sink is dropped.
+ *
+ * clock_ms() is the presentation clock of play_clock.h, following what
+ * the sink has actually played out; pending_ms() is the audio written but
+ * not heard yet. Both are lock-free and safe from any task.
+ */
+struct Output {
+    void (*init)(void);
+    void (*select)(output_id_t id);
+    output_id_t (*selected)(void);
+    void (*set_rate)(uint32_t rate);
+    void (*write)(const int16_t *pcm, size_t frames);
+    uint8_t (*headroom)(void);
+    uint32_t (*clock_ms)(void);
+    uint32_t (*pending_ms)(void);
+    void (*take_stats)(output_stats_t *stats);
+};
+
+extern const struct Output output;
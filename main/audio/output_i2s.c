@@ -0,0 +1,145 @@
+#include "output_sink.h"
+
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "driver/i2s_std.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "OUTPUT I2S";
+
+static i2s_chan_handle_t tx_chan;
+static uint32_t ring_frames;
+static uint64_t written;                /* frames handed to the driver since open */
+static atomic_uint sent_periods;        /* DMA buffers finished, counted in the ISR */
+static atomic_uint underruns;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static bool IRAM_ATTR on_sent(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    atomic_fetch_add(&sent_periods, 1);
+    return false;
+}
+
+/* The DMA ran out of queued buffers and is repeating cleared ones */
+static bool IRAM_ATTR on_send_q_ovf(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx)
+{
+    atomic_fetch_add(&underruns, 1);
+    return false;
+}
+
+/* One DMA descriptor per OUTPUT_PERIOD_FRAMES, as many as the latency target needs */
+static bool i2s_open(uint32_t rate)
+{
+    uint32_t periods = output_ring_periods(rate);
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = periods;
+    chan_cfg.dma_frame_num = OUTPUT_PERIOD_FRAMES;
+    chan_cfg.auto_clear = true;
+    if (i2s_new_channel(&chan_cfg, &tx_chan, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate the I2S channel");
+        return false;
+    }
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = I2S_BCK_GPIO_NUM,
+            .ws = I2S_WS_GPIO_NUM,
+            .dout = I2S_DOUT_GPIO_NUM,
+            .din = I2S_GPIO_UNUSED,
+        },
+    };
+    const i2s_event_callbacks_t cbs = {
+        .on_sent = on_sent,
+        .on_send_q_ovf = on_send_q_ovf,
+    };
+    if (i2s_channel_init_std_mode(tx_chan, &std_cfg) != ESP_OK ||
+        i2s_channel_register_event_callback(tx_chan, &cbs, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure I2S at %u Hz", (unsigned)rate);
+        i2s_del_channel(tx_chan);
+        tx_chan = NULL;
+        return false;
+    }
+
+    ring_frames = periods * OUTPUT_PERIOD_FRAMES;
+    written = 0;
+    atomic_store(&sent_periods, 0);
+    i2s_channel_enable(tx_chan);
+    return true;
+}
+
+/* Whatever is still queued is dropped rather than drained, so a switch costs one period */
+static void i2s_close(void)
+{
+    if (tx_chan) {
+        i2s_channel_disable(tx_chan);
+        i2s_del_channel(tx_chan);
+        tx_chan = NULL;
+    }
+}
+
+/*
+ * The driver copies straight from pcm into the DMA buffers as they free up.
+ * A failed write leaves a gap the DMA fills with cleared buffers, so it
+ * counts as an underrun.
+ */
+static uint32_t i2s_write(const int16_t *pcm, size_t frames)
+{
+    size_t bytes = 0;
+    uint64_t sent = (uint64_t)atomic_load(&sent_periods) * OUTPUT_PERIOD_FRAMES;
+
+    // Cleared buffers played while dry count as sent too; catch up so the ring reads empty
+    if (sent > written) {
+        written = sent;
+    }
+    uint32_t queued = (uint32_t)(written - sent);
+
+    esp_err_t err = i2s_channel_write(tx_chan, pcm, frames * 2 * sizeof(int16_t), &bytes, portMAX_DELAY);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Write failed: %s", esp_err_to_name(err));
+        atomic_fetch_add(&underruns, 1);
+    }
+    written += bytes / (2 * sizeof(int16_t));
+    return queued;
+}
+
+static uint32_t i2s_capacity(void)
+{
+    return ring_frames;
+}
+
+static uint32_t i2s_take_underruns(void)
+{
+    return atomic_exchange(&underruns, 0);
+}
+
+static uint32_t i2s_delay(void)
+{
+    return OUTPUT_I2S_DELAY_FRAMES;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const output_sink_t output_i2s_sink = {
+    .name = "i2s",
+    .open = i2s_open,
+    .close = i2s_close,
+    .write = i2s_write,
+    .capacity = i2s_capacity,
+    .take_underruns = i2s_take_underruns,
+    .delay = i2s_delay
+};
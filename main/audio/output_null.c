@@ -0,0 +1,238 @@
+#include "output_sink.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    uint32_t rate;
+    uint32_t capacity;
+    int64_t start_us;           /* when frame 0 would have started playing */
+    uint64_t written;
+    atomic_uint underruns;
+    FILE *log;
+} null_state_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "OUTPUT NULL";
+
+static null_state_t null_state;
+static null_state_t file_state;
+static output_consume_t last_consume;
+
+static int64_t real_now_us(void);
+static void real_sleep_us(uint32_t us);
+
+static int64_t (*clock_now_us)(void) = real_now_us;
+static void (*clock_sleep_us)(uint32_t us) = real_sleep_us;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static int64_t real_now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static void real_sleep_us(uint32_t us)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (long)(us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+#else
+    vTaskDelay(pdMS_TO_TICKS(us / 1000) + 1);
+#endif
+}
+
+static const char *log_path(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return getenv(HOST_OUTPUT_FILE_ENV);
+#else
+    return OUTPUT_FILE_PATH;
+#endif
+}
+
+static bool open_state(null_state_t *s, uint32_t rate)
+{
+    s->rate = rate;
+    s->capacity = output_ring_periods(rate) * OUTPUT_PERIOD_FRAMES;
+    s->start_us = clock_now_us();
+    s->written = 0;
+    return true;
+}
+
+/* Frames the modelled DAC has played by now; running dry counts an underrun and restarts it */
+static uint64_t consumed(null_state_t *s, int64_t now)
+{
+    uint64_t played = (uint64_t)(now - s->start_us) * s->rate / 1000000;
+
+    if (played > s->written) {
+        if (s->written) {
+            atomic_fetch_add(&s->underruns, 1);
+        }
+        s->start_us = now - (int64_t)(s->written * 1000000 / s->rate);
+        played = s->written;
+    }
+    return played;
+}
+
+/* Wait until the ring has room for frames, then queue them and note when they will play */
+static uint32_t write_state(null_state_t *s, size_t frames)
+{
+    int64_t now = clock_now_us();
+    uint64_t played = consumed(s, now);
+    uint32_t queued = (uint32_t)(s->written - played);
+
+    if (queued + frames > s->capacity) {
+        uint64_t behind = queued + frames - s->capacity;
+        clock_sleep_us((uint32_t)((behind * 1000000 + s->rate - 1) / s->rate));
+    }
+
+    last_consume.start_us = s->start_us + (int64_t)(s->written * 1000000 / s->rate);
+    last_consume.frames = frames;
+    last_consume.queued = queued;
+    s->written += frames;
+    if (s->log) {
+        fprintf(s->log, "%" PRId64 " %u %" PRIu32 "\n", last_consume.start_us, (unsigned)frames, queued);
+    }
+    return queued;
+}
+
+static uint32_t take_underruns_state(null_state_t *s)
+{
+    return atomic_exchange(&s->underruns, 0);
+}
+
+static bool null_open(uint32_t rate)
+{
+    return open_state(&null_state, rate);
+}
+
+static void null_close(void)
+{
+}
+
+static uint32_t null_write(const int16_t *pcm, size_t frames)
+{
+    return write_state(&null_state, frames);
+}
+
+static uint32_t null_capacity(void)
+{
+    return null_state.capacity;
+}
+
+static uint32_t null_take_underruns(void)
+{
+    return take_underruns_state(&null_state);
+}
+
+/* The modelled DAC plays a frame as it leaves the ring */
+static uint32_t no_delay(void)
+{
+    return 0;
+}
+
+/* Without a path the file sink is a second null sink */
+static bool file_open(uint32_t rate)
+{
+    const char *path = log_path();
+
+    if (path) {
+        file_state.log = fopen(path, "w");
+        if (file_state.log == NULL) {
+            ESP_LOGE(TAG, "Failed to open %s", path);
+        }
+    }
+    return open_state(&file_state, rate);
+}
+
+static void file_close(void)
+{
+    if (file_state.log) {
+        fclose(file_state.log);
+        file_state.log = NULL;
+    }
+}
+
+static uint32_t file_write(const int16_t *pcm, size_t frames)
+{
+    return write_state(&file_state, frames);
+}
+
+static uint32_t file_capacity(void)
+{
+    return file_state.capacity;
+}
+
+static uint32_t file_take_underruns(void)
+{
+    return take_underruns_state(&file_state);
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void output_null_set_clock(int64_t (*now_us)(void), void (*sleep_us)(uint32_t us))
+{
+    clock_now_us = now_us ? now_us : real_now_us;
+    clock_sleep_us = sleep_us ? sleep_us : real_sleep_us;
+}
+
+void output_null_last(output_consume_t *last)
+{
+    *last = last_consume;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const output_sink_t output_null_sink = {
+    .name = "null",
+    .open = null_open,
+    .close = null_close,
+    .write = null_write,
+    .capacity = null_capacity,
+    .take_underruns = null_take_underruns,
+    .delay = no_delay
+};
+
+const output_sink_t output_file_sink = {
+    .name = "file",
+    .open = file_open,
+    .close = file_close,
+    .write = file_write,
+    .capacity = file_capacity,
+    .take_underruns = file_take_underruns,
+    .delay = no_delay
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+/*
+ * One output backend behind the output module. open() sizes its ring
+ * from OUTPUT_LATENCY_MS at the given rate; write() takes interleaved
+ * stereo int16 frames straight from the caller's buffer, blocks at the
+ * device's pace until they are queued and returns how many frames were
+ * still queued when it was called. Only the output module calls these,
+ * from the one task that feeds it.
+ */
+typedef struct {
+    const char *name;
+    bool (*open)(uint32_t rate);
+    void (*close)(void);
+    uint32_t (*write)(const int16_t *pcm, size_t frames);
+    uint32_t (*capacity)(void);         /* frames the ring holds */
+    uint32_t (*take_underruns)(void);   /* times the ring ran dry since the last call */
+    uint32_t (*delay)(void);            /* frames between leaving the ring and being heard */
+} output_sink_t;
+
+/* When the null sink's last write starts playing, on the sink's clock */
+typedef struct {
+    int64_t start_us;
+    uint32_t frames;
+    uint32_t queued;
+} output_consume_t;
+
+extern const output_sink_t output_null_sink;
+extern const output_sink_t output_file_sink;
+#if !CONFIG_IDF_TARGET_LINUX
+extern const output_sink_t output_i2s_sink;
+#endif
+
+uint32_t output_ring_periods(uint32_t rate);
+
+/*
+ * The null and file sinks model a DAC with the same ring on a clock,
+ * real time unless replaced here; sleep_us must advance now_us. The file
+ * sink also logs "<start_us> <frames> <queued>" per write.
+ */
+void output_null_set_clock(int64_t (*now_us)(void), void (*sleep_us)(uint32_t us));
+void output_null_last(output_consume_t *last);
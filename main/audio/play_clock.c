@@ -0,0 +1,183 @@
+#include "play_clock.h"
+
+#include <string.h>
+
+#include "system_config.h"
+
+#define SPEED_ONE (1 << 16)
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static int64_t frames_us(uint64_t frames, uint32_t rate)
+{
+    return (int64_t)(frames * 1000000 / rate);
+}
+
+/* The reading at now from a snapshot; stalls at the limit, then runs on wall time once idle */
+static int64_t estimate(const play_clock_snap_t *s, int64_t now_us)
+{
+    int64_t dt = now_us - s->wall_us;
+    int64_t idle = PLAY_CLOCK_IDLE_MS * 1000LL;
+
+    if (dt < 0) {
+        dt = 0;
+    }
+    int64_t run = dt < idle ? dt : idle;
+    int64_t v = s->clock_us + run * s->speed / SPEED_ONE;
+    if (v > s->limit_us) {
+        v = s->limit_us;
+    }
+    return v + (dt - run);
+}
+
+/* Any task; retries while the writer is part way through an update */
+static void load(play_clock_t *c, play_clock_snap_t *out)
+{
+    uint32_t seq;
+
+    do {
+        seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        memcpy(out, &c->snap, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&c->seq, memory_order_relaxed));
+}
+
+/* Writer only */
+static void publish(play_clock_t *c, const play_clock_snap_t *s)
+{
+    atomic_fetch_add_explicit(&c->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&c->snap, s, sizeof(*s));
+    atomic_fetch_add_explicit(&c->seq, 1, memory_order_release);
+}
+
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Starts at 0 on wall time, with nothing written yet to hold it back */
+void play_clock_init(play_clock_t *c, int64_t now_us)
+{
+    memset(c, 0, sizeof(*c));
+    c->snap.wall_us = now_us;
+    c->snap.limit_us = INT64_MAX;
+    c->snap.speed = SPEED_ONE;
+    c->rebase = true;
+}
+
+/* A new stream at rate, counting frames from 0; the reading carries on where it is */
+void play_clock_start(play_clock_t *c, uint32_t rate)
+{
+    c->rate = rate;
+    c->rebase = true;
+}
+
+/* Before each write: written since start(), queued in the sink, and the sink's delay after its queue */
+void play_clock_update(play_clock_t *c, int64_t now_us, uint64_t written, uint32_t queued, uint32_t delay)
+{
+    play_clock_snap_t s = c->snap;
+
+    if (c->rate == 0) {
+        return;
+    }
+    int64_t est = estimate(&s, now_us);
+    uint64_t heard = written > (uint64_t)queued + delay ? written - queued - delay : 0;
+    uint64_t out = written > delay ? written - delay : 0;
+    bool flowing = !c->rebase && now_us - s.wall_us <= PLAY_CLOCK_IDLE_MS * 1000LL;
+
+    if (!flowing) {
+        c->offset_us = est - frames_us(heard, c->rate);
+    }
+    int64_t heard_us = c->offset_us + frames_us(heard, c->rate);
+    int64_t limit_us = c->offset_us + frames_us(out, c->rate);
+    int64_t err = heard_us - est;
+
+    store_max(&c->err_us_max, (uint32_t)(err < 0 ? -err : err));
+    if (err > PLAY_CLOCK_RESYNC_MS * 1000LL) {
+        est = heard_us;
+        err = 0;
+        s.resyncs++;
+    }
+    if (flowing) {
+        s.flow_wall_us += now_us - s.wall_us;
+        s.flow_clock_us += est - s.clock_us;
+    }
+
+    // Slew rather than step, so the reading moves on smoothly and never back
+    int64_t speed = SPEED_ONE + err * SPEED_ONE / (PLAY_CLOCK_SLEW_MS * 1000LL);
+    int64_t trim = SPEED_ONE * PLAY_CLOCK_MAX_TRIM_PCT / 100;
+    if (speed > SPEED_ONE + trim) {
+        speed = SPEED_ONE + trim;
+    } else if (speed < SPEED_ONE - trim) {
+        speed = SPEED_ONE - trim;
+    }
+
+    s.wall_us = now_us;
+    s.clock_us = est;
+    s.limit_us = !flowing || limit_us > s.limit_us ? limit_us : s.limit_us;
+    s.speed = (int32_t)speed;
+    s.updates++;
+    c->rebase = false;
+    publish(c, &s);
+}
+
+/* The reading at now; steps back by a few microseconds at most when an update races it */
+int64_t play_clock_read_us(play_clock_t *c, int64_t now_us)
+{
+    play_clock_snap_t s;
+
+    load(c, &s);
+    return estimate(&s, now_us);
+}
+
+/* The reading at now for views; never less than one handed out before, on any task */
+uint32_t play_clock_read_ms(play_clock_t *c, int64_t now_us)
+{
+    uint32_t ms = (uint32_t)(play_clock_read_us(c, now_us) / 1000);
+    uint32_t cur = atomic_load(&c->floor_ms);
+
+    while ((int32_t)(ms - cur) > 0) {
+        if (atomic_compare_exchange_weak(&c->floor_ms, &cur, ms)) {
+            return ms;
+        }
+    }
+    return cur;
+}
+
+/* Audio written that has yet to be heard; 0 when nothing is being written */
+uint32_t play_clock_pending_ms(play_clock_t *c, int64_t now_us)
+{
+    play_clock_snap_t s;
+
+    load(c, &s);
+    if (s.limit_us == INT64_MAX) {
+        return 0;
+    }
+    int64_t left = s.limit_us - estimate(&s, now_us);
+    return left > 0 ? (uint32_t)(left / 1000) : 0;
+}
+
+/* Counters since the last call */
+void play_clock_take_stats(play_clock_t *c, play_clock_stats_t *stats)
+{
+    play_clock_snap_t s;
+
+    load(c, &s);
+    int64_t wall = s.flow_wall_us - c->taken.flow_wall_us;
+    int64_t moved = s.flow_clock_us - c->taken.flow_clock_us;
+    stats->updates = s.updates - c->taken.updates;
+    stats->resyncs = s.resyncs - c->taken.resyncs;
+    stats->err_us_max = atomic_exchange(&c->err_us_max, 0);
+    stats->drift_ppm = wall > 0 ? (int32_t)((moved - wall) * 1000000 / wall) : 0;
+    stats->drift_ms = (uint32_t)(wall / 1000);
+    c->taken = s;
+}
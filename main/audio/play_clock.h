@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t updates;
+    uint32_t resyncs;           /* jumps forward after falling behind by PLAY_CLOCK_RESYNC_MS */
+    uint32_t err_us_max;        /* largest gap between estimate and measurement at an update */
+    int32_t drift_ppm;          /* the reading against wall time while audio was flowing */
+    uint32_t drift_ms;          /* wall time the drift was measured over */
+} play_clock_stats_t;
+
+/* What the writer publishes on every update; readers extrapolate from it */
+typedef struct {
+    int64_t wall_us;            /* when the update was made */
+    int64_t clock_us;           /* the reading at wall_us */
+    int64_t limit_us;           /* the reading stops here: audio written so far, less the sink's delay */
+    int32_t speed;              /* against wall time, 1 << 16 is 1.0 */
+    uint32_t updates;
+    uint32_t resyncs;
+    int64_t flow_wall_us;       /* totals over updates with audio flowing, for the drift */
+    int64_t flow_clock_us;
+} play_clock_snap_t;
+
+/*
+ * Presentation clock: where the output is in what can be heard, in
+ * microseconds that never step back. The one task that feeds the output
+ * calls update() before each write with the frames written since start(),
+ * the frames its sink still has queued and the sink's own delay; what has
+ * been heard is the difference. The estimate follows that measurement by
+ * running up to PLAY_CLOCK_MAX_TRIM_PCT fast or slow, closing any error
+ * over PLAY_CLOCK_SLEW_MS, and never runs past the audio written so far,
+ * so it stalls through an underrun. It only jumps forward, when behind by
+ * more than PLAY_CLOCK_RESYNC_MS. Without an update for PLAY_CLOCK_IDLE_MS
+ * it runs on wall time, and the next update carries on from there.
+ *
+ * Readers on any task get it with no lock: the writer publishes a
+ * snapshot under a sequence count and readers retry a torn copy.
+ */
+typedef struct {
+    atomic_uint seq;            /* odd while the writer changes snap */
+    play_clock_snap_t snap;
+    atomic_uint floor_ms;       /* highest reading handed out */
+    atomic_uint err_us_max;
+
+    /* Writer side only */
+    uint32_t rate;
+    bool rebase;                /* map the next measurement onto the current reading */
+    int64_t offset_us;          /* the reading frame 0 maps to */
+
+    /* take_stats() caller only */
+    play_clock_snap_t taken;
+} play_clock_t;
+
+void play_clock_init(play_clock_t *c, int64_t now_us);
+void play_clock_start(play_clock_t *c, uint32_t rate);
+void play_clock_update(play_clock_t *c, int64_t now_us, uint64_t written, uint32_t queued, uint32_t delay);
+int64_t play_clock_read_us(play_clock_t *c, int64_t now_us);
+uint32_t play_clock_read_ms(play_clock_t *c, int64_t now_us);
+uint32_t play_clock_pending_ms(play_clock_t *c, int64_t now_us);
+void play_clock_take_stats(play_clock_t *c, play_clock_stats_t *stats);
@@ -0,0 +1,309 @@
+#include "player.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "output.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include "lvgl.h"
+#else
+#include <sys/lock.h>
+#include "esp_timer.h"
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "PLAYER";
+
+#if !CONFIG_IDF_TARGET_LINUX
+static _lock_t state_lock;
+/* Fires when the playing library track should have been heard to the end */
+static esp_timer_handle_t end_timer;
+#endif
+
+static player_state_t state;
+static uint32_t started_ms;     /* clock reading that corresponds to position 0 while playing; may be ahead */
+static bool has_track;          /* a library track was loaded; survives stop() */
+static void (*end_cb)(void);
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&state_lock);
+#endif
+}
+
+static void unlock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&state_lock);
+#endif
+}
+
+static uint32_t now_ms(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    // The headless runner advances LVGL time itself, so follow it to keep runs repeatable
+    return lv_tick_get();
+#else
+    // What has been heard rather than decoded, so the position lags the output's latency
+    return output.clock_ms();
+#endif
+}
+
+/* Position at this instant, clamped to the track length when it is known */
+static uint32_t position_locked(void)
+{
+    uint32_t pos = state.position_ms;
+
+    if (state.playing) {
+        int32_t since = (int32_t)(now_ms() - started_ms);
+        pos = since > 0 ? (uint32_t)since : 0;
+    }
+    if (state.duration_ms && pos > state.duration_ms) {
+        pos = state.duration_ms;
+    }
+    return pos;
+}
+
+/* Caller holds state_lock */
+static void fill_saved(playback_state_t *saved)
+{
+    memset(saved, 0, sizeof(*saved));
+    saved->track = state.track;
+    saved->duration_ms = state.duration_ms;
+    saved->position_ms = position_locked();
+    saved->paused = !state.playing;
+    memcpy(saved->title, state.title, sizeof(saved->title));
+    memcpy(saved->artist, state.artist, sizeof(saved->artist));
+}
+
+/* Caller holds state_lock; true when the state changed */
+static bool set_paused_locked(bool paused)
+{
+    if (!state.active || paused != state.playing) {
+        return false;
+    }
+    if (paused) {
+        state.position_ms = position_locked();
+    } else {
+        started_ms = now_ms() - state.position_ms;
+    }
+    state.playing = !paused;
+    return true;
+}
+
+/*
+ * Caller holds state_lock. Aim the end timer at the end of the current
+ * track; streams end when their source says so, and a track of unknown
+ * length plays until something else is chosen.
+ */
+static void schedule_end_locked(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    if (end_timer == NULL) {
+        return;
+    }
+    esp_timer_stop(end_timer);
+    if (!state.playing || state.track == PLAYER_TRACK_STREAM || state.duration_ms == 0) {
+        return;
+    }
+    uint32_t left_ms = state.duration_ms - position_locked();
+    esp_timer_start_once(end_timer, (uint64_t)(left_ms ? left_ms : 1) * 1000);
+#endif
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/* esp_timer task: the clock stalls through underruns, so check the track really is over */
+static void end_timer_cb(void *arg)
+{
+    lock_state();
+    bool ended = state.playing && state.track != PLAYER_TRACK_STREAM && state.duration_ms &&
+                 position_locked() >= state.duration_ms;
+    if (!ended) {
+        schedule_end_locked();
+    }
+    unlock_state();
+    if (ended && end_cb) {
+        end_cb();
+    }
+}
+#endif
+
+/* Hand the new state to playback_state outside the lock; it may write NVS */
+static void persist(playback_save_t reason)
+{
+    playback_state_t saved;
+
+    lock_state();
+    bool keep = has_track;
+    fill_saved(&saved);
+    unlock_state();
+    if (keep) {
+        playback_state.update(&saved, reason);
+    }
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Load a track and start it from the beginning */
+static void play(uint32_t track, const char *title, const char *artist, uint32_t duration_ms) {
+    lock_state();
+    state.track = track;
+    snprintf(state.title, sizeof(state.title), "%s", title ? title : "");
+    snprintf(state.artist, sizeof(state.artist), "%s", artist ? artist : "");
+    state.duration_ms = duration_ms;
+    state.position_ms = 0;
+    state.track_seq++;
+    state.active = true;
+    state.playing = true;
+    // The new track is heard once the audio already handed to the output has played
+    started_ms = now_ms() + output.pending_ms();
+    has_track = track != PLAYER_TRACK_STREAM;
+    schedule_end_locked();
+    unlock_state();
+    ESP_LOGI(TAG, "Playing '%s' by '%s'", state.title, state.artist);
+    persist(PLAYBACK_SAVE_TRACK);
+}
+
+static void set_paused(bool paused) {
+    lock_state();
+    bool changed = set_paused_locked(paused);
+    schedule_end_locked();
+    unlock_state();
+    if (changed) {
+        persist(PLAYBACK_SAVE_PAUSE);
+    }
+}
+
+/* Read and flip under one lock, so two presses from different tasks cannot both pause */
+static void toggle(void) {
+    lock_state();
+    bool changed = set_paused_locked(state.playing);
+    schedule_end_locked();
+    unlock_state();
+    if (changed) {
+        persist(PLAYBACK_SAVE_PAUSE);
+    }
+}
+
+/* Move the position by delta_ms, clamped to the start and end of the track */
+static void seek(int32_t delta_ms) {
+    lock_state();
+    int64_t pos = (int64_t)position_locked() + delta_ms;
+    if (pos < 0) {
+        pos = 0;
+    }
+    if (state.duration_ms && pos > state.duration_ms) {
+        pos = state.duration_ms;
+    }
+    state.position_ms = (uint32_t)pos;
+    started_ms = now_ms() - state.position_ms;
+    bool active = state.active;
+    schedule_end_locked();
+    unlock_state();
+    if (active) {
+        persist(PLAYBACK_SAVE_POSITION);
+    }
+}
+
+static void stop(void) {
+    lock_state();
+    state.active = false;
+    state.playing = false;
+    state.position_ms = 0;
+    state.track_seq++;
+    bool had_track = has_track;
+    schedule_end_locked();
+    unlock_state();
+    if (had_track) {
+        // Keep the track, so the next boot offers it again from the start
+        persist(PLAYBACK_SAVE_PAUSE);
+    }
+}
+
+static void get(player_state_t *out) {
+    lock_state();
+    *out = state;
+    out->position_ms = position_locked();
+    unlock_state();
+}
+
+/* Pick up where a previous boot left off; does not report back to playback_state */
+static void restore(const playback_state_t *saved) {
+    lock_state();
+    state.track = saved->track;
+    snprintf(state.title, sizeof(state.title), "%s", saved->title);
+    snprintf(state.artist, sizeof(state.artist), "%s", saved->artist);
+    state.duration_ms = saved->duration_ms;
+    state.position_ms = saved->position_ms;
+    if (state.duration_ms && state.position_ms > state.duration_ms) {
+        state.position_ms = state.duration_ms;
+    }
+    state.track_seq++;
+    state.active = true;
+    state.playing = !saved->paused;
+    started_ms = now_ms() - state.position_ms;
+    has_track = true;
+    schedule_end_locked();
+    unlock_state();
+}
+
+/* The state to persist; false until a track has been loaded */
+static bool snapshot(playback_state_t *saved) {
+    lock_state();
+    bool ok = has_track;
+    if (ok) {
+        fill_saved(saved);
+    }
+    unlock_state();
+    return ok;
+}
+
+/*
+ * Call cb once a library track has played to its end, from the esp_timer
+ * task. The host build has no end timer; its tracks run on until replaced.
+ */
+static void set_end_cb(void (*cb)(void)) {
+    lock_state();
+    end_cb = cb;
+#if !CONFIG_IDF_TARGET_LINUX
+    if (end_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = end_timer_cb,
+            .name = "track_end",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &end_timer));
+    }
+#endif
+    // A track restored at boot may already be playing
+    schedule_end_locked();
+    unlock_state();
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Player player = {
+    .play = play,
+    .set_paused = set_paused,
+    .toggle = toggle,
+    .seek = seek,
+    .stop = stop,
+    .get = get,
+    .restore = restore,
+    .snapshot = snapshot,
+    .set_end_cb = set_end_cb
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "playback_state.h"
+#include "system_config.h"
+
+/* track for streams that are not in the library (A2DP); never persisted */
+#define PLAYER_TRACK_STREAM UINT32_MAX
+
+typedef struct {
+    uint32_t track;             /* library index */
+    char title[PLAYER_MAX_TEXT + 1];
+    char artist[PLAYER_MAX_TEXT + 1];
+    uint32_t duration_ms;       /* 0 while the length is unknown */
+    uint32_t position_ms;
+    uint32_t track_seq;         /* bumped by every play(), so views know to redraw the text */
+    bool active;                /* a track is loaded */
+    bool playing;
+} player_state_t;
+
+/*
+ * What is playing and where in it. The position is derived from a
+ * monotonic clock while playing rather than counted by a task, so readers
+ * can poll it as often or as rarely as they like. On the device that is
+ * the output's presentation clock, so it moves with what is heard. Track changes, pauses
+ * and seeks are handed to playback_state; restore() and snapshot() are
+ * its way back in. set_end_cb() names who picks the next track once a
+ * library track has played out. Safe from any task.
+ */
+struct Player {
+    void (*play)(uint32_t track, const char *title, const char *artist, uint32_t duration_ms);
+    void (*set_paused)(bool paused);
+    void (*toggle)(void);
+    void (*seek)(int32_t delta_ms);
+    void (*stop)(void);
+    void (*get)(player_state_t *state);
+    void (*restore)(const playback_state_t *saved);
+    bool (*snapshot)(playback_state_t *saved);
+    void (*set_end_cb)(void (*cb)(void));
+};
+
+extern const struct Player player;
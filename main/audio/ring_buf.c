@@ -0,0 +1,90 @@
+#include "ring_buf.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* Copy into the ring at a free-running index, splitting at the wrap point */
+static void copy_in(ring_buf_t *rb, size_t index, const uint8_t *src, size_t len)
+{
+    size_t offset = index & rb->mask;
+    size_t first = rb->mask + 1 - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(rb->buf + offset, src, first);
+    memcpy(rb->buf, src + first, len - first);
+}
+
+static void copy_out(ring_buf_t *rb, size_t index, uint8_t *dst, size_t len)
+{
+    size_t offset = index & rb->mask;
+    size_t first = rb->mask + 1 - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, rb->buf + offset, first);
+    memcpy(dst + first, rb->buf, len - first);
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void ring_buf_init(ring_buf_t *rb, uint8_t *storage, size_t size)
+{
+    assert(size != 0 && (size & (size - 1)) == 0);
+    rb->buf = storage;
+    rb->mask = size - 1;
+    ring_buf_reset(rb);
+}
+
+/* Drop everything buffered. Only safe while neither side is running. */
+void ring_buf_reset(ring_buf_t *rb)
+{
+    atomic_store(&rb->head, 0);
+    atomic_store(&rb->tail, 0);
+}
+
+/* Producer side: copy in as much of data as fits, returns bytes written */
+size_t ring_buf_write(ring_buf_t *rb, const void *data, size_t len)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    size_t space = rb->mask + 1 - (head - tail);
+
+    if (len > space) {
+        len = space;
+    }
+    copy_in(rb, head, data, len);
+    atomic_store_explicit(&rb->head, head + len, memory_order_release);
+    return len;
+}
+
+/* Consumer side: copy out up to len buffered bytes, returns bytes read */
+size_t ring_buf_read(ring_buf_t *rb, void *data, size_t len)
+{
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t avail = head - tail;
+
+    if (len > avail) {
+        len = avail;
+    }
+    copy_out(rb, tail, data, len);
+    atomic_store_explicit(&rb->tail, tail + len, memory_order_release);
+    return len;
+}
+
+size_t ring_buf_used(ring_buf_t *rb)
+{
+    return atomic_load(&rb->head) - atomic_load(&rb->tail);
+}
+
+size_t ring_buf_free(ring_buf_t *rb)
+{
+    return rb->mask + 1 - ring_buf_used(rb);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single-producer, single-consumer byte ring. One task writes and one task
+ * reads without locks; the size must be a power of two so the indices can
+ * run freely and wrap with a mask.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t mask;
+    atomic_size_t head;     /* total bytes written */
+    atomic_size_t tail;     /* total bytes read */
+} ring_buf_t;
+
+void ring_buf_init(ring_buf_t *rb, uint8_t *storage, size_t size);
+void ring_buf_reset(ring_buf_t *rb);
+size_t ring_buf_write(ring_buf_t *rb, const void *data, size_t len);
+size_t ring_buf_read(ring_buf_t *rb, void *data, size_t len);
+size_t ring_buf_used(ring_buf_t *rb);
+size_t ring_buf_free(ring_buf_t *rb);
@@ -0,0 +1,291 @@
+#include "spectrum.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "fft.h"
+#include "ring_buf.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SPECTRUM";
+
+/* log2 of a full-scale sine's peak bin after the Hann window and 1/N scaling */
+static const uint32_t full_scale_log2 = 13;
+
+static ring_buf_t tap_ring;
+static uint8_t tap_storage[FFT_SIZE * sizeof(int16_t)];
+static int16_t window[FFT_SIZE];
+static fft_cpx_t bins[FFT_SIZE];
+static uint16_t band_edges[SPECTRUM_BARS + 1];
+static uint8_t levels_shown[SPECTRUM_BARS];
+
+static bool initialized;
+static atomic_uint frame_rate;
+static atomic_bool visible;
+static atomic_bool auto_off;
+static bool auto_off_reported;      /* GUI side: the last auto-off was logged */
+static int64_t headroom_good_since; /* audio side: when headroom rose back above resume, 0 if not */
+
+static atomic_uint frames;
+static atomic_uint auto_offs;
+static atomic_uint fft_us_max;
+static atomic_uint min_headroom = 100;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static int64_t now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static void store_min(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value < cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+/* Roughly log-spaced bands from bin 1 up to Nyquist, at least one bin each */
+static void build_bands(void)
+{
+    band_edges[0] = 1;
+    for (int b = 1; b <= SPECTRUM_BARS; b++) {
+        uint32_t edge = (uint32_t)lround(pow(FFT_SIZE / 2, (double)b / SPECTRUM_BARS));
+        band_edges[b] = edge > band_edges[b - 1] ? edge : band_edges[b - 1] + 1u;
+    }
+    band_edges[SPECTRUM_BARS] = FFT_SIZE / 2;
+}
+
+/* Magnitude to 0..255 on a log scale; max + 3/8 min stands in for the square root */
+static uint8_t level_of(fft_cpx_t bin)
+{
+    uint32_t re = abs(bin.re);
+    uint32_t im = abs(bin.im);
+    uint32_t mag = re > im ? re + (im * 3 >> 3) : im + (re * 3 >> 3);
+
+    if (mag == 0) {
+        return 0;
+    }
+    uint32_t msb = 31 - __builtin_clz(mag);
+    uint32_t frac = (msb >= 8 ? mag >> (msb - 8) : mag << (8 - msb)) & 0xFF;
+    uint32_t level = ((msb << 8) | frac) * 255 / (full_scale_log2 << 8);
+    return level > 255 ? 255 : (uint8_t)level;
+}
+
+static bool active(void)
+{
+    return atomic_load(&frame_rate) > 0 && !atomic_load(&auto_off);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int spectrum_cmd(int argc, char **argv)
+{
+    spectrum_stats_t stats;
+
+    if (argc > 1) {
+        spectrum.set_fps((uint8_t)atoi(argv[1]));
+    }
+    spectrum.take_stats(&stats);
+    printf("%u fps%s, %" PRIu32 " frames, slowest %" PRIu32 " us, %" PRIu32 " auto-offs, min headroom %u%%\n",
+           spectrum.fps(), atomic_load(&auto_off) ? " (off, low headroom)" : "", stats.frames,
+           stats.fft_us_max, stats.auto_offs, stats.min_headroom_pct);
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Build the FFT tables and bands and register the "spectrum" console command */
+static void init() {
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    fft_init();
+    build_bands();
+    ring_buf_init(&tap_ring, tap_storage, sizeof(tap_storage));
+    atomic_store(&frame_rate, SPECTRUM_DEFAULT_FPS);
+
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "spectrum",
+        .help = "Set the spectrum frame rate (0 turns it off) and show its cost since the last call",
+        .hint = "[fps]",
+        .func = spectrum_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+}
+
+/*
+ * Audio side: downmix and queue samples until one window is waiting.
+ * Returns straight away while nothing is shown, the spectrum is off or
+ * the last window has not been taken yet, so the audio path pays for at
+ * most FFT_SIZE samples per displayed frame.
+ */
+static void tap(const int16_t *pcm, size_t frame_count, uint8_t channels) {
+    int16_t chunk[SPECTRUM_TAP_CHUNK];
+
+    if (!atomic_load(&visible) || !active() || channels == 0) {
+        return;
+    }
+    size_t queued = ring_buf_used(&tap_ring) / sizeof(int16_t);
+    if (queued >= FFT_SIZE) {
+        return;
+    }
+    size_t want = FFT_SIZE - queued;
+    if (frame_count > want) {
+        frame_count = want;
+    }
+
+    while (frame_count) {
+        size_t n = frame_count < SPECTRUM_TAP_CHUNK ? frame_count : SPECTRUM_TAP_CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            int32_t sum = 0;
+            for (uint8_t c = 0; c < channels; c++) {
+                sum += pcm[c];
+            }
+            chunk[i] = (int16_t)(sum / channels);
+            pcm += channels;
+        }
+        ring_buf_write(&tap_ring, chunk, n * sizeof(int16_t));
+        frame_count -= n;
+    }
+}
+
+/* Audio side: share of the output buffer still queued when a write came in; low means close to an underrun */
+static void report_headroom(uint8_t fill_pct) {
+    store_min(&min_headroom, fill_pct);
+
+    if (fill_pct < SPECTRUM_MIN_HEADROOM_PCT) {
+        headroom_good_since = 0;
+        if (atomic_load(&frame_rate) && !atomic_exchange(&auto_off, true)) {
+            atomic_fetch_add(&auto_offs, 1);
+        }
+    } else if (fill_pct < SPECTRUM_RESUME_HEADROOM_PCT || !atomic_load(&auto_off)) {
+        headroom_good_since = 0;
+    } else if (headroom_good_since == 0) {
+        headroom_good_since = now_us();
+    } else if (now_us() - headroom_good_since >= SPECTRUM_RESUME_MS * 1000LL) {
+        headroom_good_since = 0;
+        atomic_store(&auto_off, false);
+    }
+}
+
+/* Frames per second to compute, capped at SPECTRUM_MAX_FPS; 0 turns it off. Clears an auto-off. */
+static void set_fps(uint8_t fps) {
+    atomic_store(&frame_rate, fps > SPECTRUM_MAX_FPS ? SPECTRUM_MAX_FPS : fps);
+    atomic_store(&auto_off, false);
+}
+
+static uint8_t fps(void) {
+    return (uint8_t)atomic_load(&frame_rate);
+}
+
+/* Whether a view is showing the bars; the tap does nothing otherwise */
+static void set_visible(bool is_visible) {
+    atomic_store(&visible, is_visible);
+}
+
+/*
+ * GUI side: transform the queued window into SPECTRUM_BARS levels of
+ * 0..255, with bars falling back gradually. Returns false, leaving levels
+ * alone, while the spectrum is off or no full window has been tapped.
+ */
+static bool compute(uint8_t levels[SPECTRUM_BARS]) {
+    if (!active()) {
+        if (atomic_load(&auto_off) && !auto_off_reported) {
+            auto_off_reported = true;
+            ESP_LOGW(TAG, "Audio headroom below %d%%, spectrum off", SPECTRUM_MIN_HEADROOM_PCT);
+        }
+        return false;
+    }
+    if (auto_off_reported) {
+        auto_off_reported = false;
+        ESP_LOGI(TAG, "Spectrum back on");
+    }
+    if (ring_buf_used(&tap_ring) < sizeof(window)) {
+        return false;
+    }
+
+    int64_t start = now_us();
+    ring_buf_read(&tap_ring, window, sizeof(window));
+    fft_window_q15(window, bins);
+    fft_q15(bins);
+
+    for (int b = 0; b < SPECTRUM_BARS; b++) {
+        uint8_t peak = 0;
+        for (uint32_t k = band_edges[b]; k < band_edges[b + 1]; k++) {
+            uint8_t level = level_of(bins[k]);
+            if (level > peak) {
+                peak = level;
+            }
+        }
+        uint8_t shown = levels_shown[b];
+        if (peak >= shown) {
+            shown = peak;
+        } else {
+            shown = shown - peak > SPECTRUM_FALL_PER_FRAME ? shown - SPECTRUM_FALL_PER_FRAME : peak;
+        }
+        levels[b] = levels_shown[b] = shown;
+    }
+
+    atomic_fetch_add(&frames, 1);
+    store_max(&fft_us_max, (uint32_t)(now_us() - start));
+    return true;
+}
+
+static void take_stats(spectrum_stats_t *stats) {
+    stats->frames = atomic_exchange(&frames, 0);
+    stats->auto_offs = atomic_exchange(&auto_offs, 0);
+    stats->fft_us_max = atomic_exchange(&fft_us_max, 0);
+    stats->min_headroom_pct = (uint8_t)atomic_exchange(&min_headroom, 100);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Spectrum spectrum = {
+    .init = init,
+    .tap = tap,
+    .report_headroom = report_headroom,
+    .set_fps = set_fps,
+    .fps = fps,
+    .active = active,
+    .set_visible = set_visible,
+    .compute = compute,
+    .take_stats = take_stats
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef struct {
+    uint32_t frames;            /* transforms run */
+    uint32_t auto_offs;         /* times low headroom switched the spectrum off */
+    uint32_t fft_us_max;        /* slowest window + transform + bars */
+    uint8_t min_headroom_pct;   /* lowest headroom reported since the last take_stats */
+} spectrum_stats_t;
+
+/*
+ * Spectrum bars for the player screen, computed from PCM tapped off the
+ * audio path. The audio side only queues samples: tap() copies at most one
+ * transform's worth per displayed frame into a lock-free ring and returns
+ * at once while nothing is shown or the ring already holds a window. The
+ * FFT runs on the GUI side in compute(), at the user-set frame rate.
+ *
+ * The audio output reports its headroom after each write, the share of
+ * its ring still queued when the write came in. Below
+ * SPECTRUM_MIN_HEADROOM_PCT the spectrum switches itself off, and comes
+ * back once headroom has stayed above SPECTRUM_RESUME_HEADROOM_PCT for
+ * SPECTRUM_RESUME_MS or set_fps() is called again.
+ */
+struct Spectrum {
+    void (*init)(void);
+    void (*tap)(const int16_t *pcm, size_t frames, uint8_t channels);
+    void (*report_headroom)(uint8_t fill_pct);
+    void (*set_fps)(uint8_t fps);
+    uint8_t (*fps)(void);
+    bool (*active)(void);
+    void (*set_visible)(bool visible);
+    bool (*compute)(uint8_t levels[SPECTRUM_BARS]);
+    void (*take_stats)(spectrum_stats_t *stats);
+};
+
+extern const struct Spectrum spectrum;
@@ -0,0 +1,2505 @@
+#include "bench.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "ring_buf.h"
+#include "bt_util.h"
+#include "scan_sched.h"
+#include "trace.h"
+#include "shuffle.h"
+#include "search.h"
+#include "library.h"
+#include "tag_parser.h"
+#include "journal.h"
+#include "playback_state.h"
+#include "sd_fs.h"
+#include "block_cache.h"
+#include "buf_pool.h"
+#include "fft.h"
+#include "spectrum.h"
+#include "jitter_buf.h"
+#include "output.h"
+#include "output_sink.h"
+#include "play_clock.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#else
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    const char *name;
+    bool (*setup)(void);            /* optional; returning false skips the kernel */
+    void (*run)(uint32_t iters);
+    void (*teardown)(void);         /* optional */
+    uint32_t iters;
+    uint32_t bytes_per_op;          /* 0 if throughput is meaningless */
+    bool (*check)(void);            /* optional correctness check; failing counts as a regression */
+} bench_kernel_t;
+
+/* A synthetic file the tag kernel writes, under an 8.3 name, and what parsing it must give */
+typedef struct {
+    const char *name;
+    const char *title;
+    const char *artist;
+    const char *album;
+    uint32_t duration_ms;
+    uint8_t format;
+    uint32_t reads;                 /* most it may take */
+} tag_case_t;
+
+/* One simulated discovery next to a stream; see scan_sim() */
+typedef struct {
+    uint32_t done_ms;               /* when the inquiry budget was used up, 0 if never */
+    uint32_t underrun_ms;           /* output time with nothing queued */
+    uint32_t min_depth_ms;
+    scan_sched_stats_t stats;
+} scan_sim_result_t;
+
+/* One simulated packet stream; see jitter_arrival() */
+typedef struct {
+    uint32_t burst;                 /* packets the source sends back to back */
+    uint32_t jitter_us;             /* random extra delay per burst */
+    int32_t source_ppm;             /* source clock against the DAC */
+    uint32_t stall_ms;              /* a late burst at 10 s and again at 15 s */
+    const int64_t *recorded;        /* replayed arrivals instead, with their frame counts */
+    const uint16_t *recorded_frames;
+    uint32_t recorded_count;
+} jitter_scenario_t;
+
+typedef struct {
+    uint32_t startup_underruns;     /* in the first BENCH_JITTER_SETTLE_MS, while the spread is learnt */
+    uint32_t underruns;
+    uint32_t overflows;
+    uint32_t discontinuities;       /* steps in the sine that resampling cannot explain */
+    uint32_t latency_ms_avg;
+    uint32_t latency_ms_max;
+    uint32_t target_ms;
+    uint32_t target_ms_max;
+    int32_t ppm;
+} jitter_result_t;
+
+/* One simulated stream through the presentation clock; see clock_sim() */
+typedef struct {
+    uint32_t err_us_max;            /* reading against what had been heard, up to the idle gap */
+    uint32_t naive_ahead_us;        /* audio written against what was heard, where a decoder-side position would be */
+    uint32_t backsteps;             /* readings below the one before */
+    uint32_t idle_advance_ms;       /* how far the reading moved over the idle gap */
+    play_clock_stats_t steady;      /* from BENCH_CLOCK_SETTLE_MS up to the underrun */
+    play_clock_stats_t rest;
+} clock_sim_result_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "BENCH";
+
+#if !CONFIG_IDF_TARGET_LINUX
+extern const char baseline_json_start[] asm("_binary_baseline_json_start");
+#endif
+
+#define DRAW_BUF_PX (LCD_H_RES * LVGL_DRAW_BUF_LINES)
+
+static uint16_t *draw_buf;
+static FILE *sd_file;
+static uint8_t *io_buf;
+static char lv_fs_path[SD_MAX_CHAR_SIZE];
+static char lv_fs_drive_path[SD_MAX_CHAR_SIZE];
+static lv_fs_file_t lv_fs_file;
+static int lv_fs_fd = -1;
+static uint8_t lv_fs_small[BENCH_LV_FS_READ_SIZE];
+static uint8_t scan_trace[BENCH_SCAN_SIM_MS / SCAN_SCHED_TICK_MS];
+static uint32_t scan_trace_len;
+static ring_buf_t ring;
+static uint8_t *ring_storage;
+static uint32_t rng_state = 0x2545F491;
+static shuffle_t shuffle;
+static char search_words[26][SEARCH_MAX_KEY + 1];
+static int search_word_count;
+static search_result_t search_results[BENCH_SEARCH_RESULTS];
+static char walk_dir[SD_MAX_CHAR_SIZE];
+static FILE *walk_paths;
+static FILE *walk_index;
+static char tag_dir[SD_MAX_CHAR_SIZE];
+static uint8_t tag_buf[TAG_READ_SIZE];
+static uint32_t tag_next;
+static uint32_t tag_reads;
+static search_stats_t search_stats;
+static bool search_ok;
+static char (*tied_keys)[SEARCH_MAX_KEY + 1];
+static uint8_t tied_block[SEARCH_BLOCK_SIZE];
+static uint32_t tied_next;
+static char journal_path[SD_MAX_CHAR_SIZE];
+static uint8_t journal_record[BENCH_JOURNAL_RECORD_SIZE];
+static uint32_t replay_count;
+static bool replay_ok;
+static int16_t fft_pcm[FFT_SIZE * 2];
+static fft_cpx_t fft_work[FFT_SIZE];
+static jitter_buf_t jitter;
+static uint8_t *jitter_storage;
+static int16_t jitter_sine[BENCH_JITTER_SINE_PERIOD];
+static int16_t jitter_io[JITTER_MAX_READ_FRAMES * 2];
+static int64_t jitter_arrival_us;
+static uint64_t jitter_frames_in;
+static int64_t virtual_us;
+static output_id_t output_was;
+static play_clock_t bench_clock;
+static int64_t clock_run_us;
+static uint64_t clock_run_written;
+
+/* Results are folded into this so the compiler cannot drop the work */
+static volatile uint32_t sink;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint64_t now_ns(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    return (uint64_t)esp_timer_get_time() * 1000ULL;
+#endif
+}
+
+/*
+ * Cycles elapsed, for the per-op cycle figure. The device clock is fixed
+ * (no power management), so its cycles follow from the time and
+ * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ; x86 hosts read the time-stamp counter.
+ * Returns false where there is no counter.
+ */
+static bool cycles_per_op(uint64_t ns_per_op, uint64_t tsc_per_op, uint64_t *cycles)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    *cycles = ns_per_op * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / 1000;
+    return true;
+#elif defined(__x86_64__) || defined(__i386__)
+    *cycles = tsc_per_op;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static uint64_t now_tsc(void)
+{
+#if CONFIG_IDF_TARGET_LINUX && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static uint32_t xorshift32(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/* Buffers come from the same DMA-capable heap as the LVGL draw buffers */
+static void *bench_alloc(size_t size)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return malloc(size);
+#else
+    return heap_caps_malloc(size, MALLOC_CAP_DMA);
+#endif
+}
+
+static const char *sd_root(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return getenv(HOST_SD_ROOT_ENV);
+#else
+    return SD_MOUNT_POINT;
+#endif
+}
+
+/*---------------------------- display -----------------------------*/
+
+static bool draw_buf_setup(void)
+{
+    draw_buf = bench_alloc(DRAW_BUF_PX * sizeof(uint16_t));
+    if (draw_buf == NULL) {
+        return false;
+    }
+    memset(draw_buf, 0x5A, DRAW_BUF_PX * sizeof(uint16_t));
+    return true;
+}
+
+static void draw_buf_teardown(void)
+{
+    free(draw_buf);
+    draw_buf = NULL;
+}
+
+/* The byte swap lvgl_flush_cb does on every partial buffer */
+static void rgb565_swap_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        lv_draw_sw_rgb565_swap(draw_buf, DRAW_BUF_PX);
+    }
+    sink += draw_buf[0];
+}
+
+/* Solid fill of a full draw buffer, the common case for backgrounds */
+static void rgb565_fill_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        uint16_t color = (uint16_t)i;
+        for (uint32_t px = 0; px < DRAW_BUF_PX; px++) {
+            draw_buf[px] = color;
+        }
+    }
+    sink += draw_buf[DRAW_BUF_PX - 1];
+}
+
+/*---------------------------- sd card -----------------------------*/
+
+/* Open (creating once if needed) a scratch file on the card */
+static bool sd_setup(void)
+{
+    const char *root = sd_root();
+    char path[SD_MAX_CHAR_SIZE];
+
+    if (root == NULL) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/%s", root, BENCH_SD_FILE_NAME);
+
+    io_buf = bench_alloc(BENCH_SD_CHUNK_SIZE);
+    if (io_buf == NULL) {
+        return false;
+    }
+
+    sd_file = fopen(path, "rb");
+    if (sd_file != NULL) {
+        fseek(sd_file, 0, SEEK_END);
+        if (ftell(sd_file) == BENCH_SD_FILE_SIZE) {
+            return true;
+        }
+        fclose(sd_file);
+    }
+
+    // Nothing may be logged here, it would land in the middle of the JSON
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        free(io_buf);
+        io_buf = NULL;
+        return false;
+    }
+    for (uint32_t i = 0; i < BENCH_SD_CHUNK_SIZE; i++) {
+        io_buf[i] = (uint8_t)xorshift32();
+    }
+    for (uint32_t off = 0; off < BENCH_SD_FILE_SIZE; off += BENCH_SD_CHUNK_SIZE) {
+        fwrite(io_buf, 1, BENCH_SD_CHUNK_SIZE, f);
+    }
+    fclose(f);
+
+    sd_file = fopen(path, "rb");
+    return sd_file != NULL;
+}
+
+static void sd_teardown(void)
+{
+    fclose(sd_file);
+    sd_file = NULL;
+    free(io_buf);
+    io_buf = NULL;
+}
+
+static void sd_seq_read_run(uint32_t iters)
+{
+    fseek(sd_file, 0, SEEK_SET);
+    for (uint32_t i = 0; i < iters; i++) {
+        if (fread(io_buf, 1, BENCH_SD_CHUNK_SIZE, sd_file) != BENCH_SD_CHUNK_SIZE) {
+            fseek(sd_file, 0, SEEK_SET);
+        }
+    }
+    sink += io_buf[0];
+}
+
+static void sd_rand_read_run(uint32_t iters)
+{
+    const uint32_t chunks = BENCH_SD_FILE_SIZE / BENCH_SD_CHUNK_SIZE;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        fseek(sd_file, (long)(xorshift32() % chunks) * BENCH_SD_CHUNK_SIZE, SEEK_SET);
+        fread(io_buf, 1, BENCH_SD_CHUNK_SIZE, sd_file);
+    }
+    sink += io_buf[0];
+}
+
+/* Byte at offset of the drive kernels' file, with no period a misplaced block could hide in */
+static uint8_t lv_fs_byte(uint32_t offset)
+{
+    return (uint8_t)(((offset * 2654435761u) >> 24) ^ (offset >> 12));
+}
+
+/* Write the drive kernels' file once; the host run registers the drive here */
+static bool lv_fs_setup(void)
+{
+    const char *root = sd_root();
+    struct stat st;
+
+    if (root == NULL) {
+        return false;
+    }
+    snprintf(lv_fs_path, sizeof(lv_fs_path), "%s/%s", root, BENCH_LV_FS_FILE_NAME);
+    snprintf(lv_fs_drive_path, sizeof(lv_fs_drive_path), "%c:/%s", SD_FS_LETTER, BENCH_LV_FS_FILE_NAME);
+
+#if CONFIG_IDF_TARGET_LINUX
+    // Already done by app_main on the device
+    if (!lv_is_initialized()) {
+        lv_init();
+    }
+    esp_log_level_set("SD FS", ESP_LOG_NONE);
+    esp_log_level_set("BLOCK CACHE", ESP_LOG_NONE);
+    sd_fs.init();
+    esp_log_level_set("SD FS", ESP_LOG_INFO);
+    esp_log_level_set("BLOCK CACHE", ESP_LOG_INFO);
+#endif
+
+    if (stat(lv_fs_path, &st) == 0 && st.st_size == BENCH_LV_FS_FILE_SIZE) {
+        return true;
+    }
+    FILE *f = fopen(lv_fs_path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < BENCH_LV_FS_FILE_SIZE; i++) {
+        fputc(lv_fs_byte(i), f);
+    }
+    return fclose(f) == 0;
+}
+
+static bool lv_fs_open_setup(void)
+{
+    return lv_fs_setup() && lv_fs_open(&lv_fs_file, lv_fs_drive_path, LV_FS_MODE_RD) == LV_FS_RES_OK;
+}
+
+static void lv_fs_close_teardown(void)
+{
+    lv_fs_close(&lv_fs_file);
+}
+
+static bool posix_open_setup(void)
+{
+    return lv_fs_setup() && (lv_fs_fd = open(lv_fs_path, O_RDONLY)) >= 0;
+}
+
+static void posix_close_teardown(void)
+{
+    close(lv_fs_fd);
+    lv_fs_fd = -1;
+}
+
+/* The small reads LVGL makes for glyphs and image rows, through the drive and its block cache */
+static void lv_fs_read_run(uint32_t iters)
+{
+    uint32_t br;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        if (lv_fs_read(&lv_fs_file, lv_fs_small, BENCH_LV_FS_READ_SIZE, &br) != LV_FS_RES_OK ||
+            br < BENCH_LV_FS_READ_SIZE) {
+            lv_fs_seek(&lv_fs_file, 0, LV_FS_SEEK_SET);
+        }
+    }
+    sink += lv_fs_small[0];
+}
+
+/* The same reads straight to the file system, what a plain POSIX driver costs */
+static void posix_read_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        if (read(lv_fs_fd, lv_fs_small, BENCH_LV_FS_READ_SIZE) < BENCH_LV_FS_READ_SIZE) {
+            lseek(lv_fs_fd, 0, SEEK_SET);
+        }
+    }
+    sink += lv_fs_small[0];
+}
+
+/* A file of len bytes of value under the card root, made behind the cache's back */
+static bool cache_file(char *path, size_t size, const char *name, uint8_t value, uint32_t len)
+{
+    snprintf(path, size, "%s/%s", sd_root(), name);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        fputc(value, f);
+    }
+    return fclose(f) == 0;
+}
+
+/*
+ * Writes and ids: a write past the end of a file whose short last block is
+ * cached reads back whole, gap included, and a second file with the same
+ * size and time never sees the first one's blocks.
+ */
+static bool cache_write_check(void)
+{
+    char path[SD_MAX_CHAR_SIZE];
+    char other[SD_MAX_CHAR_SIZE];
+    const uint32_t len = BENCH_CACHE_GROW_AT + BENCH_CACHE_GROW_LEN;
+    uint8_t *buf = bench_alloc(len);
+    uint8_t tail[BENCH_CACHE_GROW_LEN];
+    block_cache_file_t a;
+    block_cache_file_t b;
+    bool ok = cache_file(path, sizeof(path), BENCH_CACHE_GROW_NAME, 0xA5, BENCH_CACHE_SHORT_LEN) &&
+              cache_file(other, sizeof(other), BENCH_CACHE_OTHER_NAME, 0x5A, BENCH_CACHE_SHORT_LEN);
+
+    if (!ok || buf == NULL || !block_cache.open(&a, path, O_RDWR)) {
+        free(buf);
+        return false;
+    }
+    ok = block_cache.read(&a, 0, buf, len) == BENCH_CACHE_SHORT_LEN;
+    memset(tail, 0x3C, sizeof(tail));
+    ok &= block_cache.write(&a, BENCH_CACHE_GROW_AT, tail, sizeof(tail)) == sizeof(tail);
+    ok &= block_cache.read(&a, 0, buf, len) == len;
+    for (uint32_t i = 0; ok && i < len; i++) {
+        uint8_t want = i < BENCH_CACHE_SHORT_LEN ? 0xA5 : i < BENCH_CACHE_GROW_AT ? 0 : 0x3C;
+        ok = buf[i] == want;
+    }
+    block_cache.close(&a);
+
+    if (ok && block_cache.open(&a, other, O_RDONLY)) {
+        ok = block_cache.read(&a, 0, buf, BENCH_CACHE_SHORT_LEN) == BENCH_CACHE_SHORT_LEN;
+        if (block_cache.open(&b, other, O_RDONLY)) {
+            ok &= b.id == a.id;
+            block_cache.close(&b);
+        }
+        ok &= a.id != 0 && buf[0] == 0x5A && buf[BENCH_CACHE_SHORT_LEN - 1] == 0x5A;
+        block_cache.close(&a);
+    }
+    remove(path);
+    remove(other);
+    free(buf);
+    return ok;
+}
+
+/*
+ * A sequential pass of small reads takes one card read per miss and its
+ * read-ahead, and reads at random offsets and lengths, crossing blocks and
+ * the short last one, give the file's bytes.
+ */
+static bool lv_fs_check(void)
+{
+    const uint32_t max_len = 3 * BLOCK_CACHE_BLOCK_SIZE;
+    const uint32_t run = (1 + BLOCK_CACHE_READ_AHEAD) * BLOCK_CACHE_BLOCK_SIZE;
+    sd_fs_stats_t stats;
+    uint8_t *buf = bench_alloc(max_len);
+    uint32_t br;
+    bool ok = buf && lv_fs_open_setup();
+
+    if (!ok) {
+        free(buf);
+        return false;
+    }
+
+    sd_fs.take_stats(&stats);
+    for (uint32_t i = 0; i < BENCH_LV_FS_FILE_SIZE / BENCH_LV_FS_READ_SIZE; i++) {
+        ok &= lv_fs_read(&lv_fs_file, lv_fs_small, BENCH_LV_FS_READ_SIZE, &br) == LV_FS_RES_OK &&
+              br == BENCH_LV_FS_READ_SIZE && lv_fs_small[0] == lv_fs_byte(i * BENCH_LV_FS_READ_SIZE);
+    }
+    sd_fs.take_stats(&stats);
+    uint32_t lookups = stats.cache.hits + stats.cache.misses;
+    uint32_t hit_x100 = lookups ? (uint32_t)(stats.cache.hits * 10000ULL / lookups) : 0;
+    ok &= stats.cache.card_reads <= (BENCH_LV_FS_FILE_SIZE + run - 1) / run + 1 && hit_x100 >= 9900;
+
+    for (int i = 0; i < 200; i++) {
+        uint32_t offset = xorshift32() % BENCH_LV_FS_FILE_SIZE;
+        uint32_t len = 1 + xorshift32() % max_len;
+        uint32_t want = len < BENCH_LV_FS_FILE_SIZE - offset ? len : BENCH_LV_FS_FILE_SIZE - offset;
+        lv_fs_seek(&lv_fs_file, offset, LV_FS_SEEK_SET);
+        ok &= lv_fs_read(&lv_fs_file, buf, len, &br) == LV_FS_RES_OK && br == want;
+        for (uint32_t k = 0; ok && k < br; k++) {
+            ok &= buf[k] == lv_fs_byte(offset + k);
+        }
+    }
+
+    lv_fs_close_teardown();
+    free(buf);
+    ok &= cache_write_check();
+    printf(", \"hit_pct\": %" PRIu32 ".%02" PRIu32 ", \"card_reads\": %" PRIu32,
+           hit_x100 / 100, hit_x100 % 100, stats.cache.card_reads);
+    return ok;
+}
+
+/*--------------------------- bluetooth ----------------------------*/
+
+static void bda2str_run(uint32_t iters)
+{
+    uint8_t bda[BT_UTIL_BDA_LEN] = {0x30, 0xae, 0xa4, 0x01, 0x02, 0x03};
+    char str[BT_UTIL_BDA_STR_LEN];
+
+    for (uint32_t i = 0; i < iters; i++) {
+        bda[5] = (uint8_t)i;
+        bda2str(bda, str, sizeof(str));
+        sink += (uint8_t)str[16];
+    }
+}
+
+/* A typical headphone EIR: flags, 16-bit UUIDs, TX power, then the name */
+static const uint8_t sample_eir[] = {
+    0x02, 0x01, 0x1a,
+    0x07, 0x03, 0x0b, 0x11, 0x0e, 0x11, 0x1e, 0x11,
+    0x02, 0x0a, 0x04,
+    0x10, 0x09, 'B', 'e', 'a', 't', ' ', 'H', 'e', 'a', 'd', 'p', 'h', 'o', 'n', 'e', 's',
+    0x00,
+};
+
+static void eir_parse_run(uint32_t iters)
+{
+    uint8_t name[32];
+    uint8_t name_len = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        get_name_from_eir(sample_eir, sizeof(sample_eir), name, sizeof(name) - 1, &name_len);
+        sink += name_len;
+    }
+}
+
+/*
+ * The sink's queue with a discovery running: the source sends a burst
+ * every BENCH_SCAN_BURST_MS of what it has queued, up to twice real
+ * time, but while an inquiry holds the radio only one burst in
+ * BENCH_SCAN_STARVE gets through. The output drains in real time. naive
+ * spends the whole budget in one inquiry, as bt_app_gap_start_up did.
+ * The scheduler's queue readings go to scan_trace.
+ */
+static void scan_sim(bool naive, scan_sim_result_t *r)
+{
+    scan_sched_t s;
+    uint32_t depth = BENCH_SCAN_TARGET_MS;
+    uint32_t backlog = 0;
+    uint32_t bursts = 0;
+    bool scanning = naive;
+
+    memset(r, 0, sizeof(*r));
+    r->min_depth_ms = UINT32_MAX;
+    scan_sched_init(&s);
+    scan_sched_request(&s, 0);
+    scan_trace_len = 0;
+
+    for (uint32_t t = 0; t < BENCH_SCAN_SIM_MS; t += BENCH_SCAN_STEP_MS) {
+        backlog += BENCH_SCAN_STEP_MS;
+        if (t % BENCH_SCAN_BURST_MS == 0 && (!scanning || bursts++ % BENCH_SCAN_STARVE == 0)) {
+            uint32_t n = backlog < 2 * BENCH_SCAN_BURST_MS ? backlog : 2 * BENCH_SCAN_BURST_MS;
+            backlog -= n;
+            depth += n;
+        }
+        if (depth < BENCH_SCAN_STEP_MS) {
+            r->underrun_ms += BENCH_SCAN_STEP_MS - depth;
+            depth = 0;
+        } else {
+            depth -= BENCH_SCAN_STEP_MS;
+        }
+        if (depth < r->min_depth_ms) {
+            r->min_depth_ms = depth;
+        }
+
+        if (naive) {
+            if (scanning && t + BENCH_SCAN_STEP_MS >= SCAN_SCHED_BUDGET_MS) {
+                scanning = false;
+                r->done_ms = t + BENCH_SCAN_STEP_MS;
+            }
+            continue;
+        }
+        if (t % SCAN_SCHED_TICK_MS) {
+            continue;
+        }
+        // The controller ends an inquiry after its length, whole 1.28 s units
+        uint32_t inquiry_ms = (s.window_ms + 1279) / 1280 * 1280;
+        if (scanning && t - s.window_start_ms >= inquiry_ms) {
+            scan_sched_stopped(&s, t);
+            scanning = false;
+        }
+        scan_trace[scan_trace_len++] = depth < UINT8_MAX ? depth : UINT8_MAX;
+        scan_sched_action_t action = scan_sched_step(&s, t, true, depth, BENCH_SCAN_TARGET_MS);
+        if (action != SCAN_SCHED_NONE) {
+            scanning = action == SCAN_SCHED_START;
+        }
+        if (!r->done_ms && !s.wanted && !s.scanning) {
+            r->done_ms = t;
+        }
+    }
+    r->stats = s.stats;
+}
+
+static bool scan_setup(void)
+{
+    scan_sim_result_t r;
+
+    scan_sim(false, &r);
+    return scan_trace_len > 0;
+}
+
+/* One scheduler tick against the recorded queue depths, starting over at the end of the trace */
+static void scan_sched_step_run(uint32_t iters)
+{
+    static scan_sched_t s;
+    static uint32_t pos;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        if (pos == 0) {
+            scan_sched_init(&s);
+            scan_sched_request(&s, 0);
+        }
+        sink += scan_sched_step(&s, pos * SCAN_SCHED_TICK_MS, true, scan_trace[pos], BENCH_SCAN_TARGET_MS);
+        pos = (pos + 1) % scan_trace_len;
+    }
+}
+
+/*
+ * The one-shot inquiry starves the simulated stream, while the scheduler
+ * gets through the same budget within the simulation without an underrun
+ * and has to cut windows short to do so.
+ */
+static bool scan_check(void)
+{
+    scan_sim_result_t naive;
+    scan_sim_result_t r;
+
+    scan_sim(true, &naive);
+    scan_sim(false, &r);
+    printf(", \"done_ms\": %" PRIu32 ", \"windows\": %" PRIu32 ", \"pauses\": %" PRIu32
+           ", \"min_depth_ms\": %" PRIu32 ", \"underrun_ms\": %" PRIu32 ", \"naive_underrun_ms\": %" PRIu32,
+           r.done_ms, r.stats.windows, r.stats.pauses, r.min_depth_ms, r.underrun_ms, naive.underrun_ms);
+    return naive.underrun_ms > 0 && r.underrun_ms == 0 && r.done_ms > 0 && r.stats.discoveries == 1 &&
+           r.stats.pauses > 0 && r.stats.scan_ms >= SCAN_SCHED_BUDGET_MS;
+}
+
+/*----------------------------- audio ------------------------------*/
+
+static bool ring_setup(void)
+{
+    ring_storage = bench_alloc(BENCH_RING_SIZE + 2 * BENCH_PCM_BLOCK_SIZE);
+    if (ring_storage == NULL) {
+        return false;
+    }
+    io_buf = ring_storage + BENCH_RING_SIZE;
+    memset(io_buf, 0x11, 2 * BENCH_PCM_BLOCK_SIZE);
+    ring_buf_init(&ring, ring_storage, BENCH_RING_SIZE);
+    return true;
+}
+
+static void ring_teardown(void)
+{
+    free(ring_storage);
+    ring_storage = NULL;
+    io_buf = NULL;
+}
+
+/* One PCM block through the ring per op, the shape of the audio pipeline */
+static void ring_buf_copy_run(uint32_t iters)
+{
+    uint8_t *in = io_buf;
+    uint8_t *out = io_buf + BENCH_PCM_BLOCK_SIZE;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        ring_buf_write(&ring, in, BENCH_PCM_BLOCK_SIZE);
+        ring_buf_read(&ring, out, BENCH_PCM_BLOCK_SIZE);
+    }
+    sink += out[0];
+}
+
+/* Plain PCM block copy as the reference for the ring's overhead */
+static void pcm_copy_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        memcpy(io_buf + BENCH_PCM_BLOCK_SIZE, io_buf, BENCH_PCM_BLOCK_SIZE);
+        io_buf[0] = (uint8_t)i;
+    }
+    sink += io_buf[BENCH_PCM_BLOCK_SIZE];
+}
+
+/*----------------------------- trace ------------------------------*/
+
+/* Cost of one binary trace event, the replacement for hot-path logging */
+static void trace_record_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        TRACE(TRACE_EV_NONE, i, 0);
+    }
+}
+
+/*---------------------------- library -----------------------------*/
+
+/* Made under BENCH_WALK_DIR_NAME; a trailing '/' is a directory. Files after a subdirectory catch a stale path */
+static const char *const walk_tree[] = {
+    "a.mp3", "album1/", "album1/t1.mp3", "album1/disc2/", "album1/disc2/t2.flac", "album1/t3.wav",
+    "album1/cover.jpg", "album2/", "album2/t4.ogg", "b.mp3", "notes.txt",
+};
+
+static const char *const walk_tracks[] = {
+    "a.mp3", "album1/t1.mp3", "album1/disc2/t2.flac", "album1/t3.wav", "album2/t4.ogg", "b.mp3",
+};
+
+#define WALK_TREE (sizeof(walk_tree) / sizeof(walk_tree[0]))
+#define WALK_TRACKS (sizeof(walk_tracks) / sizeof(walk_tracks[0]))
+
+/* The scan's output files next to the tree, opened for the walk to write */
+static bool walk_open(void)
+{
+    char path[SD_MAX_CHAR_SIZE + 16];
+
+    snprintf(path, sizeof(path), "%s.txt", walk_dir);
+    walk_paths = fopen(path, "w+");
+    snprintf(path, sizeof(path), "%s.idx", walk_dir);
+    walk_index = fopen(path, "wb");
+    return walk_paths && walk_index;
+}
+
+static void walk_close(void)
+{
+    if (walk_paths) {
+        fclose(walk_paths);
+        walk_paths = NULL;
+    }
+    if (walk_index) {
+        fclose(walk_index);
+        walk_index = NULL;
+    }
+}
+
+static bool walk_setup(void)
+{
+    char path[SD_MAX_CHAR_SIZE + 32];
+    const char *root = sd_root();
+
+    if (root == NULL) {
+        return false;
+    }
+    snprintf(walk_dir, sizeof(walk_dir), "%s/%s", root, BENCH_WALK_DIR_NAME);
+    mkdir(walk_dir, 0775);
+    for (size_t i = 0; i < WALK_TREE; i++) {
+        size_t len = strlen(walk_tree[i]);
+        snprintf(path, sizeof(path), "%s/%.*s", walk_dir, (int)len - (walk_tree[i][len - 1] == '/'), walk_tree[i]);
+        if (walk_tree[i][len - 1] == '/') {
+            mkdir(path, 0775);
+            continue;
+        }
+        FILE *f = fopen(path, "wb");
+        if (f == NULL) {
+            return false;
+        }
+        fclose(f);
+    }
+    return walk_open();
+}
+
+/* A whole library scan of the small tree, into the same two files every time */
+static void library_walk_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        rewind(walk_paths);
+        rewind(walk_index);
+        sink += library_walk(walk_dir, walk_paths, walk_index);
+    }
+}
+
+/* Every track comes out once with its full path, whatever order the directories list in */
+static bool walk_check(void)
+{
+    char line[LIBRARY_MAX_PATH];
+    char want[LIBRARY_MAX_PATH];
+    uint32_t seen[WALK_TRACKS] = { 0 };
+    uint32_t lines = 0;
+    bool ok = walk_open();
+
+    if (ok) {
+        ok = library_walk(walk_dir, walk_paths, walk_index) == WALK_TRACKS;
+        rewind(walk_paths);
+        while (ok && fgets(line, sizeof(line), walk_paths)) {
+            line[strcspn(line, "\n")] = '\0';
+            size_t i = 0;
+            for (; i < WALK_TRACKS; i++) {
+                snprintf(want, sizeof(want), "%s/%s", walk_dir, walk_tracks[i]);
+                if (strcmp(line, want) == 0) {
+                    seen[i]++;
+                    break;
+                }
+            }
+            ok = i < WALK_TRACKS;
+            lines++;
+        }
+    }
+    for (size_t i = 0; i < WALK_TRACKS; i++) {
+        ok &= seen[i] == 1;
+    }
+    walk_close();
+    printf(", \"tracks\": %" PRIu32, lines);
+    return ok && lines == WALK_TRACKS;
+}
+
+static bool shuffle_setup(void)
+{
+    shuffle_init(&shuffle, BENCH_SHUFFLE_TRACKS, 0xB3A7B17E);
+    return true;
+}
+
+/* Next track in shuffled order, a Feistel evaluation plus cycle walks */
+static void shuffle_next_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        sink += shuffle_track_at(&shuffle, i % BENCH_SHUFFLE_TRACKS);
+    }
+}
+
+/* Every track exactly once per cycle, and the inverse agrees */
+static bool shuffle_check(void)
+{
+    uint8_t *bitmap = malloc((BENCH_SHUFFLE_TRACKS + 7) / 8);
+    bool ok = bitmap != NULL;
+
+    for (uint32_t seed = 0; ok && seed < 4; seed++) {
+        ok = shuffle_verify(BENCH_SHUFFLE_TRACKS, seed * 0x9E3779B9, bitmap);
+    }
+    free(bitmap);
+    return ok;
+}
+
+/*
+ * Type the first title under every letter one character at a time, the
+ * way the search page queries. Needs an index on the card, e.g.
+ * build_search_index.py --synthetic 50000 for the reference library.
+ */
+static bool search_setup(void)
+{
+    char path[SD_MAX_CHAR_SIZE];
+    const char *root = sd_root();
+
+    if (root == NULL) {
+        return false;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    snprintf(path, sizeof(path), "%s/%s", root, SEARCH_INDEX_NAME);
+#else
+    snprintf(path, sizeof(path), "%s", SEARCH_INDEX_FILE);
+#endif
+    if (!search.open(path)) {
+        return false;
+    }
+
+    search_word_count = 0;
+    for (char c = 'a'; c <= 'z'; c++) {
+        char prefix[2] = { c, '\0' };
+        if (search.query(prefix, search_results, 1) == 1) {
+            strcpy(search_words[search_word_count++], search_results[0].text);
+        }
+    }
+    search.take_stats(&search_stats);
+    search_ok = true;
+    return search_word_count > 0;
+}
+
+static void search_teardown(void)
+{
+    search.take_stats(&search_stats);
+    search.close();
+}
+
+/* One keystroke: a binary search over the sparse keys and at most two block reads */
+static void search_keystroke_run(uint32_t iters)
+{
+    char prefix[SEARCH_MAX_KEY + 1];
+    int word = 0;
+    size_t len = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        const char *text = search_words[word];
+        if (text[len] == '\0') {
+            word = (word + 1) % search_word_count;
+            len = 0;
+            text = search_words[word];
+        }
+        memcpy(prefix, text, ++len);
+        prefix[len] = '\0';
+
+        int found = search.query(prefix, search_results, BENCH_SEARCH_RESULTS);
+        for (int r = 0; r < found; r++) {
+            search_ok &= strncmp(search_results[r].text, prefix, len) == 0;
+        }
+        search_ok &= found > 0;
+        sink += found;
+    }
+}
+
+/* Every query found its own word and stayed within the block read budget */
+static bool search_check(void)
+{
+    return search_ok && search_stats.max_reads <= SEARCH_MAX_BLOCK_READS;
+}
+
+static int tied_cmp(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+static void tied_le(uint8_t *p, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+/*
+ * An index of one album series, "greatest hits vol 1" to BENCH_SEARCH_TIED
+ * and "greatest hits z", so every block's cut first key is the same. Laid
+ * out as build_search_index.py does, without the shared prefixes.
+ */
+static bool search_tied_setup(void)
+{
+    char path[SD_MAX_CHAR_SIZE];
+    const char *root = sd_root();
+    uint32_t keys = BENCH_SEARCH_TIED + 1;
+    uint32_t blocks = 0;
+    uint32_t used = 2;
+    uint32_t count = 0;
+
+    tied_keys = malloc(keys * sizeof(*tied_keys));
+    if (root == NULL || tied_keys == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0; i < BENCH_SEARCH_TIED; i++) {
+        snprintf(tied_keys[i], sizeof(*tied_keys), "greatest hits vol %" PRIu32, i + 1);
+    }
+    strcpy(tied_keys[BENCH_SEARCH_TIED], "greatest hits z");
+    qsort(tied_keys, keys, sizeof(*tied_keys), tied_cmp);
+
+    snprintf(path, sizeof(path), "%s/%s", root, BENCH_SEARCH_TIED_NAME);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    uint8_t *first = calloc(keys, BENCH_SEARCH_TIED_KEY_LEN);
+    memset(tied_block, 0, sizeof(tied_block));
+    fwrite(tied_block, 1, sizeof(tied_block), f);
+    for (uint32_t i = 0; i <= keys && first; i++) {
+        size_t len = i < keys ? strlen(tied_keys[i]) : 0;
+        if (i == keys || used + 2 + len + 5 > SEARCH_BLOCK_SIZE) {
+            tied_le(tied_block, count, 2);
+            fwrite(tied_block, 1, sizeof(tied_block), f);
+            memset(tied_block, 0, sizeof(tied_block));
+            blocks++;
+            used = 2;
+            count = 0;
+            if (i == keys) {
+                break;
+            }
+        }
+        if (count == 0) {
+            memcpy(&first[blocks * BENCH_SEARCH_TIED_KEY_LEN], tied_keys[i], len < BENCH_SEARCH_TIED_KEY_LEN ? len : BENCH_SEARCH_TIED_KEY_LEN);
+        }
+        tied_block[used] = 0;
+        tied_block[used + 1] = len;
+        memcpy(&tied_block[used + 2], tied_keys[i], len);
+        tied_block[used + 2 + len] = SEARCH_FIELD_ALBUM;
+        tied_le(&tied_block[used + 3 + len], i, 4);
+        used += 2 + len + 5;
+        count++;
+    }
+    if (first) {
+        fwrite(first, BENCH_SEARCH_TIED_KEY_LEN, blocks, f);
+    }
+    uint8_t header[21] = { 'B', 'B', 'S', 'I' };
+    tied_le(header + 4, 1, 2);
+    tied_le(header + 6, SEARCH_BLOCK_SIZE, 2);
+    tied_le(header + 8, blocks, 4);
+    tied_le(header + 12, keys, 4);
+    tied_le(header + 16, (blocks + 1) * SEARCH_BLOCK_SIZE, 4);
+    header[20] = BENCH_SEARCH_TIED_KEY_LEN;
+    rewind(f);
+    fwrite(header, 1, sizeof(header), f);
+    free(first);
+    if (fclose(f) != 0 || first == NULL) {
+        return false;
+    }
+
+    tied_next = 0;
+    search_ok = true;
+    return search.open(path);
+}
+
+static void search_tied_teardown(void)
+{
+    search.close();
+    free(tied_keys);
+    tied_keys = NULL;
+}
+
+/* Each whole album name in turn; every one ties with all the cut keys */
+static void search_tied_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        const char *key = tied_keys[tied_next];
+        int found = search.query(key, search_results, BENCH_SEARCH_RESULTS);
+        search_ok &= found > 0 && strcmp(search_results[0].text, key) == 0;
+        tied_next = (tied_next + 1) % (BENCH_SEARCH_TIED + 1);
+        sink += found;
+    }
+}
+
+/* Runs after teardown, so opens the index again for the prefixes that used to come back empty */
+static bool search_tied_check(void)
+{
+    static const struct {
+        const char *prefix;
+        int found;
+    } cases[] = {
+        { "greatest hits z", 1 },
+        { "greatest hits vol 2", BENCH_SEARCH_RESULTS },
+        { "greatest hits vol 2999", 1 },
+        { "greatest hits vol 300", 2 },
+        { "greatest hits w", 0 },
+    };
+    char path[SD_MAX_CHAR_SIZE];
+    bool ok = search_ok;
+
+    snprintf(path, sizeof(path), "%s/%s", sd_root(), BENCH_SEARCH_TIED_NAME);
+    ok &= search.open(path);
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++) {
+        ok = search.query(cases[i].prefix, search_results, BENCH_SEARCH_RESULTS) == cases[i].found;
+    }
+    search.take_stats(&search_stats);
+    search.close();
+    printf(", \"max_reads\": %" PRIu32, search_stats.max_reads);
+    return ok;
+}
+
+static const tag_case_t tag_cases[] = {
+    { "id3v23.mp3", "Caf\xc3\xa9 Bench", "Latin Artist", "Latin Album", 215000, TAG_FORMAT_ID3V2, 1 },
+    { "id3v24a.mp3", "Cover First", "\xe2\x99\xab Utf16", "Utf8 Album", 0, TAG_FORMAT_ID3V2, 2 },
+    { "id3v1.mp3", "Tail Title", "Tail Artist", "Tail Album", 0, TAG_FORMAT_ID3V1, 2 },
+    { "vorbis.fla", "Flac Title", "Flac Artist", "Flac Album", 180000, TAG_FORMAT_FLAC, 2 },
+    { "info.wav", "Wave Title", "Wave Artist", "Wave Album", 2000, TAG_FORMAT_RIFF, 2 },
+};
+
+#define TAG_CASES (sizeof(tag_cases) / sizeof(tag_cases[0]))
+
+static void put(FILE *f, const void *data, size_t len)
+{
+    fwrite(data, 1, len, f);
+}
+
+static void put_fill(FILE *f, uint8_t byte, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        fputc(byte, f);
+    }
+}
+
+static void put_be32(FILE *f, uint32_t v)
+{
+    uint8_t b[4] = { v >> 24, v >> 16, v >> 8, v };
+    put(f, b, sizeof(b));
+}
+
+static void put_le32(FILE *f, uint32_t v)
+{
+    uint8_t b[4] = { v, v >> 8, v >> 16, v >> 24 };
+    put(f, b, sizeof(b));
+}
+
+static void put_syncsafe(FILE *f, uint32_t v)
+{
+    uint8_t b[4] = { v >> 21 & 0x7F, v >> 14 & 0x7F, v >> 7 & 0x7F, v & 0x7F };
+    put(f, b, sizeof(b));
+}
+
+/* Overwrite a little-endian size written earlier at offset */
+static void patch_le32(FILE *f, long offset, uint32_t v)
+{
+    long end = ftell(f);
+    fseek(f, offset, SEEK_SET);
+    put_le32(f, v);
+    fseek(f, end, SEEK_SET);
+}
+
+static void put_id3_header(FILE *f, uint8_t version, const char *id, uint32_t size)
+{
+    put(f, id, 4);
+    if (version == 4) {
+        put_syncsafe(f, size);
+    } else {
+        put_be32(f, size);
+    }
+    put_fill(f, 0, 2);
+}
+
+static void put_id3_text(FILE *f, uint8_t version, const char *id, uint8_t enc, const void *text, uint32_t len)
+{
+    put_id3_header(f, version, id, len + 1);
+    put(f, &enc, 1);
+    put(f, text, len);
+}
+
+/* The tag size goes in once the frames are written */
+static void put_id3_end(FILE *f)
+{
+    long end = ftell(f);
+    fseek(f, 6, SEEK_SET);
+    put_syncsafe(f, end - 10);
+    fseek(f, end, SEEK_SET);
+}
+
+/* NUL-terminated and padded to an even length, as RIFF wants */
+static void put_riff_text(FILE *f, const char *id, const char *text)
+{
+    uint32_t len = strlen(text) + 1;
+    put(f, id, 4);
+    put_le32(f, len);
+    put(f, text, len);
+    put_fill(f, 0, len & 1);
+}
+
+static FILE *tag_create(const char *name)
+{
+    char path[SD_MAX_CHAR_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/%s", tag_dir, name);
+    return fopen(path, "wb");
+}
+
+/*
+ * One file per format, laid out the way common writers do it: tags in
+ * the first sector, or pushed past it by cover art, the audio or (for
+ * ID3v1) the whole file, so the second read is exercised too.
+ */
+static bool tag_files_write(void)
+{
+    const uint8_t v23_header[] = { 3, 0, 0, 0, 0, 0, 0 };
+    const uint8_t v24_header[] = { 4, 0, 0, 0, 0, 0, 0 };
+    const uint8_t utf16[] = { 0xFF, 0xFE, 0x6B, 0x26, ' ', 0, 'U', 0, 't', 0, 'f', 0, '1', 0, '6', 0 };
+    bool ok = true;
+    FILE *f;
+
+    mkdir(tag_dir, 0775);
+
+    // ID3v2.3 in Latin-1 with a length frame
+    if ((f = tag_create(tag_cases[0].name)) == NULL) {
+        return false;
+    }
+    put(f, "ID3", 3);
+    put(f, v23_header, sizeof(v23_header));
+    put_id3_text(f, 3, "TIT2", 0, "Caf\xe9 Bench", 10);
+    put_id3_text(f, 3, "TPE1", 0, "Latin Artist", 12);
+    put_id3_text(f, 3, "TALB", 0, "Latin Album", 11);
+    put_id3_text(f, 3, "TLEN", 0, "215000", 6);
+    put_fill(f, 0, 256);
+    put_id3_end(f);
+    put_fill(f, 0xA5, BENCH_TAG_AUDIO_SIZE);
+    ok &= fclose(f) == 0;
+
+    // ID3v2.4 with cover art between the title and the other frames
+    if ((f = tag_create(tag_cases[1].name)) == NULL) {
+        return false;
+    }
+    put(f, "ID3", 3);
+    put(f, v24_header, sizeof(v24_header));
+    put_id3_text(f, 4, "TIT2", 3, "Cover First", 11);
+    put_id3_header(f, 4, "APIC", BENCH_TAG_ART_SIZE);
+    put_fill(f, 0x5A, BENCH_TAG_ART_SIZE);
+    put_id3_text(f, 4, "TPE1", 1, utf16, sizeof(utf16));
+    put_id3_text(f, 4, "TALB", 3, "Utf8 Album", 10);
+    put_id3_end(f);
+    put_fill(f, 0xA5, BENCH_TAG_AUDIO_SIZE);
+    ok &= fclose(f) == 0;
+
+    // ID3v1 only, at the end
+    if ((f = tag_create(tag_cases[2].name)) == NULL) {
+        return false;
+    }
+    put_fill(f, 0xA5, BENCH_TAG_AUDIO_SIZE);
+    char id3v1[128];
+    memset(id3v1, ' ', sizeof(id3v1));
+    memcpy(id3v1, "TAG", 3);
+    memcpy(id3v1 + 3, "Tail Title", 10);
+    memcpy(id3v1 + 33, "Tail Artist", 11);
+    memcpy(id3v1 + 63, "Tail Album", 10);
+    put(f, id3v1, sizeof(id3v1));
+    ok &= fclose(f) == 0;
+
+    // FLAC: STREAMINFO for three minutes at 44.1 kHz, a picture, then the comments
+    if ((f = tag_create(tag_cases[3].name)) == NULL) {
+        return false;
+    }
+    const char *comments[] = { "title=Flac Title", "ARTIST=Flac Artist", "Album=Flac Album" };
+    uint32_t block_len = 4 + 5 + 4;
+    for (size_t i = 0; i < 3; i++) {
+        block_len += 4 + strlen(comments[i]);
+    }
+    uint64_t stream = (uint64_t)44100 << 44 | (uint64_t)1 << 41 | (uint64_t)15 << 36 | 44100ULL * 180;
+    put(f, "fLaC", 4);
+    put_be32(f, 34);
+    put_fill(f, 0, 10);
+    put_be32(f, stream >> 32);
+    put_be32(f, (uint32_t)stream);
+    put_fill(f, 0, 16);
+    put_be32(f, 6u << 24 | BENCH_TAG_ART_SIZE);
+    put_fill(f, 0x5A, BENCH_TAG_ART_SIZE);
+    put_be32(f, 0x84u << 24 | block_len);
+    put_le32(f, 5);
+    put(f, "bench", 5);
+    put_le32(f, 3);
+    for (size_t i = 0; i < 3; i++) {
+        put_le32(f, strlen(comments[i]));
+        put(f, comments[i], strlen(comments[i]));
+    }
+    put_fill(f, 0xA5, BENCH_TAG_AUDIO_SIZE);
+    ok &= fclose(f) == 0;
+
+    // WAV: two seconds of 44.1 kHz stereo, LIST INFO after the data
+    if ((f = tag_create(tag_cases[4].name)) == NULL) {
+        return false;
+    }
+    const uint8_t fmt[] = { 1, 0, 2, 0, 0x44, 0xAC, 0, 0, 0x10, 0xB1, 0x02, 0, 4, 0, 16, 0 };
+    put(f, "RIFF", 4);
+    put_le32(f, 0);
+    put(f, "WAVEfmt ", 8);
+    put_le32(f, sizeof(fmt));
+    put(f, fmt, sizeof(fmt));
+    put(f, "data", 4);
+    put_le32(f, 44100 * 4 * 2);
+    put_fill(f, 0, 44100 * 4 * 2);
+    long list = ftell(f);
+    put(f, "LIST", 4);
+    put_le32(f, 0);
+    put(f, "INFO", 4);
+    put_riff_text(f, "INAM", "Wave Title");
+    put_riff_text(f, "IART", "Wave Artist");
+    put_riff_text(f, "IPRD", "Wave Album");
+    patch_le32(f, list + 4, ftell(f) - list - 8);
+    patch_le32(f, 4, ftell(f) - 8);
+    ok &= fclose(f) == 0;
+
+    return ok;
+}
+
+/* Everything the scanner does per track: open, parse, close */
+static bool tag_parse_file(const char *name, tag_info_t *info, uint32_t *reads)
+{
+    char path[SD_MAX_CHAR_SIZE + 16];
+
+    snprintf(path, sizeof(path), "%s/%s", tag_dir, name);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+    bool found = tag_parse(f, tag_buf, info, reads);
+    fclose(f);
+    return found;
+}
+
+static bool tag_setup(void)
+{
+    const char *root = sd_root();
+
+    if (root == NULL) {
+        return false;
+    }
+    snprintf(tag_dir, sizeof(tag_dir), "%s/%s", root, BENCH_TAG_DIR_NAME);
+    return tag_files_write();
+}
+
+/* One track's tags, cycling through the formats */
+static void tag_parse_run(uint32_t iters)
+{
+    tag_info_t info;
+    uint32_t reads;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        tag_parse_file(tag_cases[tag_next].name, &info, &reads);
+        tag_next = (tag_next + 1) % TAG_CASES;
+        tag_reads += reads;
+        sink += info.title[0];
+    }
+}
+
+/*
+ * Every format gives its fields within its read budget; then one timed
+ * pass reports the per-track rate the way the scanner sees it.
+ */
+static bool tag_check(void)
+{
+    const uint32_t tracks = 20 * TAG_CASES;
+    tag_info_t info;
+    uint32_t reads;
+    bool ok = true;
+
+    for (size_t i = 0; i < TAG_CASES; i++) {
+        const tag_case_t *c = &tag_cases[i];
+        ok &= tag_parse_file(c->name, &info, &reads) && reads <= c->reads && info.format == c->format &&
+              info.duration_ms == c->duration_ms && strcmp(info.title, c->title) == 0 &&
+              strcmp(info.artist, c->artist) == 0 && strcmp(info.album, c->album) == 0;
+    }
+
+    tag_next = 0;
+    tag_reads = 0;
+    uint64_t start = now_ns();
+    tag_parse_run(tracks);
+    uint64_t ns = now_ns() - start;
+    uint32_t reads_x100 = tag_reads * 100 / tracks;
+    printf(", \"tracks_per_s\": %" PRIu64 ", \"reads_per_track\": %" PRIu32 ".%02" PRIu32,
+           ns ? (uint64_t)tracks * 1000000000 / ns : 0, reads_x100 / 100, reads_x100 % 100);
+    return ok;
+}
+
+/*---------------------------- storage -----------------------------*/
+
+static bool journal_setup(void)
+{
+    const char *root = sd_root();
+
+    if (root == NULL) {
+        return false;
+    }
+    snprintf(journal_path, sizeof(journal_path), "%s/%s", root, BENCH_JOURNAL_FILE_NAME);
+    remove(journal_path);
+    memset(journal_record, 0x3C, sizeof(journal_record));
+    return true;
+}
+
+static bool journal_open_setup(void)
+{
+    return journal_setup() && journal.open(journal_path, NULL, NULL, NULL);
+}
+
+/* The journal is the play history's on the device; hand it back */
+static void journal_teardown(void)
+{
+    journal.close();
+    remove(journal_path);
+#if !CONFIG_IDF_TARGET_LINUX
+    playback_state.open_history(PLAYBACK_HISTORY_FILE);
+#endif
+}
+
+static bool history_setup(void)
+{
+    return journal_setup() && playback_state.open_history(journal_path);
+}
+
+/* One track change as the player reports it: state copied, one record appended */
+static void history_run(uint32_t iters)
+{
+    playback_state_t state = { 0 };
+
+    for (uint32_t i = 0; i < iters; i++) {
+        state.track = i;
+        playback_state.update(&state, PLAYBACK_SAVE_TRACK);
+    }
+}
+
+/* No teardown, the check needs the file: the history reads back the same after a reopen and after compaction */
+static bool history_check(void)
+{
+    uint32_t before[PLAYBACK_HISTORY_LEN];
+    uint32_t after[PLAYBACK_HISTORY_LEN];
+    int count = playback_state.history(before, PLAYBACK_HISTORY_LEN);
+    bool ok = count == PLAYBACK_HISTORY_LEN;
+
+    esp_log_level_set("JOURNAL", ESP_LOG_NONE);
+    for (int round = 0; ok && round < 2; round++) {
+        playback_state.commit();
+        ok = (round == 0 || journal.compact()) && playback_state.open_history(journal_path) &&
+             playback_state.history(after, PLAYBACK_HISTORY_LEN) == count &&
+             memcmp(before, after, count * sizeof(before[0])) == 0;
+    }
+    esp_log_level_set("JOURNAL", ESP_LOG_INFO);
+    journal_teardown();
+    return ok;
+}
+
+/* Caller-side cost of persisting one small record through the journal */
+static void journal_append_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        memcpy(journal_record, &i, sizeof(i));
+        journal.append(1, journal_record, sizeof(journal_record));
+    }
+    journal.flush();
+}
+
+/* The same record written the way sd_card.c writes files: open, write, close */
+static void sd_open_append_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        FILE *f = fopen(journal_path, "ab");
+        if (f == NULL) {
+            return;
+        }
+        memcpy(journal_record, &i, sizeof(i));
+        fwrite(journal_record, 1, sizeof(journal_record), f);
+        fclose(f);
+    }
+}
+
+/* Bench records carry their sequence number; replay must see 0, 1, 2, ... */
+static void count_replay(uint8_t type, const void *data, uint16_t len, void *ctx)
+{
+    uint32_t seq;
+
+    memcpy(&seq, data, sizeof(seq));
+    replay_ok &= type == 1 && len == BENCH_JOURNAL_RECORD_SIZE && seq == replay_count;
+    replay_count++;
+}
+
+static bool replay_file(const char *path, uint32_t *count)
+{
+    replay_count = 0;
+    replay_ok = true;
+    if (!journal.open(path, count_replay, NULL, NULL)) {
+        return false;
+    }
+    *count = replay_count;
+    return replay_ok;
+}
+
+/*
+ * Crash at every offset: cut a journal of a few units short at each byte
+ * (every JOURNAL_CRASH_STEP bytes on the device), plain and with the rest
+ * of the unit filled with junk as a torn write would leave it. Replay must
+ * return exactly the records that fit before the cut, and a record
+ * appended after recovery must survive the next open.
+ */
+static bool journal_check(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    const uint32_t step = 1;
+#else
+    const uint32_t step = 509;
+#endif
+    // Frame from journal.h: magic, type, u16 len, payload, crc32
+    const uint32_t record_size = 8 + BENCH_JOURNAL_RECORD_SIZE;
+    const uint32_t per_unit = JOURNAL_UNIT_SIZE / record_size;
+    const uint32_t records = per_unit * 5 / 2;
+    char crash_path[SD_MAX_CHAR_SIZE];
+    uint32_t count;
+    bool ok = true;
+
+    // Every cut is reported as a damaged tail, which would land in the JSON
+    esp_log_level_set("JOURNAL", ESP_LOG_NONE);
+
+    // Reference journal
+    remove(journal_path);
+    if (!journal.open(journal_path, NULL, NULL, NULL)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < records; i++) {
+        memcpy(journal_record, &i, sizeof(i));
+        journal.append(1, journal_record, sizeof(journal_record));
+    }
+    journal.close();
+    ok = replay_file(journal_path, &count) && count == records;
+    journal.close();
+
+    uint32_t size = (records / per_unit + 1) * JOURNAL_UNIT_SIZE;
+    uint8_t *image = malloc(size);
+    FILE *f = fopen(journal_path, "rb");
+    ok &= image != NULL && f != NULL && fread(image, 1, size, f) == size;
+    if (f) {
+        fclose(f);
+    }
+    remove(journal_path);
+
+    snprintf(crash_path, sizeof(crash_path), "%s/%s", sd_root(), BENCH_JOURNAL_CRASH_NAME);
+    for (uint32_t cut = 0; ok && cut <= size; cut += step) {
+        uint32_t unit_end = (cut / JOURNAL_UNIT_SIZE + 1) * JOURNAL_UNIT_SIZE;
+
+        for (int junk = 0; ok && junk < 2; junk++) {
+            // A plain cut that only drops zero bytes loses nothing; junk
+            // is the inverse of the real bytes so it never matches them
+            uint32_t intact = cut;
+            while (!junk && intact < size && image[intact] == 0) {
+                intact++;
+            }
+            uint32_t expected = (intact / JOURNAL_UNIT_SIZE) * per_unit +
+                                (intact % JOURNAL_UNIT_SIZE) / record_size;
+            if (expected > records) {
+                expected = records;
+            }
+
+            f = fopen(crash_path, "wb");
+            if (f == NULL) {
+                ok = false;
+                break;
+            }
+            fwrite(image, 1, cut, f);
+            for (uint32_t i = cut; junk && i < unit_end && i < size; i++) {
+                fputc(image[i] ^ 0xFF, f);
+            }
+            fclose(f);
+
+            ok = replay_file(crash_path, &count) && count == expected;
+            memcpy(journal_record, &expected, sizeof(expected));
+            ok &= journal.append(1, journal_record, sizeof(journal_record));
+            journal.close();
+            ok = ok && replay_file(crash_path, &count) && count == expected + 1;
+            journal.close();
+        }
+    }
+
+    remove(crash_path);
+    free(image);
+    esp_log_level_set("JOURNAL", ESP_LOG_INFO);
+    return ok;
+}
+
+/*----------------------------- memory -----------------------------*/
+
+static bool pool_setup(void)
+{
+    buf_pool_stats_t stats[BUF_POOL_CLASSES];
+
+    // Already done by app_main on the device; the host run starts it here
+    esp_log_level_set("BUF POOL", ESP_LOG_NONE);
+    buf_pool.init();
+    esp_log_level_set("BUF POOL", ESP_LOG_INFO);
+    buf_pool.take_stats(stats);
+    return true;
+}
+
+/* Sector block handed from a reader to a consumer: get, ref, two unrefs */
+static void buf_pool_cycle_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        buf_block_t *block = buf_pool.get(BUF_POOL_SECTOR_SIZE, 0);
+        if (block == NULL) {
+            return;
+        }
+        block->data[0] = (uint8_t)i;
+        buf_pool.ref(block);
+        buf_pool.unref(block);
+        sink += block->data[0];
+        buf_pool.unref(block);
+    }
+}
+
+/* What every stage would otherwise do for its own sector buffer */
+static void dma_malloc_free_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        uint8_t *buf = bench_alloc(BUF_POOL_SECTOR_SIZE);
+        if (buf == NULL) {
+            return;
+        }
+        buf[0] = (uint8_t)i;
+        sink += buf[0];
+        free(buf);
+    }
+}
+
+/*
+ * Pool bookkeeping: class selection and alignment, exhaustion reported as
+ * a failed get and counted, blocks held until their last reference, and a
+ * released block handed out again.
+ */
+static bool pool_check(void)
+{
+    buf_block_t *held[BUF_POOL_SECTOR_COUNT];
+    buf_pool_stats_t stats[BUF_POOL_CLASSES];
+    bool ok = true;
+
+    // The oversized get below is logged as an error
+    esp_log_level_set("BUF POOL", ESP_LOG_NONE);
+    buf_pool.take_stats(stats);
+
+    buf_block_t *small = buf_pool.get(1, 0);
+    ok &= small != NULL && small->size == BUF_POOL_SMALL_SIZE && small->cls == BUF_POOL_SMALL &&
+          ((uintptr_t)small->data % BUF_POOL_ALIGN) == 0;
+    if (small) {
+        buf_pool.unref(small);
+    }
+    ok &= buf_pool.get(BUF_POOL_DRAW_SIZE + 1, 0) == NULL;
+
+    for (int i = 0; i < BUF_POOL_SECTOR_COUNT; i++) {
+        held[i] = buf_pool.get(BUF_POOL_SMALL_SIZE + 1, 0);
+        ok &= held[i] != NULL && held[i]->size == BUF_POOL_SECTOR_SIZE;
+        for (int j = 0; ok && j < i; j++) {
+            ok &= held[i]->data != held[j]->data;
+        }
+    }
+    ok &= buf_pool.get(BUF_POOL_SECTOR_SIZE, 0) == NULL;
+
+    if (held[0]) {
+        buf_pool.ref(held[0]);
+        buf_pool.unref(held[0]);
+        ok &= buf_pool.get(BUF_POOL_SECTOR_SIZE, 0) == NULL;
+        buf_pool.unref(held[0]);
+        buf_block_t *again = buf_pool.get(BUF_POOL_SECTOR_SIZE, 0);
+        ok &= again == held[0] && atomic_load(&again->refs) == 1;
+        held[0] = again;
+    }
+
+    for (int i = 0; i < BUF_POOL_SECTOR_COUNT; i++) {
+        if (held[i]) {
+            buf_pool.unref(held[i]);
+        }
+    }
+
+    esp_log_level_set("BUF POOL", ESP_LOG_INFO);
+    buf_pool.take_stats(stats);
+    ok &= stats[BUF_POOL_SECTOR].failures == 2 && stats[BUF_POOL_SECTOR].waits == 2 &&
+          stats[BUF_POOL_SECTOR].min_free == 0 && stats[BUF_POOL_SMALL].gets == 1;
+    return ok;
+}
+
+/*----------------------------- spectrum ----------------------------*/
+
+/* A tone at bin 20 under some noise, and again with a second tone, for the window + transform */
+static bool fft_setup(void)
+{
+    fft_init();
+    for (int k = 0; k < FFT_SIZE; k++) {
+        int32_t tone = (int32_t)(20000 * sin(2 * M_PI * 20 * k / FFT_SIZE));
+        fft_pcm[k] = (int16_t)(tone + (int16_t)xorshift32() / 8);
+    }
+    return true;
+}
+
+/* One displayed frame's worth of work: window, then transform */
+static void fft_q15_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        fft_window_q15(fft_pcm, fft_work);
+        fft_q15(fft_work);
+        sink += fft_work[20].im;
+    }
+}
+
+/* Fill the tap with a stereo tone at bin, then let the bars settle on it */
+static bool spectrum_tone(uint32_t bin, uint8_t levels[SPECTRUM_BARS])
+{
+    bool ok = true;
+
+    for (int frame = 0; frame < 255 / SPECTRUM_FALL_PER_FRAME + 2; frame++) {
+        for (int k = 0; k < FFT_SIZE; k++) {
+            int16_t v = (int16_t)(24000 * sin(2 * M_PI * bin * k / FFT_SIZE));
+            fft_pcm[2 * k] = v;
+            fft_pcm[2 * k + 1] = v;
+        }
+        spectrum.tap(fft_pcm, FFT_SIZE, 2);
+        ok &= spectrum.compute(levels);
+    }
+    return ok;
+}
+
+static int loudest_bar(const uint8_t levels[SPECTRUM_BARS])
+{
+    int loudest = 0;
+    for (int b = 1; b < SPECTRUM_BARS; b++) {
+        if (levels[b] > levels[loudest]) {
+            loudest = b;
+        }
+    }
+    return loudest;
+}
+
+/*
+ * The transform against a double-precision DFT of the same windowed
+ * input, then the spectrum around it: a tone lands in one loud bar and
+ * a higher tone further right, nothing is queued while no view is shown,
+ * and low headroom switches it off until set_fps() clears that.
+ */
+static bool fft_check(void)
+{
+    uint8_t levels[SPECTRUM_BARS];
+    spectrum_stats_t stats;
+    double cos_k[FFT_SIZE];
+    double sin_k[FFT_SIZE];
+    double in[FFT_SIZE];
+    double max_err = 0;
+    bool ok = true;
+
+    for (int k = 0; k < FFT_SIZE; k++) {
+        cos_k[k] = cos(2 * M_PI * k / FFT_SIZE);
+        sin_k[k] = sin(2 * M_PI * k / FFT_SIZE);
+    }
+    for (int trial = 0; trial < 4; trial++) {
+        for (int k = 0; k < FFT_SIZE; k++) {
+            fft_pcm[k] = (int16_t)xorshift32();
+        }
+        fft_window_q15(fft_pcm, fft_work);
+        for (int k = 0; k < FFT_SIZE; k++) {
+            in[k] = fft_work[k].re;
+        }
+        fft_q15(fft_work);
+        for (int f = 0; f < FFT_SIZE; f++) {
+            double re = 0, im = 0;
+            for (int k = 0; k < FFT_SIZE; k++) {
+                re += in[k] * cos_k[f * k % FFT_SIZE];
+                im -= in[k] * sin_k[f * k % FFT_SIZE];
+            }
+            max_err = fmax(max_err, fabs(re / FFT_SIZE - fft_work[f].re));
+            max_err = fmax(max_err, fabs(im / FFT_SIZE - fft_work[f].im));
+        }
+    }
+    ok &= max_err <= 4;
+
+    esp_log_level_set("SPECTRUM", ESP_LOG_NONE);
+    spectrum.init();
+    spectrum.set_fps(SPECTRUM_DEFAULT_FPS);
+    spectrum.take_stats(&stats);
+
+    spectrum.set_visible(false);
+    spectrum.tap(fft_pcm, FFT_SIZE, 1);
+    ok &= !spectrum.compute(levels);
+
+    spectrum.set_visible(true);
+    ok &= spectrum_tone(6, levels);
+    int low = loudest_bar(levels);
+    ok &= levels[low] > 200;
+    for (int b = 0; b < SPECTRUM_BARS; b++) {
+        if (b < low - 2 || b > low + 2) {
+            ok &= levels[b] < levels[low] / 2;
+        }
+    }
+    ok &= spectrum_tone(80, levels);
+    ok &= loudest_bar(levels) > low + 2;
+
+    spectrum.report_headroom(SPECTRUM_MIN_HEADROOM_PCT - 1);
+    ok &= !spectrum.active() && !spectrum.compute(levels);
+    spectrum.report_headroom(100);
+    ok &= !spectrum.active();
+    spectrum.set_fps(SPECTRUM_DEFAULT_FPS);
+    ok &= spectrum.active();
+
+    spectrum.take_stats(&stats);
+    ok &= stats.auto_offs == 1 && stats.min_headroom_pct == SPECTRUM_MIN_HEADROOM_PCT - 1 &&
+          stats.frames == 2 * (255 / SPECTRUM_FALL_PER_FRAME + 2);
+
+    spectrum.set_visible(false);
+    esp_log_level_set("SPECTRUM", ESP_LOG_INFO);
+    return ok;
+}
+
+/*--------------------------- a2dp sink -----------------------------*/
+
+/* Frames from media position pos onwards of the sine every stream carries */
+static void jitter_fill(int16_t *pcm, uint64_t pos, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++) {
+        int16_t v = jitter_sine[(pos + i) % BENCH_JITTER_SINE_PERIOD];
+        pcm[2 * i] = v;
+        pcm[2 * i + 1] = v;
+    }
+}
+
+static bool jitter_setup(void)
+{
+    jitter_storage = bench_alloc(JITTER_BUF_FRAMES * 2 * sizeof(int16_t));
+    if (jitter_storage == NULL) {
+        return false;
+    }
+    for (int k = 0; k < BENCH_JITTER_SINE_PERIOD; k++) {
+        jitter_sine[k] = (int16_t)(8000 * sin(2 * M_PI * k / BENCH_JITTER_SINE_PERIOD));
+    }
+
+    // Evenly spaced packets up to the minimum target, so the timed reads play instead of buffering
+    jitter_buf_init(&jitter, jitter_storage, JITTER_BUF_FRAMES * 2 * sizeof(int16_t), A2DP_SINK_DEFAULT_RATE);
+    jitter_arrival_us = 0;
+    jitter_frames_in = 0;
+    while (jitter_frames_in < (uint64_t)JITTER_MIN_MS * A2DP_SINK_DEFAULT_RATE / 1000 + OUTPUT_PERIOD_FRAMES) {
+        jitter_fill(jitter_io, jitter_frames_in, OUTPUT_PERIOD_FRAMES);
+        jitter_buf_write(&jitter, jitter_io, OUTPUT_PERIOD_FRAMES, jitter_arrival_us);
+        jitter_frames_in += OUTPUT_PERIOD_FRAMES;
+        jitter_arrival_us = jitter_frames_in * 1000000 / A2DP_SINK_DEFAULT_RATE;
+    }
+    return true;
+}
+
+static void jitter_teardown(void)
+{
+    free(jitter_storage);
+    jitter_storage = NULL;
+}
+
+/* One DMA buffer's worth in and out per op: arrival bookkeeping, ring and resampler */
+static void jitter_buf_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        jitter_buf_write(&jitter, jitter_io, OUTPUT_PERIOD_FRAMES, jitter_arrival_us);
+        jitter_frames_in += OUTPUT_PERIOD_FRAMES;
+        jitter_arrival_us = jitter_frames_in * 1000000 / A2DP_SINK_DEFAULT_RATE;
+        jitter_buf_read(&jitter, jitter_io, OUTPUT_PERIOD_FRAMES);
+    }
+    sink += jitter_io[0];
+}
+
+/*
+ * Arrival time and size of packet i. Synthetic sources produce packets on
+ * their own clock and send them in bursts, when the last packet of the
+ * burst is complete, plus a random delay.
+ */
+static bool jitter_arrival(const jitter_scenario_t *sc, uint32_t i, int64_t *arrival_us, uint32_t *frames)
+{
+    if (sc->recorded) {
+        if (i >= sc->recorded_count) {
+            return false;
+        }
+        *arrival_us = sc->recorded[i] - sc->recorded[0];
+        *frames = sc->recorded_frames[i];
+        return true;
+    }
+
+    int64_t packet_us = (int64_t)BENCH_JITTER_PACKET_FRAMES * 1000000 / A2DP_SINK_DEFAULT_RATE;
+    if ((int64_t)i * packet_us >= BENCH_JITTER_SIM_S * 1000000LL) {
+        return false;
+    }
+    uint32_t last = (i / sc->burst + 1) * sc->burst;
+    int64_t ready = (int64_t)last * packet_us * 1000000 / (1000000 + sc->source_ppm);
+    uint32_t seed = last * 2654435761u;
+    seed ^= seed >> 15;
+    *arrival_us = ready + (sc->jitter_us ? seed % sc->jitter_us : 0);
+    if (sc->stall_ms && (ready / 5000000 == 2 || ready / 5000000 == 3) &&
+        ready % 5000000 < (int64_t)sc->stall_ms * 1000) {
+        *arrival_us = ready - ready % 5000000 + sc->stall_ms * 1000;
+    }
+    *frames = BENCH_JITTER_PACKET_FRAMES;
+    return true;
+}
+
+/*
+ * Play a stream through the buffer against an ideal DAC clock, reading one
+ * DMA buffer at a time, and follow the sine across reads: any step bigger
+ * than the curve allows is a dropped or repeated sample.
+ */
+static void jitter_simulate(const jitter_scenario_t *sc, jitter_result_t *res)
+{
+    jitter_stats_t stats;
+    uint64_t latency_sum = 0;
+    uint32_t latency_reads = 0;
+    uint32_t packet = 0;
+    uint64_t media = 0;
+    uint64_t reads = 0;
+    int64_t arrival;
+    uint32_t frames;
+    int32_t prev[2] = { 0, 0 };
+    uint32_t history = 0;
+
+    memset(res, 0, sizeof(*res));
+    jitter_buf_init(&jitter, jitter_storage, JITTER_BUF_FRAMES * 2 * sizeof(int16_t), A2DP_SINK_DEFAULT_RATE);
+    bool more = jitter_arrival(sc, packet, &arrival, &frames);
+    while (more) {
+        int64_t read_at = (int64_t)((reads + 1) * OUTPUT_PERIOD_FRAMES * 1000000 / A2DP_SINK_DEFAULT_RATE);
+        if (arrival <= read_at) {
+            frames = frames > JITTER_MAX_READ_FRAMES ? JITTER_MAX_READ_FRAMES : frames;
+            jitter_fill(jitter_io, media, frames);
+            jitter_buf_write(&jitter, jitter_io, frames, arrival);
+            media += frames;
+            more = jitter_arrival(sc, ++packet, &arrival, &frames);
+            continue;
+        }
+
+        reads++;
+        if (!jitter_buf_read(&jitter, jitter_io, OUTPUT_PERIOD_FRAMES)) {
+            jitter_buf_take_stats(&jitter, &stats);
+            if (read_at < BENCH_JITTER_SETTLE_MS * 1000LL) {
+                res->startup_underruns += stats.underruns;
+            } else {
+                res->underruns += stats.underruns;
+            }
+            history = 0;
+            continue;
+        }
+        for (int n = 0; n < OUTPUT_PERIOD_FRAMES; n++, history++) {
+            int32_t v = jitter_io[2 * n];
+            if (history >= 2 && abs(v - 2 * prev[1] + prev[0]) > 64) {
+                res->discontinuities++;
+            }
+            prev[0] = prev[1];
+            prev[1] = v;
+        }
+        jitter_buf_take_stats(&jitter, &stats);
+        if (read_at < BENCH_JITTER_SETTLE_MS * 1000LL) {
+            res->startup_underruns += stats.underruns;
+        } else {
+            res->underruns += stats.underruns;
+        }
+        res->overflows += stats.overflows;
+        if (stats.target_ms > res->target_ms_max) {
+            res->target_ms_max = stats.target_ms;
+        }
+        if (stats.latency_ms_max > res->latency_ms_max) {
+            res->latency_ms_max = stats.latency_ms_max;
+        }
+        latency_sum += stats.latency_ms;
+        latency_reads++;
+        res->target_ms = stats.target_ms;
+        res->ppm = stats.ppm;
+    }
+    res->latency_ms_avg = latency_reads ? latency_sum / latency_reads : 0;
+}
+
+static void jitter_report(const char *name, const jitter_result_t *res)
+{
+    printf(", \"%s\": {\"latency_ms\": %" PRIu32 ", \"latency_ms_max\": %" PRIu32 ", \"target_ms\": %" PRIu32
+           ", \"target_ms_max\": %" PRIu32 ", \"ppm\": %" PRId32 ", \"startup_underruns\": %" PRIu32
+           ", \"underruns\": %" PRIu32 ", \"overflows\": %" PRIu32 ", \"glitches\": %" PRIu32 "}",
+           name, res->latency_ms_avg, res->latency_ms_max, res->target_ms, res->target_ms_max, res->ppm,
+           res->startup_underruns, res->underruns, res->overflows, res->discontinuities);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+/* Replay the arrivals named by HOST_JITTER_TRACE_ENV, if any; only reported, never judged */
+static void jitter_replay(void)
+{
+    const char *path = getenv(HOST_JITTER_TRACE_ENV);
+    jitter_scenario_t sc = { 0 };
+    jitter_result_t res;
+    unsigned long long at;
+    unsigned frames;
+
+    if (path == NULL) {
+        return;
+    }
+    FILE *f = fopen(path, "r");
+    int64_t *arrivals = malloc(BENCH_JITTER_MAX_TRACE * sizeof(int64_t));
+    uint16_t *sizes = malloc(BENCH_JITTER_MAX_TRACE * sizeof(uint16_t));
+    if (f && arrivals && sizes) {
+        while (sc.recorded_count < BENCH_JITTER_MAX_TRACE && fscanf(f, "%llu %u", &at, &frames) == 2) {
+            arrivals[sc.recorded_count] = (int64_t)at;
+            sizes[sc.recorded_count++] = (uint16_t)frames;
+        }
+        sc.recorded = arrivals;
+        sc.recorded_frames = sizes;
+        if (sc.recorded_count) {
+            jitter_simulate(&sc, &res);
+            jitter_report("recorded", &res);
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    free(arrivals);
+    free(sizes);
+}
+#endif
+
+/*
+ * Synthetic streams, each reported as it runs: bursty arrivals from a
+ * faster and a slower source settle near the target without a glitch and
+ * with the correction following the source, and a stall costs one
+ * underrun after which the grown target absorbs the next one before
+ * shrinking again. An underrun while the first bursts are still being
+ * measured is expected and reported apart.
+ */
+static bool jitter_check(void)
+{
+    const jitter_scenario_t fast = { .burst = 4, .jitter_us = 5000, .source_ppm = 300 };
+    const jitter_scenario_t slow = { .burst = 4, .jitter_us = 5000, .source_ppm = -300 };
+    const jitter_scenario_t stall = { .burst = 4, .jitter_us = 5000, .stall_ms = 80 };
+    jitter_result_t res;
+    bool ok = true;
+
+    if (!jitter_setup()) {
+        return false;
+    }
+
+    jitter_simulate(&fast, &res);
+    jitter_report("fast_source", &res);
+    ok &= res.underruns == 0 && res.overflows == 0 && res.discontinuities == 0;
+    ok &= res.ppm > 100 && res.ppm < 500;
+    ok &= res.latency_ms_avg + 10 >= res.target_ms && res.latency_ms_avg <= res.target_ms + 10;
+
+    jitter_simulate(&slow, &res);
+    jitter_report("slow_source", &res);
+    ok &= res.underruns == 0 && res.overflows == 0 && res.discontinuities == 0;
+    ok &= res.ppm < -100 && res.ppm > -500;
+
+    jitter_simulate(&stall, &res);
+    jitter_report("stalls", &res);
+    ok &= res.underruns == 1 && res.overflows == 0 && res.discontinuities == 0;
+    ok &= res.target_ms_max >= 80 + JITTER_MARGIN_MS && res.target_ms < res.target_ms_max;
+
+#if CONFIG_IDF_TARGET_LINUX
+    jitter_replay();
+#endif
+    jitter_teardown();
+    return ok;
+}
+
+/*----------------------------- output -----------------------------*/
+
+/*
+ * The bench stands in for the audio task that feeds the output, so run
+ * it while nothing is streaming; the selection is put back afterwards.
+ */
+
+/* The null sink's clock in the bench: sleeping advances it, nothing else does */
+static int64_t virtual_now_us(void)
+{
+    return virtual_us;
+}
+
+static void virtual_sleep_us(uint32_t us)
+{
+    virtual_us += us;
+}
+
+static bool output_setup(void)
+{
+    esp_log_level_set("OUTPUT", ESP_LOG_NONE);
+    output_was = output.selected();
+    output_null_set_clock(virtual_now_us, virtual_sleep_us);
+    output.select(OUTPUT_NULL);
+    output.set_rate(A2DP_SINK_DEFAULT_RATE);
+    memset(jitter_io, 0, sizeof(jitter_io));
+    return true;
+}
+
+static void output_teardown(void)
+{
+    output.select(output_was);
+    output.set_rate(A2DP_SINK_DEFAULT_RATE);
+    output_null_set_clock(NULL, NULL);
+    esp_log_level_set("OUTPUT", ESP_LOG_INFO);
+}
+
+/* One period through the output layer into the null sink, which waits on the virtual clock */
+static void output_null_run(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    }
+}
+
+/*
+ * Pacing and switching on the null sinks: a feeder that keeps up is
+ * consumed one period apart with no underrun, one that falls behind the
+ * whole ring gets exactly one, and switching sinks with a full ring
+ * starts the new one within a period. I2S is not there on the host.
+ */
+static bool output_check(void)
+{
+    const uint32_t rate = 48000;
+    const int64_t period_us = (int64_t)OUTPUT_PERIOD_FRAMES * 1000000 / rate;
+    output_consume_t prev, last;
+    output_stats_t stats;
+    bool ok = true;
+
+    output_setup();
+    output.set_rate(rate);
+    output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    output.take_stats(&stats);
+    for (int i = 0; i < 100; i++) {
+        output_null_last(&prev);
+        output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    }
+    output_null_last(&last);
+    output.take_stats(&stats);
+    ok &= stats.underruns == 0 && stats.writes == 100 && stats.switches == 0;
+    ok &= last.start_us - prev.start_us >= period_us - 1 && last.start_us - prev.start_us <= period_us + 1;
+    // A full ring less the period being written, give or take the microsecond rounding
+    ok &= last.queued + OUTPUT_PERIOD_FRAMES + 1 >= output_ring_periods(rate) * OUTPUT_PERIOD_FRAMES;
+
+    virtual_us += 3 * output_ring_periods(rate) * period_us;
+    output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    output.take_stats(&stats);
+    ok &= stats.underruns == 1 && stats.min_headroom_pct == 0;
+
+    for (int i = 0; i < 20; i++) {
+        output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    }
+    output.select(OUTPUT_FILE);
+    int64_t before = virtual_us;
+    output.write(jitter_io, OUTPUT_PERIOD_FRAMES);
+    output_null_last(&last);
+    output.take_stats(&stats);
+    ok &= stats.switches == 1 && virtual_us - before <= period_us && last.start_us - before <= period_us;
+
+#if CONFIG_IDF_TARGET_LINUX
+    output.select(OUTPUT_I2S);
+    ok &= output.selected() == OUTPUT_NULL;
+#endif
+    output_teardown();
+    return ok;
+}
+
+/*--------------------------- play clock ---------------------------*/
+
+/* Next pseudo-random number of a fixed sequence, so every run sees the same trace */
+static uint32_t clock_sim_rand(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+/*
+ * An I2S ring driven by a DAC whose crystal runs BENCH_CLOCK_PPM fast
+ * against the wall clock. The feeder writes a period whenever the ring
+ * has room, waking up to BENCH_CLOCK_JITTER_US late, and reports what is
+ * queued in whole DMA periods the way output_i2s does. It stops for
+ * BENCH_CLOCK_UNDERRUN_MS, long enough to run the ring dry, and later
+ * for BENCH_CLOCK_IDLE_GAP_MS. The clock is read every step.
+ */
+static void clock_sim(clock_sim_result_t *r)
+{
+    const uint32_t rate = A2DP_SINK_DEFAULT_RATE;
+    const uint32_t ring = output_ring_periods(rate) * OUTPUT_PERIOD_FRAMES;
+    const int64_t underrun_us = BENCH_CLOCK_UNDERRUN_AT_MS * 1000LL;
+    const int64_t idle_us = BENCH_CLOCK_IDLE_AT_MS * 1000LL;
+    uint64_t written = 0;
+    uint64_t played = 0;
+    uint64_t dac_acc = 0;
+    int64_t wake_us = 0;
+    int64_t last = 0;
+    int64_t idle_start = 0;
+    uint32_t seed = 1;
+    bool blocked = false;
+
+    memset(r, 0, sizeof(*r));
+    play_clock_init(&bench_clock, 0);
+    play_clock_start(&bench_clock, rate);
+
+    for (int64_t t = 0; t < BENCH_CLOCK_SIM_MS * 1000LL; t += BENCH_CLOCK_STEP_US) {
+        // Frames the DAC takes this step, in millionths of a frame so the ppm survives
+        dac_acc += (uint64_t)rate * (1000000 + BENCH_CLOCK_PPM) * BENCH_CLOCK_STEP_US;
+        uint64_t n = dac_acc / 1000000000000ULL;
+        dac_acc %= 1000000000000ULL;
+        played += n < written - played ? n : written - played;
+
+        bool gap = (t >= underrun_us && t < underrun_us + BENCH_CLOCK_UNDERRUN_MS * 1000LL) ||
+                   (t >= idle_us && t < idle_us + BENCH_CLOCK_IDLE_GAP_MS * 1000LL);
+        if (!gap && !blocked && t >= wake_us) {
+            uint32_t queued = (uint32_t)(written - played / OUTPUT_PERIOD_FRAMES * OUTPUT_PERIOD_FRAMES);
+            play_clock_update(&bench_clock, t, written, queued, OUTPUT_I2S_DELAY_FRAMES);
+            blocked = true;
+        }
+        if (blocked && written - played + OUTPUT_PERIOD_FRAMES <= ring) {
+            written += OUTPUT_PERIOD_FRAMES;
+            blocked = false;
+            wake_us = t + clock_sim_rand(&seed) % BENCH_CLOCK_JITTER_US;
+        }
+
+        int64_t reading = play_clock_read_us(&bench_clock, t);
+        if (reading < last) {
+            r->backsteps++;
+        }
+        last = reading;
+        // The drift is taken from once the start has settled up to the underrun
+        if (t == BENCH_CLOCK_SETTLE_MS * 1000LL) {
+            play_clock_take_stats(&bench_clock, &r->steady);
+        }
+        if (t == underrun_us) {
+            play_clock_take_stats(&bench_clock, &r->steady);
+        }
+        if (t == idle_us) {
+            idle_start = reading;
+        }
+        if (t == idle_us + BENCH_CLOCK_IDLE_GAP_MS * 1000LL) {
+            r->idle_advance_ms = (uint32_t)((reading - idle_start) / 1000);
+        }
+        // Before the gap the reading and the heard audio share frame 0
+        if (t < idle_us) {
+            int64_t heard_us = played > OUTPUT_I2S_DELAY_FRAMES ?
+                               (int64_t)((played - OUTPUT_I2S_DELAY_FRAMES) * 1000000 / rate) : 0;
+            int64_t err = reading - heard_us;
+            if ((uint32_t)llabs(err) > r->err_us_max) {
+                r->err_us_max = (uint32_t)llabs(err);
+            }
+            if (t == underrun_us - BENCH_CLOCK_STEP_US) {
+                r->naive_ahead_us = (uint32_t)((int64_t)(written * 1000000 / rate) - heard_us);
+            }
+        }
+    }
+    play_clock_take_stats(&bench_clock, &r->rest);
+}
+
+static bool clock_setup(void)
+{
+    play_clock_init(&bench_clock, 0);
+    play_clock_start(&bench_clock, A2DP_SINK_DEFAULT_RATE);
+    clock_run_us = 0;
+    clock_run_written = 0;
+    return true;
+}
+
+/* One update and one reading per period, the output task's and a view's share */
+static void play_clock_run(uint32_t iters)
+{
+    const int64_t period_us = (int64_t)OUTPUT_PERIOD_FRAMES * 1000000 / A2DP_SINK_DEFAULT_RATE;
+    const uint32_t queued = (output_ring_periods(A2DP_SINK_DEFAULT_RATE) - 1) * OUTPUT_PERIOD_FRAMES;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        play_clock_update(&bench_clock, clock_run_us, clock_run_written, queued, OUTPUT_I2S_DELAY_FRAMES);
+        sink += play_clock_read_ms(&bench_clock, clock_run_us + period_us / 2);
+        clock_run_us += period_us;
+        clock_run_written += OUTPUT_PERIOD_FRAMES;
+    }
+}
+
+/*
+ * On the synthetic DAC the reading stays within a DMA period and a wake
+ * up of what has been heard, where the audio written runs ahead by the
+ * ring and the DAC's delay. It never steps back, stalls through the underrun, runs
+ * on wall time through the idle gap once PLAY_CLOCK_IDLE_MS is up, and
+ * the drift up to the underrun comes out as the crystal's.
+ */
+static bool clock_check(void)
+{
+    clock_sim_result_t r;
+    const uint32_t period_us = (uint32_t)((uint64_t)OUTPUT_PERIOD_FRAMES * 1000000 / A2DP_SINK_DEFAULT_RATE);
+
+    clock_sim(&r);
+    printf(", \"err_us_max\": %" PRIu32 ", \"naive_ahead_us\": %" PRIu32 ", \"drift_ppm\": %" PRId32
+           ", \"idle_advance_ms\": %" PRIu32 ", \"backsteps\": %" PRIu32 ", \"resyncs\": %" PRIu32,
+           r.err_us_max, r.naive_ahead_us, r.steady.drift_ppm, r.idle_advance_ms, r.backsteps,
+           r.steady.resyncs + r.rest.resyncs);
+    int32_t drift_off = r.steady.drift_ppm - BENCH_CLOCK_PPM;
+    return r.backsteps == 0 && r.err_us_max <= period_us + BENCH_CLOCK_JITTER_US &&
+           r.naive_ahead_us > r.err_us_max && drift_off >= -BENCH_CLOCK_PPM_SLACK &&
+           drift_off <= BENCH_CLOCK_PPM_SLACK &&
+           r.idle_advance_ms >= BENCH_CLOCK_IDLE_GAP_MS - PLAY_CLOCK_IDLE_MS &&
+           r.idle_advance_ms <= BENCH_CLOCK_IDLE_GAP_MS;
+}
+
+static const bench_kernel_t kernels[] = {
+    { "rgb565_swap", draw_buf_setup, rgb565_swap_run, draw_buf_teardown, 200, DRAW_BUF_PX * 2 },
+    { "rgb565_fill", draw_buf_setup, rgb565_fill_run, draw_buf_teardown, 200, DRAW_BUF_PX * 2 },
+    { "sd_seq_read", sd_setup, sd_seq_read_run, sd_teardown, 256, BENCH_SD_CHUNK_SIZE },
+    { "sd_rand_read", sd_setup, sd_rand_read_run, sd_teardown, 128, BENCH_SD_CHUNK_SIZE },
+    { "lv_fs_read", lv_fs_open_setup, lv_fs_read_run, lv_fs_close_teardown, 20000, BENCH_LV_FS_READ_SIZE, lv_fs_check },
+    { "posix_read", posix_open_setup, posix_read_run, posix_close_teardown, 20000, BENCH_LV_FS_READ_SIZE },
+    { "bda2str", NULL, bda2str_run, NULL, 20000, 0 },
+    { "eir_parse", NULL, eir_parse_run, NULL, 20000, 0 },
+    { "scan_sched_step", scan_setup, scan_sched_step_run, NULL, 20000, 0, scan_check },
+    { "ring_buf_copy", ring_setup, ring_buf_copy_run, ring_teardown, 20000, BENCH_PCM_BLOCK_SIZE },
+    { "pcm_copy", ring_setup, pcm_copy_run, ring_teardown, 20000, BENCH_PCM_BLOCK_SIZE },
+    { "trace_record", NULL, trace_record_run, NULL, 20000, 0 },
+    { "library_walk", walk_setup, library_walk_run, walk_close, 200, 0, walk_check },
+    { "shuffle_next", shuffle_setup, shuffle_next_run, NULL, 20000, 0, shuffle_check },
+    { "search_keystroke", search_setup, search_keystroke_run, search_teardown, 2000, 0, search_check },
+    { "search_tied", search_tied_setup, search_tied_run, search_tied_teardown, 2000, 0, search_tied_check },
+    { "tag_parse", tag_setup, tag_parse_run, NULL, 200, 0, tag_check },
+    { "journal_append", journal_open_setup, journal_append_run, journal_teardown, 5000, BENCH_JOURNAL_RECORD_SIZE, journal_check },
+    { "sd_open_append", journal_setup, sd_open_append_run, journal_teardown, 20, BENCH_JOURNAL_RECORD_SIZE },
+    { "play_history", history_setup, history_run, NULL, 5000, 0, history_check },
+    { "buf_pool_cycle", pool_setup, buf_pool_cycle_run, NULL, 20000, 0, pool_check },
+    { "dma_malloc_free", NULL, dma_malloc_free_run, NULL, 20000, 0 },
+    { "fft_q15", fft_setup, fft_q15_run, NULL, 2000, 0, fft_check },
+    { "jitter_buf", jitter_setup, jitter_buf_run, jitter_teardown, 5000, OUTPUT_PERIOD_FRAMES * 4, jitter_check },
+    { "output_null", output_setup, output_null_run, output_teardown, 20000, OUTPUT_PERIOD_FRAMES * 4, output_check },
+    { "play_clock", clock_setup, play_clock_run, NULL, 20000, 0, clock_check },
+};
+
+/*--------------------------- reporting ----------------------------*/
+
+/* Load the checked-in baseline; the caller frees the host copy */
+static char *load_baseline(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    const char *path = getenv(HOST_BENCH_BASELINE_ENV);
+    if (path == NULL) {
+        return NULL;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open baseline %s", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(len + 1);
+    if (text) {
+        text[fread(text, 1, len, f)] = '\0';
+    }
+    fclose(f);
+    return text;
+#else
+    return (char *)baseline_json_start;
+#endif
+}
+
+static void free_baseline(char *text)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    free(text);
+#endif
+}
+
+/*
+ * Look up "<name>": {"ns_per_op": N in the baseline. The baseline is the
+ * "results" object of an earlier run, so a good run can be checked in as
+ * the new baseline unchanged. A kernel listed with "ns_per_op": null has
+ * no measurement yet; it is found, with *ns_per_op set to 0.
+ */
+static bool baseline_lookup(const char *json, const char *name, uint64_t *ns_per_op)
+{
+    char key[48];
+
+    if (json == NULL) {
+        return false;
+    }
+    snprintf(key, sizeof(key), "\"%s\"", name);
+    const char *p = strstr(json, key);
+    if (p == NULL) {
+        return false;
+    }
+    p = strstr(p, "\"ns_per_op\"");
+    if (p == NULL || (p = strchr(p, ':')) == NULL) {
+        return false;
+    }
+    p += strspn(p + 1, " ") + 1;
+    if (strncmp(p, "null", 4) == 0) {
+        *ns_per_op = 0;
+        return true;
+    }
+    *ns_per_op = strtoull(p, NULL, 10);
+    return *ns_per_op > 0;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/*
+ * Run every kernel whose name contains filter (all when NULL), print the
+ * results as JSON and compare against the baseline. Returns the number of
+ * kernels that failed their check or regressed beyond BENCH_TOLERANCE_PCT.
+ */
+static int run(const char *filter) {
+    char *baseline = load_baseline();
+    int regressions = 0;
+    bool first = true;
+
+    printf("{\"target\": \"%s\", \"tolerance_pct\": %d, \"results\": {",
+           CONFIG_IDF_TARGET, BENCH_TOLERANCE_PCT);
+
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        const bench_kernel_t *k = &kernels[i];
+        if (filter && strstr(k->name, filter) == NULL) {
+            continue;
+        }
+
+        printf("%s\n  \"%s\": {", first ? "" : ",", k->name);
+        first = false;
+
+        if (k->setup && !k->setup()) {
+            printf("\"status\": \"skipped\"}");
+            continue;
+        }
+
+        // One untimed pass to warm caches and fault in buffers, then keep
+        // the fastest of a few repeats so scheduler noise does not read as
+        // a regression
+        k->run(1);
+        uint64_t ns_per_op = UINT64_MAX;
+        uint64_t tsc_per_op = 0;
+        for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+            uint64_t tsc = now_tsc();
+            uint64_t start = now_ns();
+            k->run(k->iters);
+            uint64_t ns = (now_ns() - start) / k->iters;
+            if (ns < ns_per_op) {
+                ns_per_op = ns;
+                tsc_per_op = (now_tsc() - tsc) / k->iters;
+            }
+        }
+
+        if (k->teardown) {
+            k->teardown();
+        }
+
+        printf("\"ns_per_op\": %" PRIu64, ns_per_op);
+        uint64_t cycles;
+        if (cycles_per_op(ns_per_op, tsc_per_op, &cycles)) {
+            printf(", \"cycles_per_op\": %" PRIu64, cycles);
+        }
+        if (k->check && !k->check()) {
+            printf(", \"status\": \"failed\"}");
+            regressions++;
+            continue;
+        }
+        if (k->bytes_per_op && ns_per_op) {
+            printf(", \"kb_per_s\": %" PRIu64, (uint64_t)(k->bytes_per_op * 1000000000ULL / 1024 / ns_per_op));
+        }
+
+        uint64_t base_ns;
+        if (!baseline_lookup(baseline, k->name, &base_ns)) {
+            printf(", \"status\": \"new\"}");
+            continue;
+        }
+        // Reported so a reference run can fill the baseline in, but not gated on
+        if (base_ns == 0) {
+            printf(", \"status\": \"unmeasured\"}");
+            continue;
+        }
+        int64_t delta_pct = ((int64_t)ns_per_op - (int64_t)base_ns) * 100 / (int64_t)base_ns;
+        bool regressed = delta_pct > BENCH_TOLERANCE_PCT;
+        printf(", \"baseline_ns\": %" PRIu64 ", \"delta_pct\": %" PRId64 ", \"status\": \"%s\"}",
+               base_ns, delta_pct, regressed ? "regressed" : "ok");
+        if (regressed) {
+            regressions++;
+        }
+    }
+
+    printf("\n}, \"regressions\": %d}\n", regressions);
+    free_baseline(baseline);
+
+    if (regressions) {
+        ESP_LOGE(TAG, "%d kernel(s) failed their check or regressed more than %d%% against the baseline", regressions, BENCH_TOLERANCE_PCT);
+    }
+    return regressions;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int bench_cmd(int argc, char **argv)
+{
+    return run(argc > 1 ? argv[1] : NULL);
+}
+#endif
+
+/* Register the "bench" console command */
+static void init() {
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "bench",
+        .help = "Run kernel benchmarks and compare with the baseline",
+        .hint = "[filter]",
+        .func = bench_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Bench bench = {
+    .init = init,
+    .run = run
+};
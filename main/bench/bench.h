@@ -0,0 +1,8 @@
+#pragma once
+
+struct Bench {
+    void (*init)(void);
+    int (*run)(const char *filter);
+};
+
+extern const struct Bench bench;
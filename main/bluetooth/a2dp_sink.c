@@ -0,0 +1,341 @@
+#include "a2dp_sink.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/lock.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_a2dp_api.h"
+#include "esp_avrc_api.h"
+
+#include "player.h"
+#include "output.h"
+#include "trace.h"
+#include "console.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    char title[PLAYER_MAX_TEXT + 1];
+    char artist[PLAYER_MAX_TEXT + 1];
+    uint32_t duration_ms;
+    uint8_t received;           /* ESP_AVRC_MD_ATTR_* bits answered so far */
+} pending_meta_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "A2DP SINK";
+
+#define META_ATTRS (ESP_AVRC_MD_ATTR_TITLE | ESP_AVRC_MD_ATTR_ARTIST | ESP_AVRC_MD_ATTR_PLAYING_TIME)
+
+static jitter_buf_t jitter;
+static uint8_t *jitter_storage;
+static TaskHandle_t output_task_handle;
+static atomic_bool output_parked;
+static pending_meta_t meta;
+static _lock_t meta_lock;           /* the BTC task fills meta, the settle timer may publish it */
+static esp_timer_handle_t meta_timer;
+static uint8_t avrc_label;
+static bool started;
+static atomic_bool audio_started;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* AVRCP transaction labels are four bits */
+static uint8_t next_label(void)
+{
+    avrc_label = (avrc_label + 1) & 0x0F;
+    return avrc_label;
+}
+
+/* Forget the last track's text, so attributes the source leaves out come up empty */
+static void request_metadata(void)
+{
+    _lock_acquire(&meta_lock);
+    memset(&meta, 0, sizeof(meta));
+    _lock_release(&meta_lock);
+    esp_avrc_ct_send_metadata_cmd(next_label(), META_ATTRS);
+}
+
+/* Hand whatever has arrived to the player, once per response */
+static void publish_metadata(void)
+{
+    pending_meta_t copy;
+
+    _lock_acquire(&meta_lock);
+    copy = meta;
+    meta.received = 0;
+    _lock_release(&meta_lock);
+    if (copy.received) {
+        player.play(PLAYER_TRACK_STREAM, copy.title, copy.artist, copy.duration_ms);
+    }
+}
+
+/* esp_timer task: the response ended without every attribute, e.g. no playing time for a radio stream */
+static void meta_settled(void *arg)
+{
+    publish_metadata();
+}
+
+static void copy_attr(char *dst, size_t size, const uint8_t *text, int len)
+{
+    if (len >= (int)size) {
+        len = size - 1;
+    }
+    memcpy(dst, text, len);
+    dst[len] = '\0';
+}
+
+/*
+ * Metadata arrives as one event per attribute, with nothing to mark the
+ * end of the response. The track goes to the player once all are in, or
+ * A2DP_META_SETTLE_MS after the last one with what there is.
+ */
+static void on_metadata(const esp_avrc_ct_cb_param_t *param)
+{
+    char digits[12];
+
+    _lock_acquire(&meta_lock);
+    switch (param->meta_rsp.attr_id) {
+    case ESP_AVRC_MD_ATTR_TITLE:
+        copy_attr(meta.title, sizeof(meta.title), param->meta_rsp.attr_text, param->meta_rsp.attr_length);
+        break;
+    case ESP_AVRC_MD_ATTR_ARTIST:
+        copy_attr(meta.artist, sizeof(meta.artist), param->meta_rsp.attr_text, param->meta_rsp.attr_length);
+        break;
+    case ESP_AVRC_MD_ATTR_PLAYING_TIME:
+        copy_attr(digits, sizeof(digits), param->meta_rsp.attr_text, param->meta_rsp.attr_length);
+        meta.duration_ms = strtoul(digits, NULL, 10);
+        break;
+    default:
+        _lock_release(&meta_lock);
+        return;
+    }
+    meta.received |= param->meta_rsp.attr_id;
+    bool complete = meta.received == META_ATTRS;
+    _lock_release(&meta_lock);
+
+    esp_timer_stop(meta_timer);
+    if (complete) {
+        publish_metadata();
+    } else {
+        esp_timer_start_once(meta_timer, A2DP_META_SETTLE_MS * 1000);
+    }
+}
+
+static void avrc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_AVRC_CT_CONNECTION_STATE_EVT:
+        ESP_LOGI(TAG, "AVRCP %s", param->conn_stat.connected ? "connected" : "disconnected");
+        if (param->conn_stat.connected) {
+            request_metadata();
+            esp_avrc_ct_send_register_notification_cmd(next_label(), ESP_AVRC_RN_TRACK_CHANGE, 0);
+            esp_avrc_ct_send_register_notification_cmd(next_label(), ESP_AVRC_RN_PLAY_STATUS_CHANGE, 0);
+        }
+        break;
+    case ESP_AVRC_CT_METADATA_RSP_EVT:
+        on_metadata(param);
+        break;
+    case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
+        // Notifications are one-shot; register again for the next change
+        if (param->change_ntf.event_id == ESP_AVRC_RN_TRACK_CHANGE) {
+            request_metadata();
+            esp_avrc_ct_send_register_notification_cmd(next_label(), ESP_AVRC_RN_TRACK_CHANGE, 0);
+        } else if (param->change_ntf.event_id == ESP_AVRC_RN_PLAY_STATUS_CHANGE) {
+            player.set_paused(param->change_ntf.event_parameter.playback != ESP_AVRC_PLAYBACK_PLAYING);
+            esp_avrc_ct_send_register_notification_cmd(next_label(), ESP_AVRC_RN_PLAY_STATUS_CHANGE, 0);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* SBC sampling frequency from the first octet of the codec information element */
+static uint32_t sbc_rate(const esp_a2d_mcc_t *mcc)
+{
+    uint8_t oct0 = mcc->cie.sbc[0];
+
+    if (oct0 & (1 << 6)) {
+        return 32000;
+    }
+    if (oct0 & (1 << 5)) {
+        return 44100;
+    }
+    if (oct0 & (1 << 4)) {
+        return 48000;
+    }
+    return 16000;
+}
+
+static void a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
+{
+    switch (event) {
+    case ESP_A2D_CONNECTION_STATE_EVT:
+        ESP_LOGI(TAG, "A2DP connection state %d", param->conn_stat.state);
+        if (param->conn_stat.state == ESP_A2D_CONNECTION_STATE_DISCONNECTED) {
+            atomic_store(&audio_started, false);
+            player.stop();
+        }
+        break;
+    case ESP_A2D_AUDIO_STATE_EVT:
+        ESP_LOGI(TAG, "A2DP audio %s", param->audio_stat.state == ESP_A2D_AUDIO_STATE_STARTED ? "started" : "stopped");
+        atomic_store(&audio_started, param->audio_stat.state == ESP_A2D_AUDIO_STATE_STARTED);
+        if (atomic_load(&audio_started)) {
+            xTaskNotifyGive(output_task_handle);
+        }
+        break;
+    case ESP_A2D_AUDIO_CFG_EVT:
+        if (param->audio_cfg.mcc.type == ESP_A2D_MCT_SBC) {
+            uint32_t rate = sbc_rate(&param->audio_cfg.mcc);
+            ESP_LOGI(TAG, "SBC stream at %" PRIu32 " Hz", rate);
+            jitter_buf_set_rate(&jitter, rate);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Bluedroid's task: decoded stereo int16 PCM, in bursts */
+static void a2d_data_cb(const uint8_t *data, uint32_t len)
+{
+    uint32_t frames = len / (2 * sizeof(int16_t));
+
+    jitter_buf_write(&jitter, (const int16_t *)data, frames, esp_timer_get_time());
+    TRACE(TRACE_EV_A2DP_PACKET, frames, ring_buf_used(&jitter.ring) / (2 * sizeof(int16_t)));
+    if (atomic_load(&output_parked)) {
+        xTaskNotifyGive(output_task_handle);
+    }
+}
+
+/*
+ * Pull one period at a time at the output's pace; the blocking write is
+ * the clock the jitter buffer steers against. The resampler writes into
+ * pcm and the sink takes it from there. With no stream and the buffer
+ * drained the task parks until audio starts or a packet comes in; the
+ * I2S DMA clears its own buffers meanwhile.
+ */
+static void output_task(void *arg)
+{
+    static int16_t pcm[OUTPUT_PERIOD_FRAMES * 2];
+
+    while (1) {
+        output.set_rate(jitter_buf_rate(&jitter));
+        bool had_audio = jitter_buf_read(&jitter, pcm, OUTPUT_PERIOD_FRAMES);
+        if (!had_audio && !atomic_load(&audio_started)) {
+            atomic_store(&output_parked, true);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            atomic_store(&output_parked, false);
+            continue;
+        }
+        output.write(pcm, OUTPUT_PERIOD_FRAMES);
+    }
+}
+
+static int a2dp_cmd(int argc, char **argv)
+{
+    jitter_stats_t s;
+
+    a2dp_sink.take_stats(&s);
+    printf("%" PRIu32 " packets, jitter %" PRIu32 " us, target %" PRIu32 " ms, latency %" PRIu32
+           " ms (max %" PRIu32 "), %+" PRId32 " ppm, %" PRIu32 " underruns, %" PRIu32 " overflows\n",
+           s.packets, s.jitter_us, s.target_ms, s.latency_ms, s.latency_ms_max, s.ppm, s.underruns, s.overflows);
+    return 0;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Register the sink and AVRCP controller; the buffer and output task are set up on the first call */
+static void start(void) {
+    if (started) {
+        return;
+    }
+    if (jitter_storage == NULL) {
+        jitter_storage = heap_caps_malloc(JITTER_BUF_FRAMES * 2 * sizeof(int16_t), MALLOC_CAP_INTERNAL);
+        if (jitter_storage == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate the jitter buffer");
+            return;
+        }
+        jitter_buf_init(&jitter, jitter_storage, JITTER_BUF_FRAMES * 2 * sizeof(int16_t), A2DP_SINK_DEFAULT_RATE);
+        const esp_timer_create_args_t timer_args = {
+            .callback = meta_settled,
+            .name = "avrc_meta",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &meta_timer));
+        xTaskCreatePinnedToCore(output_task, "a2dp_out", A2DP_OUTPUT_TASK_STACK_SIZE, NULL,
+                                A2DP_OUTPUT_TASK_PRIORITY, &output_task_handle, A2DP_OUTPUT_TASK_CORE);
+
+        const esp_console_cmd_t cmd = {
+            .command = "a2dp",
+            .help = "Show jitter buffer depth, correction and glitch counters since the last call",
+            .hint = NULL,
+            .func = a2dp_cmd,
+        };
+        console.register_cmd(&cmd);
+    }
+
+    // AVRCP first, as Bluedroid expects
+    esp_avrc_ct_init();
+    esp_avrc_ct_register_callback(avrc_ct_cb);
+    esp_a2d_register_callback(a2d_cb);
+    esp_a2d_sink_register_data_callback(a2d_data_cb);
+    esp_err_t err = esp_a2d_sink_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the A2DP sink: %s", esp_err_to_name(err));
+        return;
+    }
+    started = true;
+    ESP_LOGI(TAG, "A2DP sink ready");
+}
+
+static void stop(void) {
+    if (!started) {
+        return;
+    }
+    esp_a2d_sink_deinit();
+    esp_avrc_ct_deinit();
+    started = false;
+}
+
+/* Audio queued for the output and the depth the jitter buffer aims for; false without a stream */
+static bool queue_depth(uint32_t *queued_ms, uint32_t *target_ms) {
+    if (jitter_storage == NULL || !atomic_load(&audio_started)) {
+        return false;
+    }
+    *queued_ms = jitter_buf_depth_ms(&jitter);
+    *target_ms = jitter_buf_target_ms(&jitter);
+    return true;
+}
+
+static void take_stats(jitter_stats_t *stats) {
+    jitter_buf_take_stats(&jitter, stats);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct A2dpSink a2dp_sink = {
+    .start = start,
+    .stop = stop,
+    .queue_depth = queue_depth,
+    .take_stats = take_stats
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "jitter_buf.h"
+
+/*
+ * Bluetooth receiver mode: the phone streams over A2DP, packets go
+ * through the adaptive jitter buffer to the selected output, and AVRCP
+ * track metadata and play status drive the player screen. start() needs
+ * Bluedroid enabled; the output task stays up between streams and plays
+ * silence while the buffer is empty.
+ */
+struct A2dpSink {
+    void (*start)(void);
+    void (*stop)(void);
+    bool (*queue_depth)(uint32_t *queued_ms, uint32_t *target_ms);
+    void (*take_stats)(jitter_stats_t *stats);
+};
+
+extern const struct A2dpSink a2dp_sink;
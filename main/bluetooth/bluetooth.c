@@ -1,22 +1,37 @@
 #include "bluetooth.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/lock.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_bt.h"
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gap_bt_api.h"
 
+#include "bt_util.h"
+#include "a2dp_sink.h"
+#include "scan_sched.h"
+#include "console.h"
+#include "trace.h"
+#include "system_config.h"
+
 
 #define GAP_TAG  "GAP"
 
+/* esp_bt_gap_start_discovery() takes the inquiry length in these units, 1 to 0x30 */
+#define INQ_UNIT_MS 1280
+#define INQ_MAX_UNITS 0x30
+
 typedef enum {
     APP_GAP_STATE_IDLE = 0,
     APP_GAP_STATE_DEVICE_DISCOVERING,
@@ -40,16 +55,56 @@ typedef struct {
 
 static app_gap_cb_t m_dev_info;
 
-static char *bda2str(esp_bd_addr_t bda, char *str, size_t size)
+/* Scheduler state is shared by the GAP callback and the tick timer under scan_lock */
+static scan_sched_t scan;
+static _lock_t scan_lock;
+static esp_timer_handle_t scan_timer;
+
+static uint32_t now_ms(void)
 {
-    if (bda == NULL || str == NULL || size < 18) {
-        return "";
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/* Carry out the scheduler's decision for this tick; the timer stops once the discovery is over */
+static void scan_tick(void *arg)
+{
+    uint32_t queued_ms = 0;
+    uint32_t target_ms = 0;
+    bool streaming = a2dp_sink.queue_depth(&queued_ms, &target_ms);
+
+    _lock_acquire(&scan_lock);
+    scan_sched_action_t action = scan_sched_step(&scan, now_ms(), streaming, queued_ms, target_ms);
+    uint32_t units = (scan.window_ms + INQ_UNIT_MS - 1) / INQ_UNIT_MS;
+    bool idle = !scan.wanted && !scan.scanning;
+    _lock_release(&scan_lock);
+
+    if (action == SCAN_SCHED_START) {
+        units = units < 1 ? 1 : units > INQ_MAX_UNITS ? INQ_MAX_UNITS : units;
+        esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, units, 0);
+    } else if (action == SCAN_SCHED_STOP) {
+        esp_bt_gap_cancel_discovery();
+    }
+    if (idle) {
+        esp_timer_stop(scan_timer);
     }
+}
 
-    uint8_t *p = bda;
-    snprintf(str, size, "%02x:%02x:%02x:%02x:%02x:%02x",
-             p[0], p[1], p[2], p[3], p[4], p[5]);
-    return str;
+static int scan_cmd(int argc, char **argv)
+{
+    scan_sched_stats_t s;
+
+    _lock_acquire(&scan_lock);
+    scan_sched_take_stats(&scan, &s);
+    bool wanted = scan.wanted;
+    uint32_t budget_ms = scan.budget_ms;
+    _lock_release(&scan_lock);
+    printf("%" PRIu32 " windows, %" PRIu32 " ms of inquiry, %" PRIu32 " cut short by the audio queue, %" PRIu32
+           " discoveries done; %s\n", s.windows, s.scan_ms, s.pauses, s.discoveries,
+           wanted ? "discovering" : "idle");
+    if (wanted) {
+        printf("%" PRIu32 " ms of inquiry left\n", budget_ms);
+    }
+    return 0;
 }
 
 static char *uuid2str(esp_bt_uuid_t *uuid, char *str, size_t size)
@@ -74,38 +129,6 @@ static char *uuid2str(esp_bt_uuid_t *uuid, char *str, size_t size)
     return str;
 }
 
-static bool get_name_from_eir(uint8_t *eir, uint8_t *bdname, uint8_t *bdname_len)
-{
-    uint8_t *rmt_bdname = NULL;
-    uint8_t rmt_bdname_len = 0;
-
-    if (!eir) {
-        return false;
-    }
-
-    rmt_bdname = esp_bt_gap_resolve_eir_data(eir, ESP_BT_EIR_TYPE_CMPL_LOCAL_NAME, &rmt_bdname_len);
-    if (!rmt_bdname) {
-        rmt_bdname = esp_bt_gap_resolve_eir_data(eir, ESP_BT_EIR_TYPE_SHORT_LOCAL_NAME, &rmt_bdname_len);
-    }
-
-    if (rmt_bdname) {
-        if (rmt_bdname_len > ESP_BT_GAP_MAX_BDNAME_LEN) {
-            rmt_bdname_len = ESP_BT_GAP_MAX_BDNAME_LEN;
-        }
-
-        if (bdname) {
-            memcpy(bdname, rmt_bdname, rmt_bdname_len);
-            bdname[rmt_bdname_len] = '\0';
-        }
-        if (bdname_len) {
-            *bdname_len = rmt_bdname_len;
-        }
-        return true;
-    }
-
-    return false;
-}
-
 static void update_device_info(esp_bt_gap_cb_param_t *param)
 {
     char bda_str[18];
@@ -117,17 +140,20 @@ static void update_device_info(esp_bt_gap_cb_param_t *param)
     uint8_t eir_len = 0;
     esp_bt_gap_dev_prop_t *p;
 
-    ESP_LOGI(GAP_TAG, "Device found: %s", bda2str(param->disc_res.bda, bda_str, sizeof(bda_str)));
+    uint8_t *bda = param->disc_res.bda;
+    TRACE(TRACE_EV_BT_DEVICE_FOUND,
+          (uint32_t)bda[0] << 24 | (uint32_t)bda[1] << 16 | (uint32_t)bda[2] << 8 | bda[3],
+          (uint32_t)bda[4] << 24 | (uint32_t)bda[5] << 16 | param->disc_res.num_prop);
     for (int i = 0; i < param->disc_res.num_prop; i++) {
         p = param->disc_res.prop + i;
         switch (p->type) {
         case ESP_BT_GAP_DEV_PROP_COD:
             cod = *(uint32_t *)(p->val);
-            ESP_LOGI(GAP_TAG, "--Class of Device: 0x%"PRIx32, cod);
+            TRACE(TRACE_EV_BT_COD, cod, 0);
             break;
         case ESP_BT_GAP_DEV_PROP_RSSI:
             rssi = *(int8_t *)(p->val);
-            ESP_LOGI(GAP_TAG, "--RSSI: %"PRId32, rssi);
+            TRACE(TRACE_EV_BT_RSSI, rssi, 0);
             break;
         case ESP_BT_GAP_DEV_PROP_BDNAME:
             bdname_len = (p->len > ESP_BT_GAP_MAX_BDNAME_LEN) ? ESP_BT_GAP_MAX_BDNAME_LEN :
@@ -171,12 +197,16 @@ static void update_device_info(esp_bt_gap_cb_param_t *param)
     }
 
     if (p_dev->bdname_len == 0) {
-        get_name_from_eir(p_dev->eir, p_dev->bdname, &p_dev->bdname_len);
+        get_name_from_eir(p_dev->eir, p_dev->eir_len, p_dev->bdname, ESP_BT_GAP_MAX_BDNAME_LEN, &p_dev->bdname_len);
     }
 
-    ESP_LOGI(GAP_TAG, "Found a target device, address %s, name %s", bda_str, p_dev->bdname);
+    ESP_LOGI(GAP_TAG, "Found a target device, address %s, name %s",
+             bda2str(p_dev->bda, bda_str, sizeof(bda_str)), p_dev->bdname);
     p_dev->state = APP_GAP_STATE_DEVICE_DISCOVER_COMPLETE;
     ESP_LOGI(GAP_TAG, "Cancel device discovery ...");
+    _lock_acquire(&scan_lock);
+    scan_sched_finish(&scan);
+    _lock_release(&scan_lock);
     esp_bt_gap_cancel_discovery();
 }
 
@@ -202,6 +232,9 @@ static void bt_app_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *pa
     case ESP_BT_GAP_DISC_STATE_CHANGED_EVT: {
         if (param->disc_st_chg.state == ESP_BT_GAP_DISCOVERY_STOPPED) {
             ESP_LOGI(GAP_TAG, "Device discovery stopped.");
+            _lock_acquire(&scan_lock);
+            scan_sched_stopped(&scan, now_ms());
+            _lock_release(&scan_lock);
             if ( (p_dev->state == APP_GAP_STATE_DEVICE_DISCOVER_COMPLETE ||
                     p_dev->state == APP_GAP_STATE_DEVICE_DISCOVERING)
                     && p_dev->dev_found) {
@@ -254,10 +287,31 @@ static void bt_app_gap_start_up(void)
     /* initialize device information and status */
     bt_app_gap_init();
 
-    /* start to discover nearby Bluetooth devices */
+    if (scan_timer == NULL) {
+        const esp_timer_create_args_t scan_timer_args = {
+            .callback = &scan_tick,
+            .name = "bt_scan"
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&scan_timer_args, &scan_timer));
+
+        const esp_console_cmd_t cmd = {
+            .command = "scan",
+            .help = "Show inquiry windows and the ones the audio queue cut short since the last call",
+            .hint = NULL,
+            .func = scan_cmd,
+        };
+        console.register_cmd(&cmd);
+    }
+
+    /* start to discover nearby Bluetooth devices, in windows that leave the A2DP stream its slots */
     app_gap_cb_t *p_dev = &m_dev_info;
     p_dev->state = APP_GAP_STATE_DEVICE_DISCOVERING;
-    esp_bt_gap_start_discovery(ESP_BT_INQ_MODE_GENERAL_INQUIRY, 10, 0);
+    _lock_acquire(&scan_lock);
+    scan_sched_init(&scan);
+    scan_sched_request(&scan, now_ms());
+    _lock_release(&scan_lock);
+    esp_timer_stop(scan_timer);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(scan_timer, SCAN_SCHED_TICK_MS * 1000));
 }
 
 void bt_enable(bool enable) {
@@ -273,8 +327,13 @@ void bt_enable(bool enable) {
         }
 
         bt_app_gap_start_up();
+        a2dp_sink.start();
 
     } else {
+        if (scan_timer) {
+            esp_timer_stop(scan_timer);
+        }
+        a2dp_sink.stop();
         if ((ret = esp_bluedroid_disable()) != ESP_OK) {
             ESP_LOGE(GAP_TAG, "%s disable bluedroid failed: %s", __func__, esp_err_to_name(ret));
         }
@@ -0,0 +1,86 @@
+#include "bt_util.h"
+
+#include <string.h>
+
+/*
+ * Helpers for turning inquiry results into something printable. They are
+ * called for every device in an inquiry burst, so they avoid stdio and
+ * walk EIR data in place instead of going through the Bluedroid API. That
+ * also keeps them buildable on the host for benchmarking.
+ */
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Format a 6-byte device address as "xx:xx:xx:xx:xx:xx" */
+char *bda2str(const uint8_t *bda, char *str, size_t size)
+{
+    if (bda == NULL || str == NULL || size < BT_UTIL_BDA_STR_LEN) {
+        return "";
+    }
+
+    char *out = str;
+    for (int i = 0; i < BT_UTIL_BDA_LEN; i++) {
+        *out++ = hex_digits[bda[i] >> 4];
+        *out++ = hex_digits[bda[i] & 0x0F];
+        *out++ = ':';
+    }
+    out[-1] = '\0';
+    return str;
+}
+
+/*
+ * Find the first EIR structure of the given type. EIR is a sequence of
+ * [length][type][data...] records where length covers type and data; a
+ * zero length ends the significant part. Returns a pointer to the data and
+ * its length, or NULL if the type is absent or the data is malformed.
+ */
+const uint8_t *eir_find(const uint8_t *eir, size_t eir_len, uint8_t type, uint8_t *out_len)
+{
+    size_t pos = 0;
+
+    if (eir == NULL) {
+        return NULL;
+    }
+
+    while (pos < eir_len) {
+        uint8_t len = eir[pos];
+        if (len == 0 || pos + 1 + len > eir_len) {
+            break;
+        }
+        if (eir[pos + 1] == type) {
+            if (out_len) {
+                *out_len = len - 1;
+            }
+            return &eir[pos + 2];
+        }
+        pos += 1 + len;
+    }
+
+    return NULL;
+}
+
+/* Copy the complete (or else shortened) local name out of EIR data */
+bool get_name_from_eir(const uint8_t *eir, size_t eir_len, uint8_t *bdname, size_t bdname_max, uint8_t *bdname_len)
+{
+    uint8_t rmt_bdname_len = 0;
+    const uint8_t *rmt_bdname = eir_find(eir, eir_len, BT_UTIL_EIR_CMPL_LOCAL_NAME, &rmt_bdname_len);
+
+    if (!rmt_bdname) {
+        rmt_bdname = eir_find(eir, eir_len, BT_UTIL_EIR_SHORT_LOCAL_NAME, &rmt_bdname_len);
+    }
+    if (!rmt_bdname) {
+        return false;
+    }
+
+    if (rmt_bdname_len > bdname_max) {
+        rmt_bdname_len = bdname_max;
+    }
+    if (bdname) {
+        memcpy(bdname, rmt_bdname, rmt_bdname_len);
+        bdname[rmt_bdname_len] = '\0';
+    }
+    if (bdname_len) {
+        *bdname_len = rmt_bdname_len;
+    }
+    return true;
+}
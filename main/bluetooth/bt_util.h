@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BT_UTIL_BDA_LEN 6
+#define BT_UTIL_BDA_STR_LEN 18
+
+/* EIR data types (Bluetooth Assigned Numbers, "Common Data Types") */
+#define BT_UTIL_EIR_SHORT_LOCAL_NAME 0x08
+#define BT_UTIL_EIR_CMPL_LOCAL_NAME 0x09
+
+char *bda2str(const uint8_t *bda, char *str, size_t size);
+const uint8_t *eir_find(const uint8_t *eir, size_t eir_len, uint8_t type, uint8_t *out_len);
+bool get_name_from_eir(const uint8_t *eir, size_t eir_len, uint8_t *bdname, size_t bdname_max, uint8_t *bdname_len);
@@ -0,0 +1,102 @@
+#include "scan_sched.h"
+
+#include <string.h>
+
+#include "system_config.h"
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* Account the window that ran until now; the caller cancels the inquiry if it has to */
+static void end_window(scan_sched_t *s, uint32_t now_ms, bool paused)
+{
+    uint32_t elapsed = now_ms - s->window_start_ms;
+
+    s->scanning = false;
+    s->stats.scan_ms += elapsed;
+    s->budget_ms -= elapsed < s->budget_ms ? elapsed : s->budget_ms;
+    s->next_window_ms = now_ms + (paused ? 0 : SCAN_SCHED_GAP_MS);
+    if (paused) {
+        s->stats.pauses++;
+    }
+    if (s->wanted && s->budget_ms == 0) {
+        s->wanted = false;
+        s->stats.discoveries++;
+    }
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void scan_sched_init(scan_sched_t *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+/* Start a discovery with a fresh budget; windows begin on the next step */
+void scan_sched_request(scan_sched_t *s, uint32_t now_ms)
+{
+    s->wanted = true;
+    s->budget_ms = SCAN_SCHED_BUDGET_MS;
+    if (!s->scanning) {
+        s->next_window_ms = now_ms;
+    }
+}
+
+/* The device was found; no more windows, and the next step stops a running one */
+void scan_sched_finish(scan_sched_t *s)
+{
+    s->wanted = false;
+}
+
+/* The stack ended the inquiry by itself, at the end of its length or on a cancel */
+void scan_sched_stopped(scan_sched_t *s, uint32_t now_ms)
+{
+    if (s->scanning) {
+        end_window(s, now_ms, false);
+    }
+}
+
+/* Every SCAN_SCHED_TICK_MS, with the A2DP sink's queue depth and target */
+scan_sched_action_t scan_sched_step(scan_sched_t *s, uint32_t now_ms, bool streaming, uint32_t queued_ms,
+                                    uint32_t target_ms)
+{
+    if (!streaming) {
+        s->shallow = false;
+    } else if (queued_ms < target_ms * SCAN_SCHED_PAUSE_PCT / 100) {
+        s->shallow = true;
+    } else if (queued_ms >= target_ms * SCAN_SCHED_RESUME_PCT / 100) {
+        s->shallow = false;
+    }
+
+    if (s->scanning) {
+        bool over = now_ms - s->window_start_ms >= s->window_ms;
+        if (s->wanted && !s->shallow && !over) {
+            return SCAN_SCHED_NONE;
+        }
+        end_window(s, now_ms, s->wanted && s->shallow && !over);
+        return SCAN_SCHED_STOP;
+    }
+
+    if (!s->wanted || s->shallow || (int32_t)(now_ms - s->next_window_ms) < 0) {
+        return SCAN_SCHED_NONE;
+    }
+    // A window opens just after a burst topped the queue up
+    if (streaming && queued_ms < target_ms * SCAN_SCHED_RESUME_PCT / 100) {
+        return SCAN_SCHED_NONE;
+    }
+    s->window_ms = streaming && s->budget_ms > SCAN_SCHED_WINDOW_MS ? SCAN_SCHED_WINDOW_MS : s->budget_ms;
+    s->window_start_ms = now_ms;
+    s->scanning = true;
+    s->stats.windows++;
+    return SCAN_SCHED_START;
+}
+
+/* Copy the counters and reset them */
+void scan_sched_take_stats(scan_sched_t *s, scan_sched_stats_t *stats)
+{
+    *stats = s->stats;
+    memset(&s->stats, 0, sizeof(s->stats));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    SCAN_SCHED_NONE = 0,
+    SCAN_SCHED_START,           /* start an inquiry of window_ms */
+    SCAN_SCHED_STOP,            /* cancel the running inquiry */
+} scan_sched_action_t;
+
+typedef struct {
+    uint32_t windows;
+    uint32_t pauses;            /* windows cut short by a shallow audio queue */
+    uint32_t scan_ms;
+    uint32_t discoveries;       /* inquiry budgets used up */
+} scan_sched_stats_t;
+
+/*
+ * Splits a discovery's SCAN_SCHED_BUDGET_MS of inquiry into windows so
+ * it can run next to an A2DP stream. While a stream plays, a window is
+ * SCAN_SCHED_WINDOW_MS and the next one waits SCAN_SCHED_GAP_MS. A
+ * window starts only with the audio queue at SCAN_SCHED_RESUME_PCT of
+ * the jitter buffer's target, right after a burst has come in, and is
+ * cut short once the queue drops below SCAN_SCHED_PAUSE_PCT; the next
+ * one waits for the queue to recover instead of the gap. Without a
+ * stream the whole budget goes in one inquiry.
+ *
+ * Pure policy with the time passed in; the caller serialises the calls
+ * and carries out the actions.
+ */
+typedef struct {
+    bool wanted;                /* a discovery is under way */
+    bool scanning;
+    bool shallow;               /* below the pause level, until back at the resume level */
+    uint32_t window_start_ms;
+    uint32_t window_ms;         /* length of the window being run */
+    uint32_t next_window_ms;
+    uint32_t budget_ms;         /* inquiry time the discovery has left */
+    scan_sched_stats_t stats;
+} scan_sched_t;
+
+void scan_sched_init(scan_sched_t *s);
+void scan_sched_request(scan_sched_t *s, uint32_t now_ms);
+void scan_sched_finish(scan_sched_t *s);
+void scan_sched_stopped(scan_sched_t *s, uint32_t now_ms);
+scan_sched_action_t scan_sched_step(scan_sched_t *s, uint32_t now_ms, bool streaming, uint32_t queued_ms,
+                                    uint32_t target_ms);
+void scan_sched_take_stats(scan_sched_t *s, scan_sched_stats_t *stats);
@@ -0,0 +1,200 @@
+#include "display_power.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/lock.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+#include "lcd.h"
+#include "console.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "DISPLAY POWER";
+
+static const char *state_names[DISPLAY_POWER_STATES] = { "on", "dim", "off" };
+
+static lv_display_t *display;
+static display_power_state_t state;
+/* Keypad input that ended the last sleep; cleared once its frame is out */
+static int64_t wake_start_us;
+static bool waking;
+
+/* Counters below are shared with the console task under stats_lock */
+static _lock_t stats_lock;
+static int64_t state_since_us;
+static uint64_t state_us[DISPLAY_POWER_STATES];
+static uint64_t lit_busy_us;
+static uint32_t sleeps;
+static uint32_t wake_us_max;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void enter(display_power_state_t next)
+{
+    int64_t now = esp_timer_get_time();
+
+    _lock_acquire(&stats_lock);
+    state_us[state] += now - state_since_us;
+    state_since_us = now;
+    state = next;
+    if (next == DISPLAY_POWER_OFF) {
+        sleeps++;
+    }
+    _lock_release(&stats_lock);
+}
+
+/* The first frame after a wake is on the panel; light it */
+static void refr_ready_cb(lv_event_t *e)
+{
+    if (!waking) {
+        return;
+    }
+    waking = false;
+    lcd.set_backlight(100, 0);
+
+    uint32_t wake_us = (uint32_t)(esp_timer_get_time() - wake_start_us);
+    _lock_acquire(&stats_lock);
+    if (wake_us > wake_us_max) {
+        wake_us_max = wake_us;
+    }
+    _lock_release(&stats_lock);
+}
+
+static int display_cmd(int argc, char **argv)
+{
+    display_power_stats_t s;
+
+    display_power.take_stats(&s);
+    uint32_t lit_ms = s.state_ms[DISPLAY_POWER_ON] + s.state_ms[DISPLAY_POWER_DIM];
+    uint32_t busy_x100 = lit_ms ? (uint32_t)(s.lit_busy_ms * 10000ULL / lit_ms) : 0;
+    printf("on %" PRIu32 " ms, dim %" PRIu32 " ms, off %" PRIu32 " ms, now %s; LVGL busy %" PRIu32 ".%02" PRIu32
+           "%% while lit, %" PRIu32 " ms CPU saved while off; %" PRIu32 " sleeps, slowest wake %" PRIu32 " us\n",
+           s.state_ms[DISPLAY_POWER_ON], s.state_ms[DISPLAY_POWER_DIM], s.state_ms[DISPLAY_POWER_OFF],
+           state_names[state], busy_x100 / 100, busy_x100 % 100, s.saved_ms, s.sleeps, s.wake_us_max);
+    return 0;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Start on, with the backlight lcd.init() turned on */
+static void init(lv_display_t *disp) {
+    display = disp;
+    state = DISPLAY_POWER_ON;
+    state_since_us = esp_timer_get_time();
+    lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, NULL);
+
+    const esp_console_cmd_t cmd = {
+        .command = "display",
+        .help = "Show time in each display power state and the LVGL time saved since the last call",
+        .hint = NULL,
+        .func = display_cmd,
+    };
+    console.register_cmd(&cmd);
+    ESP_LOGI(TAG, "Dim after %d ms, off after %d ms", DISPLAY_DIM_AFTER_MS, DISPLAY_OFF_AFTER_MS);
+}
+
+/* After every lv_timer_handler call, with the time it took */
+static void update(uint32_t busy_us) {
+    uint32_t inactive_ms = lv_display_get_inactive_time(display);
+
+    _lock_acquire(&stats_lock);
+    lit_busy_us += busy_us;
+    _lock_release(&stats_lock);
+
+    switch (state) {
+    case DISPLAY_POWER_ON:
+        if (inactive_ms >= DISPLAY_DIM_AFTER_MS) {
+            lcd.set_backlight(DISPLAY_DIM_PCT, DISPLAY_FADE_MS);
+            enter(DISPLAY_POWER_DIM);
+        }
+        break;
+    case DISPLAY_POWER_DIM:
+        if (inactive_ms < DISPLAY_DIM_AFTER_MS) {
+            lcd.set_backlight(100, 0);
+            enter(DISPLAY_POWER_ON);
+        } else if (inactive_ms >= DISPLAY_OFF_AFTER_MS) {
+            lcd.set_backlight(0, 0);
+            lcd.enable_panel(false);
+            enter(DISPLAY_POWER_OFF);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static bool sleeping(void) {
+    return state == DISPLAY_POWER_OFF;
+}
+
+/* Block until the keypad UART has something; it stays buffered for the input device */
+static void wait_for_input(void) {
+    size_t len = 0;
+
+    while (uart_get_buffered_data_len(UART_PORT_NUM, &len) != ESP_OK || len == 0) {
+        vTaskDelay(pdMS_TO_TICKS(DISPLAY_WAKE_POLL_MS));
+    }
+    wake_start_us = esp_timer_get_time();
+}
+
+/*
+ * Panel on and one full frame straight away; the LVGL tick stood still
+ * while off, so the idle time restarts here rather than from the last key.
+ */
+static void wake(void) {
+    lcd.enable_panel(true);
+    lv_display_trigger_activity(display);
+    lv_obj_invalidate(lv_display_get_screen_active(display));
+    waking = true;
+    enter(DISPLAY_POWER_ON);
+    lv_refr_now(display);
+}
+
+/* Copy and reset the counters; the current state's time so far is included */
+static void take_stats(display_power_stats_t *stats) {
+    int64_t now = esp_timer_get_time();
+
+    _lock_acquire(&stats_lock);
+    state_us[state] += now - state_since_us;
+    state_since_us = now;
+    uint64_t lit_us = state_us[DISPLAY_POWER_ON] + state_us[DISPLAY_POWER_DIM];
+    for (int i = 0; i < DISPLAY_POWER_STATES; i++) {
+        stats->state_ms[i] = state_us[i] / 1000;
+    }
+    stats->lit_busy_ms = lit_busy_us / 1000;
+    stats->saved_ms = lit_us ? lit_busy_us * (state_us[DISPLAY_POWER_OFF] / 1000) / lit_us : 0;
+    stats->sleeps = sleeps;
+    stats->wake_us_max = wake_us_max;
+    memset(state_us, 0, sizeof(state_us));
+    lit_busy_us = 0;
+    sleeps = 0;
+    wake_us_max = 0;
+    _lock_release(&stats_lock);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct DisplayPower display_power = {
+    .init = init,
+    .update = update,
+    .sleeping = sleeping,
+    .wait_for_input = wait_for_input,
+    .wake = wake,
+    .take_stats = take_stats
+};
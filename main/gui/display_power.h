@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+typedef enum {
+    DISPLAY_POWER_ON = 0,
+    DISPLAY_POWER_DIM,          /* backlight at DISPLAY_DIM_PCT, still rendering */
+    DISPLAY_POWER_OFF,          /* backlight and panel off, LVGL stopped */
+    DISPLAY_POWER_STATES,
+} display_power_state_t;
+
+typedef struct {
+    uint32_t state_ms[DISPLAY_POWER_STATES];
+    uint32_t lit_busy_ms;       /* in lv_timer_handler while on or dim */
+    uint32_t saved_ms;          /* what LVGL would have taken at that rate while off */
+    uint32_t sleeps;
+    uint32_t wake_us_max;       /* from keypad input to the first full frame on the panel */
+} display_power_stats_t;
+
+/*
+ * Keypad inactivity policy for the panel, run by the LVGL task. After
+ * DISPLAY_DIM_AFTER_MS without a key the backlight fades to
+ * DISPLAY_DIM_PCT; after DISPLAY_OFF_AFTER_MS the backlight and panel go
+ * off and the LVGL task stops calling lv_timer_handler, so nothing
+ * renders or flushes. The task then only looks at the keypad UART every
+ * DISPLAY_WAKE_POLL_MS; the first byte brings the panel back with one
+ * full refresh, and the backlight comes on once that frame is out. That
+ * byte is not pressed as a key: the LVGL task has the input device
+ * swallow it.
+ *
+ * update() and wake() are called with the LVGL lock held,
+ * wait_for_input() without it.
+ */
+struct DisplayPower {
+    void (*init)(lv_display_t *display);
+    void (*update)(uint32_t busy_us);
+    bool (*sleeping)(void);
+    void (*wait_for_input)(void);
+    void (*wake)(void);
+    void (*take_stats)(display_power_stats_t *stats);
+};
+
+extern const struct DisplayPower display_power;
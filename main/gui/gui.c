@@ -1,5 +1,9 @@
 #include "gui.h"
 
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/lock.h>
 #include <sys/param.h>
@@ -9,18 +13,62 @@
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
 #include "uart.h"
+#include "uart_indev.h"
+#include "display_power.h"
+#include "screen_mgr.h"
+#include "buf_pool.h"
+#include "console.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "lvgl.h"
-#include "driver/uart.h"
 #include "system_config.h"
 
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+/* MADCTL bits that turn the panel's native portrait scan into an orientation */
+typedef struct {
+    const char *name;
+    bool swap_xy;
+    bool mirror_x;
+    bool mirror_y;
+} orientation_def_t;
+
 /*********************************************************************
  * STATIC VARS
  *********************************************************************/
 
 static const char *TAG = "GUI";
 static _lock_t lvgl_api_lock;
+static esp_timer_handle_t lvgl_tick_timer;
+static lv_display_t *display;
+
+static const orientation_def_t orientations[GUI_ORIENTATIONS] = {
+    [GUI_ORIENTATION_PORTRAIT]          = { "portrait",          false, false, false },
+    [GUI_ORIENTATION_LANDSCAPE]         = { "landscape",         true,  true,  false },
+    [GUI_ORIENTATION_PORTRAIT_FLIPPED]  = { "portrait flipped",  false, true,  true  },
+    [GUI_ORIENTATION_LANDSCAPE_FLIPPED] = { "landscape flipped", true,  false, true  },
+};
+static atomic_int orientation;
+
+/* Pixels sent to the panel since the last "flush" command */
+static atomic_uint flush_area_px;
+static atomic_uint flush_count;
+static int64_t flush_window_start_us;
+
+/*
+ * The flush in flight, from lvgl_flush_cb to the end of its transfer;
+ * LVGL does not start another until this one is reported ready.
+ */
+static int64_t flush_start_us;
+static uint32_t flush_px;
+static int flush_orientation;
+
+/* Time from flush call to transfer done, per orientation the flush was sent in */
+static atomic_uint orient_flush_us[GUI_ORIENTATIONS];
+static atomic_uint orient_flush_px[GUI_ORIENTATIONS];
+static atomic_uint orient_flushes[GUI_ORIENTATIONS];
 
 /*********************************************************************
  * PRIVATE FUNCTIONS
@@ -32,6 +80,10 @@ static bool notify_lvgl_flush_ready(
     void *user_ctx)
 {
     lv_display_t *disp = (lv_display_t *)user_ctx;
+
+    atomic_fetch_add(&orient_flush_us[flush_orientation], (uint32_t)(esp_timer_get_time() - flush_start_us));
+    atomic_fetch_add(&orient_flush_px[flush_orientation], flush_px);
+    atomic_fetch_add(&orient_flushes[flush_orientation], 1);
     lv_display_flush_ready(disp);
     return false;
 }
@@ -47,8 +99,20 @@ static void lvgl_port_task(void *arg)
     ESP_LOGI(TAG, "Starting LVGL task");
     uint32_t time_till_next_ms = 0;
     while (1) {
+        if (display_power.sleeping()) {
+            // Nothing ticks, renders or flushes until a key comes in
+            esp_timer_stop(lvgl_tick_timer);
+            display_power.wait_for_input();
+            esp_timer_start_periodic(lvgl_tick_timer, LVGL_TICK_PERIOD_MS * 1000);
+            _lock_acquire(&lvgl_api_lock);
+            display_power.wake();
+            uart_indev.swallow_wake_key();
+            _lock_release(&lvgl_api_lock);
+        }
         _lock_acquire(&lvgl_api_lock);
+        int64_t start = esp_timer_get_time();
         time_till_next_ms = lv_timer_handler();
+        display_power.update((uint32_t)(esp_timer_get_time() - start));
         _lock_release(&lvgl_api_lock);
         // in case of triggering a WDT
         time_till_next_ms = MAX(time_till_next_ms, LVGL_TASK_MIN_DELAY_MS);
@@ -67,73 +131,82 @@ static void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px
     int offsety1 = area->y1;
     int offsety2 = area->y2;
 
-    // because SPI LCD is big-endian, we need to swap the RGB bytes order
-    lv_draw_sw_rgb565_swap(px_map, (offsetx2 + 1 - offsetx1) * (offsety2 + 1 - offsety1));
+    flush_start_us = esp_timer_get_time();
+    flush_orientation = atomic_load(&orientation);
 
-    // copy a buffer's content to a specific area of the display
+    // because SPI LCD is big-endian, we need to swap the RGB bytes order
+    uint32_t area_px = (offsetx2 + 1 - offsetx1) * (offsety2 + 1 - offsety1);
+    lv_draw_sw_rgb565_swap(px_map, area_px);
+    atomic_fetch_add(&flush_area_px, area_px);
+    atomic_fetch_add(&flush_count, 1);
+    flush_px = area_px;
+
+    // copy a buffer's content to a specific area of the display; the panel maps it
+    // through MADCTL, so every orientation is the same copy
     esp_lcd_panel_draw_bitmap(*lcd.handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, px_map);
 }
 
-static void uart_indev_read_cb(lv_indev_t *indev_driver, lv_indev_data_t *data)
+/* Report how much of the SPI link the flushes since the last call used */
+static int flush_cmd(int argc, char **argv)
 {
-    // Lets see if data is available
-    size_t len;
-    uart_get_buffered_data_len(UART_PORT_NUM, &len);
-
-    if (len > 0) {
-        // Great, data is available. Lets read the data and store it
-        uint8_t buf;
-        int read_len = uart_read_bytes(UART_PORT_NUM, &buf, 1, 10); // read just one byte
-    
-        if (read_len > 0) {
-            // Whew, we read one byte. Lets see what it was and map it to the appropriate
-            // LV key for the action
-            // Also, if its a valid key, let LVGL know that we pressed a key. 
-            switch (buf) {
-                case 'w': case 'W':
-                    ESP_LOGI(TAG, "w");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_PREV;
-                    break;
-                case 's': case 'S':
-                    ESP_LOGI(TAG, "s");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_NEXT;
-                    break;
-                case 'a': case 'A':
-                    ESP_LOGI(TAG, "a");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_LEFT;
-                    break;
-                case 'd': case 'D':
-                    ESP_LOGI(TAG, "d");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_RIGHT;
-                    break;
-                case '\r': case '\n':
-                    ESP_LOGI(TAG, "enter");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_ENTER;
-                    break;
-                case 27:
-                    ESP_LOGI(TAG, "esc");
-                    data->state = LV_INDEV_STATE_PRESSED;
-                    data->key = LV_KEY_ESC;
-                    break;
-                default:
-                    break;
-            }
-
-            // Set flag to tell LVGL there is more to read so
-            // we can call this function some more.
-            data->continue_reading = len > read_len;
-            return;
+    int64_t now = esp_timer_get_time();
+    int64_t window_us = now - flush_window_start_us;
+    uint32_t px = atomic_exchange(&flush_area_px, 0);
+    uint32_t flushes = atomic_exchange(&flush_count, 0);
+    flush_window_start_us = now;
+
+    // RGB565 on the wire; command and address bytes are small enough to leave out
+    uint64_t bits = (uint64_t)px * 16;
+    uint64_t capacity = (uint64_t)LCD_SPI_PCLK_HZ * window_us / 1000000;
+    uint32_t pct_x100 = capacity ? (uint32_t)(bits * 10000 / capacity) : 0;
+
+    printf("%" PRIu32 " flushes, %" PRIu32 " px in %" PRId64 " ms: %" PRIu32 ".%02" PRIu32
+           "%% of SPI bandwidth, budget %d%%%s\n",
+           flushes, px, window_us / 1000, pct_x100 / 100, pct_x100 % 100, GUI_SPI_BUDGET_PCT,
+           pct_x100 > GUI_SPI_BUDGET_PCT * 100 ? " (over)" : "");
+
+    for (int i = 0; i < GUI_ORIENTATIONS; i++) {
+        uint32_t us = atomic_exchange(&orient_flush_us[i], 0);
+        uint32_t o_px = atomic_exchange(&orient_flush_px[i], 0);
+        uint32_t n = atomic_exchange(&orient_flushes[i], 0);
+        if (n == 0) {
+            continue;
         }
+        printf("  %s: %" PRIu32 " flushes, %" PRIu32 " us/flush, %" PRIu32 " px/ms\n",
+               orientations[i].name, n, us / n, us ? (uint32_t)(o_px * 1000ULL / us) : 0);
+    }
+    return 0;
+}
+
+static int rotate_cmd(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("%s\n", orientations[atomic_load(&orientation)].name);
+        return 0;
     }
+    int o = atoi(argv[1]);
+    if (o < 0 || o >= GUI_ORIENTATIONS) {
+        printf("Orientation is 0-%d\n", GUI_ORIENTATIONS - 1);
+        return 1;
+    }
+    gui.set_orientation(o);
+    return 0;
+}
 
-    // Nothing left to read! Now this function can finally rest.
-    data->state = LV_INDEV_STATE_RELEASED;
-    return;
+/* Panel scan and LVGL resolution for an orientation; the caller holds the LVGL lock */
+static void apply_orientation(gui_orientation_t o)
+{
+    const orientation_def_t *def = &orientations[o];
+
+    // The panel IO queues the MADCTL write behind any pixels still on the bus
+    lcd.set_orientation(def->swap_xy, def->mirror_x, def->mirror_y);
+    if (def->swap_xy) {
+        lv_display_set_resolution(display, LCD_V_RES, LCD_H_RES);
+    } else {
+        lv_display_set_resolution(display, LCD_H_RES, LCD_V_RES);
+    }
+    atomic_store(&orientation, o);
+    ESP_LOGI(TAG, "Orientation %s", def->name);
 }
 
 /*********************************************************************
@@ -147,24 +220,29 @@ static void init() {
     ESP_LOGI(TAG, "Initalizing LVGL library");
     lv_init();
 
-    lv_display_t *display = lv_display_create(LCD_H_RES, LCD_V_RES);
+    display = lv_display_create(LCD_H_RES, LCD_V_RES);
 
+    // Draw buffers are held for the life of the display; in landscape the same bytes hold fewer, longer lines
     size_t draw_buffer_sz = LCD_H_RES * LVGL_DRAW_BUF_LINES * sizeof(lv_color16_t);
-    void *buf1 = spi_bus_dma_memory_alloc(LCD_SPI_HOST, draw_buffer_sz, 0);
-    void *buf2 = spi_bus_dma_memory_alloc(LCD_SPI_HOST, draw_buffer_sz, 0);
+    buf_block_t *buf1 = buf_pool.get(draw_buffer_sz, 0);
+    buf_block_t *buf2 = buf_pool.get(draw_buffer_sz, 0);
+    if (buf1 == NULL || buf2 == NULL) {
+        ESP_LOGE(TAG, "No draw buffers in the buffer pool");
+        return;
+    }
 
-    lv_display_set_buffers(display, buf1, buf2, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_set_buffers(display, buf1->data, buf2->data, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_PARTIAL);
     lv_display_set_user_data(display, lcd.handle);
 
     lv_display_set_color_format(display, LV_COLOR_FORMAT_RGB565);
     lv_display_set_flush_cb(display, lvgl_flush_cb);
+    apply_orientation(GUI_ORIENTATION_DEFAULT);
 
     ESP_LOGI(TAG, "Installing LVGL tick timer");
     const esp_timer_create_args_t lvgl_tick_timer_args = {
         .callback = &increase_lvgl_tick,
         .name = "lvgl_tick"
     };
-    esp_timer_handle_t lvgl_tick_timer = NULL;
     ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
     ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, LVGL_TICK_PERIOD_MS * 1000));
 
@@ -180,13 +258,42 @@ static void init() {
     lv_group_t *group = lv_group_create();
     lv_group_set_default(group);
 
-    lv_indev_t *uart_indev = lv_indev_create();
-    lv_indev_set_type(uart_indev, LV_INDEV_TYPE_KEYPAD);
-    lv_indev_set_read_cb(uart_indev, uart_indev_read_cb);
-    lv_indev_set_group(uart_indev, group);
-    lv_indev_enable(uart_indev, true);
+    uart_indev.create(display, group);
+    display_power.init(display);
 
     lcd.enable_panel(true);
+
+    flush_window_start_us = esp_timer_get_time();
+    const esp_console_cmd_t cmd = {
+        .command = "flush",
+        .help = "Show pixels flushed to the panel and the share of SPI bandwidth since the last call",
+        .hint = NULL,
+        .func = flush_cmd,
+    };
+    console.register_cmd(&cmd);
+
+    const esp_console_cmd_t rotate = {
+        .command = "rotate",
+        .help = "Show the display orientation, or set it: 0 portrait, 1 landscape, 2 and 3 flipped",
+        .hint = "[0-3]",
+        .func = rotate_cmd,
+    };
+    console.register_cmd(&rotate);
+}
+
+/*
+ * Turn the display a number of quarter turns. The panel does the rotation
+ * in its scan order, so LVGL renders at the new resolution and the flush
+ * stays a plain copy; the screens are built again for the new shape.
+ */
+static void set_orientation(gui_orientation_t o) {
+    if (o >= GUI_ORIENTATIONS || display == NULL) {
+        return;
+    }
+    _lock_acquire(&lvgl_api_lock);
+    apply_orientation(o);
+    screen_mgr.rebuild();
+    _lock_release(&lvgl_api_lock);
 }
 
 /*********************************************************************
@@ -194,7 +301,8 @@ static void init() {
  *********************************************************************/
 
  const struct Gui gui = {
-    .init = init
+    .init = init,
+    .set_orientation = set_orientation
  };
 
 
@@ -1,7 +1,17 @@
 #pragma once
 
+/* Quarter turns clockwise from the panel's native portrait */
+typedef enum {
+    GUI_ORIENTATION_PORTRAIT = 0,
+    GUI_ORIENTATION_LANDSCAPE,
+    GUI_ORIENTATION_PORTRAIT_FLIPPED,
+    GUI_ORIENTATION_LANDSCAPE_FLIPPED,
+    GUI_ORIENTATIONS,
+} gui_orientation_t;
+
 struct Gui {
     void (*init)(void);
+    void (*set_orientation)(gui_orientation_t orientation);
 };
 
 extern const struct Gui gui;
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "input_proto.h"
+
+#include <string.h>
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef enum {
+    STATE_IDLE = 0,
+    STATE_TYPE,
+    STATE_SEQ,
+    STATE_COUNT,
+    STATE_STEPS,
+    STATE_CRC,
+} parser_state_t;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint8_t crc8_update(uint8_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void put_u16(uint8_t *out, uint16_t v)
+{
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t v)
+{
+    put_u16(out, (uint16_t)v);
+    put_u16(out + 2, (uint16_t)(v >> 16));
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void input_proto_init(input_proto_parser_t *parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = STATE_IDLE;
+}
+
+/* Advance the frame parser by one received byte */
+input_proto_result_t input_proto_feed(input_proto_parser_t *parser, uint8_t byte)
+{
+    input_proto_batch_t *batch = &parser->batch;
+
+    switch (parser->state) {
+        case STATE_IDLE:
+            if (byte != INPUT_PROTO_SYNC) {
+                return INPUT_PROTO_NONE;
+            }
+            parser->state = STATE_TYPE;
+            return INPUT_PROTO_PENDING;
+
+        case STATE_TYPE:
+            // Anything but a batch header drops back to plain key input
+            parser->state = (byte == INPUT_PROTO_TYPE_BATCH) ? STATE_SEQ : STATE_IDLE;
+            parser->crc = 0;
+            return parser->state == STATE_SEQ ? INPUT_PROTO_PENDING : INPUT_PROTO_NONE;
+
+        case STATE_SEQ:
+            batch->seq = byte;
+            parser->crc = crc8_update(parser->crc, byte);
+            parser->state = STATE_COUNT;
+            return INPUT_PROTO_PENDING;
+
+        case STATE_COUNT:
+            parser->crc = crc8_update(parser->crc, byte);
+            if (byte > INPUT_PROTO_MAX_STEPS) {
+                parser->state = STATE_IDLE;
+                return INPUT_PROTO_BAD_CRC;
+            }
+            batch->count = byte;
+            parser->pos = 0;
+            parser->state = byte ? STATE_STEPS : STATE_CRC;
+            return INPUT_PROTO_PENDING;
+
+        case STATE_STEPS: {
+            parser->crc = crc8_update(parser->crc, byte);
+            parser->step_bytes[parser->pos % 4] = byte;
+            parser->pos++;
+            if (parser->pos % 4 == 0) {
+                input_proto_step_t *step = &batch->steps[parser->pos / 4 - 1];
+                step->key = parser->step_bytes[0];
+                step->repeat = parser->step_bytes[1];
+                step->delay_ms = (uint16_t)(parser->step_bytes[2] | parser->step_bytes[3] << 8);
+                if (parser->pos / 4 == batch->count) {
+                    parser->state = STATE_CRC;
+                }
+            }
+            return INPUT_PROTO_PENDING;
+        }
+
+        case STATE_CRC:
+            parser->state = STATE_IDLE;
+            return byte == parser->crc ? INPUT_PROTO_BATCH : INPUT_PROTO_BAD_CRC;
+
+        default:
+            parser->state = STATE_IDLE;
+            return INPUT_PROTO_NONE;
+    }
+}
+
+/* Serialize an ack frame, returns its length */
+size_t input_proto_encode_ack(const input_proto_ack_t *ack, uint8_t out[INPUT_PROTO_ACK_LEN])
+{
+    uint8_t crc = 0;
+
+    out[0] = INPUT_PROTO_SYNC;
+    out[1] = INPUT_PROTO_TYPE_ACK;
+    out[2] = ack->seq;
+    out[3] = ack->status;
+    put_u16(&out[4], ack->keys);
+    put_u32(&out[6], ack->process_us);
+    put_u32(&out[10], ack->render_us);
+    for (int i = 2; i < INPUT_PROTO_ACK_LEN - 1; i++) {
+        crc = crc8_update(crc, out[i]);
+    }
+    out[INPUT_PROTO_ACK_LEN - 1] = crc;
+    return INPUT_PROTO_ACK_LEN;
+}
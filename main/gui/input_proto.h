@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Framed binary input for scripted UI stress tests, sharing the keypad
+ * UART with interactive keys. 0xA5 never appears in typed input, so a
+ * frame can always be told apart from WASD and ':' commands.
+ *
+ * Batch (host -> device):
+ *   A5 5A | seq u8 | count u8 | count x { key u8, repeat u8, delay_ms u16le } | crc8
+ * Ack (device -> host), sent once the batch's last key has been rendered:
+ *   A5 5B | seq u8 | status u8 | keys u16le | process_us u32le | render_us u32le | crc8
+ *
+ * Keys use the same ASCII codes as interactive input. delay_ms is the wait
+ * before a step relative to the previous one. The CRC-8 (poly 0x07) covers
+ * everything between the sync bytes and the CRC.
+ */
+
+#define INPUT_PROTO_SYNC 0xA5
+#define INPUT_PROTO_TYPE_BATCH 0x5A
+#define INPUT_PROTO_TYPE_ACK 0x5B
+
+#define INPUT_PROTO_MAX_STEPS 32
+#define INPUT_PROTO_ACK_LEN 15
+
+typedef enum {
+    INPUT_PROTO_NONE = 0,           /* byte is not part of a frame */
+    INPUT_PROTO_PENDING,            /* byte consumed, frame incomplete */
+    INPUT_PROTO_BATCH,              /* byte completed a valid batch */
+    INPUT_PROTO_BAD_CRC,            /* byte completed a corrupt batch */
+} input_proto_result_t;
+
+typedef enum {
+    INPUT_PROTO_STATUS_OK = 0,
+    INPUT_PROTO_STATUS_BAD_CRC,
+    INPUT_PROTO_STATUS_BUSY,
+} input_proto_status_t;
+
+typedef struct {
+    uint8_t key;
+    uint8_t repeat;
+    uint16_t delay_ms;
+} input_proto_step_t;
+
+typedef struct {
+    uint8_t seq;
+    uint8_t count;
+    input_proto_step_t steps[INPUT_PROTO_MAX_STEPS];
+} input_proto_batch_t;
+
+typedef struct {
+    uint8_t seq;
+    uint8_t status;
+    uint16_t keys;
+    uint32_t process_us;
+    uint32_t render_us;
+} input_proto_ack_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t crc;
+    uint16_t pos;
+    uint8_t step_bytes[4];
+    input_proto_batch_t batch;
+} input_proto_parser_t;
+
+void input_proto_init(input_proto_parser_t *parser);
+input_proto_result_t input_proto_feed(input_proto_parser_t *parser, uint8_t byte);
+size_t input_proto_encode_ack(const input_proto_ack_t *ack, uint8_t out[INPUT_PROTO_ACK_LEN]);
@@ -0,0 +1,372 @@
+#include "player_screen.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "player.h"
+#include "play_order.h"
+#include "screen_mgr.h"
+#include "spectrum_view.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef enum {
+    STATUS_NONE = 0,
+    STATUS_STOPPED,
+    STATUS_PLAYING,
+    STATUS_PAUSED,
+} status_t;
+
+/* A row of one-character labels of equal width, so a tick redraws only the digits that changed */
+typedef struct {
+    lv_obj_t *cells[PLAYER_TIME_CELLS];
+    char shown[PLAYER_TIME_CELLS];
+} time_row_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "PLAYER SCREEN";
+
+static lv_obj_t *screen;
+static lv_obj_t *title_label;
+static lv_obj_t *artist_label;
+static lv_obj_t *status_label;
+static lv_obj_t *bar;
+static time_row_t elapsed_row;
+static time_row_t remaining_row;
+
+static uint32_t shown_seq = UINT32_MAX;
+static status_t shown_status;
+static uint32_t shown_elapsed_s = UINT32_MAX;
+static uint32_t shown_remaining_s = UINT32_MAX;
+static int32_t bar_px;          /* filled columns currently on the panel */
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* Widest digit of the font; every cell gets this width so no digit moves its neighbours */
+static int32_t digit_cell_width(const lv_font_t *font)
+{
+    int32_t width = 0;
+
+    for (char c = '0'; c <= '9'; c++) {
+        int32_t w = lv_font_get_glyph_width(font, c, 0);
+        if (w > width) {
+            width = w;
+        }
+    }
+    return width;
+}
+
+static void create_time_row(time_row_t *row, int32_t x, int32_t y, int32_t cell_w, int32_t cell_h)
+{
+    for (int i = 0; i < PLAYER_TIME_CELLS; i++) {
+        lv_obj_t *cell = lv_label_create(screen);
+        lv_obj_set_pos(cell, x + i * cell_w, y);
+        lv_obj_set_size(cell, cell_w, cell_h);
+        lv_obj_set_style_text_align(cell, LV_TEXT_ALIGN_CENTER, 0);
+        lv_label_set_text_static(cell, "");
+        row->cells[i] = cell;
+        row->shown[i] = '\0';
+    }
+}
+
+/* Write text into the row, touching only the cells whose character changed */
+static void set_time_row(time_row_t *row, const char *text)
+{
+    size_t len = strlen(text);
+
+    for (int i = 0; i < PLAYER_TIME_CELLS; i++) {
+        char glyph[2] = { i < (int)len ? text[i] : ' ', '\0' };
+        if (row->shown[i] == glyph[0]) {
+            continue;
+        }
+        row->shown[i] = glyph[0];
+        lv_label_set_text(row->cells[i], glyph);
+    }
+}
+
+static void format_time(char *buf, size_t len, const char *sign, uint32_t seconds)
+{
+    uint32_t minutes = seconds / 60;
+
+    if (minutes > 99) {
+        minutes = 99;
+        seconds = 59;
+    }
+    lv_snprintf(buf, len, "%s%02u:%02u", sign, (unsigned)minutes, (unsigned)(seconds % 60));
+}
+
+/* Redraw only the columns between the old and new fill position */
+static void set_bar_px(int32_t px)
+{
+    lv_area_t area;
+
+    if (px == bar_px) {
+        return;
+    }
+    lv_obj_get_coords(bar, &area);
+    int32_t x1 = area.x1;
+    area.x1 = x1 + LV_MIN(px, bar_px);
+    area.x2 = x1 + LV_MAX(px, bar_px) - 1;
+    bar_px = px;
+    lv_obj_invalidate_area(bar, &area);
+}
+
+static void bar_draw_cb(lv_event_t *e)
+{
+    lv_obj_t *obj = lv_event_get_target_obj(e);
+    lv_layer_t *layer = lv_event_get_layer(e);
+    lv_draw_rect_dsc_t dsc;
+    lv_area_t coords;
+    lv_area_t part;
+
+    lv_obj_get_coords(obj, &coords);
+    lv_draw_rect_dsc_init(&dsc);
+
+    part = coords;
+    part.x2 = coords.x1 + bar_px - 1;
+    if (part.x2 >= part.x1) {
+        dsc.bg_color = lv_theme_get_color_primary(obj);
+        lv_draw_rect(layer, &dsc, &part);
+    }
+
+    part.x1 = coords.x1 + bar_px;
+    part.x2 = coords.x2;
+    if (part.x2 >= part.x1) {
+        dsc.bg_color = lv_palette_lighten(LV_PALETTE_GREY, 2);
+        lv_draw_rect(layer, &dsc, &part);
+    }
+}
+
+static void set_status(status_t status)
+{
+    if (status == shown_status) {
+        return;
+    }
+    shown_status = status;
+    switch (status) {
+        case STATUS_PLAYING:
+            lv_label_set_text_static(status_label, LV_SYMBOL_PLAY);
+            break;
+        case STATUS_PAUSED:
+            lv_label_set_text_static(status_label, LV_SYMBOL_PAUSE);
+            break;
+        default:
+            lv_label_set_text_static(status_label, "Nothing playing");
+            break;
+    }
+}
+
+/*
+ * Bring the screen up to date with the player. Every element compares
+ * against what it last drew and is left alone when unchanged, so a
+ * playing screen only redraws a digit or two and a few bar columns each
+ * second.
+ */
+static void refresh(void)
+{
+    player_state_t state;
+    char text[PLAYER_TIME_CELLS + 1];
+
+    player.get(&state);
+
+    if (state.track_seq != shown_seq) {
+        shown_seq = state.track_seq;
+        lv_label_set_text(title_label, state.active ? state.title : "");
+        lv_label_set_text(artist_label, state.active ? state.artist : "");
+        shown_elapsed_s = UINT32_MAX;
+        shown_remaining_s = UINT32_MAX;
+    }
+    set_status(!state.active ? STATUS_STOPPED : state.playing ? STATUS_PLAYING : STATUS_PAUSED);
+
+    uint32_t elapsed_s = state.position_ms / 1000;
+    if (elapsed_s != shown_elapsed_s) {
+        shown_elapsed_s = elapsed_s;
+        format_time(text, sizeof(text), "", elapsed_s);
+        set_time_row(&elapsed_row, state.active ? text : "");
+    }
+
+    // Counted from the same whole second as elapsed, so both rows tick together
+    uint32_t duration_s = state.duration_ms / 1000;
+    uint32_t remaining_s = duration_s > elapsed_s ? duration_s - elapsed_s : 0;
+    if (remaining_s != shown_remaining_s) {
+        shown_remaining_s = remaining_s;
+        format_time(text, sizeof(text), "-", remaining_s);
+        set_time_row(&remaining_row, state.active && state.duration_ms ? text : "");
+    }
+
+    // From the whole seconds shown, so a short track's bar still moves at most once a second
+    int32_t px = 0;
+    if (state.active && state.duration_ms) {
+        px = (int32_t)((uint64_t)elapsed_s * 1000 * lv_obj_get_width(bar) / state.duration_ms);
+    }
+    set_bar_px(px);
+}
+
+static void update_timer_cb(lv_timer_t *timer)
+{
+    if (lv_screen_active() == screen) {
+        refresh();
+    }
+}
+
+/*
+ * Left and right walk the play order. Left first goes back to the start of
+ * the track when it is further in than PLAYER_PREV_RESTART_MS. A Bluetooth
+ * stream is not in the order and ignores both.
+ */
+static void skip_key(bool forward)
+{
+    player_state_t state;
+
+    player.get(&state);
+    if (state.active && state.track == PLAYER_TRACK_STREAM) {
+        return;
+    }
+    if (forward) {
+        play_order.next();
+    } else if (state.active && state.position_ms > PLAYER_PREV_RESTART_MS) {
+        player.seek(-(int32_t)state.position_ms);
+    } else {
+        play_order.prev();
+    }
+}
+
+static void key_event_cb(lv_event_t *e)
+{
+    switch (lv_event_get_key(e)) {
+        case LV_KEY_ESC:
+            screen_mgr.pop();
+            return;
+        case LV_KEY_ENTER:
+            player.toggle();
+            break;
+        case LV_KEY_LEFT:
+            skip_key(false);
+            break;
+        case LV_KEY_RIGHT:
+            skip_key(true);
+            break;
+        default:
+            return;
+    }
+    refresh();
+}
+
+static void reset_shown(void)
+{
+    shown_seq = UINT32_MAX;
+    shown_status = STATUS_NONE;
+    shown_elapsed_s = UINT32_MAX;
+    shown_remaining_s = UINT32_MAX;
+    bar_px = 0;
+}
+
+static void screen_loaded_cb(lv_event_t *e)
+{
+    refresh();
+}
+
+/*
+ * Deleted by the screen manager; the next build starts from a blank slate.
+ * The delete is asynchronous, so the screen may have been built again in
+ * the meantime: then only this tree's own timer goes and the statics stay
+ * with the new one.
+ */
+static void screen_delete_cb(lv_event_t *e)
+{
+    lv_timer_delete(lv_event_get_user_data(e));
+    if (lv_event_get_target_obj(e) != screen) {
+        return;
+    }
+    screen = NULL;
+    reset_shown();
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/*
+ * Build the now-playing screen: title, artist, the spectrum, a progress
+ * bar drawn by hand and elapsed/remaining time in fixed-width digit cells.
+ * Apart from the spectrum nothing on it animates; a PLAYER_SCREEN_UPDATE_MS
+ * timer polls the player and redraws only what changed. Keys: esc goes
+ * back, enter pauses, left/right go to the previous/next track.
+ */
+static lv_obj_t *create(lv_group_t *group) {
+    screen = lv_obj_create(NULL);
+    int32_t hor_res = lv_disp_get_hor_res(NULL);
+    int32_t ver_res = lv_disp_get_ver_res(NULL);
+    lv_obj_set_size(screen, hor_res, ver_res);
+    lv_obj_remove_flag(screen, LV_OBJ_FLAG_SCROLLABLE);
+
+    // Same column in every orientation; landscape only has less height to spend
+    int32_t raise = hor_res > ver_res ? PLAYER_LANDSCAPE_RAISE : 0;
+    int32_t width = hor_res - 2 * PLAYER_SCREEN_MARGIN;
+    const lv_font_t *font = lv_obj_get_style_text_font(screen, LV_PART_MAIN);
+    int32_t line_h = lv_font_get_line_height(font);
+
+    title_label = lv_label_create(screen);
+    lv_obj_set_pos(title_label, PLAYER_SCREEN_MARGIN, PLAYER_TITLE_Y - raise);
+    lv_obj_set_size(title_label, width, line_h);
+    lv_obj_set_style_text_align(title_label, LV_TEXT_ALIGN_CENTER, 0);
+    // Dots instead of scrolling: a scrolling title would repaint its whole row every frame
+    lv_label_set_long_mode(title_label, LV_LABEL_LONG_MODE_DOTS);
+
+    artist_label = lv_label_create(screen);
+    lv_obj_set_pos(artist_label, PLAYER_SCREEN_MARGIN, PLAYER_TITLE_Y + PLAYER_LINE_SPACING - raise);
+    lv_obj_set_size(artist_label, width, line_h);
+    lv_obj_set_style_text_align(artist_label, LV_TEXT_ALIGN_CENTER, 0);
+    lv_label_set_long_mode(artist_label, LV_LABEL_LONG_MODE_DOTS);
+
+    spectrum_view.create(screen, PLAYER_SCREEN_MARGIN, PLAYER_SPECTRUM_Y - raise, width, PLAYER_SPECTRUM_HEIGHT);
+
+    bar = lv_obj_create(screen);
+    lv_obj_remove_style_all(bar);
+    lv_obj_set_pos(bar, PLAYER_SCREEN_MARGIN, PLAYER_BAR_Y - raise);
+    lv_obj_set_size(bar, width, PLAYER_BAR_HEIGHT);
+    lv_obj_add_event_cb(bar, bar_draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+    lv_obj_add_event_cb(bar, key_event_cb, LV_EVENT_KEY, NULL);
+
+    int32_t cell_w = digit_cell_width(font);
+    int32_t time_y = PLAYER_BAR_Y - raise + PLAYER_BAR_HEIGHT + PLAYER_SCREEN_MARGIN;
+    create_time_row(&elapsed_row, PLAYER_SCREEN_MARGIN, time_y, cell_w, line_h);
+    create_time_row(&remaining_row, hor_res - PLAYER_SCREEN_MARGIN - PLAYER_TIME_CELLS * cell_w,
+                    time_y, cell_w, line_h);
+
+    status_label = lv_label_create(screen);
+    lv_obj_set_width(status_label, width);
+    lv_obj_set_pos(status_label, PLAYER_SCREEN_MARGIN, time_y + line_h + PLAYER_LINE_SPACING);
+    lv_obj_set_style_text_align(status_label, LV_TEXT_ALIGN_CENTER, 0);
+
+    // The bar takes the keys; it has no focus style, so focusing it draws nothing
+    lv_group_add_obj(group, bar);
+
+    lv_obj_add_event_cb(screen, screen_loaded_cb, LV_EVENT_SCREEN_LOADED, NULL);
+    reset_shown();
+    refresh();
+    lv_timer_t *update_timer = lv_timer_create(update_timer_cb, PLAYER_SCREEN_UPDATE_MS, NULL);
+    lv_obj_add_event_cb(screen, screen_delete_cb, LV_EVENT_DELETE, update_timer);
+
+    ESP_LOGI(TAG, "Player screen ready, digit cells %" PRId32 "x%" PRId32 " px", cell_w, line_h);
+    return screen;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct PlayerScreen player_screen = {
+    .create = create
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "lvgl.h"
+
+struct PlayerScreen {
+    lv_obj_t *(*create)(lv_group_t *group);
+};
+
+extern const struct PlayerScreen player_screen;
@@ -0,0 +1,279 @@
+#include "screen_mgr.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    lv_obj_t *screen;
+    lv_group_t *group;
+    uint32_t last_shown;        /* navigation count when it was last on top */
+    screen_stats_t stats;
+} screen_slot_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SCREEN MGR";
+
+static const screen_def_t *defs;
+static screen_slot_t slots[SCREEN_COUNT];
+static screen_id_t stack[SCREEN_STACK_DEPTH];
+static int depth;
+static uint32_t navigations;
+
+/* LVGL heap as of the last navigation, for the console, which runs outside the LVGL task */
+static lv_mem_monitor_t heap;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint64_t now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static uint32_t heap_used(void)
+{
+    lv_mem_monitor_t mon;
+    lv_mem_monitor(&mon);
+    return mon.total_size - mon.free_size;
+}
+
+static void build(screen_id_t id)
+{
+    screen_slot_t *slot = &slots[id];
+    uint32_t used = heap_used();
+    uint64_t start = now_us();
+
+    slot->group = lv_group_create();
+    slot->screen = defs[id].build(slot->group);
+
+    uint32_t us = (uint32_t)(now_us() - start);
+    uint32_t after = heap_used();
+    slot->stats.built = true;
+    slot->stats.builds++;
+    slot->stats.build_us_last = us;
+    if (us > slot->stats.build_us_max) {
+        slot->stats.build_us_max = us;
+    }
+    slot->stats.heap_bytes = after > used ? after - used : 0;
+    ESP_LOGI(TAG, "Built %s in %" PRIu32 " us, %" PRIu32 " B of LVGL heap", defs[id].name, us,
+             slot->stats.heap_bytes);
+}
+
+static void delete_group_cb(void *group)
+{
+    lv_group_delete(group);
+}
+
+/*
+ * Drop a screen's tree. The caller may be an event handler of one of its
+ * objects, so the tree and its group go away on the next timer pass,
+ * unless now says the caller is outside the tree.
+ */
+static void destroy(screen_id_t id, bool now)
+{
+    screen_slot_t *slot = &slots[id];
+
+    if (now) {
+        lv_obj_delete(slot->screen);
+        lv_group_delete(slot->group);
+    } else {
+        lv_obj_delete_async(slot->screen);
+        lv_async_call(delete_group_cb, slot->group);
+    }
+    slot->screen = NULL;
+    slot->group = NULL;
+    slot->stats.built = false;
+    ESP_LOGI(TAG, "Destroyed %s, %" PRIu32 " B back to the LVGL heap", defs[id].name, slot->stats.heap_bytes);
+}
+
+/*
+ * Destroy the screens that are off the stack: uncacheable ones straight
+ * away, cached ones least recently shown first until the rest fit under
+ * SCREEN_CACHE_MAX_BYTES.
+ */
+static void trim_cache(void)
+{
+    for (int i = 0; i < SCREEN_COUNT; i++) {
+        if (slots[i].stats.built && !slots[i].stats.on_stack && !defs[i].cacheable) {
+            destroy(i, false);
+        }
+    }
+
+    while (true) {
+        uint32_t cached = 0;
+        int oldest = -1;
+        for (int i = 0; i < SCREEN_COUNT; i++) {
+            screen_slot_t *slot = &slots[i];
+            if (!slot->stats.built || slot->stats.on_stack) {
+                continue;
+            }
+            cached += slot->stats.heap_bytes;
+            if (oldest < 0 || slot->last_shown < slots[oldest].last_shown) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0 || cached <= SCREEN_CACHE_MAX_BYTES) {
+            return;
+        }
+        destroy(oldest, false);
+    }
+}
+
+/* Load the top of the stack and point the keypad at its group */
+static void show_top(void)
+{
+    screen_id_t id = stack[depth - 1];
+    screen_slot_t *slot = &slots[id];
+
+    if (!slot->stats.built) {
+        build(id);
+    }
+    slot->last_shown = ++navigations;
+
+    lv_indev_t *indev = NULL;
+    while ((indev = lv_indev_get_next(indev)) != NULL) {
+        if (lv_indev_get_type(indev) == LV_INDEV_TYPE_KEYPAD) {
+            lv_indev_set_group(indev, slot->group);
+        }
+    }
+    lv_screen_load(slot->screen);
+
+    trim_cache();
+    lv_mem_monitor(&heap);
+}
+
+static void back_key_cb(lv_event_t *e)
+{
+    if (lv_event_get_key(e) == LV_KEY_ESC) {
+        screen_mgr.pop();
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int screens_cmd(int argc, char **argv)
+{
+    for (int i = 0; i < SCREEN_COUNT; i++) {
+        screen_stats_t *s = &slots[i].stats;
+        printf("%-10s %-8s builds %" PRIu32 ", last %" PRIu32 " us, max %" PRIu32 " us, %" PRIu32 " B\n",
+               defs[i].name, s->on_stack ? "shown" : s->built ? "cached" : "-", s->builds,
+               s->build_us_last, s->build_us_max, s->heap_bytes);
+    }
+    printf("LVGL heap: %" PRIu32 " of %" PRIu32 " B used, peak %" PRIu32 " B, %u%% fragmented\n",
+           heap.total_size - heap.free_size, heap.total_size, heap.max_used, heap.frag_pct);
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Take the screen table and register the "screens" console command; builds nothing yet */
+static void init(const screen_def_t screen_defs[SCREEN_COUNT]) {
+    defs = screen_defs;
+
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "screens",
+        .help = "Show which screens are built, their build time and LVGL heap use",
+        .hint = NULL,
+        .func = screens_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+}
+
+/* Go back one screen; the bottom screen stays */
+static void pop(void) {
+    if (depth <= 1) {
+        return;
+    }
+    screen_id_t leaving = stack[--depth];
+    slots[leaving].stats.on_stack = false;
+    show_top();
+}
+
+/* Show a screen on top of the stack; a screen already on it is returned to instead */
+static void push(screen_id_t id) {
+    for (int i = 0; i < depth; i++) {
+        if (stack[i] == id) {
+            while (depth > i + 1) {
+                pop();
+            }
+            return;
+        }
+    }
+    if (depth == SCREEN_STACK_DEPTH) {
+        ESP_LOGW(TAG, "Navigation stack full, not showing %s", defs[id].name);
+        return;
+    }
+    stack[depth++] = id;
+    slots[id].stats.on_stack = true;
+    show_top();
+}
+
+/*
+ * Drop every built screen and build the top of the stack again, for a
+ * display whose resolution changed under the layouts. The rest of the
+ * stack is rebuilt as it is returned to. The old trees go at once, so
+ * screens that keep their objects in statics are clear before they are
+ * built again; not to be called from an event of a screen.
+ */
+static void rebuild(void) {
+    for (int i = 0; i < SCREEN_COUNT; i++) {
+        if (slots[i].stats.built) {
+            destroy(i, true);
+        }
+    }
+    if (depth > 0) {
+        show_top();
+    }
+}
+
+/* Make esc on obj go back, for controls that have no other use for it */
+static void bind_back(lv_obj_t *obj) {
+    lv_obj_add_event_cb(obj, back_key_cb, LV_EVENT_KEY, NULL);
+}
+
+static void get_stats(screen_id_t id, screen_stats_t *stats) {
+    *stats = slots[id].stats;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct ScreenMgr screen_mgr = {
+    .init = init,
+    .push = push,
+    .pop = pop,
+    .rebuild = rebuild,
+    .bind_back = bind_back,
+    .get_stats = get_stats
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+typedef enum {
+    SCREEN_MENU = 0,
+    SCREEN_BLUETOOTH,
+    SCREEN_SEARCH,
+    SCREEN_PLAYER,
+    SCREEN_COUNT
+} screen_id_t;
+
+typedef struct {
+    const char *name;
+    /* Build the screen's tree, adding its controls to group; returns the screen object */
+    lv_obj_t *(*build)(lv_group_t *group);
+    /* Keep the tree after it leaves the stack, as long as the cache stays under SCREEN_CACHE_MAX_BYTES */
+    bool cacheable;
+} screen_def_t;
+
+typedef struct {
+    bool built;
+    bool on_stack;
+    uint32_t builds;
+    uint32_t build_us_last;
+    uint32_t build_us_max;
+    uint32_t heap_bytes;        /* LVGL heap the last build took */
+} screen_stats_t;
+
+/*
+ * Navigation stack of screens built on demand. push() builds a screen the
+ * first time it is needed and hands it the keypad; pop() goes back and
+ * destroys the screen it leaves, unless it is cacheable and fits in the
+ * cache, where the least recently shown screens are dropped first.
+ * Screens must free what they own outside the tree (timers, pointers to
+ * their objects) from LV_EVENT_DELETE on the screen object. Call only from
+ * the LVGL task.
+ */
+struct ScreenMgr {
+    void (*init)(const screen_def_t defs[SCREEN_COUNT]);
+    void (*push)(screen_id_t id);
+    void (*pop)(void);
+    void (*rebuild)(void);
+    void (*bind_back)(lv_obj_t *obj);
+    void (*get_stats)(screen_id_t id, screen_stats_t *stats);
+};
+
+extern const struct ScreenMgr screen_mgr;
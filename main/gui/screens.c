@@ -1,19 +1,26 @@
 #include "screens.h"
 #include "lvgl.h"
 #include "bluetooth.h"
+#include "search_page.h"
+#include "player_screen.h"
+#include "play_order.h"
+#include "screen_mgr.h"
 #include "esp_log.h"
 
 #define TAG "screens"
 
 
-struct Screens screens;
-
-
 static lv_obj_t *create_menu_switch(lv_obj_t *page, const char *txt, void (*cb_func)(lv_event_t*), bool chk);
 static lv_obj_t *create_menu_item(lv_obj_t *page, const char *icon, const char *txt, bool selectable);
 
+// Group of the screen being built
 static lv_group_t *group;
-static lv_display_t *disp;
+// The Bluetooth screen is rebuilt on every visit, so its switch state lives here
+static bool bt_enabled;
+
+static void open_screen_event_handler(lv_event_t *e) {
+    screen_mgr.push((screen_id_t)(uintptr_t)lv_event_get_user_data(e));
+}
 
 static void bt_switch_event_handler(lv_event_t *e) {
     lv_event_code_t code = lv_event_get_code(e);
@@ -22,7 +29,8 @@ static void bt_switch_event_handler(lv_event_t *e) {
     if(code == LV_EVENT_VALUE_CHANGED) {
         // LV_UNUSED(obj);
         // ESP_LOGI(TAG, "State: %s\n", lv_obj_has_state(obj, LV_STATE_CHECKED) ? "On" : "Off");
-        if (lv_obj_has_state(obj, LV_STATE_CHECKED)) {
+        bt_enabled = lv_obj_has_state(obj, LV_STATE_CHECKED);
+        if (bt_enabled) {
         //bt_init();
             ESP_LOGI(TAG, "Enabling bluetooth");
             bt_enable(true);
@@ -34,6 +42,27 @@ static void bt_switch_event_handler(lv_event_t *e) {
     }
 }
 
+static void shuffle_switch_event_handler(lv_event_t *e) {
+    if (lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
+        bool on = lv_obj_has_state(lv_event_get_target_obj(e), LV_STATE_CHECKED);
+        ESP_LOGI(TAG, "Shuffle %s", on ? "on" : "off");
+        play_order.set_shuffle(on);
+    }
+}
+
+// The menu is built before the library loads the saved mode, so the switch catches up whenever it is shown
+static void sync_shuffle_event_handler(lv_event_t *e) {
+    lv_obj_t *sw = lv_event_get_user_data(e);
+    if (play_order.shuffle_enabled() != lv_obj_has_state(sw, LV_STATE_CHECKED)) {
+        lv_obj_set_state(sw, LV_STATE_CHECKED, play_order.shuffle_enabled());
+    }
+}
+
+static void reshuffle_event_handler(lv_event_t *e) {
+    ESP_LOGI(TAG, "Reshuffling");
+    play_order.reshuffle();
+}
+
 // static void file_explorer_event_handler(lv_event_t *e) {
 //     lv_event_code_t code = lv_event_get_code(e);
 //     lv_obj_t *obj = lv_event_get_target_obj(e);
@@ -76,11 +105,12 @@ static void bt_switch_event_handler(lv_event_t *e) {
 // }
 
 
-static void create_menu_screen() {
-    screens.menu = lv_obj_create(NULL);
-    lv_obj_set_size(screens.menu, 240, 320);
+// A screen holding a full-size lv_menu in the house colours
+static lv_obj_t *create_menu(lv_obj_t **screen) {
+    *screen = lv_obj_create(NULL);
+    lv_obj_set_size(*screen, lv_disp_get_hor_res(NULL), lv_disp_get_ver_res(NULL));
 
-    lv_obj_t *menu = lv_menu_create(screens.menu);
+    lv_obj_t *menu = lv_menu_create(*screen);
     lv_color_t bg_color = lv_obj_get_style_bg_color(menu, (lv_part_t)0);
     if(lv_color_brightness(bg_color) > 127) {
         lv_obj_set_style_bg_color(menu, lv_color_darken(lv_obj_get_style_bg_color(menu, (lv_part_t)0), 10), 0);
@@ -89,15 +119,53 @@ static void create_menu_screen() {
     }
     lv_obj_set_size(menu, lv_disp_get_hor_res(NULL), lv_disp_get_ver_res(NULL));
     lv_obj_center(menu);
+    return menu;
+}
+
+static lv_obj_t *create_open_item(lv_obj_t *section, const char *icon, const char *txt, screen_id_t id) {
+    lv_obj_t *cont = create_menu_item(section, icon, txt, true);
+    lv_obj_add_event_cb(cont, open_screen_event_handler, LV_EVENT_CLICKED, (void *)(uintptr_t)id);
+    return cont;
+}
+
+static lv_obj_t *build_menu_screen(lv_group_t *screen_group) {
+    lv_obj_t *screen;
+    group = screen_group;
+    lv_obj_t *menu = create_menu(&screen);
+
+    lv_obj_t *root_page = lv_menu_page_create(menu, NULL);
+    lv_obj_set_style_pad_hor(root_page, lv_obj_get_style_pad_left(lv_menu_get_main_header(menu), (lv_part_t)0), 0);
+    lv_obj_t *section = lv_menu_section_create(root_page);
+    create_open_item(section, LV_SYMBOL_SETTINGS, "Bluetooth", SCREEN_BLUETOOTH);
+    create_open_item(section, LV_SYMBOL_LIST, "Search", SCREEN_SEARCH);
+    create_open_item(section, LV_SYMBOL_AUDIO, "Now Playing", SCREEN_PLAYER);
+    lv_menu_separator_create(root_page);
+    section = lv_menu_section_create(root_page);
+    lv_obj_t *shuffle = create_menu_switch(section, "Shuffle", shuffle_switch_event_handler, play_order.shuffle_enabled());
+    lv_obj_add_event_cb(screen, sync_shuffle_event_handler, LV_EVENT_SCREEN_LOADED, lv_obj_get_child(shuffle, -1));
+    lv_obj_t *reshuffle = create_menu_item(section, LV_SYMBOL_SHUFFLE, "New shuffle order", true);
+    lv_obj_add_event_cb(reshuffle, reshuffle_event_handler, LV_EVENT_CLICKED, NULL);
 
-    lv_obj_t *cont;
+    lv_menu_set_page(menu, root_page);
+
+    // File explorer stuff
+    // lv_obj_t *file_explorer = lv_file_explorer_create(screen);
+    // lv_file_explorer_set_sort(file_explorer, LV_EXPLORER_SORT_KIND);
+    // lv_file_explorer_open_dir(file_explorer, "A:/");
+
+    return screen;
+}
+
+static lv_obj_t *build_bluetooth_screen(lv_group_t *screen_group) {
+    lv_obj_t *screen;
     lv_obj_t *section;
+    group = screen_group;
+    lv_obj_t *menu = create_menu(&screen);
 
-    // Create sub-pages
     lv_obj_t *bluetooth_page = lv_menu_page_create(menu, "Bluetooth");
     lv_obj_set_style_pad_hor(bluetooth_page, lv_obj_get_style_pad_left(lv_menu_get_main_header(menu), (lv_part_t)0),0);
     section = lv_menu_section_create(bluetooth_page);
-    create_menu_switch(section, "Enable Bluetooth", bt_switch_event_handler, false);
+    create_menu_switch(section, "Enable Bluetooth", bt_switch_event_handler, bt_enabled);
     lv_menu_separator_create(bluetooth_page);
     create_menu_item(bluetooth_page, NULL, "My Devices", false);
     section = lv_menu_section_create(bluetooth_page);
@@ -112,27 +180,39 @@ static void create_menu_screen() {
     create_menu_item(section, NULL, "Test3", true);
     create_menu_item(section, NULL, "Test4", true);
 
+    lv_menu_set_page(menu, bluetooth_page);
+    return screen;
+}
 
-    lv_obj_t *root_page = lv_menu_page_create(menu, NULL);
-    lv_obj_set_style_pad_hor(root_page, lv_obj_get_style_pad_left(lv_menu_get_main_header(menu), (lv_part_t)0), 0);
-    section = lv_menu_section_create(root_page);
-    cont = create_menu_item(section, LV_SYMBOL_SETTINGS, "Bluetooth", true);
-    lv_menu_set_load_page_event(menu, cont, bluetooth_page);
-
-    lv_menu_set_page(menu, root_page);
+static lv_obj_t *build_search_screen(lv_group_t *screen_group) {
+    lv_obj_t *screen;
+    group = screen_group;
+    lv_obj_t *menu = create_menu(&screen);
 
-    // File explorer stuff
-    // lv_obj_t *file_explorer = lv_file_explorer_create(screens.menu);
-    // lv_file_explorer_set_sort(file_explorer, LV_EXPLORER_SORT_KIND);
-    // lv_file_explorer_open_dir(file_explorer, "A:/");
+    lv_menu_set_page(menu, search_page.create(menu, screen_group));
+    return screen;
+}
 
+static lv_obj_t *build_player_screen(lv_group_t *screen_group) {
+    return player_screen.create(screen_group);
 }
 
+/*
+ * Every screen is built on first navigation. The menu, search and player
+ * are visited often enough to stay cached; the Bluetooth page is rare and
+ * is freed as soon as it is left.
+ */
+static const screen_def_t screen_defs[SCREEN_COUNT] = {
+    [SCREEN_MENU] = { "menu", build_menu_screen, true },
+    [SCREEN_BLUETOOTH] = { "bluetooth", build_bluetooth_screen, false },
+    [SCREEN_SEARCH] = { "search", build_search_screen, true },
+    [SCREEN_PLAYER] = { "player", build_player_screen, true },
+};
+
 
 void create_screens() {
-    group = lv_group_get_default();
-    disp = lv_disp_get_default();
-    create_menu_screen();
+    screen_mgr.init(screen_defs);
+    screen_mgr.push(SCREEN_MENU);
 }
 
 static lv_obj_t *create_menu_item(lv_obj_t *page, const char *icon, const char *txt, bool selectable) {
@@ -154,6 +234,7 @@ static lv_obj_t *create_menu_item(lv_obj_t *page, const char *icon, const char *
 
     if (selectable) {
         lv_group_add_obj(group, obj);
+        screen_mgr.bind_back(obj);
     }
 
     return obj;
@@ -165,6 +246,7 @@ static lv_obj_t *create_menu_switch(lv_obj_t *page, const char *txt, void (*cb_f
     lv_obj_t *sw = lv_switch_create(obj);
     lv_obj_add_state(sw, default_checked ? LV_STATE_CHECKED : LV_STATE_DEFAULT);
     lv_group_add_obj(group, sw);
+    screen_mgr.bind_back(sw);
 
     if (cb_func) {
         lv_obj_add_event_cb(sw, cb_func, LV_EVENT_ALL, NULL);
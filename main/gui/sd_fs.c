@@ -0,0 +1,267 @@
+#include "sd_fs.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "block_cache.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    block_cache_file_t file;
+    uint32_t pos;
+} sd_fs_file_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SD FS";
+
+static lv_fs_drv_t drv;
+static bool registered;
+static char root[SD_MAX_CHAR_SIZE];
+
+/* Card bytes at the end of the previous refresh; only the LVGL task touches it */
+static uint32_t frame_start_bytes;
+static atomic_uint frames;
+static atomic_uint frame_bytes_max;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+/* LVGL hands over the path after the letter, "/art/cover.png" for "S:/art/cover.png" */
+static bool full_path(char *out, size_t len, const char *path)
+{
+    int n = snprintf(out, len, "%s%s%s", root, path[0] == '/' ? "" : "/", path);
+    return n > 0 && (size_t)n < len;
+}
+
+static void *open_cb(lv_fs_drv_t *drv, const char *path, lv_fs_mode_t mode)
+{
+    char full[LIBRARY_MAX_PATH];
+    int flags = mode == LV_FS_MODE_RD ? O_RDONLY :
+                mode == LV_FS_MODE_WR ? O_WRONLY | O_CREAT | O_TRUNC : O_RDWR | O_CREAT;
+
+    if (!full_path(full, sizeof(full), path)) {
+        return NULL;
+    }
+    sd_fs_file_t *f = malloc(sizeof(*f));
+    if (f == NULL) {
+        return NULL;
+    }
+    if (!block_cache.open(&f->file, full, flags)) {
+        free(f);
+        return NULL;
+    }
+    f->pos = 0;
+    return f;
+}
+
+static lv_fs_res_t close_cb(lv_fs_drv_t *drv, void *file_p)
+{
+    sd_fs_file_t *f = file_p;
+
+    block_cache.close(&f->file);
+    free(f);
+    return LV_FS_RES_OK;
+}
+
+/* Short at the end of the file, which LVGL takes as EOF */
+static lv_fs_res_t read_cb(lv_fs_drv_t *drv, void *file_p, void *buf, uint32_t btr, uint32_t *br)
+{
+    sd_fs_file_t *f = file_p;
+
+    *br = block_cache.read(&f->file, f->pos, buf, btr);
+    f->pos += *br;
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t write_cb(lv_fs_drv_t *drv, void *file_p, const void *buf, uint32_t btw, uint32_t *bw)
+{
+    sd_fs_file_t *f = file_p;
+
+    *bw = block_cache.write(&f->file, f->pos, buf, btw);
+    f->pos += *bw;
+    return *bw == btw ? LV_FS_RES_OK : LV_FS_RES_HW_ERR;
+}
+
+static lv_fs_res_t seek_cb(lv_fs_drv_t *drv, void *file_p, uint32_t pos, lv_fs_whence_t whence)
+{
+    sd_fs_file_t *f = file_p;
+
+    switch (whence) {
+    case LV_FS_SEEK_SET:
+        f->pos = pos;
+        break;
+    case LV_FS_SEEK_CUR:
+        f->pos += pos;
+        break;
+    case LV_FS_SEEK_END:
+        f->pos = f->file.size + pos;
+        break;
+    default:
+        return LV_FS_RES_INV_PARAM;
+    }
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t tell_cb(lv_fs_drv_t *drv, void *file_p, uint32_t *pos_p)
+{
+    *pos_p = ((sd_fs_file_t *)file_p)->pos;
+    return LV_FS_RES_OK;
+}
+
+static void *dir_open_cb(lv_fs_drv_t *drv, const char *path)
+{
+    char full[LIBRARY_MAX_PATH];
+
+    if (!full_path(full, sizeof(full), path)) {
+        return NULL;
+    }
+    return opendir(full);
+}
+
+/* Directories come back as "/name", and "" ends the listing */
+static lv_fs_res_t dir_read_cb(lv_fs_drv_t *drv, void *rddir_p, char *fn, uint32_t fn_len)
+{
+    struct dirent *entry;
+
+    do {
+        entry = readdir(rddir_p);
+    } while (entry && (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0));
+
+    if (entry == NULL) {
+        fn[0] = '\0';
+    } else {
+        snprintf(fn, fn_len, "%s%s", entry->d_type == DT_DIR ? "/" : "", entry->d_name);
+    }
+    return LV_FS_RES_OK;
+}
+
+static lv_fs_res_t dir_close_cb(lv_fs_drv_t *drv, void *rddir_p)
+{
+    closedir(rddir_p);
+    return LV_FS_RES_OK;
+}
+
+/* Charge the card reads since the previous refresh to this one */
+static void refr_ready_cb(lv_event_t *e)
+{
+    uint32_t total = block_cache.card_bytes();
+
+    store_max(&frame_bytes_max, total - frame_start_bytes);
+    frame_start_bytes = total;
+    atomic_fetch_add(&frames, 1);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int fscache_cmd(int argc, char **argv)
+{
+    sd_fs_stats_t s;
+
+    sd_fs.take_stats(&s);
+    uint32_t lookups = s.cache.hits + s.cache.misses;
+    uint32_t hit_x100 = lookups ? (uint32_t)(s.cache.hits * 10000ULL / lookups) : 0;
+    printf("%" PRIu32 " lookups, %" PRIu32 ".%02" PRIu32 "%% hits, %" PRIu32 " read-ahead blocks used, %" PRIu32
+           " card reads; %" PRIu32 " B read for %" PRIu32 " B handed out\n",
+           lookups, hit_x100 / 100, hit_x100 % 100, s.cache.ahead_used, s.cache.card_reads, s.cache.bytes_in,
+           s.cache.bytes_out);
+    printf("%" PRIu32 " frames, %" PRIu32 " B/frame, max %" PRIu32 " B\n",
+           s.frames, s.frames ? s.cache.bytes_in / s.frames : 0, s.frame_bytes_max);
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* After gui.init(), so the refreshes of the default display are counted */
+static void init(void) {
+    if (registered) {
+        return;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    const char *dir = getenv(HOST_SD_ROOT_ENV);
+    if (dir == NULL) {
+        ESP_LOGW(TAG, "%s not set, no %c: drive", HOST_SD_ROOT_ENV, SD_FS_LETTER);
+        return;
+    }
+    snprintf(root, sizeof(root), "%s", dir);
+#else
+    snprintf(root, sizeof(root), "%s", SD_MOUNT_POINT);
+#endif
+    block_cache.init();
+
+    lv_fs_drv_init(&drv);
+    drv.letter = SD_FS_LETTER;
+    drv.open_cb = open_cb;
+    drv.close_cb = close_cb;
+    drv.read_cb = read_cb;
+    drv.write_cb = write_cb;
+    drv.seek_cb = seek_cb;
+    drv.tell_cb = tell_cb;
+    drv.dir_open_cb = dir_open_cb;
+    drv.dir_read_cb = dir_read_cb;
+    drv.dir_close_cb = dir_close_cb;
+    lv_fs_drv_register(&drv);
+    registered = true;
+
+    lv_display_t *display = lv_display_get_default();
+    if (display) {
+        frame_start_bytes = block_cache.card_bytes();
+        lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, NULL);
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "fscache",
+        .help = "Show the LVGL drive's block cache hit rate and card bytes per frame since the last call",
+        .hint = NULL,
+        .func = fscache_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+    // Debug only: the lv_fs_read bench kernel registers the drive while its JSON is being printed
+    ESP_LOGD(TAG, "%c: on %s", SD_FS_LETTER, root);
+}
+
+/* Copy and reset the counters */
+static void take_stats(sd_fs_stats_t *stats) {
+    block_cache.take_stats(&stats->cache);
+    stats->frames = atomic_exchange(&frames, 0);
+    stats->frame_bytes_max = atomic_exchange(&frame_bytes_max, 0);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct SdFs sd_fs = {
+    .init = init,
+    .take_stats = take_stats
+};
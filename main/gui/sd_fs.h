@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "block_cache.h"
+
+typedef struct {
+    block_cache_stats_t cache;
+    uint32_t frames;            /* display refreshes since the last take_stats */
+    uint32_t frame_bytes_max;   /* most read from the card during one of them */
+} sd_fs_stats_t;
+
+/*
+ * LVGL drive SD_FS_LETTER over SD_MOUNT_POINT, or over the directory in
+ * HOST_SD_ROOT_ENV on the host, so "S:/art/cover.png" opens
+ * /sdcard/art/cover.png. File reads go through the block cache instead of
+ * a FATFS read per small request. Bytes read from the card are also
+ * counted per refresh of the default display.
+ */
+struct SdFs {
+    void (*init)(void);
+    void (*take_stats)(sd_fs_stats_t *stats);
+};
+
+extern const struct SdFs sd_fs;
@@ -0,0 +1,176 @@
+#include "search_page.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "search.h"
+#include "play_order.h"
+#include "screen_mgr.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SEARCH PAGE";
+
+static const char charset[] = SEARCH_PAGE_CHARSET;
+static const char *field_icons[] = { LV_SYMBOL_AUDIO, LV_SYMBOL_DIRECTORY, LV_SYMBOL_LIST };
+
+static lv_obj_t *query_label;
+static lv_obj_t *status_label;
+static lv_obj_t *items[SEARCH_PAGE_RESULTS];
+static lv_obj_t *item_labels[SEARCH_PAGE_RESULTS];
+
+static search_result_t results[SEARCH_PAGE_RESULTS];
+static char query[SEARCH_MAX_KEY + 1];
+static size_t query_len;
+static size_t pick;             /* charset position offered for the next character */
+static bool index_tried;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* Opened on first use, the card is mounted after the UI is built */
+static void ensure_index(void)
+{
+    char path[SD_MAX_CHAR_SIZE];
+
+    if (index_tried) {
+        return;
+    }
+    index_tried = true;
+#if CONFIG_IDF_TARGET_LINUX
+    const char *root = getenv(HOST_SD_ROOT_ENV);
+    if (root == NULL) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s", root, SEARCH_INDEX_NAME);
+#else
+    snprintf(path, sizeof(path), "%s", SEARCH_INDEX_FILE);
+#endif
+    if (!search.open(path)) {
+        ESP_LOGW(TAG, "Search unavailable, no index at %s", path);
+    }
+}
+
+static void update_query_label(void)
+{
+    lv_label_set_text_fmt(query_label, "%s[%c]", query, charset[pick]);
+}
+
+/* Re-run the query and reuse the fixed result rows, hiding the unused ones */
+static void update_results(void)
+{
+    int found = search.query(query, results, SEARCH_PAGE_RESULTS);
+
+    for (int i = 0; i < SEARCH_PAGE_RESULTS; i++) {
+        if (i < found) {
+            lv_label_set_text_fmt(item_labels[i], "%s %s", field_icons[results[i].field % 3], results[i].text);
+            lv_obj_remove_flag(items[i], LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_obj_add_flag(items[i], LV_OBJ_FLAG_HIDDEN);
+        }
+    }
+
+    if (!search.is_open()) {
+        lv_label_set_text(status_label, "No search index on card");
+    } else if (query_len == 0) {
+        lv_label_set_text(status_label, "Left/right pick, enter adds, esc deletes");
+    } else if (found == 0) {
+        lv_label_set_text(status_label, "No matches");
+    } else {
+        lv_label_set_text_fmt(status_label, "%d%s matches", found, found == SEARCH_PAGE_RESULTS ? "+" : "");
+    }
+}
+
+static void query_event_cb(lv_event_t *e)
+{
+    lv_event_code_t code = lv_event_get_code(e);
+    size_t charset_len = sizeof(charset) - 1;
+
+    if (code == LV_EVENT_FOCUSED) {
+        ensure_index();
+        update_results();
+    } else if (code == LV_EVENT_KEY) {
+        uint32_t key = lv_event_get_key(e);
+        if (key == LV_KEY_RIGHT) {
+            pick = (pick + 1) % charset_len;
+        } else if (key == LV_KEY_LEFT) {
+            pick = (pick + charset_len - 1) % charset_len;
+        } else if (key == LV_KEY_ESC && query_len > 0) {
+            query[--query_len] = '\0';
+            update_results();
+        } else if (key == LV_KEY_ESC) {
+            screen_mgr.pop();
+            return;
+        }
+        update_query_label();
+    } else if (code == LV_EVENT_CLICKED && query_len < SEARCH_MAX_KEY) {
+        query[query_len++] = charset[pick];
+        query[query_len] = '\0';
+        update_query_label();
+        update_results();
+    }
+}
+
+static void result_event_cb(lv_event_t *e)
+{
+    int i = (int)(uintptr_t)lv_event_get_user_data(e);
+
+    ESP_LOGI(TAG, "Playing track %" PRIu32 " (%s)", results[i].track, results[i].text);
+    // Tags from the scanner when it has been this far; until then a title match stands in,
+    // while an artist or album match would not be a title, so the file name does
+    const char *title = results[i].field == SEARCH_FIELD_TITLE ? results[i].text : NULL;
+    play_order.play_track(results[i].track, title);
+    screen_mgr.push(SCREEN_PLAYER);
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Build the search page: the query being typed, a status line and the result rows */
+static lv_obj_t *create(lv_obj_t *menu, lv_group_t *group) {
+    lv_obj_t *page = lv_menu_page_create(menu, "Search");
+    lv_obj_set_style_pad_hor(page, lv_obj_get_style_pad_left(lv_menu_get_main_header(menu), (lv_part_t)0), 0);
+
+    lv_obj_t *section = lv_menu_section_create(page);
+    lv_obj_t *query_box = lv_menu_cont_create(section);
+    query_label = lv_label_create(query_box);
+    lv_label_set_long_mode(query_label, LV_LABEL_LONG_MODE_SCROLL_CIRCULAR);
+    lv_obj_set_flex_grow(query_label, 1);
+    lv_obj_add_event_cb(query_box, query_event_cb, LV_EVENT_ALL, NULL);
+    lv_group_add_obj(group, query_box);
+    update_query_label();
+
+    status_label = lv_label_create(page);
+    lv_label_set_text(status_label, "");
+
+    section = lv_menu_section_create(page);
+    for (int i = 0; i < SEARCH_PAGE_RESULTS; i++) {
+        items[i] = lv_menu_cont_create(section);
+        item_labels[i] = lv_label_create(items[i]);
+        lv_label_set_long_mode(item_labels[i], LV_LABEL_LONG_MODE_SCROLL_CIRCULAR);
+        lv_obj_set_flex_grow(item_labels[i], 1);
+        lv_obj_add_flag(items[i], LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_event_cb(items[i], result_event_cb, LV_EVENT_CLICKED, (void *)(uintptr_t)i);
+        lv_group_add_obj(group, items[i]);
+        screen_mgr.bind_back(items[i]);
+    }
+    return page;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct SearchPage search_page = {
+    .create = create
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "lvgl.h"
+
+struct SearchPage {
+    lv_obj_t *(*create)(lv_obj_t *menu, lv_group_t *group);
+};
+
+extern const struct SearchPage search_page;
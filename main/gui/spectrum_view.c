@@ -0,0 +1,149 @@
+#include "spectrum_view.h"
+
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "spectrum.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SPECTRUM VIEW";
+
+static lv_obj_t *view;
+static int32_t bar_w;
+static int32_t bar_px[SPECTRUM_BARS];     /* heights currently on the panel */
+static uint8_t levels[SPECTRUM_BARS];
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void bar_x_range(const lv_area_t *coords, int b, int32_t *x1, int32_t *x2)
+{
+    *x1 = coords->x1 + b * (bar_w + PLAYER_SPECTRUM_GAP);
+    *x2 = *x1 + bar_w - 1;
+}
+
+/* Invalidate just the rows between the old and new top of one bar */
+static void set_bar_px(int b, int32_t px)
+{
+    lv_area_t area;
+
+    if (px == bar_px[b]) {
+        return;
+    }
+    lv_obj_get_coords(view, &area);
+    int32_t bottom = area.y2;
+    bar_x_range(&area, b, &area.x1, &area.x2);
+    area.y1 = bottom - LV_MAX(px, bar_px[b]) + 1;
+    area.y2 = bottom - LV_MIN(px, bar_px[b]);
+    bar_px[b] = px;
+    lv_obj_invalidate_area(view, &area);
+}
+
+/*
+ * All bars are filled from this one object's draw callback, straight into
+ * the layer being rendered; LVGL clips to the invalidated rows, so a frame
+ * costs what changed rather than a widget per bar.
+ */
+static void draw_cb(lv_event_t *e)
+{
+    lv_layer_t *layer = lv_event_get_layer(e);
+    lv_draw_rect_dsc_t dsc;
+    lv_area_t coords;
+    lv_area_t area;
+
+    lv_obj_get_coords(view, &coords);
+    lv_draw_rect_dsc_init(&dsc);
+    dsc.bg_color = lv_theme_get_color_primary(view);
+
+    for (int b = 0; b < SPECTRUM_BARS; b++) {
+        if (bar_px[b] == 0) {
+            continue;
+        }
+        bar_x_range(&coords, b, &area.x1, &area.x2);
+        area.y1 = coords.y2 - bar_px[b] + 1;
+        area.y2 = coords.y2;
+        lv_draw_rect(layer, &dsc, &area);
+    }
+}
+
+/* Runs at the spectrum frame rate; the FFT only happens while the view is on screen */
+static void update_timer_cb(lv_timer_t *t)
+{
+    bool shown = lv_obj_get_screen(view) == lv_screen_active();
+    spectrum.set_visible(shown);
+    if (!shown) {
+        return;
+    }
+
+    uint8_t fps = spectrum.fps();
+    lv_timer_set_period(t, 1000 / (fps ? fps : SPECTRUM_DEFAULT_FPS));
+
+    if (spectrum.compute(levels)) {
+        int32_t height = lv_obj_get_height(view);
+        for (int b = 0; b < SPECTRUM_BARS; b++) {
+            set_bar_px(b, levels[b] * height / 255);
+        }
+    } else if (!spectrum.active()) {
+        for (int b = 0; b < SPECTRUM_BARS; b++) {
+            set_bar_px(b, 0);
+        }
+    }
+}
+
+static void reset_bars(void)
+{
+    for (int b = 0; b < SPECTRUM_BARS; b++) {
+        bar_px[b] = 0;
+    }
+}
+
+/*
+ * The player screen was deleted; stop computing for it. The screen
+ * manager deletes asynchronously, so a new view may already have taken
+ * the statics over: only this view's own timer goes then.
+ */
+static void delete_cb(lv_event_t *e)
+{
+    lv_timer_delete(lv_event_get_user_data(e));
+    if (lv_event_get_target_obj(e) != view) {
+        return;
+    }
+    view = NULL;
+    spectrum.set_visible(false);
+    reset_bars();
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* A SPECTRUM_BARS bar graph in one plain object with no styles of its own */
+static lv_obj_t *create(lv_obj_t *parent, int32_t x, int32_t y, int32_t width, int32_t height) {
+    view = lv_obj_create(parent);
+    lv_obj_remove_style_all(view);
+    lv_obj_set_pos(view, x, y);
+    lv_obj_set_size(view, width, height);
+    lv_obj_add_event_cb(view, draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+    reset_bars();
+
+    bar_w = (width - (SPECTRUM_BARS - 1) * PLAYER_SPECTRUM_GAP) / SPECTRUM_BARS;
+    lv_timer_t *timer = lv_timer_create(update_timer_cb, 1000 / SPECTRUM_DEFAULT_FPS, NULL);
+    lv_obj_add_event_cb(view, delete_cb, LV_EVENT_DELETE, timer);
+
+    ESP_LOGI(TAG, "%d bars of %d px", SPECTRUM_BARS, (int)bar_w);
+    return view;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct SpectrumView spectrum_view = {
+    .create = create
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "lvgl.h"
+
+struct SpectrumView {
+    lv_obj_t *(*create)(lv_obj_t *parent, int32_t x, int32_t y, int32_t width, int32_t height);
+};
+
+extern const struct SpectrumView spectrum_view;
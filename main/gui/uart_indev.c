@@ -0,0 +1,342 @@
+#include "uart_indev.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "lvgl.h"
+#include "console.h"
+#include "input_proto.h"
+#include "trace.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+/* A key waiting to be handed to LVGL, possibly repeated and delayed */
+typedef struct {
+    uint32_t key;
+    uint8_t repeat;
+    int8_t ack_slot;        /* batch this key belongs to, -1 for typed keys */
+    bool last_in_batch;
+    uint16_t delay_ms;      /* wait after the previous key before this one */
+} key_entry_t;
+
+typedef enum {
+    ACK_SLOT_FREE = 0,
+    ACK_SLOT_KEYS,          /* keys of the batch are still being fed */
+    ACK_SLOT_RENDER,        /* all keys fed, waiting for the next refresh */
+} ack_slot_state_t;
+
+typedef struct {
+    ack_slot_state_t state;
+    uint8_t seq;
+    uint16_t keys;
+    int64_t rx_us;
+    int64_t keys_done_us;
+} ack_slot_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "UART INDEV";
+
+/* Console command being typed on the keypad UART, -1 when not in a command */
+static char cmd_line[CONSOLE_MAX_LINE];
+static int cmd_len = -1;
+
+static input_proto_parser_t proto;
+static ack_slot_t ack_slots[INPUT_ACK_SLOTS];
+
+static key_entry_t key_queue[INPUT_KEY_QUEUE_LEN];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static int64_t last_key_us;
+
+/* Key reported as pressed on the previous read, released on this one */
+static bool key_down;
+static uint32_t down_key;
+
+/* The next byte received woke the panel; drop it if it is a typed key */
+static bool swallow_next;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint32_t queue_free(void)
+{
+    return INPUT_KEY_QUEUE_LEN - (queue_tail - queue_head);
+}
+
+static void enqueue_key(uint32_t key, uint8_t repeat, uint16_t delay_ms, int8_t ack_slot, bool last)
+{
+    key_entry_t *entry = &key_queue[queue_tail % INPUT_KEY_QUEUE_LEN];
+    entry->key = key;
+    entry->repeat = repeat;
+    entry->delay_ms = delay_ms;
+    entry->ack_slot = ack_slot;
+    entry->last_in_batch = last;
+    queue_tail++;
+}
+
+/* Map a typed byte to the LV key for the action */
+static bool map_ascii_key(uint8_t byte, uint32_t *key)
+{
+    switch (byte) {
+        case 'w': case 'W':
+            *key = LV_KEY_PREV;
+            break;
+        case 's': case 'S':
+            *key = LV_KEY_NEXT;
+            break;
+        case 'a': case 'A':
+            *key = LV_KEY_LEFT;
+            break;
+        case 'd': case 'D':
+            *key = LV_KEY_RIGHT;
+            break;
+        case '\r': case '\n':
+            *key = LV_KEY_ENTER;
+            break;
+        case 27:
+            *key = LV_KEY_ESC;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void send_ack(uint8_t seq, input_proto_status_t status, uint16_t keys, uint32_t process_us, uint32_t render_us)
+{
+    uint8_t frame[INPUT_PROTO_ACK_LEN];
+    const input_proto_ack_t ack = {
+        .seq = seq,
+        .status = status,
+        .keys = keys,
+        .process_us = process_us,
+        .render_us = render_us,
+    };
+    uart_write_bytes(UART_PORT_NUM, frame, input_proto_encode_ack(&ack, frame));
+}
+
+/* Queue every step of a received batch and start timing it */
+static void enqueue_batch(const input_proto_batch_t *batch, int64_t now)
+{
+    int8_t slot = -1;
+    for (int i = 0; i < INPUT_ACK_SLOTS; i++) {
+        if (ack_slots[i].state == ACK_SLOT_FREE) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 || queue_free() < batch->count) {
+        send_ack(batch->seq, INPUT_PROTO_STATUS_BUSY, 0, 0, 0);
+        return;
+    }
+
+    ack_slot_t *ack = &ack_slots[slot];
+    ack->seq = batch->seq;
+    ack->keys = 0;
+    ack->rx_us = now;
+    ack->keys_done_us = now;
+    ack->state = batch->count ? ACK_SLOT_KEYS : ACK_SLOT_RENDER;
+
+    for (int i = 0; i < batch->count; i++) {
+        const input_proto_step_t *step = &batch->steps[i];
+        uint32_t key = 0;
+        bool last = i == batch->count - 1;
+        if (!map_ascii_key(step->key, &key) || step->repeat == 0) {
+            // Keep the slot bookkeeping intact even for a step we cannot press
+            key = 0;
+        }
+        enqueue_key(key, step->repeat ? step->repeat : 1, step->delay_ms, slot, last);
+    }
+}
+
+/* Feed one byte to the console line collector; false if it is not part of a command */
+static bool collect_cmd_byte(uint8_t byte)
+{
+    if (cmd_len < 0) {
+        if (byte != CONSOLE_CMD_PREFIX) {
+            return false;
+        }
+        cmd_len = 0;
+        return true;
+    }
+
+    if (byte == '\r' || byte == '\n') {
+        cmd_line[cmd_len] = '\0';
+        if (cmd_len > 0 && !console.submit(cmd_line)) {
+            ESP_LOGW(TAG, "Console busy, dropped: %s", cmd_line);
+        }
+        cmd_len = -1;
+    } else if (cmd_len < CONSOLE_MAX_LINE - 1) {
+        cmd_line[cmd_len++] = (char)byte;
+    }
+    return true;
+}
+
+/* Sort a received byte into batch frames, console commands or typed keys */
+static void handle_byte(uint8_t byte, int64_t now)
+{
+    bool swallow = swallow_next;
+
+    swallow_next = false;
+    switch (input_proto_feed(&proto, byte)) {
+        case INPUT_PROTO_BATCH:
+            enqueue_batch(&proto.batch, now);
+            return;
+        case INPUT_PROTO_BAD_CRC:
+            send_ack(proto.batch.seq, INPUT_PROTO_STATUS_BAD_CRC, 0, 0, 0);
+            return;
+        case INPUT_PROTO_PENDING:
+            return;
+        default:
+            break;
+    }
+
+    if (collect_cmd_byte(byte)) {
+        return;
+    }
+
+    uint32_t key = 0;
+    if (map_ascii_key(byte, &key) && !swallow) {
+        enqueue_key(key, 1, 0, -1, false);
+    }
+    TRACE(TRACE_EV_KEY, byte, key);
+}
+
+/* Pull in what the UART has buffered, as long as the key queue can take it */
+static void drain_uart(int64_t now)
+{
+    uint8_t rx[INPUT_RX_CHUNK];
+    size_t len;
+
+    uart_get_buffered_data_len(UART_PORT_NUM, &len);
+    // A chunk of typed keys plus a completed batch must always fit
+    while (len > 0 && queue_free() >= INPUT_RX_CHUNK + INPUT_PROTO_MAX_STEPS) {
+        int read_len = uart_read_bytes(UART_PORT_NUM, rx, MIN(len, sizeof(rx)), 0);
+        if (read_len <= 0) {
+            break;
+        }
+        for (int i = 0; i < read_len; i++) {
+            handle_byte(rx[i], now);
+        }
+        len -= read_len;
+    }
+}
+
+/* Take the next key that is due, honouring batch step delays */
+static bool pop_key(int64_t now, uint32_t *key)
+{
+    while (queue_head != queue_tail) {
+        key_entry_t *entry = &key_queue[queue_head % INPUT_KEY_QUEUE_LEN];
+        if (now - last_key_us < (int64_t)entry->delay_ms * 1000) {
+            return false;
+        }
+
+        *key = entry->key;
+        last_key_us = now;
+        // Repeats of a step follow each other without the step delay
+        entry->delay_ms = 0;
+        if (entry->ack_slot >= 0) {
+            ack_slots[entry->ack_slot].keys++;
+        }
+        if (--entry->repeat == 0) {
+            if (entry->last_in_batch) {
+                ack_slot_t *ack = &ack_slots[entry->ack_slot];
+                ack->keys_done_us = now;
+                ack->state = ACK_SLOT_RENDER;
+            }
+            queue_head++;
+        }
+        if (*key != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void uart_indev_read_cb(lv_indev_t *indev_driver, lv_indev_data_t *data)
+{
+    int64_t now = esp_timer_get_time();
+
+    // A key goes down on one read and comes back up on the next, so a whole
+    // batch is handed to LVGL in a single input poll
+    if (key_down) {
+        key_down = false;
+        data->key = down_key;
+        data->state = LV_INDEV_STATE_RELEASED;
+        data->continue_reading = queue_head != queue_tail;
+        return;
+    }
+
+    drain_uart(now);
+
+    if (pop_key(now, &down_key)) {
+        key_down = true;
+        data->key = down_key;
+        data->state = LV_INDEV_STATE_PRESSED;
+        data->continue_reading = true;
+        return;
+    }
+
+    // Nothing left to read! Now this function can finally rest.
+    data->state = LV_INDEV_STATE_RELEASED;
+}
+
+/* Ack every batch whose keys have all been fed and are now on screen */
+static void refr_ready_cb(lv_event_t *e)
+{
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 0; i < INPUT_ACK_SLOTS; i++) {
+        ack_slot_t *ack = &ack_slots[i];
+        if (ack->state != ACK_SLOT_RENDER) {
+            continue;
+        }
+        send_ack(ack->seq, INPUT_PROTO_STATUS_OK, ack->keys,
+                 (uint32_t)(ack->keys_done_us - ack->rx_us),
+                 (uint32_t)(now - ack->keys_done_us));
+        ack->state = ACK_SLOT_FREE;
+    }
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Create the keypad input device reading from the UART */
+static lv_indev_t *create(lv_display_t *display, lv_group_t *group) {
+    input_proto_init(&proto);
+
+    lv_indev_t *indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_KEYPAD);
+    lv_indev_set_read_cb(indev, uart_indev_read_cb);
+    lv_indev_set_group(indev, group);
+    lv_indev_enable(indev, true);
+
+    lv_display_add_event_cb(display, refr_ready_cb, LV_EVENT_REFR_READY, NULL);
+    return indev;
+}
+
+/* Drop the typed key that woke the panel; batch frames and console commands still get through */
+static void swallow_wake_key(void) {
+    swallow_next = true;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct UartIndev uart_indev = {
+    .create = create,
+    .swallow_wake_key = swallow_wake_key
+};
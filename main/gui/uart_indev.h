@@ -0,0 +1,15 @@
+#pragma once
+
+#include "lvgl.h"
+
+/*
+ * swallow_wake_key() is called with the LVGL lock held when the panel
+ * wakes from off: the byte that woke it is still buffered, and if it is a
+ * typed key it is dropped rather than pressed on a screen nobody has seen.
+ */
+struct UartIndev {
+    lv_indev_t *(*create)(lv_display_t *display, lv_group_t *group);
+    void (*swallow_wake_key)(void);
+};
+
+extern const struct UartIndev uart_indev;
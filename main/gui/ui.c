@@ -5,5 +5,4 @@
 
 void create_ui(void) {
     create_screens();
-    lv_screen_load(screens.menu);
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "bluetooth.h"
+
+#include "esp_log.h"
+
+/*
+ * The host build has no radio. The menu still calls into the Bluetooth
+ * module, so those calls just log.
+ */
+
+#define GAP_TAG "GAP"
+
+void bt_init(void)
+{
+    ESP_LOGI(GAP_TAG, "Bluetooth unavailable on host");
+}
+
+void bt_enable(bool enable)
+{
+    ESP_LOGI(GAP_TAG, "%s: %s (ignored on host)", __func__, enable ? "on" : "off");
+}
@@ -0,0 +1,104 @@
+#include "fb_display.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "FB DISPLAY";
+
+/*
+ * Stand-in for the panel's GRAM: flushed areas land here instead of on SPI.
+ * Rows are as wide as the display's current resolution, so a rotated
+ * display keeps its picture upright, the way MADCTL shows it on the panel.
+ */
+static uint16_t framebuffer[LCD_H_RES * LCD_V_RES];
+
+/* Same partial draw buffer geometry as the device so render cost matches */
+static uint16_t draw_buf1[LCD_H_RES * LVGL_DRAW_BUF_LINES];
+static uint16_t draw_buf2[LCD_H_RES * LVGL_DRAW_BUF_LINES];
+
+static struct FbStats stats;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void fb_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    int32_t width = lv_area_get_width(area);
+    int32_t stride = lv_display_get_horizontal_resolution(disp);
+    const uint16_t *src = (const uint16_t *)px_map;
+
+    for (int32_t y = area->y1; y <= area->y2; y++) {
+        memcpy(&framebuffer[y * stride + area->x1], src, width * sizeof(uint16_t));
+        src += width;
+    }
+
+    stats.flushes++;
+    stats.area_px += lv_area_get_size(area);
+
+    lv_display_flush_ready(disp);
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Create an LVGL display that renders into the memory framebuffer */
+static lv_display_t *create(void) {
+    lv_display_t *display = lv_display_create(LCD_H_RES, LCD_V_RES);
+
+    lv_display_set_buffers(display, draw_buf1, draw_buf2, sizeof(draw_buf1), LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_set_color_format(display, LV_COLOR_FORMAT_RGB565);
+    lv_display_set_flush_cb(display, fb_flush_cb);
+
+    ESP_LOGI(TAG, "Framebuffer display created (%dx%d)", LCD_H_RES, LCD_V_RES);
+    return display;
+}
+
+/* Copy out the flush counters accumulated since the last call and reset them */
+static void take_stats(struct FbStats *out) {
+    *out = stats;
+    memset(&stats, 0, sizeof(stats));
+}
+
+/* Write the current framebuffer contents as a binary PPM image */
+static bool dump_ppm(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", path);
+        return false;
+    }
+
+    lv_display_t *display = lv_display_get_default();
+    fprintf(f, "P6\n%d %d\n255\n", (int)lv_display_get_horizontal_resolution(display),
+            (int)lv_display_get_vertical_resolution(display));
+    for (int i = 0; i < LCD_H_RES * LCD_V_RES; i++) {
+        uint16_t px = framebuffer[i];
+        uint8_t rgb[3] = {
+            (uint8_t)(((px >> 11) & 0x1F) << 3),
+            (uint8_t)(((px >> 5) & 0x3F) << 2),
+            (uint8_t)((px & 0x1F) << 3),
+        };
+        fwrite(rgb, 1, sizeof(rgb), f);
+    }
+    fclose(f);
+    return true;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct FbDisplay fb_display = {
+    .create = create,
+    .take_stats = take_stats,
+    .dump_ppm = dump_ppm
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+struct FbStats {
+    uint32_t flushes;
+    uint32_t area_px;
+};
+
+struct FbDisplay {
+    lv_display_t *(*create)(void);
+    void (*take_stats)(struct FbStats *stats);
+    bool (*dump_ppm)(const char *path);
+};
+
+extern const struct FbDisplay fb_display;
@@ -0,0 +1,178 @@
+#include "headless.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "fb_display.h"
+#include "gui.h"
+#include "script_indev.h"
+#include "player.h"
+#include "screen_mgr.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "HEADLESS";
+
+static struct {
+    uint32_t frames;
+    uint64_t render_us;
+    uint32_t max_render_us;
+    uint64_t area_px;
+} totals;
+
+static unsigned frame_num;
+static uint64_t step_area_px;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Advance LVGL by one refresh period, render, and report what it cost */
+static void run_frame(const struct ScriptStep *step)
+{
+    struct FbStats fb;
+
+    lv_tick_inc(HOST_FRAME_PERIOD_MS);
+
+    uint64_t start = now_us();
+    lv_timer_handler();
+    uint32_t render_us = (uint32_t)(now_us() - start);
+
+    fb_display.take_stats(&fb);
+
+    // One CSV row per frame so runs can be diffed and gated by a script
+    printf("%u,%u,%s,%u,%u,%u\n", frame_num++, step->line, step->arg,
+           render_us, fb.area_px, fb.flushes);
+
+    totals.frames++;
+    totals.render_us += render_us;
+    totals.area_px += fb.area_px;
+    step_area_px += fb.area_px;
+    if (render_us > totals.max_render_us) {
+        totals.max_render_us = render_us;
+    }
+}
+
+static bool dump_frame(const char *name)
+{
+    const char *dir = getenv(HOST_DUMP_DIR_ENV);
+    if (dir == NULL) {
+        return true;
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.ppm", dir, name);
+    return fb_display.dump_ppm(path);
+}
+
+/*
+ * Share of the panel's SPI link the pixels flushed during a wait would
+ * take on the device, in hundredths of a percent. Nothing is pressed
+ * during a wait, so this is what a static screen costs.
+ */
+static uint32_t spi_share_x100(uint64_t area_px, uint32_t ms)
+{
+    uint64_t capacity = (uint64_t)LCD_SPI_PCLK_HZ * ms / 1000;
+    return capacity ? (uint32_t)(area_px * 16 * 10000 / capacity) : 0;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/*
+ * Replay the navigation script named by BEAT_BYTE_SCRIPT against the UI.
+ * Frames are dumped to BEAT_BYTE_DUMP_DIR when it is set. Returns a
+ * process exit code.
+ */
+static int run(void) {
+    struct ScriptStep step = {0};
+
+    // Settle the initial screen so the first scripted frame is not the boot render
+    snprintf(step.arg, sizeof(step.arg), "boot");
+    printf("frame,line,step,render_us,area_px,flushes\n");
+    run_frame(&step);
+
+    const char *path = getenv(HOST_SCRIPT_ENV);
+    if (path == NULL) {
+        ESP_LOGW(TAG, "%s not set, rendered boot frame only", HOST_SCRIPT_ENV);
+    } else if (!script_indev.load(path)) {
+        return EXIT_FAILURE;
+    }
+
+    while (path) {
+        if (!script_indev.next_step(&step)) {
+            return EXIT_FAILURE;
+        }
+        if (step.type == SCRIPT_STEP_END) {
+            break;
+        }
+
+        switch (step.type) {
+            case SCRIPT_STEP_KEY:
+                for (uint32_t i = 0; i < step.count; i++) {
+                    script_indev.press(step.key);
+                    run_frame(&step);
+                }
+                break;
+            case SCRIPT_STEP_WAIT: {
+                uint32_t ms = 0;
+                step_area_px = 0;
+                for (; ms < step.count; ms += HOST_FRAME_PERIOD_MS) {
+                    run_frame(&step);
+                }
+                uint32_t share = spi_share_x100(step_area_px, ms);
+                ESP_LOGI(TAG, "Line %u: %"PRIu64" px in %"PRIu32" ms, %"PRIu32".%02"PRIu32"%% of SPI bandwidth%s",
+                         step.line, step_area_px, ms, share / 100, share % 100,
+                         share > GUI_SPI_BUDGET_PCT * 100 ? " (over budget)" : "");
+                break;
+            }
+            case SCRIPT_STEP_PLAY:
+                player.play(0, "Script Track", "Beat-Byte", step.count * 1000);
+                screen_mgr.push(SCREEN_PLAYER);
+                run_frame(&step);
+                break;
+            case SCRIPT_STEP_ROTATE:
+                if (step.count >= GUI_ORIENTATIONS) {
+                    ESP_LOGE(TAG, "Line %u: no orientation %"PRIu32, step.line, step.count);
+                    return EXIT_FAILURE;
+                }
+                gui.set_orientation(step.count);
+                run_frame(&step);
+                break;
+            case SCRIPT_STEP_DUMP:
+                if (!dump_frame(step.arg)) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    ESP_LOGI(TAG, "%"PRIu32" frames, avg render %"PRIu64" us, max render %"PRIu32" us, %"PRIu64" px flushed",
+             totals.frames, totals.render_us / totals.frames, totals.max_render_us, totals.area_px);
+    return EXIT_SUCCESS;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Headless headless = {
+    .run = run
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+struct Headless {
+    int (*run)(void);
+};
+
+extern const struct Headless headless;
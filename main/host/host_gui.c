@@ -0,0 +1,58 @@
+#include "gui.h"
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "fb_display.h"
+#include "script_indev.h"
+#include "screen_mgr.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "HOST GUI";
+
+static lv_display_t *display;
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/*
+ * Host counterpart of gui.c: same LVGL setup, but rendering goes to the
+ * memory framebuffer and input comes from the script runner. There is no
+ * tick timer or LVGL task; the runner advances time itself so every run
+ * renders the exact same frames.
+ */
+static void init() {
+    ESP_LOGI(TAG, "Initalizing LVGL library");
+    lv_init();
+
+    display = fb_display.create();
+
+    lv_group_t *group = lv_group_create();
+    lv_group_set_default(group);
+
+    script_indev.create(group);
+}
+
+/* Only the LVGL side: the framebuffer has no scan order to change */
+static void set_orientation(gui_orientation_t orientation) {
+    if (orientation >= GUI_ORIENTATIONS || display == NULL) {
+        return;
+    }
+    bool landscape = orientation == GUI_ORIENTATION_LANDSCAPE || orientation == GUI_ORIENTATION_LANDSCAPE_FLIPPED;
+    lv_display_set_resolution(display, landscape ? LCD_V_RES : LCD_H_RES, landscape ? LCD_H_RES : LCD_V_RES);
+    screen_mgr.rebuild();
+    ESP_LOGI(TAG, "Orientation %d", orientation);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Gui gui = {
+    .init = init,
+    .set_orientation = set_orientation
+};
@@ -0,0 +1,167 @@
+#include "script_indev.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "lvgl.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SCRIPT INDEV";
+
+static FILE *script;
+static unsigned line_num;
+
+/* Key waiting to be reported; a press is followed by one release read */
+static uint32_t pending_key;
+static bool key_pending;
+static bool key_down;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* Map the same key names the UART keypad understands to LVGL keys */
+static bool parse_key(const char *name, uint32_t *key)
+{
+    if (strcasecmp(name, "w") == 0) {
+        *key = LV_KEY_PREV;
+    } else if (strcasecmp(name, "s") == 0) {
+        *key = LV_KEY_NEXT;
+    } else if (strcasecmp(name, "a") == 0) {
+        *key = LV_KEY_LEFT;
+    } else if (strcasecmp(name, "d") == 0) {
+        *key = LV_KEY_RIGHT;
+    } else if (strcasecmp(name, "enter") == 0) {
+        *key = LV_KEY_ENTER;
+    } else if (strcasecmp(name, "esc") == 0) {
+        *key = LV_KEY_ESC;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void script_indev_read_cb(lv_indev_t *indev_driver, lv_indev_data_t *data)
+{
+    data->key = pending_key;
+
+    if (key_pending && !key_down) {
+        data->state = LV_INDEV_STATE_PRESSED;
+        key_down = true;
+        // Report the release on the very next read
+        data->continue_reading = true;
+        return;
+    }
+
+    key_pending = false;
+    key_down = false;
+    data->state = LV_INDEV_STATE_RELEASED;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Create a keypad input device that reports the keys fed by the script runner */
+static lv_indev_t *create(lv_group_t *group) {
+    lv_indev_t *indev = lv_indev_create();
+    lv_indev_set_type(indev, LV_INDEV_TYPE_KEYPAD);
+    lv_indev_set_read_cb(indev, script_indev_read_cb);
+    lv_indev_set_group(indev, group);
+    lv_indev_enable(indev, true);
+    return indev;
+}
+
+/* Open a navigation script for replay */
+static bool load(const char *path) {
+    if (script) {
+        fclose(script);
+    }
+    script = fopen(path, "r");
+    if (script == NULL) {
+        ESP_LOGE(TAG, "Failed to open script %s", path);
+        return false;
+    }
+    line_num = 0;
+    ESP_LOGI(TAG, "Loaded script %s", path);
+    return true;
+}
+
+/*
+ * Parse the next command from the script. One command per line:
+ *   w | s | a | d | enter | esc [count]   press a key, optionally repeated
+ *   wait <ms>                              let LVGL run for a while
+ *   dump <name>                            save the current frame as <name>.ppm
+ *   play <seconds>                         start a track that long and open the player
+ *   rotate <0-3>                           turn the display that many quarter turns from portrait
+ * Blank lines and lines starting with '#' are ignored. Returns false on a
+ * malformed line; the end of the script is reported as SCRIPT_STEP_END.
+ */
+static bool next_step(struct ScriptStep *step) {
+    char line[HOST_SCRIPT_MAX_LINE];
+
+    memset(step, 0, sizeof(*step));
+    step->type = SCRIPT_STEP_END;
+
+    while (script && fgets(line, sizeof(line), script)) {
+        line_num++;
+
+        char *cmd = strtok(line, " \t\r\n");
+        if (cmd == NULL || cmd[0] == '#') {
+            continue;
+        }
+        char *arg = strtok(NULL, " \t\r\n");
+
+        step->line = line_num;
+        if (strcasecmp(cmd, "wait") == 0) {
+            step->type = SCRIPT_STEP_WAIT;
+            step->count = arg ? strtoul(arg, NULL, 10) : HOST_FRAME_PERIOD_MS;
+        } else if (strcasecmp(cmd, "dump") == 0) {
+            step->type = SCRIPT_STEP_DUMP;
+            snprintf(step->arg, sizeof(step->arg), "%s", arg ? arg : "frame");
+        } else if (strcasecmp(cmd, "play") == 0) {
+            step->type = SCRIPT_STEP_PLAY;
+            step->count = arg ? strtoul(arg, NULL, 10) : 0;
+            snprintf(step->arg, sizeof(step->arg), "%s", cmd);
+        } else if (strcasecmp(cmd, "rotate") == 0) {
+            step->type = SCRIPT_STEP_ROTATE;
+            step->count = arg ? strtoul(arg, NULL, 10) : 0;
+            snprintf(step->arg, sizeof(step->arg), "%s", cmd);
+        } else if (parse_key(cmd, &step->key)) {
+            step->type = SCRIPT_STEP_KEY;
+            step->count = arg ? strtoul(arg, NULL, 10) : 1;
+            snprintf(step->arg, sizeof(step->arg), "%s", cmd);
+        } else {
+            ESP_LOGE(TAG, "Line %u: unknown command '%s'", line_num, cmd);
+            return false;
+        }
+        return true;
+    }
+
+    return true;
+}
+
+/* Queue a single key press to be reported on the next input read */
+static void press(uint32_t key) {
+    pending_key = key;
+    key_pending = true;
+    key_down = false;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct ScriptIndev script_indev = {
+    .create = create,
+    .load = load,
+    .next_step = next_step,
+    .press = press
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+#include "system_config.h"
+
+typedef enum {
+    SCRIPT_STEP_KEY = 0,
+    SCRIPT_STEP_WAIT,
+    SCRIPT_STEP_DUMP,
+    SCRIPT_STEP_PLAY,
+    SCRIPT_STEP_ROTATE,
+    SCRIPT_STEP_END,
+} script_step_type_t;
+
+struct ScriptStep {
+    script_step_type_t type;
+    uint32_t key;       /* LV_KEY_* for SCRIPT_STEP_KEY */
+    uint32_t count;     /* repeat count for keys, milliseconds for waits, seconds for play, quarter turns */
+    unsigned line;
+    char arg[HOST_SCRIPT_MAX_LINE];
+};
+
+struct ScriptIndev {
+    lv_indev_t *(*create)(lv_group_t *group);
+    bool (*load)(const char *path);
+    bool (*next_step)(struct ScriptStep *step);
+    void (*press)(uint32_t key);
+};
+
+extern const struct ScriptIndev script_indev;
@@ -0,0 +1,210 @@
+#include "library.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "LIBRARY";
+
+/*
+ * Tracks are numbered in scan order. tracks.txt holds one path per line and
+ * tracks.idx the byte offset of each line as a little-endian u32, so any
+ * track resolves with two small reads no matter how big the library is.
+ */
+static FILE *paths_file;
+static FILE *index_file;
+static uint32_t count;
+
+static const char *audio_exts[] = { ".mp3", ".flac", ".wav", ".ogg", ".m4a", ".aac" };
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static bool is_audio_file(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    if (ext == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(audio_exts) / sizeof(audio_exts[0]); i++) {
+        if (strcasecmp(ext, audio_exts[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void close_files(void)
+{
+    if (paths_file) {
+        fclose(paths_file);
+        paths_file = NULL;
+    }
+    if (index_file) {
+        fclose(index_file);
+        index_file = NULL;
+    }
+}
+
+/*
+ * Depth-first walk from root writing every audio file it finds. Only one
+ * directory handle per level is held, so memory stays bounded by
+ * LIBRARY_MAX_DEPTH regardless of library size. path holds the directory
+ * on top of the stack up to path_len[depth]; each entry is appended
+ * there, and stays on when it is a directory that was pushed.
+ */
+static uint32_t walk(const char *root, FILE *paths, FILE *index)
+{
+    DIR *stack[LIBRARY_MAX_DEPTH];
+    size_t path_len[LIBRARY_MAX_DEPTH];
+    char path[LIBRARY_MAX_PATH];
+    int depth = 0;
+    uint32_t found = 0;
+
+    snprintf(path, sizeof(path), "%s", root);
+    stack[0] = opendir(path);
+    path_len[0] = strlen(path);
+    if (stack[0] == NULL) {
+        return 0;
+    }
+
+    while (depth >= 0) {
+        struct dirent *entry = readdir(stack[depth]);
+        if (entry == NULL) {
+            closedir(stack[depth--]);
+            continue;
+        }
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        size_t base = path_len[depth];
+        int n = snprintf(path + base, sizeof(path) - base, "/%s", entry->d_name);
+        if (n < 0 || base + n >= sizeof(path)) {
+            path[base] = '\0';
+            continue;
+        }
+
+        if (entry->d_type == DT_DIR) {
+            DIR *sub = depth + 1 < LIBRARY_MAX_DEPTH ? opendir(path) : NULL;
+            if (sub) {
+                stack[++depth] = sub;
+                path_len[depth] = base + n;
+                continue;
+            }
+        } else if (is_audio_file(entry->d_name)) {
+            uint32_t offset = (uint32_t)ftell(paths);
+            uint8_t le[4] = { offset, offset >> 8, offset >> 16, offset >> 24 };
+            fwrite(le, 1, sizeof(le), index);
+            fprintf(paths, "%s\n", path);
+            found++;
+        }
+        path[base] = '\0';
+    }
+    return found;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Open the track index written by a previous scan */
+static bool load(void) {
+    struct stat st;
+
+    close_files();
+    count = 0;
+    if (stat(LIBRARY_INDEX_FILE, &st) != 0) {
+        return false;
+    }
+    paths_file = fopen(LIBRARY_PATHS_FILE, "r");
+    index_file = fopen(LIBRARY_INDEX_FILE, "rb");
+    if (paths_file == NULL || index_file == NULL) {
+        close_files();
+        return false;
+    }
+    count = st.st_size / sizeof(uint32_t);
+    ESP_LOGI(TAG, "Loaded %" PRIu32 " tracks", count);
+    return true;
+}
+
+/* Walk the card and rebuild the numbered track list */
+static bool scan(void) {
+    close_files();
+    mkdir(LIBRARY_DB_DIR, 0775);
+    // Tags are stored by track number, which this scan hands out afresh
+    remove(LIBRARY_META_FILE);
+
+    FILE *paths = fopen(LIBRARY_PATHS_FILE, "w");
+    FILE *index = fopen(LIBRARY_INDEX_FILE, "wb");
+    if (paths == NULL || index == NULL) {
+        ESP_LOGE(TAG, "Failed to create library index");
+        if (paths) {
+            fclose(paths);
+        }
+        if (index) {
+            fclose(index);
+        }
+        return false;
+    }
+
+    uint32_t found = walk(SD_MOUNT_POINT, paths, index);
+    fclose(paths);
+    fclose(index);
+    ESP_LOGI(TAG, "Scan found %" PRIu32 " tracks", found);
+    return load();
+}
+
+/* The scan's walk from another root, for the bench */
+uint32_t library_walk(const char *root, FILE *paths, FILE *index)
+{
+    return walk(root, paths, index);
+}
+
+static uint32_t track_count(void) {
+    return count;
+}
+
+/* Resolve a track number to its full path */
+static bool track_path(uint32_t index, char *path, size_t len) {
+    uint8_t le[4];
+
+    if (index >= count || index_file == NULL) {
+        return false;
+    }
+    if (fseek(index_file, (long)index * sizeof(le), SEEK_SET) != 0 ||
+            fread(le, 1, sizeof(le), index_file) != sizeof(le)) {
+        return false;
+    }
+    uint32_t offset = le[0] | le[1] << 8 | le[2] << 16 | (uint32_t)le[3] << 24;
+    if (fseek(paths_file, offset, SEEK_SET) != 0 || fgets(path, len, paths_file) == NULL) {
+        return false;
+    }
+
+    char *newline = strchr(path, '\n');
+    if (newline) {
+        *newline = '\0';
+    }
+    return true;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Library library = {
+    .scan = scan,
+    .load = load,
+    .track_count = track_count,
+    .track_path = track_path
+};
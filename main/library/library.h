@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct Library {
+    bool (*scan)(void);
+    bool (*load)(void);
+    uint32_t (*track_count)(void);
+    bool (*track_path)(uint32_t index, char *path, size_t len);
+};
+
+extern const struct Library library;
+
+uint32_t library_walk(const char *root, FILE *paths, FILE *index);
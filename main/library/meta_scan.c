@@ -0,0 +1,245 @@
+#include "meta_scan.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/lock.h>
+#include <sys/stat.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "library.h"
+#include "output.h"
+#include "buf_pool.h"
+#include "console.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "META SCAN";
+
+/* LIBRARY_META_FILE; the scanner's writes and lookups share it under db_lock */
+static FILE *db;
+static _lock_t db_lock;
+static atomic_uint done;
+static uint32_t total;
+static bool started;
+
+static atomic_uint tracks;
+static atomic_uint reads;
+static atomic_uint untagged;
+static atomic_uint yields;
+static atomic_uint busy_us;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_db(void)
+{
+    _lock_acquire(&db_lock);
+}
+
+static void unlock_db(void)
+{
+    _lock_release(&db_lock);
+}
+
+/* The file name without its directory or extension, cut on a character boundary */
+static void title_from_path(char *title, const char *path)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *ext = strrchr(name, '.');
+    size_t len = ext ? (size_t)(ext - name) : strlen(name);
+
+    if (len > TAG_MAX_TEXT) {
+        len = TAG_MAX_TEXT;
+        while (len > 0 && (name[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+    memcpy(title, name, len);
+    title[len] = '\0';
+}
+
+/* The card and the CPU go to the audio first */
+static void wait_for_headroom(void)
+{
+    while (output.headroom() < META_SCAN_MIN_HEADROOM_PCT) {
+        atomic_fetch_add(&yields, 1);
+        vTaskDelay(pdMS_TO_TICKS(META_SCAN_BACKOFF_MS));
+    }
+}
+
+static void scan_file(const char *path, tag_info_t *info)
+{
+    buf_block_t *block = buf_pool.get(TAG_READ_SIZE, portMAX_DELAY);
+    FILE *f = fopen(path, "rb");
+    uint32_t n = 0;
+    bool found = false;
+
+    memset(info, 0, sizeof(*info));
+    if (block && f) {
+        // Unbuffered, so every TAG_READ_SIZE read goes to FATFS in one piece
+        setvbuf(f, NULL, _IONBF, 0);
+        found = tag_parse(f, block->data, info, &n);
+    }
+    if (f) {
+        fclose(f);
+    }
+    if (block) {
+        buf_pool.unref(block);
+    }
+
+    if (!found) {
+        atomic_fetch_add(&untagged, 1);
+    }
+    if (info->title[0] == '\0') {
+        title_from_path(info->title, path);
+    }
+    atomic_fetch_add(&reads, n);
+}
+
+/* Walks tracks.txt from the first track without a record to the end, then exits */
+static void scan_task(void *arg)
+{
+    char path[LIBRARY_MAX_PATH];
+    tag_info_t info;
+    uint32_t first = atomic_load(&done);
+    uint32_t track = 0;
+    int64_t start = esp_timer_get_time();
+
+    FILE *paths = fopen(LIBRARY_PATHS_FILE, "r");
+    if (paths == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", LIBRARY_PATHS_FILE);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (fgets(path, sizeof(path), paths)) {
+        if (track++ < first) {
+            continue;
+        }
+        char *newline = strchr(path, '\n');
+        if (newline) {
+            *newline = '\0';
+        }
+
+        wait_for_headroom();
+        int64_t t0 = esp_timer_get_time();
+        scan_file(path, &info);
+
+        lock_db();
+        bool ok = fseek(db, (long)(track - 1) * sizeof(info), SEEK_SET) == 0 &&
+                  fwrite(&info, sizeof(info), 1, db) == 1;
+        if (ok) {
+            atomic_store(&done, track);
+        }
+        unlock_db();
+
+        atomic_fetch_add(&busy_us, (uint32_t)(esp_timer_get_time() - t0));
+        atomic_fetch_add(&tracks, 1);
+        if (!ok) {
+            ESP_LOGE(TAG, "Failed to store track %" PRIu32, track - 1);
+            break;
+        }
+    }
+    fclose(paths);
+
+    lock_db();
+    fflush(db);
+    unlock_db();
+
+    uint32_t scanned = atomic_load(&done) - first;
+    int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    ESP_LOGI(TAG, "Tagged %" PRIu32 " tracks in %" PRId64 " ms, %" PRIu32 " tracks/s", scanned, elapsed_ms,
+             elapsed_ms ? (uint32_t)(scanned * 1000LL / elapsed_ms) : 0);
+    vTaskDelete(NULL);
+}
+
+static int meta_cmd(int argc, char **argv)
+{
+    meta_scan_stats_t s;
+
+    meta_scan.take_stats(&s);
+    uint32_t per_s = s.busy_us ? (uint32_t)(s.tracks * 1000000ULL / s.busy_us) : 0;
+    uint32_t reads_x100 = s.tracks ? s.reads * 100 / s.tracks : 0;
+    printf("%" PRIu32 "/%" PRIu32 " tracks tagged; %" PRIu32 " since the last call at %" PRIu32
+           " tracks/s, %" PRIu32 ".%02" PRIu32 " reads per track, %" PRIu32 " untagged, %" PRIu32 " back-offs\n",
+           s.done, s.total, s.tracks, per_s, reads_x100 / 100, reads_x100 % 100, s.untagged, s.yields);
+    return 0;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Pick up the records of an earlier scan and tag the rest of the library in the background */
+static void start(void) {
+    struct stat st;
+
+    if (started) {
+        return;
+    }
+    started = true;
+
+    total = library.track_count();
+    uint32_t have = stat(LIBRARY_META_FILE, &st) == 0 ? st.st_size / sizeof(tag_info_t) : 0;
+    db = fopen(LIBRARY_META_FILE, have ? "r+b" : "w+b");
+    if (db == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", LIBRARY_META_FILE);
+        return;
+    }
+    atomic_store(&done, have < total ? have : total);
+
+    const esp_console_cmd_t cmd = {
+        .command = "meta",
+        .help = "Show tag scan progress and throughput since the last call",
+        .hint = NULL,
+        .func = meta_cmd,
+    };
+    console.register_cmd(&cmd);
+
+    ESP_LOGI(TAG, "%" PRIu32 " of %" PRIu32 " tracks tagged", atomic_load(&done), total);
+    if (atomic_load(&done) < total) {
+        xTaskCreatePinnedToCore(scan_task, "meta_scan", META_SCAN_TASK_STACK_SIZE, NULL, META_SCAN_TASK_PRIORITY,
+                                NULL, META_SCAN_CORE);
+    }
+}
+
+/* Tags of a track the scan has reached; false for the rest */
+static bool lookup(uint32_t track, tag_info_t *info) {
+    lock_db();
+    bool ok = db && track < atomic_load(&done) &&
+              fseek(db, (long)track * sizeof(*info), SEEK_SET) == 0 && fread(info, sizeof(*info), 1, db) == 1;
+    unlock_db();
+    return ok;
+}
+
+/* Copy and reset the counters; done and total are current */
+static void take_stats(meta_scan_stats_t *stats) {
+    stats->done = atomic_load(&done);
+    stats->total = total;
+    stats->tracks = atomic_exchange(&tracks, 0);
+    stats->reads = atomic_exchange(&reads, 0);
+    stats->untagged = atomic_exchange(&untagged, 0);
+    stats->yields = atomic_exchange(&yields, 0);
+    stats->busy_us = atomic_exchange(&busy_us, 0);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct MetaScan meta_scan = {
+    .start = start,
+    .lookup = lookup,
+    .take_stats = take_stats
+};
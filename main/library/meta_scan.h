@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tag_parser.h"
+
+typedef struct {
+    uint32_t done;              /* tracks with a record so far */
+    uint32_t total;
+    uint32_t tracks;            /* parsed since the last take_stats */
+    uint32_t reads;             /* TAG_READ_SIZE reads they took */
+    uint32_t untagged;          /* no tag found; titled after the file name */
+    uint32_t yields;            /* back-offs while the output ring was low */
+    uint32_t busy_us;           /* time spent on them, back-offs left out */
+} meta_scan_stats_t;
+
+/*
+ * Background tag scanner. A task at the lowest working priority, pinned
+ * to META_SCAN_CORE, walks tracks.txt and parses each file's tag with
+ * tag_parse(), so a track costs its open and one or two sector reads.
+ * Before every track it waits while the output ring is below
+ * META_SCAN_MIN_HEADROOM_PCT. Records go to LIBRARY_META_FILE by track
+ * number; a scan interrupted by a reset carries on from the last record,
+ * and library.scan() drops the file since it renumbers the tracks.
+ */
+struct MetaScan {
+    void (*start)(void);
+    bool (*lookup)(uint32_t track, tag_info_t *info);
+    void (*take_stats)(meta_scan_stats_t *stats);
+};
+
+extern const struct MetaScan meta_scan;
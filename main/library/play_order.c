@@ -0,0 +1,266 @@
+#include "play_order.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "library.h"
+#include "player.h"
+#include "shuffle.h"
+#include "tag_parser.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include <sys/lock.h>
+#include "esp_random.h"
+#include "nvs.h"
+#include "meta_scan.h"
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "PLAY ORDER";
+
+#if !CONFIG_IDF_TARGET_LINUX
+/* Keys on the LVGL task and track ends on the esp_timer task both move pos */
+static _lock_t order_lock;
+#endif
+
+static shuffle_t order;
+static uint32_t seed;
+static bool shuffled;
+static uint32_t count;
+static uint32_t pos;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_order(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&order_lock);
+#endif
+}
+
+static void unlock_order(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&order_lock);
+#endif
+}
+
+static uint32_t random_seed(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return (uint32_t)rand();
+#else
+    return esp_random();
+#endif
+}
+
+/* Store the shuffle seed and mode so the order survives a reboot */
+static void save_settings(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    nvs_handle_t handle;
+    if (nvs_open(PLAYER_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", PLAYER_NVS_NAMESPACE);
+        return;
+    }
+    nvs_set_u32(handle, "shuffle_seed", seed);
+    nvs_set_u8(handle, "shuffle_on", shuffled);
+    nvs_commit(handle);
+    nvs_close(handle);
+#endif
+}
+
+/* The host build has no NVS and starts from a fresh seed every run */
+static void load_settings(void)
+{
+    seed = random_seed();
+#if !CONFIG_IDF_TARGET_LINUX
+    nvs_handle_t handle;
+    uint8_t on = 0;
+
+    if (nvs_open(PLAYER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    nvs_get_u32(handle, "shuffle_seed", &seed);
+    nvs_get_u8(handle, "shuffle_on", &on);
+    nvs_close(handle);
+    shuffled = on;
+#endif
+}
+
+static uint32_t track_at(uint32_t position)
+{
+    return shuffled ? shuffle_track_at(&order, position) : position;
+}
+
+static uint32_t position_of(uint32_t track)
+{
+    return shuffled ? shuffle_position_of(&order, track) : track;
+}
+
+/*
+ * Hand track to the player with its tags. Until the tag scanner has
+ * reached it, title stands in, or the file name when there is none, and
+ * artist and length stay empty.
+ */
+static void start_track(uint32_t track, const char *title)
+{
+    tag_info_t info;
+    char path[LIBRARY_MAX_PATH];
+
+    memset(&info, 0, sizeof(info));
+#if !CONFIG_IDF_TARGET_LINUX
+    if (meta_scan.lookup(track, &info)) {
+        player.play(track, info.title, info.artist, info.duration_ms);
+        return;
+    }
+    memset(&info, 0, sizeof(info));
+#endif
+    if (title == NULL && library.track_path(track, path, sizeof(path))) {
+        char *name = strrchr(path, '/');
+        name = name ? name + 1 : path;
+        char *ext = strrchr(name, '.');
+        if (ext) {
+            *ext = '\0';
+        }
+        title = name;
+    }
+    player.play(track, title, info.artist, info.duration_ms);
+}
+
+/* Move pos by step, or to position when absolute, and play what is there */
+static uint32_t move_to(int32_t step, uint32_t position, bool absolute)
+{
+    lock_order();
+    if (count == 0) {
+        unlock_order();
+        return 0;
+    }
+    if (absolute) {
+        pos = position % count;
+    } else {
+        pos = (pos + count + step) % count;
+    }
+    uint32_t track = track_at(pos);
+    unlock_order();
+    start_track(track, NULL);
+    return track;
+}
+
+/* Player end timer: the track played out, so the order carries on */
+static void track_ended(void)
+{
+    move_to(1, 0, false);
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Set up the order for a library of track_count tracks; playback advances through it from here on */
+static void init(uint32_t track_count) {
+    lock_order();
+    count = track_count;
+    pos = 0;
+    load_settings();
+    shuffle_init(&order, count, seed);
+    unlock_order();
+    player.set_end_cb(track_ended);
+    ESP_LOGI(TAG, "%" PRIu32 " tracks, shuffle %s", count, shuffled ? "on" : "off");
+}
+
+/* Carry on from a track the player restored at boot; nothing starts playing */
+static void resume(uint32_t track) {
+    lock_order();
+    if (track < count) {
+        pos = position_of(track);
+    }
+    unlock_order();
+}
+
+/* Switch modes without changing the track that is playing */
+static void set_shuffle(bool enable) {
+    lock_order();
+    uint32_t current = track_at(pos);
+    shuffled = enable;
+    pos = position_of(current);
+    unlock_order();
+    save_settings();
+}
+
+static bool shuffle_enabled(void) {
+    return shuffled;
+}
+
+/* Pick a new random order, keeping the current track */
+static void reshuffle(void) {
+    lock_order();
+    uint32_t current = track_at(pos);
+    seed = random_seed();
+    shuffle_init(&order, count, seed);
+    pos = position_of(current);
+    unlock_order();
+    save_settings();
+}
+
+static uint32_t position(void) {
+    return pos;
+}
+
+static uint32_t track(void) {
+    lock_order();
+    uint32_t current = track_at(pos);
+    unlock_order();
+    return current;
+}
+
+/* Advance one position, wrapping into the next cycle of the same order, and play it */
+static uint32_t next(void) {
+    return move_to(1, 0, false);
+}
+
+static uint32_t prev(void) {
+    return move_to(-1, 0, false);
+}
+
+static uint32_t jump(uint32_t position) {
+    return move_to(0, position, true);
+}
+
+/*
+ * Play a track chosen from the library and continue the order from there;
+ * title is what the caller showed for it, used until the tags are in.
+ */
+static void play_track(uint32_t track, const char *title) {
+    lock_order();
+    if (track < count) {
+        pos = position_of(track);
+    }
+    unlock_order();
+    start_track(track, title);
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct PlayOrder play_order = {
+    .init = init,
+    .resume = resume,
+    .set_shuffle = set_shuffle,
+    .shuffle_enabled = shuffle_enabled,
+    .reshuffle = reshuffle,
+    .position = position,
+    .track = track,
+    .next = next,
+    .prev = prev,
+    .jump = jump,
+    .play_track = play_track
+};
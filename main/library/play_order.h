@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Which library track plays next, in order or shuffled. Every track
+ * change goes to the player with the track's tags from the tag scanner,
+ * and once init() has run a track that plays to its end moves on to the
+ * next position. Safe from any task.
+ */
+struct PlayOrder {
+    void (*init)(uint32_t track_count);
+    void (*resume)(uint32_t track);
+    void (*set_shuffle)(bool enable);
+    bool (*shuffle_enabled)(void);
+    void (*reshuffle)(void);
+    uint32_t (*position)(void);
+    uint32_t (*track)(void);
+    uint32_t (*next)(void);
+    uint32_t (*prev)(void);
+    uint32_t (*jump)(uint32_t position);
+    void (*play_track)(uint32_t track, const char *title);
+};
+
+extern const struct PlayOrder play_order;
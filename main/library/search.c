@@ -0,0 +1,312 @@
+#include "search.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    int32_t block;                      /* -1 when empty */
+    uint32_t last_used;
+    uint8_t data[SEARCH_BLOCK_SIZE];
+} cached_block_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "SEARCH";
+
+#define SEARCH_MAGIC "BBSI"
+#define SEARCH_VERSION 1
+#define SEARCH_HEADER_LEN 21
+#define SEARCH_ENTRY_TAIL 5             /* u8 field, u32 track */
+
+static FILE *index_file;
+static uint32_t block_count;
+static uint32_t entry_count;
+static uint8_t sparse_key_len;
+static uint8_t *sparse_keys;            /* first key of every block, zero padded */
+static cached_block_t *cache;
+static uint32_t use_clock;
+static search_stats_t stats;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Same folding as the index builder: ASCII lower-case, everything else as is */
+static size_t normalize(const char *in, char *out)
+{
+    size_t len = 0;
+
+    while (*in == ' ') {
+        in++;
+    }
+    while (*in && len < SEARCH_MAX_KEY) {
+        out[len++] = (char)tolower((unsigned char)*in++);
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* Block from the cache, reading it into the least recently used slot on a miss */
+static const uint8_t *get_block(uint32_t block, uint32_t *reads)
+{
+    cached_block_t *victim = &cache[0];
+
+    for (int i = 0; i < SEARCH_CACHE_BLOCKS; i++) {
+        if (cache[i].block == (int32_t)block) {
+            cache[i].last_used = ++use_clock;
+            stats.cache_hits++;
+            return cache[i].data;
+        }
+        if (cache[i].last_used < victim->last_used) {
+            victim = &cache[i];
+        }
+    }
+
+    victim->block = -1;
+    if (fseek(index_file, (long)(block + 1) * SEARCH_BLOCK_SIZE, SEEK_SET) != 0 ||
+        fread(victim->data, 1, SEARCH_BLOCK_SIZE, index_file) != SEARCH_BLOCK_SIZE) {
+        ESP_LOGE(TAG, "Failed to read block %" PRIu32, block);
+        return NULL;
+    }
+    victim->block = block;
+    victim->last_used = ++use_clock;
+    stats.block_reads++;
+    (*reads)++;
+    return victim->data;
+}
+
+/* Whether the first key of a block, stored whole, sorts strictly before the prefix */
+static bool first_key_before(const uint8_t *block, const char *prefix, size_t len)
+{
+    const uint8_t *p = block + 2;
+
+    if (get_u16(block) == 0 || p[1] > SEARCH_MAX_KEY) {
+        return false;
+    }
+    int cmp = memcmp(p + 2, prefix, p[1] < len ? p[1] : len);
+    return cmp < 0 || (cmp == 0 && p[1] < len);
+}
+
+/*
+ * Last block whose first key sorts strictly before the prefix; the first
+ * match, if any, is in that block or the next one. The sparse keys settle
+ * it unless the prefix is as long as they are and ties with a run of them,
+ * as a long album series does; the run is then binary searched on the
+ * first keys of its blocks, read from the card.
+ */
+static uint32_t find_block(const char *prefix, size_t len, uint32_t *reads)
+{
+    uint8_t probe[UINT8_MAX] = { 0 };
+    uint32_t lo = 0;
+    uint32_t hi = block_count;
+
+    memcpy(probe, prefix, len < sparse_key_len ? len : sparse_key_len);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (memcmp(&sparse_keys[mid * sparse_key_len], probe, sparse_key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (len >= sparse_key_len) {
+        hi = lo;
+        while (hi < block_count && memcmp(&sparse_keys[hi * sparse_key_len], probe, sparse_key_len) == 0) {
+            hi++;
+        }
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            const uint8_t *data = get_block(mid, reads);
+            if (data == NULL) {
+                break;
+            }
+            if (first_key_before(data, prefix, len)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+/*
+ * Walk one block, collecting entries that start with prefix. Returns true
+ * once an entry sorts past every possible match, i.e. the search is over.
+ */
+static bool scan_block(const uint8_t *block, const char *prefix, size_t len,
+                       search_result_t *results, int max_results, int *found)
+{
+    char key[SEARCH_MAX_KEY + 1];
+    size_t key_len = 0;
+    const uint8_t *p = block + 2;
+    const uint8_t *end = block + SEARCH_BLOCK_SIZE;
+    uint16_t entries = get_u16(block);
+
+    for (uint16_t i = 0; i < entries; i++) {
+        if (p + 2 > end) {
+            break;
+        }
+        uint8_t shared = p[0];
+        uint8_t suffix = p[1];
+        if (shared > key_len || shared + suffix > SEARCH_MAX_KEY ||
+            p + 2 + suffix + SEARCH_ENTRY_TAIL > end) {
+            ESP_LOGE(TAG, "Corrupt entry in index");
+            return true;
+        }
+        memcpy(key + shared, p + 2, suffix);
+        key_len = shared + suffix;
+        key[key_len] = '\0';
+        p += 2 + suffix;
+
+        int cmp = memcmp(key, prefix, key_len < len ? key_len : len);
+        if (cmp > 0) {
+            return true;
+        }
+        if (cmp == 0 && key_len >= len) {
+            search_result_t *r = &results[(*found)++];
+            r->field = p[0];
+            r->track = get_u32(p + 1);
+            memcpy(r->text, key, key_len + 1);
+            if (*found == max_results) {
+                return true;
+            }
+        }
+        p += SEARCH_ENTRY_TAIL;
+    }
+    return false;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+static void close_index(void) {
+    if (index_file) {
+        fclose(index_file);
+        index_file = NULL;
+    }
+    free(sparse_keys);
+    sparse_keys = NULL;
+    free(cache);
+    cache = NULL;
+    block_count = 0;
+}
+
+/* Load the header and sparse first-key index of an index file */
+static bool open_index(const char *path) {
+    uint8_t header[SEARCH_HEADER_LEN];
+
+    close_index();
+    index_file = fopen(path, "rb");
+    if (index_file == NULL) {
+        ESP_LOGD(TAG, "No search index at %s", path);
+        return false;
+    }
+    // Every read is a whole block into the cache, stdio buffering would only copy twice
+    setvbuf(index_file, NULL, _IONBF, 0);
+
+    if (fread(header, 1, sizeof(header), index_file) != sizeof(header) ||
+        memcmp(header, SEARCH_MAGIC, 4) != 0 || get_u16(header + 4) != SEARCH_VERSION ||
+        get_u16(header + 6) != SEARCH_BLOCK_SIZE || header[20] == 0) {
+        ESP_LOGE(TAG, "%s is not a version %d search index", path, SEARCH_VERSION);
+        close_index();
+        return false;
+    }
+    block_count = get_u32(header + 8);
+    entry_count = get_u32(header + 12);
+    uint32_t sparse_offset = get_u32(header + 16);
+    sparse_key_len = header[20];
+
+    sparse_keys = malloc((size_t)block_count * sparse_key_len);
+    cache = malloc(SEARCH_CACHE_BLOCKS * sizeof(cached_block_t));
+    if (sparse_keys == NULL || cache == NULL ||
+        fseek(index_file, sparse_offset, SEEK_SET) != 0 ||
+        fread(sparse_keys, sparse_key_len, block_count, index_file) != block_count) {
+        ESP_LOGE(TAG, "Failed to load sparse index of %s", path);
+        close_index();
+        return false;
+    }
+    for (int i = 0; i < SEARCH_CACHE_BLOCKS; i++) {
+        cache[i].block = -1;
+        cache[i].last_used = 0;
+    }
+
+    ESP_LOGD(TAG, "%" PRIu32 " entries in %" PRIu32 " blocks, %" PRIu32 " bytes of index in RAM",
+             entry_count, block_count, block_count * sparse_key_len);
+    return true;
+}
+
+static bool is_open(void) {
+    return index_file != NULL;
+}
+
+/*
+ * Fill results with up to max_results entries starting with prefix, in key
+ * order. Returns the number found, 0 for an empty prefix or no index.
+ */
+static int query(const char *prefix, search_result_t *results, int max_results) {
+    char key[SEARCH_MAX_KEY + 1];
+    size_t len = normalize(prefix, key);
+    uint32_t reads = 0;
+    int found = 0;
+
+    if (index_file == NULL || block_count == 0 || len == 0 || max_results <= 0) {
+        return 0;
+    }
+    stats.queries++;
+
+    uint32_t block = find_block(key, len, &reads);
+    for (int i = 0; i < SEARCH_MAX_BLOCK_READS && block + i < block_count; i++) {
+        const uint8_t *data = get_block(block + i, &reads);
+        if (data == NULL || scan_block(data, key, len, results, max_results, &found)) {
+            break;
+        }
+    }
+
+    if (reads > stats.max_reads) {
+        stats.max_reads = reads;
+    }
+    return found;
+}
+
+/* Copy and reset the counters */
+static void take_stats(search_stats_t *out) {
+    *out = stats;
+    memset(&stats, 0, sizeof(stats));
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Search search = {
+    .open = open_index,
+    .close = close_index,
+    .is_open = is_open,
+    .query = query,
+    .take_stats = take_stats
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef enum {
+    SEARCH_FIELD_TITLE = 0,
+    SEARCH_FIELD_ARTIST = 1,
+    SEARCH_FIELD_ALBUM = 2,
+} search_field_t;
+
+typedef struct {
+    uint32_t track;
+    uint8_t field;                      /* search_field_t */
+    char text[SEARCH_MAX_KEY + 1];      /* normalised (lower-case) key */
+} search_result_t;
+
+typedef struct {
+    uint32_t queries;
+    uint32_t block_reads;
+    uint32_t cache_hits;
+    uint32_t max_reads;                 /* most block reads a single query needed */
+} search_stats_t;
+
+/*
+ * Type-ahead search over the sorted string table built by
+ * tools/build_search_index.py. Only the first key of every 4 KB block is
+ * kept in RAM, cut to a few bytes; a query is one binary search over those
+ * keys and at most SEARCH_MAX_BLOCK_READS block reads, fewer when the block
+ * is still cached from the previous keystroke. A long query that ties with
+ * many cut keys reads a few more blocks to find where it starts.
+ */
+struct Search {
+    bool (*open)(const char *path);
+    void (*close)(void);
+    bool (*is_open)(void);
+    int (*query)(const char *prefix, search_result_t *results, int max_results);
+    void (*take_stats)(search_stats_t *stats);
+};
+
+extern const struct Search search;
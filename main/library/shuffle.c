@@ -0,0 +1,120 @@
+#include "shuffle.h"
+
+#include <string.h>
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/* splitmix32 step, used to expand the seed into round keys */
+static uint32_t next_key(uint32_t *state)
+{
+    uint32_t z = (*state += 0x9E3779B9);
+    z = (z ^ (z >> 16)) * 0x85EBCA6B;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35;
+    return z ^ (z >> 16);
+}
+
+static uint32_t round_fn(const shuffle_t *shuffle, uint32_t half, uint32_t key)
+{
+    uint32_t h = (half * 0x9E3779B1) ^ key;
+    h ^= h >> 15;
+    h *= 0x85EBCA77;
+    h ^= h >> 13;
+    return h & shuffle->half_mask;
+}
+
+static uint32_t encrypt(const shuffle_t *shuffle, uint32_t x)
+{
+    uint32_t left = x >> shuffle->half_bits;
+    uint32_t right = x & shuffle->half_mask;
+
+    for (int i = 0; i < SHUFFLE_ROUNDS; i++) {
+        uint32_t next_right = left ^ round_fn(shuffle, right, shuffle->keys[i]);
+        left = right;
+        right = next_right;
+    }
+    return (left << shuffle->half_bits) | right;
+}
+
+static uint32_t decrypt(const shuffle_t *shuffle, uint32_t x)
+{
+    uint32_t left = x >> shuffle->half_bits;
+    uint32_t right = x & shuffle->half_mask;
+
+    for (int i = SHUFFLE_ROUNDS - 1; i >= 0; i--) {
+        uint32_t prev_left = right ^ round_fn(shuffle, left, shuffle->keys[i]);
+        right = left;
+        left = prev_left;
+    }
+    return (left << shuffle->half_bits) | right;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+void shuffle_init(shuffle_t *shuffle, uint32_t n, uint32_t seed)
+{
+    uint32_t bits = 1;
+    while (bits < 32 && (1u << bits) < n) {
+        bits++;
+    }
+
+    memset(shuffle, 0, sizeof(*shuffle));
+    shuffle->n = n;
+    shuffle->half_bits = (bits + 1) / 2;
+    shuffle->half_mask = (1u << shuffle->half_bits) - 1;
+    for (int i = 0; i < SHUFFLE_ROUNDS; i++) {
+        shuffle->keys[i] = next_key(&seed);
+    }
+}
+
+/* Track index played at a shuffled position, both in [0, n) */
+uint32_t shuffle_track_at(const shuffle_t *shuffle, uint32_t position)
+{
+    if (shuffle->n == 0) {
+        return 0;
+    }
+    uint32_t x = encrypt(shuffle, position % shuffle->n);
+    while (x >= shuffle->n) {
+        x = encrypt(shuffle, x);
+    }
+    return x;
+}
+
+/* Inverse of shuffle_track_at: where in the order a track is played */
+uint32_t shuffle_position_of(const shuffle_t *shuffle, uint32_t track)
+{
+    if (shuffle->n == 0) {
+        return 0;
+    }
+    uint32_t x = decrypt(shuffle, track % shuffle->n);
+    while (x >= shuffle->n) {
+        x = decrypt(shuffle, x);
+    }
+    return x;
+}
+
+/*
+ * Check that one cycle over n positions hits every track exactly once and
+ * that the inverse agrees. scratch_bitmap must hold (n + 7) / 8 bytes.
+ */
+bool shuffle_verify(uint32_t n, uint32_t seed, uint8_t *scratch_bitmap)
+{
+    shuffle_t shuffle;
+
+    shuffle_init(&shuffle, n, seed);
+    memset(scratch_bitmap, 0, (n + 7) / 8);
+    for (uint32_t pos = 0; pos < n; pos++) {
+        uint32_t track = shuffle_track_at(&shuffle, pos);
+        if (track >= n || (scratch_bitmap[track / 8] & (1u << (track % 8)))) {
+            return false;
+        }
+        if (shuffle_position_of(&shuffle, track) != pos) {
+            return false;
+        }
+        scratch_bitmap[track / 8] |= 1u << (track % 8);
+    }
+    return true;
+}
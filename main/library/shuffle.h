@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHUFFLE_ROUNDS 4
+
+/*
+ * Seeded bijective shuffle of [0, n) in constant memory. Positions are
+ * mapped to tracks with a balanced Feistel network over the smallest
+ * even-bit power of two >= n, cycle-walking past values >= n. Both
+ * directions are O(1) expected (fewer than four walks on average), so
+ * next, previous and "jump to position" need no permutation table.
+ */
+typedef struct {
+    uint32_t n;
+    uint32_t half_bits;
+    uint32_t half_mask;
+    uint32_t keys[SHUFFLE_ROUNDS];
+} shuffle_t;
+
+void shuffle_init(shuffle_t *shuffle, uint32_t n, uint32_t seed);
+uint32_t shuffle_track_at(const shuffle_t *shuffle, uint32_t position);
+uint32_t shuffle_position_of(const shuffle_t *shuffle, uint32_t track);
+bool shuffle_verify(uint32_t n, uint32_t seed, uint8_t *scratch_bitmap);
@@ -0,0 +1,521 @@
+#include "tag_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+/* The part of the file currently in buf */
+typedef struct {
+    FILE *f;
+    uint8_t *buf;
+    uint32_t base;              /* file offset of buf[0] */
+    uint32_t len;
+    uint32_t size;              /* of the whole file */
+    uint32_t reads;
+} window_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+/* Enough of a field for TAG_MAX_TEXT bytes of UTF-8 from any encoding, with its key or encoding byte and BOM */
+#define TEXT_SPAN (2 * TAG_MAX_TEXT + 3)
+
+_Static_assert((TAG_READ_SIZE & (TAG_READ_SIZE - 1)) == 0, "reads are aligned to TAG_READ_SIZE");
+_Static_assert(TEXT_SPAN + 10 <= TAG_READ_SIZE, "a frame header and its text fit one read");
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static uint32_t be24(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 16 | p[1] << 8 | p[2];
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* ID3v2 sizes keep the top bit of every byte clear */
+static uint32_t syncsafe(const uint8_t *p)
+{
+    return (uint32_t)(p[0] & 0x7F) << 21 | (p[1] & 0x7F) << 14 | (p[2] & 0x7F) << 7 | (p[3] & 0x7F);
+}
+
+static bool window_has(const window_t *w, uint32_t offset, uint32_t need)
+{
+    return offset >= w->base && (uint64_t)offset - w->base + need <= w->len;
+}
+
+/*
+ * Make [offset, offset + need) readable. Outside the bytes already in
+ * buf this costs one of the TAG_MAX_READS reads, of the aligned block
+ * holding offset so that it stays a single card sector where it can.
+ */
+static const uint8_t *window_get(window_t *w, uint32_t offset, uint32_t need)
+{
+    if (window_has(w, offset, need)) {
+        return w->buf + (offset - w->base);
+    }
+    if (w->reads >= TAG_MAX_READS || need > TAG_READ_SIZE || (uint64_t)offset + need > w->size) {
+        return NULL;
+    }
+
+    uint32_t base = offset & ~(uint32_t)(TAG_READ_SIZE - 1);
+    if (offset - base + need > TAG_READ_SIZE) {
+        base = offset;
+    }
+    w->reads++;
+    w->base = base;
+    w->len = fseek(w->f, base, SEEK_SET) == 0 ? fread(w->buf, 1, TAG_READ_SIZE, w->f) : 0;
+    return offset - base + need <= w->len ? w->buf + (offset - base) : NULL;
+}
+
+static bool complete(const tag_info_t *info)
+{
+    return info->title[0] && info->artist[0] && info->album[0];
+}
+
+/* Append one code point unless it does not fit whole; false once the field is full */
+static bool put_utf8(char *dst, size_t *len, uint32_t cp)
+{
+    char enc[4];
+    size_t n;
+
+    if (cp < 0x80) {
+        enc[0] = cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        enc[0] = 0xC0 | cp >> 6;
+        enc[1] = 0x80 | (cp & 0x3F);
+        n = 2;
+    } else if (cp < 0x10000) {
+        enc[0] = 0xE0 | cp >> 12;
+        enc[1] = 0x80 | (cp >> 6 & 0x3F);
+        enc[2] = 0x80 | (cp & 0x3F);
+        n = 3;
+    } else {
+        enc[0] = 0xF0 | cp >> 18;
+        enc[1] = 0x80 | (cp >> 12 & 0x3F);
+        enc[2] = 0x80 | (cp >> 6 & 0x3F);
+        enc[3] = 0x80 | (cp & 0x3F);
+        n = 4;
+    }
+    if (*len + n > TAG_MAX_TEXT) {
+        return false;
+    }
+    memcpy(dst + *len, enc, n);
+    *len += n;
+    return true;
+}
+
+static void copy_utf8(char *dst, const uint8_t *src, size_t n)
+{
+    size_t len = 0;
+
+    while (len < n && src[len] != '\0') {
+        len++;
+    }
+    if (len > TAG_MAX_TEXT) {
+        // Drop the character the cut lands in
+        len = TAG_MAX_TEXT;
+        while (len > 0 && (src[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void copy_latin1(char *dst, const uint8_t *src, size_t n)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < n && src[i] != '\0' && put_utf8(dst, &len, src[i]); i++) {
+    }
+    dst[len] = '\0';
+}
+
+/* A BOM overrides big_endian */
+static void copy_utf16(char *dst, const uint8_t *src, size_t n, bool big_endian)
+{
+    size_t len = 0;
+    size_t i = 0;
+
+    if (n >= 2 && ((src[0] == 0xFF && src[1] == 0xFE) || (src[0] == 0xFE && src[1] == 0xFF))) {
+        big_endian = src[0] == 0xFE;
+        i = 2;
+    }
+    for (; i + 1 < n; i += 2) {
+        uint32_t cp = big_endian ? src[i] << 8 | src[i + 1] : src[i + 1] << 8 | src[i];
+        if (cp == 0) {
+            break;
+        }
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 3 < n) {
+            uint32_t low = big_endian ? src[i + 2] << 8 | src[i + 3] : src[i + 3] << 8 | src[i + 2];
+            if (low >= 0xDC00 && low < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        if (cp >= 0xD800 && cp < 0xE000) {
+            cp = 0xFFFD;
+        }
+        if (!put_utf8(dst, &len, cp)) {
+            break;
+        }
+    }
+    dst[len] = '\0';
+}
+
+static void trim_spaces(char *s)
+{
+    size_t len = strlen(s);
+
+    while (len > 0 && s[len - 1] == ' ') {
+        s[--len] = '\0';
+    }
+}
+
+/*----------------------------- id3 -------------------------------*/
+
+/* Text frame body: an encoding byte, then the string */
+static void id3_text(char *dst, const uint8_t *p, size_t n)
+{
+    if (n < 1) {
+        return;
+    }
+    switch (p[0]) {
+    case 0:
+        copy_latin1(dst, p + 1, n - 1);
+        break;
+    case 1:
+        copy_utf16(dst, p + 1, n - 1, false);
+        break;
+    case 2:
+        copy_utf16(dst, p + 1, n - 1, true);
+        break;
+    default:
+        copy_utf8(dst, p + 1, n - 1);
+        break;
+    }
+}
+
+/* v2.2 has three letter frame ids */
+static char *id3_field(tag_info_t *info, const uint8_t *id, uint8_t version)
+{
+    if (memcmp(id, version == 2 ? "TT2" : "TIT2", version == 2 ? 3 : 4) == 0) {
+        return info->title;
+    }
+    if (memcmp(id, version == 2 ? "TP1" : "TPE1", version == 2 ? 3 : 4) == 0) {
+        return info->artist;
+    }
+    if (memcmp(id, version == 2 ? "TAL" : "TALB", version == 2 ? 3 : 4) == 0) {
+        return info->album;
+    }
+    return NULL;
+}
+
+/*
+ * Frames in tag order until the text fields are in, and past that only
+ * as far as the bytes already read, for a length frame; padding or the
+ * read budget ends it early.
+ */
+static bool parse_id3v2(window_t *w, tag_info_t *info)
+{
+    const uint8_t *p = window_get(w, 0, 10);
+
+    if (p == NULL || memcmp(p, "ID3", 3) != 0 || p[3] < 2 || p[3] > 4) {
+        return false;
+    }
+    uint8_t version = p[3];
+    uint32_t head_len = version == 2 ? 6 : 10;
+    uint32_t end = 10 + syncsafe(p + 6);
+    uint32_t off = 10;
+
+    if (version > 2 && (p[5] & 0x40)) {
+        // Extended header: v2.3 counts the bytes after its size, v2.4 the whole of it
+        if ((p = window_get(w, off, 4)) == NULL) {
+            return false;
+        }
+        uint32_t ext = version == 3 ? 4 + be32(p) : syncsafe(p);
+        if (ext > end - off) {
+            return false;
+        }
+        off += ext;
+    }
+
+    while ((uint64_t)off + head_len <= end) {
+        if (complete(info) && (info->duration_ms || !window_has(w, off, head_len))) {
+            break;
+        }
+        if ((p = window_get(w, off, head_len)) == NULL || p[0] == '\0') {
+            break;
+        }
+        uint32_t size = version == 2 ? be24(p + 3) : version == 4 ? syncsafe(p + 4) : be32(p + 4);
+        uint8_t flags = version == 2 ? 0 : p[9];
+        char *field = id3_field(info, p, version);
+        bool length = memcmp(p, version == 2 ? "TLE" : "TLEN", version == 2 ? 3 : 4) == 0;
+        uint32_t body = off + head_len;
+
+        if (size > end - body) {
+            break;
+        }
+        off = body + size;
+        if ((field == NULL || field[0]) && !length) {
+            continue;
+        }
+        // Compressed or encrypted text is skipped; a v2.4 data length indicator is stepped over
+        if (flags & (version == 3 ? 0xC0 : 0x0C)) {
+            continue;
+        }
+        if (version == 4 && (flags & 0x01) && size >= 4) {
+            body += 4;
+            size -= 4;
+        }
+
+        uint32_t span = size < TEXT_SPAN ? size : TEXT_SPAN;
+        if ((p = window_get(w, body, span)) == NULL) {
+            continue;
+        }
+        if (field) {
+            id3_text(field, p, span);
+        } else {
+            char digits[TAG_MAX_TEXT + 1] = "";
+            id3_text(digits, p, span);
+            info->duration_ms = strtoul(digits, NULL, 10);
+        }
+    }
+
+    if (info->title[0] || info->artist[0] || info->album[0]) {
+        info->format = TAG_FORMAT_ID3V2;
+    }
+    return true;
+}
+
+/* The 128 bytes at the end of the file; only fills fields the ID3v2 tag left empty */
+static bool parse_id3v1(window_t *w, tag_info_t *info)
+{
+    static const uint8_t offsets[] = { 3, 33, 63 };
+    char *fields[] = { info->title, info->artist, info->album };
+    bool found = false;
+
+    const uint8_t *p = w->size >= 128 ? window_get(w, w->size - 128, 128) : NULL;
+    if (p == NULL || memcmp(p, "TAG", 3) != 0) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fields[i][0] == '\0') {
+            copy_latin1(fields[i], p + offsets[i], 30);
+            trim_spaces(fields[i]);
+            found |= fields[i][0] != '\0';
+        }
+    }
+    if (found && info->format == TAG_FORMAT_NONE) {
+        info->format = TAG_FORMAT_ID3V1;
+    }
+    return found;
+}
+
+/*---------------------------- flac -------------------------------*/
+
+static char *vorbis_field(tag_info_t *info, const uint8_t *key, size_t len)
+{
+    if (len == 5 && strncasecmp((const char *)key, "TITLE", 5) == 0) {
+        return info->title;
+    }
+    if (len == 6 && strncasecmp((const char *)key, "ARTIST", 6) == 0) {
+        return info->artist;
+    }
+    if (len == 5 && strncasecmp((const char *)key, "ALBUM", 5) == 0) {
+        return info->album;
+    }
+    return NULL;
+}
+
+/* VORBIS_COMMENT block in [off, end): little-endian lengths, "KEY=value" in UTF-8 */
+static void parse_vorbis(window_t *w, tag_info_t *info, uint32_t off, uint32_t end)
+{
+    const uint8_t *p;
+
+    // Vendor string, then the comment count
+    if (end - off < 8 || (p = window_get(w, off, 4)) == NULL || le32(p) > end - off - 8) {
+        return;
+    }
+    off += 4 + le32(p);
+    if ((p = window_get(w, off, 4)) == NULL) {
+        return;
+    }
+    uint32_t count = le32(p);
+    off += 4;
+
+    for (uint32_t i = 0; i < count && end - off >= 4 && !complete(info); i++) {
+        if ((p = window_get(w, off, 4)) == NULL) {
+            return;
+        }
+        uint32_t len = le32(p);
+        uint32_t body = off + 4;
+        if (len > end - body) {
+            return;
+        }
+        off = body + len;
+
+        uint32_t span = len < TEXT_SPAN ? len : TEXT_SPAN;
+        if ((p = window_get(w, body, span)) == NULL) {
+            return;
+        }
+        const uint8_t *eq = memchr(p, '=', span);
+        char *field = eq ? vorbis_field(info, p, eq - p) : NULL;
+        if (field && field[0] == '\0') {
+            copy_utf8(field, eq + 1, p + span - eq - 1);
+        }
+    }
+}
+
+/* Metadata blocks up to the Vorbis comments; STREAMINFO, always first, gives the length */
+static bool parse_flac(window_t *w, tag_info_t *info)
+{
+    const uint8_t *p = window_get(w, 0, 4);
+
+    if (p == NULL || memcmp(p, "fLaC", 4) != 0) {
+        return false;
+    }
+    info->format = TAG_FORMAT_FLAC;
+
+    uint32_t off = 4;
+    bool last = false;
+    while (!last && (p = window_get(w, off, 4)) != NULL) {
+        uint8_t type = p[0] & 0x7F;
+        uint32_t len = be24(p + 1);
+        uint32_t body = off + 4;
+        last = p[0] & 0x80;
+        off = body + len;
+
+        if (type == 0 && len >= 18 && (p = window_get(w, body, 18)) != NULL) {
+            uint32_t rate = (uint32_t)p[10] << 12 | p[11] << 4 | p[12] >> 4;
+            uint64_t samples = (uint64_t)(p[13] & 0x0F) << 32 | be32(p + 14);
+            if (rate) {
+                info->duration_ms = (uint32_t)(samples * 1000 / rate);
+            }
+        } else if (type == 4) {
+            parse_vorbis(w, info, body, off);
+            break;
+        }
+    }
+    return true;
+}
+
+/*---------------------------- riff -------------------------------*/
+
+static char *info_field(tag_info_t *info, const uint8_t *id)
+{
+    if (memcmp(id, "INAM", 4) == 0) {
+        return info->title;
+    }
+    if (memcmp(id, "IART", 4) == 0) {
+        return info->artist;
+    }
+    if (memcmp(id, "IPRD", 4) == 0) {
+        return info->album;
+    }
+    return NULL;
+}
+
+/* LIST INFO subchunks in [off, end); the strings are NUL-terminated and taken as UTF-8 */
+static void parse_info(window_t *w, tag_info_t *info, uint32_t off, uint32_t end)
+{
+    const uint8_t *p;
+
+    while (end - off >= 8 && !complete(info) && (p = window_get(w, off, 8)) != NULL) {
+        char *field = info_field(info, p);
+        uint32_t size = le32(p + 4);
+        uint32_t body = off + 8;
+        if (size > end - body) {
+            return;
+        }
+        off = body + size + (size & 1);
+        if (off > end) {
+            off = end;
+        }
+
+        uint32_t span = size < TEXT_SPAN ? size : TEXT_SPAN;
+        if (field && field[0] == '\0' && (p = window_get(w, body, span)) != NULL) {
+            copy_utf8(field, p, span);
+        }
+    }
+}
+
+/* Chunks until LIST INFO, which writers put before or after the data */
+static bool parse_riff(window_t *w, tag_info_t *info)
+{
+    const uint8_t *p = window_get(w, 0, 12);
+
+    if (p == NULL || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    info->format = TAG_FORMAT_RIFF;
+
+    uint32_t byte_rate = 0;
+    uint32_t off = 12;
+    while ((p = window_get(w, off, 8)) != NULL) {
+        char id[4];
+        memcpy(id, p, sizeof(id));
+        uint32_t size = le32(p + 4);
+        uint32_t body = off + 8;
+
+        if (memcmp(id, "fmt ", 4) == 0 && size >= 16 && (p = window_get(w, body, 16)) != NULL) {
+            byte_rate = le32(p + 8);
+        } else if (memcmp(id, "data", 4) == 0 && byte_rate) {
+            info->duration_ms = (uint32_t)((uint64_t)size * 1000 / byte_rate);
+        } else if (memcmp(id, "LIST", 4) == 0 && size >= 4 && (p = window_get(w, body, 4)) != NULL &&
+                   memcmp(p, "INFO", 4) == 0) {
+            parse_info(w, info, body + 4, size > w->size - body ? w->size : body + size);
+            break;
+        }
+        // Chunks are padded to an even length
+        if (size >= UINT32_MAX - body) {
+            break;
+        }
+        off = body + size + (size & 1);
+    }
+    return true;
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+bool tag_parse(FILE *f, uint8_t *buf, tag_info_t *info, uint32_t *reads)
+{
+    window_t w = { .f = f, .buf = buf };
+
+    memset(info, 0, sizeof(*info));
+    // The size comes from the directory entry, so this costs no read
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long size = ftell(f);
+        w.size = size > 0 ? (uint32_t)size : 0;
+    }
+
+    if (!parse_flac(&w, info) && !parse_riff(&w, info)) {
+        parse_id3v2(&w, info);
+        if (!complete(info)) {
+            parse_id3v1(&w, info);
+        }
+    }
+
+    if (reads) {
+        *reads = w.reads;
+    }
+    return info->title[0] || info->artist[0] || info->album[0];
+}
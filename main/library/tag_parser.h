@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "system_config.h"
+
+typedef enum {
+    TAG_FORMAT_NONE = 0,
+    TAG_FORMAT_ID3V2,
+    TAG_FORMAT_ID3V1,
+    TAG_FORMAT_FLAC,            /* Vorbis comments */
+    TAG_FORMAT_RIFF,            /* LIST INFO */
+} tag_format_t;
+
+typedef struct {
+    uint32_t duration_ms;               /* 0 when the header does not say */
+    uint8_t format;                     /* tag_format_t the fields came from */
+    char title[TAG_MAX_TEXT + 1];       /* UTF-8; empty when the tag has none */
+    char artist[TAG_MAX_TEXT + 1];
+    char album[TAG_MAX_TEXT + 1];
+} tag_info_t;
+
+/*
+ * Title, artist, album and length from the tag at the head of a file,
+ * without reading the audio. buf holds TAG_READ_SIZE bytes and is read a
+ * sector-aligned TAG_READ_SIZE at a time, at most TAG_MAX_READS times:
+ * the first read covers the usual tag, the second follows one that runs
+ * past it (cover art ahead of the text frames, a RIFF LIST after the
+ * data chunk) or fetches the ID3v1 tail. Text longer than TAG_MAX_TEXT
+ * bytes is cut on a character boundary. Returns false when no field was
+ * found; reads, when not NULL, is set to the reads it took.
+ */
+bool tag_parse(FILE *f, uint8_t *buf, tag_info_t *info, uint32_t *reads);
@@ -1,21 +1,90 @@
 #include "esp_log.h"
+#include "nvs_flash.h"
 
 #include "gui.h"
+#include "sd_fs.h"
 #include "ui.h"
 #include "sd_card.h"
+#include "library.h"
+#include "play_order.h"
+#include "meta_scan.h"
+#include "bench.h"
+#include "trace.h"
+#include "buf_pool.h"
+#include "spectrum.h"
+#include "output.h"
+#include "player.h"
+#include "playback_state.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <stdlib.h>
+#include <string.h>
+#include "headless.h"
+#else
+#include "console.h"
+#endif
 
 
 static const char *TAG = "MAIN";
 
+#if !CONFIG_IDF_TARGET_LINUX
+/* NVS holds player settings as well as Bluetooth PHY calibration data */
+static void nvs_init(void)
+{
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+}
+#endif
+
 // /*********************************************************************
 //  * MAIN APPLICATION
 //  *********************************************************************/
 
 void app_main(void) {
     ESP_LOGI(TAG, "*** Beat-Byte Main Starting ***");
+#if CONFIG_IDF_TARGET_LINUX
+    const char *bench_filter = getenv(HOST_BENCH_ENV);
+    if (bench_filter) {
+        exit(bench.run(strcmp(bench_filter, "all") == 0 ? NULL : bench_filter) ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+#else
+    nvs_init();
+    console.init();
+    trace.init();
+    bench.init();
+#endif
+    buf_pool.init();
+    spectrum.init();
+    output.init();
+    // Before the card and the library: the saved state carries everything the player screen shows
+    playback_state.init(player.snapshot);
+    playback_state_t resumed;
+    bool have_resumed = playback_state.resume(&resumed);
+    if (have_resumed) {
+        player.restore(&resumed);
+    }
     gui.init();
+    sd_fs.init();
     create_ui();
+#if CONFIG_IDF_TARGET_LINUX
+    exit(headless.run());
+#else
     sd_card.init();
+    if (!library.load()) {
+        library.scan();
+    }
+    // The scan makes LIBRARY_DB_DIR on a fresh card
+    playback_state.open_history(PLAYBACK_HISTORY_FILE);
+    play_order.init(library.track_count());
+    if (have_resumed) {
+        // Next and previous go on from the restored track, not from the top of the order
+        play_order.resume(resumed.track);
+    }
+    meta_scan.start();
+#endif
 }
-
-
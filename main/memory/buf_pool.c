@@ -0,0 +1,260 @@
+#include "buf_pool.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    size_t size;
+    uint32_t count;
+    buf_block_t *blocks;
+    atomic_uint free_bits;          /* bit i set while block i is free */
+#if !CONFIG_IDF_TARGET_LINUX
+    SemaphoreHandle_t available;    /* counts the set bits, so takers can wait */
+#endif
+    atomic_uint gets;
+    atomic_uint waits;
+    atomic_uint failures;
+    atomic_uint min_free;
+    atomic_uint wait_us_max;
+    atomic_ullong wait_us_total;
+} pool_class_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "BUF POOL";
+
+static pool_class_t classes[BUF_POOL_CLASSES] = {
+    [BUF_POOL_SMALL] = { .size = BUF_POOL_SMALL_SIZE, .count = BUF_POOL_SMALL_COUNT },
+    [BUF_POOL_SECTOR] = { .size = BUF_POOL_SECTOR_SIZE, .count = BUF_POOL_SECTOR_COUNT },
+    [BUF_POOL_DRAW] = { .size = BUF_POOL_DRAW_SIZE, .count = BUF_POOL_DRAW_COUNT },
+};
+
+static bool initialized;
+
+_Static_assert(BUF_POOL_SMALL_COUNT <= 32 && BUF_POOL_SECTOR_COUNT <= 32 && BUF_POOL_DRAW_COUNT <= 32,
+               "free_bits holds at most 32 blocks per class");
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void *alloc_slab(size_t size)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return aligned_alloc(BUF_POOL_ALIGN, size);
+#else
+    return heap_caps_aligned_alloc(BUF_POOL_ALIGN, size, MALLOC_CAP_DMA);
+#endif
+}
+
+static void store_min(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value < cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void store_max(atomic_uint *target, uint32_t value)
+{
+    uint32_t cur = atomic_load(target);
+    while (value > cur && !atomic_compare_exchange_weak(target, &cur, value)) {
+    }
+}
+#endif
+
+/*
+ * Wait until the class has a free block for this caller. On the device the
+ * semaphore reserves one, so the claim below cannot come up empty; the
+ * host build has no scheduler to wait on and only reports whether one is
+ * free right now.
+ */
+static bool reserve(pool_class_t *c, uint32_t timeout_ms)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    if (atomic_load(&c->free_bits) == 0) {
+        atomic_fetch_add(&c->waits, 1);
+        atomic_fetch_add(&c->failures, 1);
+        return false;
+    }
+    return true;
+#else
+    if (xSemaphoreTake(c->available, 0) == pdTRUE) {
+        return true;
+    }
+    atomic_fetch_add(&c->waits, 1);
+    int64_t start = esp_timer_get_time();
+    bool ok = xSemaphoreTake(c->available, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+    uint32_t waited = esp_timer_get_time() - start;
+    atomic_fetch_add(&c->wait_us_total, waited);
+    store_max(&c->wait_us_max, waited);
+    if (!ok) {
+        atomic_fetch_add(&c->failures, 1);
+    }
+    return ok;
+#endif
+}
+
+/* Take the lowest free block; lock-free against concurrent gets and unrefs */
+static buf_block_t *claim(pool_class_t *c)
+{
+    uint32_t bits = atomic_load(&c->free_bits);
+    uint32_t index;
+
+    do {
+        if (bits == 0) {
+            return NULL;
+        }
+        index = __builtin_ctz(bits);
+    } while (!atomic_compare_exchange_weak(&c->free_bits, &bits, bits & ~(1u << index)));
+
+    store_min(&c->min_free, __builtin_popcount(bits) - 1);
+    return &c->blocks[index];
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int pool_cmd(int argc, char **argv)
+{
+    buf_pool_stats_t stats[BUF_POOL_CLASSES];
+
+    buf_pool.take_stats(stats);
+    for (int i = 0; i < BUF_POOL_CLASSES; i++) {
+        printf("class %d: %u x %u B, gets %" PRIu32 ", waits %" PRIu32 ", failures %" PRIu32
+               ", min free %" PRIu32 ", wait max %" PRIu32 " us, wait total %" PRIu64 " us\n",
+               i, (unsigned)stats[i].count, (unsigned)stats[i].size, stats[i].gets, stats[i].waits,
+               stats[i].failures, stats[i].min_free, stats[i].wait_us_max, stats[i].wait_us_total);
+    }
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Allocate every class up front and register the "pool" console command */
+static void init() {
+    if (initialized) {
+        return;
+    }
+
+    for (int i = 0; i < BUF_POOL_CLASSES; i++) {
+        pool_class_t *c = &classes[i];
+        size_t stride = (c->size + BUF_POOL_ALIGN - 1) & ~(size_t)(BUF_POOL_ALIGN - 1);
+        uint8_t *slab = alloc_slab(stride * c->count);
+        c->blocks = calloc(c->count, sizeof(buf_block_t));
+        if (slab == NULL || c->blocks == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate %" PRIu32 " x %u B blocks", c->count, (unsigned)c->size);
+            abort();
+        }
+
+        for (uint32_t b = 0; b < c->count; b++) {
+            c->blocks[b].data = slab + b * stride;
+            c->blocks[b].size = c->size;
+            c->blocks[b].cls = i;
+            c->blocks[b].index = b;
+        }
+        atomic_store(&c->free_bits, c->count == 32 ? UINT32_MAX : (1u << c->count) - 1);
+        atomic_store(&c->min_free, c->count);
+#if !CONFIG_IDF_TARGET_LINUX
+        c->available = xSemaphoreCreateCounting(c->count, c->count);
+#endif
+    }
+    initialized = true;
+
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "pool",
+        .help = "Show buffer pool usage and wait counters since the last call",
+        .hint = NULL,
+        .func = pool_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+    ESP_LOGI(TAG, "Buffer pool ready");
+}
+
+/* A block of the smallest class holding size bytes with one reference, or NULL */
+static buf_block_t *get(size_t size, uint32_t timeout_ms) {
+    for (int i = 0; i < BUF_POOL_CLASSES; i++) {
+        pool_class_t *c = &classes[i];
+        if (size > c->size) {
+            continue;
+        }
+        atomic_fetch_add(&c->gets, 1);
+        if (!reserve(c, timeout_ms)) {
+            return NULL;
+        }
+        buf_block_t *block = claim(c);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->len = 0;
+        atomic_store(&block->refs, 1);
+        return block;
+    }
+    ESP_LOGE(TAG, "No class holds %u B", (unsigned)size);
+    return NULL;
+}
+
+static void ref(buf_block_t *block) {
+    atomic_fetch_add(&block->refs, 1);
+}
+
+/* Drop a reference; the last one hands the block back to its class */
+static void unref(buf_block_t *block) {
+    if (atomic_fetch_sub(&block->refs, 1) != 1) {
+        return;
+    }
+    pool_class_t *c = &classes[block->cls];
+    atomic_fetch_or(&c->free_bits, 1u << block->index);
+#if !CONFIG_IDF_TARGET_LINUX
+    xSemaphoreGive(c->available);
+#endif
+}
+
+/* Copy and reset the counters; min_free restarts from the current free count */
+static void take_stats(buf_pool_stats_t stats[BUF_POOL_CLASSES]) {
+    for (int i = 0; i < BUF_POOL_CLASSES; i++) {
+        pool_class_t *c = &classes[i];
+        stats[i].size = c->size;
+        stats[i].count = c->count;
+        stats[i].gets = atomic_exchange(&c->gets, 0);
+        stats[i].waits = atomic_exchange(&c->waits, 0);
+        stats[i].failures = atomic_exchange(&c->failures, 0);
+        stats[i].min_free = atomic_exchange(&c->min_free, __builtin_popcount(atomic_load(&c->free_bits)));
+        stats[i].wait_us_max = atomic_exchange(&c->wait_us_max, 0);
+        stats[i].wait_us_total = atomic_exchange(&c->wait_us_total, 0);
+    }
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct BufPool buf_pool = {
+    .init = init,
+    .get = get,
+    .ref = ref,
+    .unref = unref,
+    .take_stats = take_stats
+};
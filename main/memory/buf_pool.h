@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef enum {
+    BUF_POOL_SMALL = 0,         /* PCM blocks, packet payloads */
+    BUF_POOL_SECTOR,            /* one SD sector / SPI transfer */
+    BUF_POOL_DRAW,              /* one LVGL partial draw buffer */
+    BUF_POOL_CLASSES
+} buf_pool_class_t;
+
+/*
+ * A pooled block. Pass the descriptor, not the data pointer, between
+ * stages; each stage that keeps the block takes a reference and drops it
+ * when done, and the block returns to the pool on the last unref.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t size;                /* capacity, the class size */
+    size_t len;                 /* valid bytes, set by whoever fills it */
+    atomic_uint refs;
+    uint8_t cls;
+    uint8_t index;
+} buf_block_t;
+
+typedef struct {
+    size_t size;
+    uint32_t count;
+    uint32_t gets;
+    uint32_t waits;             /* gets that found the class empty */
+    uint32_t failures;          /* gets that gave up after their timeout */
+    uint32_t min_free;          /* low-water mark since the last take_stats */
+    uint32_t wait_us_max;
+    uint64_t wait_us_total;
+} buf_pool_stats_t;
+
+/*
+ * Fixed-size classes of DMA-capable, BUF_POOL_ALIGN-aligned blocks,
+ * allocated once at init. get() hands out the smallest class that fits and
+ * blocks up to timeout_ms when it is empty (the host build never blocks).
+ * ref/unref are safe from any task.
+ */
+struct BufPool {
+    void (*init)(void);
+    buf_block_t *(*get)(size_t size, uint32_t timeout_ms);
+    void (*ref)(buf_block_t *block);
+    void (*unref)(buf_block_t *block);
+    void (*take_stats)(buf_pool_stats_t stats[BUF_POOL_CLASSES]);
+};
+
+extern const struct BufPool buf_pool;
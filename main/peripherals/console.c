@@ -0,0 +1,89 @@
+#include "console.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "system_config.h"
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "CONSOLE";
+static QueueHandle_t line_queue;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+/*
+ * UART0 is shared with the keypad, so there is no REPL. Command lines are
+ * picked out of the key stream by the input driver and executed here, off
+ * the LVGL task, so long-running commands do not freeze the UI.
+ */
+static void console_task(void *arg)
+{
+    char line[CONSOLE_MAX_LINE];
+    int ret;
+
+    while (1) {
+        if (xQueueReceive(line_queue, line, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        esp_err_t err = esp_console_run(line, &ret);
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Unknown command: %s", line);
+        } else if (err == ESP_OK && ret != 0) {
+            ESP_LOGE(TAG, "Command returned non-zero error code: %d", ret);
+        } else if (err != ESP_OK && err != ESP_ERR_INVALID_ARG) {
+            ESP_LOGE(TAG, "Internal error: %s", esp_err_to_name(err));
+        }
+    }
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Set up the command registry and the task that runs commands */
+static void init() {
+    esp_console_config_t console_config = ESP_CONSOLE_CONFIG_DEFAULT();
+    console_config.max_cmdline_length = CONSOLE_MAX_LINE;
+    ESP_ERROR_CHECK(esp_console_init(&console_config));
+    ESP_ERROR_CHECK(esp_console_register_help_command());
+
+    line_queue = xQueueCreate(CONSOLE_QUEUE_DEPTH, CONSOLE_MAX_LINE);
+    xTaskCreate(console_task, "console", CONSOLE_TASK_STACK_SIZE, NULL, CONSOLE_TASK_PRIORITY, NULL);
+    ESP_LOGI(TAG, "Console initialized");
+}
+
+static void register_cmd(const esp_console_cmd_t *cmd) {
+    ESP_ERROR_CHECK(esp_console_cmd_register(cmd));
+}
+
+/* Queue a command line for execution; safe to call from the LVGL task */
+static bool submit(const char *line) {
+    char buf[CONSOLE_MAX_LINE];
+
+    if (line_queue == NULL) {
+        return false;
+    }
+    snprintf(buf, sizeof(buf), "%s", line);
+    return xQueueSend(line_queue, buf, 0) == pdTRUE;
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Console console = {
+    .init = init,
+    .register_cmd = register_cmd,
+    .submit = submit
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_console.h"
+
+struct Console {
+    void (*init)(void);
+    void (*register_cmd)(const esp_console_cmd_t *cmd);
+    bool (*submit)(const char *line);
+};
+
+extern const struct Console console;
@@ -1,10 +1,12 @@
 #include "lcd.h"
 
+#include <sys/param.h>
+
 #include "esp_log.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
-#include "driver/gpio.h"
+#include "driver/ledc.h"
 
 #include "system_config.h"
 
@@ -20,14 +22,29 @@ static esp_lcd_panel_io_handle_t io_handle;
  * PRIVATE FUNCTIONS
  *********************************************************************/
 
-/* Configure the GPIO for the LCD backlight control */
-static void gpio_init() {
-    gpio_config_t bk_gpio_config = {
-        .pin_bit_mask = 1ULL << LCD_BK_GPIO_NUM,
-        .mode = GPIO_MODE_OUTPUT,
+/* Drive the LCD backlight from LEDC PWM so it can be dimmed and faded in hardware */
+static void backlight_init() {
+    ledc_timer_config_t timer_config = {
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .duty_resolution = LCD_BK_LEDC_RESOLUTION,
+        .timer_num = LCD_BK_LEDC_TIMER,
+        .freq_hz = LCD_BK_LEDC_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+    ESP_ERROR_CHECK(ledc_timer_config(&timer_config));
+
+    ledc_channel_config_t channel_config = {
+        .gpio_num = LCD_BK_GPIO_NUM,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = LCD_BK_LEDC_CHANNEL,
+        .timer_sel = LCD_BK_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+        .flags.output_invert = LCD_BK_LIGHT_ON_LVL == 0,
     };
-    ESP_ERROR_CHECK(gpio_config(&bk_gpio_config));
-    ESP_LOGI(TAG, "GPIO initialized");
+    ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
+    ESP_ERROR_CHECK(ledc_fade_func_install(0));
+    ESP_LOGI(TAG, "Backlight PWM initialized");
 }
 
 /* Configure the SPI bus for the LCD interface */
@@ -75,10 +92,22 @@ void panel_init() {
  * PUBLIC FUNCTIONS
  *********************************************************************/
 
+/*
+ * Set the backlight to pct of full brightness, fading over fade_ms without
+ * waiting for it. A change requested while a fade runs waits for that fade.
+ */
+static void set_backlight(uint8_t pct, uint32_t fade_ms) {
+    uint32_t duty = ((1u << LCD_BK_LEDC_RESOLUTION) - 1) * MIN(pct, 100) / 100;
+    if (fade_ms) {
+        ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, LCD_BK_LEDC_CHANNEL, duty, fade_ms, LEDC_FADE_NO_WAIT);
+    } else {
+        ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, LCD_BK_LEDC_CHANNEL, duty, 0);
+    }
+}
+
 /* Enable or disable the LCD backlight */
 static void enable_backlight(bool enable) {
-    int set_level = enable ? LCD_BK_LIGHT_ON_LVL : LCD_BK_LIGHT_OFF_LVL;
-    gpio_set_level((gpio_num_t)LCD_BK_GPIO_NUM, set_level);   
+    set_backlight(enable ? 100 : 0, 0);
 }
 
 /* Turn on or off the LCD panel */
@@ -86,9 +115,15 @@ static void enable_panel(bool enable) {
     ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(handle, enable));  
 }
 
+/* Rotate through MADCTL, so the panel maps incoming pixels and flushes stay plain copies */
+static void set_orientation(bool swap_xy, bool mirror_x, bool mirror_y) {
+    ESP_ERROR_CHECK(esp_lcd_panel_swap_xy(handle, swap_xy));
+    ESP_ERROR_CHECK(esp_lcd_panel_mirror(handle, mirror_x, mirror_y));
+}
+
 /* Fully initialize the LCD interface in sequence */
 static void init() {
-    gpio_init();
+    backlight_init();
     spi_init();
 
     enable_backlight(true);
@@ -103,7 +138,9 @@ static void init() {
 const struct Lcd lcd = {
     .init = init,
     .enable_backlight = enable_backlight,
+    .set_backlight = set_backlight,
     .enable_panel = enable_panel,
+    .set_orientation = set_orientation,
     .handle = &handle,
     .io_handle = &io_handle
 };
@@ -5,7 +5,9 @@
 struct Lcd {
     void (*init)(void);
     void (*enable_backlight)(bool);
+    void (*set_backlight)(uint8_t pct, uint32_t fade_ms);
     void (*enable_panel)(bool);
+    void (*set_orientation)(bool swap_xy, bool mirror_x, bool mirror_y);
     esp_lcd_panel_handle_t *handle;
     esp_lcd_panel_io_handle_t *io_handle;
 };
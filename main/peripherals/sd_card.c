@@ -77,7 +77,7 @@ static void init() {
         .sclk_io_num = SD_SPI_CLK_GPIO_NUM,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
-        .max_transfer_sz = 4000,
+        .max_transfer_sz = BUF_POOL_SECTOR_SIZE,
     };
 
 
@@ -0,0 +1,341 @@
+#include "block_cache.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include <sys/lock.h>
+#include "esp_heap_caps.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    uint32_t id;
+    uint32_t block;
+    uint32_t len;               /* valid bytes; short in a file's last block */
+    uint32_t stamp;             /* last use; 0 while empty */
+    bool ahead;                 /* read ahead and not used yet */
+} slot_t;
+
+/* A file whose blocks may be cached, compared in full when it is opened again */
+typedef struct {
+    char path[LIBRARY_MAX_PATH];
+    uint32_t size;
+    int64_t mtime;
+    uint32_t id;
+    uint32_t stamp;             /* last open; 0 while empty */
+} known_file_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "BLOCK CACHE";
+
+#define BLOCK_SIZE BLOCK_CACHE_BLOCK_SIZE
+
+_Static_assert(BLOCK_CACHE_READ_AHEAD + 1 <= BLOCK_CACHE_BLOCKS / 2,
+               "a miss and its read-ahead must leave half of the cache alone");
+
+#if !CONFIG_IDF_TARGET_LINUX
+static _lock_t cache_lock;
+#endif
+
+static uint8_t *slab;           /* BLOCK_CACHE_BLOCKS blocks back to back, so a run of slots takes one read */
+static slot_t slots[BLOCK_CACHE_BLOCKS];
+static known_file_t files[BLOCK_CACHE_FILES];
+static uint32_t last_id;
+static uint32_t use_count;
+static block_cache_stats_t stats;
+static atomic_uint card_total;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_cache(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&cache_lock);
+#endif
+}
+
+static void unlock_cache(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&cache_lock);
+#endif
+}
+
+static uint8_t *slot_data(const slot_t *slot)
+{
+    return slab + (slot - slots) * BLOCK_SIZE;
+}
+
+static slot_t *find(uint32_t id, uint32_t block)
+{
+    for (int i = 0; i < BLOCK_CACHE_BLOCKS; i++) {
+        if (slots[i].stamp && slots[i].id == id && slots[i].block == block) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Caller holds cache_lock. The id of the file as it is now: the known one
+ * when path, size and time all match, otherwise a new one in place of the
+ * least recently opened entry, whose blocks go with it.
+ */
+static uint32_t file_id(const char *path, uint32_t size, int64_t mtime)
+{
+    known_file_t *victim = &files[0];
+
+    for (int i = 0; i < BLOCK_CACHE_FILES; i++) {
+        known_file_t *k = &files[i];
+        if (k->stamp && k->size == size && k->mtime == mtime && strcmp(k->path, path) == 0) {
+            k->stamp = ++use_count;
+            return k->id;
+        }
+        if (k->stamp < victim->stamp) {
+            victim = k;
+        }
+    }
+
+    for (int i = 0; victim->stamp && i < BLOCK_CACHE_BLOCKS; i++) {
+        if (slots[i].id == victim->id) {
+            slots[i].stamp = 0;
+        }
+    }
+    if (++last_id == 0) {
+        last_id = 1;
+    }
+    // A path too long to remember still gets an id of its own, just not found again
+    bool fits = strlen(path) < sizeof(victim->path);
+    snprintf(victim->path, sizeof(victim->path), "%s", fits ? path : "");
+    victim->size = size;
+    victim->mtime = mtime;
+    victim->id = last_id;
+    victim->stamp = fits ? ++use_count : 0;
+    return last_id;
+}
+
+/* First of count adjacent slots whose most recent use is the oldest */
+static int victim_run(uint32_t count)
+{
+    uint32_t best_stamp = UINT32_MAX;
+    int best = 0;
+
+    for (int i = 0; i + count <= BLOCK_CACHE_BLOCKS; i++) {
+        uint32_t newest = 0;
+        for (uint32_t k = 0; k < count; k++) {
+            if (slots[i + k].stamp > newest) {
+                newest = slots[i + k].stamp;
+            }
+        }
+        if (newest < best_stamp) {
+            best_stamp = newest;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Caller holds cache_lock. Read block, and the read-ahead when the miss is sequential, in one pread */
+static slot_t *fill(block_cache_file_t *file, uint32_t block)
+{
+    uint32_t last = (file->size - 1) / BLOCK_SIZE;
+    uint32_t count = block == file->next_block ? 1 + BLOCK_CACHE_READ_AHEAD : 1;
+
+    if (count > last - block + 1) {
+        count = last - block + 1;
+    }
+    for (uint32_t k = 1; k < count; k++) {
+        if (find(file->id, block + k)) {
+            count = k;
+            break;
+        }
+    }
+
+    int first = victim_run(count);
+    for (uint32_t k = 0; k < count; k++) {
+        slots[first + k].stamp = 0;
+    }
+    ssize_t got = pread(file->fd, slot_data(&slots[first]), count * BLOCK_SIZE, (off_t)block * BLOCK_SIZE);
+    stats.card_reads++;
+    if (got <= 0) {
+        return NULL;
+    }
+    stats.bytes_in += got;
+    atomic_fetch_add(&card_total, (uint32_t)got);
+
+    for (uint32_t k = 0; k < count && (ssize_t)(k * BLOCK_SIZE) < got; k++) {
+        slot_t *s = &slots[first + k];
+        s->id = file->id;
+        s->block = block + k;
+        s->len = got - k * BLOCK_SIZE < BLOCK_SIZE ? got - k * BLOCK_SIZE : BLOCK_SIZE;
+        s->stamp = ++use_count;
+        s->ahead = k > 0;
+    }
+    file->next_block = block + count;
+    return &slots[first];
+}
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Allocate the blocks where the SD driver can DMA straight into them */
+static void init(void) {
+    if (slab) {
+        return;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    slab = aligned_alloc(BUF_POOL_ALIGN, BLOCK_CACHE_BLOCKS * BLOCK_SIZE);
+#else
+    slab = heap_caps_aligned_alloc(BUF_POOL_ALIGN, BLOCK_CACHE_BLOCKS * BLOCK_SIZE, MALLOC_CAP_DMA);
+#endif
+    if (slab == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d x %d B blocks", BLOCK_CACHE_BLOCKS, BLOCK_SIZE);
+        abort();
+    }
+    ESP_LOGI(TAG, "%d x %d B blocks, %d read ahead", BLOCK_CACHE_BLOCKS, BLOCK_SIZE, BLOCK_CACHE_READ_AHEAD);
+}
+
+/* flags as for open(2) */
+static bool open_file(block_cache_file_t *file, const char *path, int flags) {
+    struct stat st;
+
+    file->fd = open(path, flags, 0664);
+    if (file->fd < 0) {
+        return false;
+    }
+    if (fstat(file->fd, &st) != 0) {
+        close(file->fd);
+        file->fd = -1;
+        return false;
+    }
+    uint32_t size = st.st_size;
+    lock_cache();
+    file->id = file_id(path, size, st.st_mtime);
+    unlock_cache();
+    file->size = size;
+    file->next_block = 0;
+    return true;
+}
+
+static void close_file(block_cache_file_t *file) {
+    if (file->fd >= 0) {
+        close(file->fd);
+        file->fd = -1;
+    }
+}
+
+/* Copy up to len bytes from offset; short at the end of the file or on a card error */
+static uint32_t read_file(block_cache_file_t *file, uint32_t offset, void *dst, uint32_t len) {
+    uint8_t *out = dst;
+    uint32_t done = 0;
+
+    if (offset >= file->size) {
+        return 0;
+    }
+    if (len > file->size - offset) {
+        len = file->size - offset;
+    }
+
+    lock_cache();
+    while (done < len) {
+        uint32_t pos = offset + done;
+        uint32_t in = pos % BLOCK_SIZE;
+        slot_t *s = find(file->id, pos / BLOCK_SIZE);
+        if (s) {
+            stats.hits++;
+            stats.ahead_used += s->ahead;
+            s->ahead = false;
+        } else {
+            stats.misses++;
+            s = fill(file, pos / BLOCK_SIZE);
+            if (s == NULL) {
+                break;
+            }
+        }
+        s->stamp = ++use_count;
+        if (s->len <= in) {
+            break;
+        }
+        uint32_t n = s->len - in < len - done ? s->len - in : len - done;
+        memcpy(out + done, slot_data(s) + in, n);
+        done += n;
+    }
+    stats.bytes_out += done;
+    unlock_cache();
+    return done;
+}
+
+/*
+ * Write through, dropping the cached blocks the write covers. A write that
+ * extends the file also drops the block the old end was in: cached short,
+ * it would stop reads there, and a write past the end leaves a gap in it.
+ */
+static uint32_t write_file(block_cache_file_t *file, uint32_t offset, const void *src, uint32_t len) {
+    ssize_t written = pwrite(file->fd, src, len, offset);
+    if (written <= 0) {
+        return 0;
+    }
+
+    lock_cache();
+    for (uint32_t block = offset / BLOCK_SIZE; block <= (offset + written - 1) / BLOCK_SIZE; block++) {
+        slot_t *s = find(file->id, block);
+        if (s) {
+            s->stamp = 0;
+        }
+    }
+    slot_t *tail = offset + written > file->size ? find(file->id, file->size / BLOCK_SIZE) : NULL;
+    if (tail) {
+        tail->stamp = 0;
+    }
+    unlock_cache();
+    if (offset + written > file->size) {
+        file->size = offset + written;
+    }
+    return written;
+}
+
+/* Bytes read from the card since boot; never reset, for accounting over frames */
+static uint32_t card_bytes(void) {
+    return atomic_load(&card_total);
+}
+
+/* Copy the counters and reset them */
+static void take_stats(block_cache_stats_t *out) {
+    lock_cache();
+    *out = stats;
+    memset(&stats, 0, sizeof(stats));
+    unlock_cache();
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct BlockCache block_cache = {
+    .init = init,
+    .open = open_file,
+    .close = close_file,
+    .read = read_file,
+    .write = write_file,
+    .card_bytes = card_bytes,
+    .take_stats = take_stats
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef struct {
+    int fd;
+    uint32_t id;                /* names the file's blocks in the cache; never reused */
+    uint32_t size;
+    uint32_t next_block;        /* the block after the last miss; a miss there reads ahead */
+} block_cache_file_t;
+
+typedef struct {
+    uint32_t hits;              /* block lookups served from memory */
+    uint32_t misses;
+    uint32_t ahead_used;        /* read-ahead blocks hit before they were evicted */
+    uint32_t card_reads;        /* reads issued to the card, each one miss and its read-ahead */
+    uint32_t bytes_in;          /* read from the card */
+    uint32_t bytes_out;         /* handed to callers */
+} block_cache_stats_t;
+
+/*
+ * Shared LRU of BLOCK_CACHE_BLOCKS blocks of BLOCK_CACHE_BLOCK_SIZE bytes,
+ * one FATFS sector each, for readers that make many small reads: LVGL's
+ * fonts, images and directory browsing. A read copies out of cached
+ * blocks; a miss reads the block with one pread into the least recently
+ * used slot, and when it continues the file's previous miss the next
+ * BLOCK_CACHE_READ_AHEAD blocks come with it in the same read.
+ *
+ * Blocks are keyed by a file id and the block number. The cache remembers
+ * the path, size and modification time behind the last BLOCK_CACHE_FILES
+ * ids, so reopening a file finds its blocks again and a file rewritten
+ * behind the cache's back gets a new id. Writes go straight to the file
+ * and drop the blocks they cover, and the old short last block when they
+ * extend the file.
+ */
+struct BlockCache {
+    void (*init)(void);
+    bool (*open)(block_cache_file_t *file, const char *path, int flags);
+    void (*close)(block_cache_file_t *file);
+    uint32_t (*read)(block_cache_file_t *file, uint32_t offset, void *dst, uint32_t len);
+    uint32_t (*write)(block_cache_file_t *file, uint32_t offset, const void *src, uint32_t len);
+    uint32_t (*card_bytes)(void);
+    void (*take_stats)(block_cache_stats_t *stats);
+};
+
+extern const struct BlockCache block_cache;
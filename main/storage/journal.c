@@ -0,0 +1,502 @@
+#include "journal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include <sys/lock.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "JOURNAL";
+
+#define RECORD_MAGIC 0xB7
+#define RECORD_HEADER_LEN 4
+#define RECORD_CRC_LEN 4
+#define RECORD_OVERHEAD (RECORD_HEADER_LEN + RECORD_CRC_LEN)
+
+static FILE *file;
+static char file_path[SD_MAX_CHAR_SIZE];
+static journal_snapshot_cb_t snapshot_cb;
+static void *snapshot_ctx;
+
+/*
+ * Two unit buffers: appends fill the active one while a full one waits for
+ * its write, or while the spare holds a copy of a partly filled unit being
+ * flushed. Everything below is guarded by state_lock; io_lock serialises
+ * card writes between the flush task and explicit flushes.
+ */
+static uint8_t units[2][JOURNAL_UNIT_SIZE];
+static int active;
+static uint32_t active_off;         /* file offset of the active unit */
+static uint32_t active_fill;
+static uint32_t written_fill;       /* bytes of the active unit already on the card */
+static bool full_pending;           /* spare holds a full unit to write at full_off */
+static uint32_t full_off;
+static bool spare_busy;             /* spare is being written */
+static bool compacting;             /* snapshot appends are written inline */
+static journal_stats_t stats;
+
+#if !CONFIG_IDF_TARGET_LINUX
+static _lock_t state_lock;
+static _lock_t io_lock;
+static TaskHandle_t flush_task_handle;
+#endif
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&state_lock);
+#endif
+}
+
+static void unlock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&state_lock);
+#endif
+}
+
+static void lock_io(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire_recursive(&io_lock);
+#endif
+}
+
+static void unlock_io(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release_recursive(&io_lock);
+#endif
+}
+
+/* Full units are written by the flush task when there is one, inline otherwise */
+static bool has_flush_task(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    return flush_task_handle != NULL && !compacting;
+#else
+    return false;
+#endif
+}
+
+static void wake_flush_task(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    xTaskNotifyGive(flush_task_handle);
+#endif
+}
+
+/* CRC-32 (IEEE), one nibble at a time to keep the table small */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+}
+
+static uint32_t record_crc(const uint8_t *record, uint16_t len)
+{
+    return ~crc32_update(0xFFFFFFFF, record + 1, RECORD_HEADER_LEN - 1 + len);
+}
+
+/* One aligned, whole-unit write made durable before returning */
+static bool write_unit(const uint8_t *unit, uint32_t offset)
+{
+    if (fseek(file, offset, SEEK_SET) != 0 ||
+        fwrite(unit, 1, JOURNAL_UNIT_SIZE, file) != JOURNAL_UNIT_SIZE ||
+        fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        ESP_LOGE(TAG, "Failed to write unit at %" PRIu32, offset);
+        return false;
+    }
+    return true;
+}
+
+/* Retire the active unit to the spare slot and start an empty one after it */
+static void rotate_locked(void)
+{
+    full_pending = true;
+    full_off = active_off;
+    active ^= 1;
+    memset(units[active], 0, JOURNAL_UNIT_SIZE);
+    active_off += JOURNAL_UNIT_SIZE;
+    active_fill = 0;
+    written_fill = 0;
+}
+
+/* Write the waiting full unit, then the unwritten part of the active one */
+static void flush_units(void)
+{
+    lock_io();
+    lock_state();
+    if (file == NULL) {
+        unlock_state();
+        unlock_io();
+        return;
+    }
+
+    if (full_pending) {
+        uint32_t offset = full_off;
+        spare_busy = true;
+        unlock_state();
+        write_unit(units[active ^ 1], offset);
+        lock_state();
+        full_pending = false;
+        spare_busy = false;
+        stats.unit_writes++;
+    }
+
+    if (active_fill > written_fill) {
+        // Write from a copy so appends can continue into the active unit
+        int spare = active ^ 1;
+        uint32_t offset = active_off;
+        uint32_t fill = active_fill;
+        memcpy(units[spare], units[active], JOURNAL_UNIT_SIZE);
+        spare_busy = true;
+        unlock_state();
+        write_unit(units[spare], offset);
+        lock_state();
+        spare_busy = false;
+        if (active_off == offset) {
+            written_fill = fill;
+        }
+        stats.partial_writes++;
+    }
+    unlock_state();
+    unlock_io();
+}
+
+/*
+ * Walk the units from the start, handing every intact record to replay.
+ * Returns with the last unit that holds records loaded as the active unit;
+ * *torn is set when a damaged record ended the walk early.
+ */
+static void replay_units(journal_replay_cb_t replay, void *ctx, bool *torn)
+{
+    uint8_t *unit = units[0];
+    uint32_t offset = 0;
+
+    active = 0;
+    active_off = 0;
+    active_fill = 0;
+    *torn = false;
+    memset(units[1], 0, JOURNAL_UNIT_SIZE);
+
+    fseek(file, 0, SEEK_SET);
+    while (!*torn) {
+        size_t n = fread(unit, 1, JOURNAL_UNIT_SIZE, file);
+        if (n == 0 || unit[0] == 0) {
+            break;
+        }
+        memset(unit + n, 0, JOURNAL_UNIT_SIZE - n);
+
+        uint32_t pos = 0;
+        while (pos + RECORD_OVERHEAD <= JOURNAL_UNIT_SIZE && unit[pos] != 0) {
+            uint16_t len = unit[pos + 2] | (unit[pos + 3] << 8);
+            uint32_t end = pos + RECORD_OVERHEAD + len;
+            if (unit[pos] != RECORD_MAGIC || end > JOURNAL_UNIT_SIZE) {
+                *torn = true;
+                break;
+            }
+            const uint8_t *crc = &unit[end - RECORD_CRC_LEN];
+            uint32_t stored = crc[0] | (crc[1] << 8) | (crc[2] << 16) | ((uint32_t)crc[3] << 24);
+            if (stored != record_crc(&unit[pos], len)) {
+                *torn = true;
+                break;
+            }
+            if (replay) {
+                replay(unit[pos + 1], &unit[pos + RECORD_HEADER_LEN], len, ctx);
+            }
+            stats.replayed++;
+            pos = end;
+        }
+
+        // Keep the valid prefix of this unit; appends continue right after it
+        memcpy(units[1], unit, pos);
+        memset(units[1] + pos, 0, JOURNAL_UNIT_SIZE - pos);
+        active_off = offset;
+        active_fill = pos;
+        offset += JOURNAL_UNIT_SIZE;
+        if (n < JOURNAL_UNIT_SIZE) {
+            break;
+        }
+    }
+    memcpy(units[0], units[1], JOURNAL_UNIT_SIZE);
+}
+
+/* Where compaction builds the new file: path with its extension swapped for JOURNAL_TMP_EXT, still an 8.3 name */
+static void tmp_name(const char *path, char *out, size_t size)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    int stem = dot && (slash == NULL || dot > slash) ? (int)(dot - path) : (int)strlen(path);
+
+    snprintf(out, size, "%.*s" JOURNAL_TMP_EXT, stem, path);
+}
+
+/* A compaction interrupted between remove and rename leaves only the new file */
+static void recover_compaction(const char *path)
+{
+    char tmp_path[SD_MAX_CHAR_SIZE + 1];
+    FILE *f;
+
+    tmp_name(path, tmp_path, sizeof(tmp_path));
+    if ((f = fopen(path, "rb")) != NULL) {
+        fclose(f);
+        remove(tmp_path);
+    } else if ((f = fopen(tmp_path, "rb")) != NULL) {
+        fclose(f);
+        ESP_LOGW(TAG, "Finishing interrupted compaction of %s", path);
+        rename(tmp_path, path);
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void flush_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(JOURNAL_FLUSH_INTERVAL_MS));
+        flush_units();
+        if (snapshot_cb && active_off + JOURNAL_UNIT_SIZE > JOURNAL_COMPACT_BYTES) {
+            journal.compact();
+        }
+    }
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+static void close_journal(void) {
+    flush_units();
+    lock_io();
+    lock_state();
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    unlock_state();
+    unlock_io();
+}
+
+/*
+ * Replay path into replay, cut off any damaged tail and get ready to
+ * append. snapshot, if given, is called to rewrite the live state during
+ * compaction.
+ */
+static bool open_journal(const char *path, journal_replay_cb_t replay, journal_snapshot_cb_t snapshot, void *ctx) {
+    bool torn;
+
+    close_journal();
+    recover_compaction(path);
+    snprintf(file_path, sizeof(file_path), "%s", path);
+
+    file = fopen(path, "r+b");
+    if (file == NULL) {
+        file = fopen(path, "w+b");
+    }
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return false;
+    }
+
+    replay_units(replay, ctx, &torn);
+    full_pending = false;
+    spare_busy = false;
+    written_fill = active_fill;
+    snapshot_cb = snapshot;
+    snapshot_ctx = ctx;
+
+    // Overwrite the damaged unit with its valid prefix and drop anything
+    // after it, so the next open does not stop at the same place
+    if (torn) {
+        ESP_LOGW(TAG, "%s: damaged record at %" PRIu32 ", discarding the rest", path, active_off + active_fill);
+        stats.torn++;
+        if (!write_unit(units[active], active_off) ||
+            ftruncate(fileno(file), active_off + JOURNAL_UNIT_SIZE) != 0) {
+            ESP_LOGE(TAG, "Failed to repair %s", path);
+        }
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if (flush_task_handle == NULL) {
+        xTaskCreate(flush_task, "journal", JOURNAL_TASK_STACK_SIZE, NULL, JOURNAL_TASK_PRIORITY, &flush_task_handle);
+    }
+#endif
+    return true;
+}
+
+/*
+ * Frame and buffer one record. Never touches the card when the flush task
+ * is running; returns false if the record is too big or both buffers are
+ * still waiting to be written.
+ */
+static bool append(uint8_t type, const void *data, uint16_t len) {
+    uint32_t size = RECORD_OVERHEAD + len;
+    bool write_now = false;
+
+    if (size > JOURNAL_UNIT_SIZE) {
+        return false;
+    }
+
+    lock_state();
+    if (file == NULL) {
+        unlock_state();
+        return false;
+    }
+    if (active_fill + size > JOURNAL_UNIT_SIZE) {
+        if (full_pending || spare_busy) {
+            stats.dropped++;
+            unlock_state();
+            return false;
+        }
+        rotate_locked();
+        write_now = true;
+    }
+
+    uint8_t *record = &units[active][active_fill];
+    record[0] = RECORD_MAGIC;
+    record[1] = type;
+    record[2] = len & 0xFF;
+    record[3] = len >> 8;
+    memcpy(record + RECORD_HEADER_LEN, data, len);
+    uint32_t crc = record_crc(record, len);
+    record[size - 4] = crc & 0xFF;
+    record[size - 3] = (crc >> 8) & 0xFF;
+    record[size - 2] = (crc >> 16) & 0xFF;
+    record[size - 1] = crc >> 24;
+    active_fill += size;
+    stats.appended++;
+    unlock_state();
+
+    if (write_now) {
+        if (has_flush_task()) {
+            wake_flush_task();
+        } else {
+            flush_units();
+        }
+    }
+    return true;
+}
+
+/* Put everything appended so far on the card, e.g. before sleep or power-off */
+static void flush(void) {
+    flush_units();
+}
+
+/*
+ * Rewrite the journal as the snapshot callback's records only. The new
+ * file is built next to the old one and renamed over it, so a crash at any
+ * point leaves one complete journal.
+ */
+static bool compact(void) {
+    char tmp_path[SD_MAX_CHAR_SIZE + 1];
+    bool ok;
+
+    if (snapshot_cb == NULL) {
+        return false;
+    }
+    tmp_name(file_path, tmp_path, sizeof(tmp_path));
+
+    // Finish the old file under both locks: an append between a flush and
+    // the swap would leave a unit meant for the old file pending for the new
+    lock_io();
+    lock_state();
+    if (full_pending) {
+        write_unit(units[active ^ 1], full_off);
+        full_pending = false;
+        stats.unit_writes++;
+    }
+    if (active_fill > written_fill) {
+        write_unit(units[active], active_off);
+        stats.partial_writes++;
+    }
+    fclose(file);
+    file = fopen(tmp_path, "w+b");
+    ok = file != NULL;
+    if (ok) {
+        active_off = 0;
+        active_fill = 0;
+        written_fill = 0;
+        memset(units[active], 0, JOURNAL_UNIT_SIZE);
+        compacting = true;
+    }
+    unlock_state();
+
+    if (ok) {
+        snapshot_cb(snapshot_ctx);
+        flush_units();
+        lock_state();
+        compacting = false;
+        fclose(file);
+        ok = remove(file_path) == 0 && rename(tmp_path, file_path) == 0;
+        file = fopen(file_path, "r+b");
+        unlock_state();
+    } else {
+        // Could not start the new file; carry on with the old one
+        file = fopen(file_path, "r+b");
+        if (file) {
+            bool torn;
+            replay_units(NULL, NULL, &torn);
+            written_fill = active_fill;
+        }
+    }
+    unlock_io();
+
+    if (file == NULL) {
+        // The next open finishes the rename from the leftover new file
+        ESP_LOGE(TAG, "Lost %s during compaction", file_path);
+        return false;
+    }
+    if (ok) {
+        stats.compactions++;
+        ESP_LOGI(TAG, "Compacted %s to %" PRIu32 " bytes", file_path, active_off + active_fill);
+    } else {
+        ESP_LOGE(TAG, "Compaction of %s failed", file_path);
+    }
+    return ok;
+}
+
+/* Copy and reset the counters */
+static void take_stats(journal_stats_t *out) {
+    lock_state();
+    *out = stats;
+    memset(&stats, 0, sizeof(stats));
+    unlock_state();
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Journal journal = {
+    .open = open_journal,
+    .append = append,
+    .flush = flush,
+    .compact = compact,
+    .close = close_journal,
+    .take_stats = take_stats
+};
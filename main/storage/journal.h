@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*journal_replay_cb_t)(uint8_t type, const void *data, uint16_t len, void *ctx);
+typedef void (*journal_snapshot_cb_t)(void *ctx);
+
+typedef struct {
+    uint32_t appended;
+    uint32_t dropped;           /* appends refused because both buffers were busy */
+    uint32_t unit_writes;       /* full units written */
+    uint32_t partial_writes;    /* partly filled units written by a flush */
+    uint32_t replayed;
+    uint32_t torn;              /* opens that found and cut off a damaged tail */
+    uint32_t compactions;
+} journal_stats_t;
+
+/*
+ * Append-only record log for small, frequent state changes (play counts,
+ * resume points, history). Records are framed as
+ *
+ *   u8 magic, u8 type, u16 len, payload, u32 crc32(type, len, payload)
+ *
+ * and packed into JOURNAL_UNIT_SIZE units that never straddle a boundary,
+ * so every write to the card is one whole, aligned unit. Appends only copy
+ * into a RAM buffer; units go out when full, every JOURNAL_FLUSH_INTERVAL_MS
+ * or on flush(), e.g. before powering down.
+ *
+ * open() replays every intact record through the replay callback and stops
+ * at the first bad one, cutting the damaged tail off. Once the file passes
+ * JOURNAL_COMPACT_BYTES it is rewritten from the snapshot callback, which
+ * re-appends the owner's live state, into a file next to it named with
+ * JOURNAL_TMP_EXT in place of the extension.
+ */
+struct Journal {
+    bool (*open)(const char *path, journal_replay_cb_t replay, journal_snapshot_cb_t snapshot, void *ctx);
+    bool (*append)(uint8_t type, const void *data, uint16_t len);
+    void (*flush)(void);
+    bool (*compact)(void);
+    void (*close)(void);
+    void (*take_stats)(journal_stats_t *stats);
+};
+
+extern const struct Journal journal;
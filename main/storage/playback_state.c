@@ -0,0 +1,441 @@
+#include "playback_state.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "journal.h"
+#include "system_config.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include <sys/lock.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "console.h"
+#endif
+
+/*********************************************************************
+ * TYPES
+ *********************************************************************/
+
+typedef struct {
+    uint32_t magic;
+    playback_state_t state;
+    uint32_t crc;
+} rtc_copy_t;
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "PLAYBACK STATE";
+
+#define RTC_COPY_MAGIC 0x50425354   /* "PBST" */
+#define JOURNAL_PLAYED 1            /* u32 track */
+
+#if !CONFIG_IDF_TARGET_LINUX
+/* Left alone by the bootloader on soft resets; garbage after power-on, which the CRC catches */
+static RTC_NOINIT_ATTR rtc_copy_t rtc_copy;
+static _lock_t state_lock;
+static _lock_t nvs_lock;
+static TaskHandle_t task_handle;
+static int64_t last_commit_us;
+static playback_state_t committed;  /* what NVS holds, as far as this boot knows */
+static bool have_committed;
+#endif
+
+static playback_snapshot_cb_t snapshot_cb;
+static playback_state_t current;
+static bool have_current;
+static playback_state_stats_t stats;
+static uint32_t played[PLAYBACK_HISTORY_LEN];  /* ring, oldest at played_total % LEN once full */
+static uint32_t played_total;
+static uint32_t played_unsaved;     /* started before the journal was open */
+static bool history_open;
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static void lock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_acquire(&state_lock);
+#endif
+}
+
+static void unlock_state(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    _lock_release(&state_lock);
+#endif
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/* Track fields only; position and pause have keys of their own */
+static bool same_track(const playback_state_t *a, const playback_state_t *b)
+{
+    return a->track == b->track && a->duration_ms == b->duration_ms &&
+           strcmp(a->title, b->title) == 0 && strcmp(a->artist, b->artist) == 0;
+}
+#endif
+
+/* Caller holds state_lock */
+static void store_current(const playback_state_t *state)
+{
+    memcpy(&current, state, sizeof(current));
+    have_current = true;
+#if !CONFIG_IDF_TARGET_LINUX
+    rtc_copy.magic = RTC_COPY_MAGIC;
+    memcpy(&rtc_copy.state, state, sizeof(rtc_copy.state));
+    rtc_copy.crc = esp_rom_crc32_le(0, (const uint8_t *)&rtc_copy.state, sizeof(rtc_copy.state));
+#endif
+}
+
+/* Caller holds state_lock */
+static void push_played(uint32_t track)
+{
+    played[played_total % PLAYBACK_HISTORY_LEN] = track;
+    played_total++;
+    if (!history_open && played_unsaved < PLAYBACK_HISTORY_LEN) {
+        played_unsaved++;
+    }
+}
+
+/* Oldest first into tracks; caller holds state_lock */
+static int copy_played(uint32_t *tracks)
+{
+    int count = played_total < PLAYBACK_HISTORY_LEN ? (int)played_total : PLAYBACK_HISTORY_LEN;
+
+    for (int i = 0; i < count; i++) {
+        tracks[i] = played[(played_total - count + i) % PLAYBACK_HISTORY_LEN];
+    }
+    return count;
+}
+
+static void replay_history(uint8_t type, const void *data, uint16_t len, void *ctx)
+{
+    uint32_t track;
+
+    if (type != JOURNAL_PLAYED || len != sizeof(track)) {
+        return;
+    }
+    memcpy(&track, data, sizeof(track));
+    lock_state();
+    push_played(track);
+    unlock_state();
+}
+
+/* Compaction: the ring is all the history there is, so it is all the new journal needs */
+static void snapshot_history(void *ctx)
+{
+    uint32_t tracks[PLAYBACK_HISTORY_LEN];
+
+    lock_state();
+    int count = copy_played(tracks);
+    unlock_state();
+    for (int i = 0; i < count; i++) {
+        journal.append(JOURNAL_PLAYED, &tracks[i], sizeof(tracks[i]));
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static bool load_rtc(playback_state_t *state)
+{
+    if (rtc_copy.magic != RTC_COPY_MAGIC ||
+        rtc_copy.crc != esp_rom_crc32_le(0, (const uint8_t *)&rtc_copy.state, sizeof(rtc_copy.state))) {
+        return false;
+    }
+    memcpy(state, &rtc_copy.state, sizeof(*state));
+    return true;
+}
+
+static bool load_nvs(playback_state_t *state)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(*state);
+    uint8_t paused = 1;
+
+    if (nvs_open(PLAYER_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    bool ok = nvs_get_blob(handle, "pb_track", state, &len) == ESP_OK && len == sizeof(*state);
+    if (ok) {
+        nvs_get_u32(handle, "pb_pos", &state->position_ms);
+        nvs_get_u8(handle, "pb_paused", &paused);
+        state->paused = paused;
+    }
+    nvs_close(handle);
+    return ok;
+}
+
+/*
+ * Write whatever differs from what NVS already holds: the track blob only
+ * when the track changed, otherwise just the position and pause keys.
+ */
+static void commit_now(void)
+{
+    playback_state_t state;
+    nvs_handle_t handle;
+
+    lock_state();
+    bool have = have_current;
+    memcpy(&state, &current, sizeof(state));
+    unlock_state();
+    if (!have) {
+        return;
+    }
+
+    _lock_acquire(&nvs_lock);
+    last_commit_us = esp_timer_get_time();
+    bool track_changed = !have_committed || !same_track(&state, &committed);
+    bool pos_changed = !have_committed || state.position_ms != committed.position_ms;
+    bool paused_changed = !have_committed || state.paused != committed.paused;
+    if (!track_changed && !pos_changed && !paused_changed) {
+        stats.skipped++;
+        _lock_release(&nvs_lock);
+        return;
+    }
+
+    if (nvs_open(PLAYER_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s", PLAYER_NVS_NAMESPACE);
+        _lock_release(&nvs_lock);
+        return;
+    }
+    if (track_changed) {
+        // The blob carries position 0, playing; the keys below hold the live values
+        playback_state_t track = state;
+        track.position_ms = 0;
+        track.paused = false;
+        nvs_set_blob(handle, "pb_track", &track, sizeof(track));
+    }
+    if (pos_changed) {
+        nvs_set_u32(handle, "pb_pos", state.position_ms);
+    }
+    if (paused_changed) {
+        nvs_set_u8(handle, "pb_paused", state.paused);
+    }
+    esp_err_t err = nvs_commit(handle);
+    nvs_close(handle);
+
+    if (err == ESP_OK) {
+        memcpy(&committed, &state, sizeof(committed));
+        have_committed = true;
+        stats.commits++;
+    } else {
+        ESP_LOGE(TAG, "NVS commit failed: %s", esp_err_to_name(err));
+    }
+    _lock_release(&nvs_lock);
+}
+
+/*
+ * Follow the position into RTC memory once a second and commit when asked
+ * to or when PLAYBACK_STATE_COMMIT_MS has passed.
+ */
+static void persist_task(void *arg)
+{
+    playback_state_t state;
+
+    while (1) {
+        bool asked = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PLAYBACK_STATE_RTC_PERIOD_MS)) > 0;
+
+        memset(&state, 0, sizeof(state));
+        if (snapshot_cb && snapshot_cb(&state)) {
+            lock_state();
+            store_current(&state);
+            unlock_state();
+        }
+        if (asked || esp_timer_get_time() - last_commit_us >= PLAYBACK_STATE_COMMIT_MS * 1000LL) {
+            commit_now();
+        }
+    }
+}
+
+static int playstate_cmd(int argc, char **argv)
+{
+    static const char *sources[] = { "nothing", "RTC memory", "NVS" };
+    playback_state_stats_t s;
+
+    playback_state.take_stats(&s);
+    printf("resumed from %s at %" PRIu32 " ms after boot; %" PRIu32 " updates, %" PRIu32
+           " NVS commits, %" PRIu32 " unchanged\n",
+           sources[s.resumed_from], s.resume_us / 1000, s.updates, s.commits, s.skipped);
+    if (have_current) {
+        printf("track %" PRIu32 " '%s' at %" PRIu32 " ms%s\n", current.track, current.title,
+               current.position_ms, current.paused ? ", paused" : "");
+    }
+
+    uint32_t tracks[PLAYBACK_HISTORY_LEN];
+    int count = playback_state.history(tracks, PLAYBACK_HISTORY_LEN);
+    printf("last played:");
+    for (int i = 0; i < count; i++) {
+        printf(" %" PRIu32, tracks[i]);
+    }
+    printf("%s\n", count ? "" : " nothing yet");
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Start the persistence task; snapshot reports the live state once a second */
+static void init(playback_snapshot_cb_t snapshot) {
+    snapshot_cb = snapshot;
+#if !CONFIG_IDF_TARGET_LINUX
+    last_commit_us = esp_timer_get_time();
+    xTaskCreate(persist_task, "playstate", PLAYBACK_STATE_TASK_STACK_SIZE, NULL,
+                PLAYBACK_STATE_TASK_PRIORITY, &task_handle);
+
+    const esp_console_cmd_t cmd = {
+        .command = "playstate",
+        .help = "Show where playback resumed from and how often NVS was written",
+        .hint = NULL,
+        .func = playstate_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+}
+
+/*
+ * Fast path for boot: only needs NVS, not the card. RTC memory wins when
+ * its CRC holds, since it is at most a second old; NVS is as old as the
+ * last commit. Returns false when there is nothing to resume.
+ */
+static bool resume(playback_state_t *state) {
+    memset(state, 0, sizeof(*state));
+    stats.resumed_from = PLAYBACK_RESUME_NONE;
+#if !CONFIG_IDF_TARGET_LINUX
+    playback_state_t stored;
+    memset(&stored, 0, sizeof(stored));
+    if (load_nvs(&stored)) {
+        memcpy(&committed, &stored, sizeof(committed));
+        have_committed = true;
+    }
+    if (load_rtc(state)) {
+        stats.resumed_from = PLAYBACK_RESUME_RTC;
+    } else if (have_committed) {
+        memcpy(state, &stored, sizeof(*state));
+        stats.resumed_from = PLAYBACK_RESUME_NVS;
+    }
+    stats.resume_us = (uint32_t)esp_timer_get_time();
+#endif
+    if (stats.resumed_from == PLAYBACK_RESUME_NONE) {
+        return false;
+    }
+
+    lock_state();
+    store_current(state);
+    unlock_state();
+    ESP_LOGI(TAG, "Resuming track %" PRIu32 " at %" PRIu32 " ms from %s, %" PRIu32 " ms after boot",
+             state->track, state->position_ms, stats.resumed_from == PLAYBACK_RESUME_RTC ? "RTC" : "NVS",
+             stats.resume_us / 1000);
+    return true;
+}
+
+/* Record a change; track changes and pauses are committed by the persistence task */
+static void update(const playback_state_t *state, playback_save_t reason) {
+    lock_state();
+    store_current(state);
+    stats.updates++;
+    if (reason == PLAYBACK_SAVE_TRACK) {
+        push_played(state->track);
+    }
+    bool journal_it = reason == PLAYBACK_SAVE_TRACK && history_open;
+    unlock_state();
+
+    if (journal_it) {
+        journal.append(JOURNAL_PLAYED, &state->track, sizeof(state->track));
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if (reason != PLAYBACK_SAVE_POSITION && task_handle) {
+        xTaskNotifyGive(task_handle);
+    }
+#endif
+}
+
+/* Write to NVS and the history journal now and wait for it, e.g. on low battery or before powering down */
+static void commit(void) {
+#if !CONFIG_IDF_TARGET_LINUX
+    commit_now();
+#else
+    stats.commits++;
+#endif
+    if (history_open) {
+        journal.flush();
+    }
+}
+
+/*
+ * Replay the history journal at path once the card is mounted; tracks
+ * started before it was open come after what it holds and are added to it.
+ */
+static bool open_history(const char *path) {
+    uint32_t all[PLAYBACK_HISTORY_LEN];
+
+    lock_state();
+    int count = copy_played(all);
+    uint32_t unsaved = played_unsaved;
+    played_total = 0;
+    played_unsaved = 0;
+    history_open = false;
+    unlock_state();
+
+    bool ok = journal.open(path, replay_history, snapshot_history, NULL);
+    if (!ok) {
+        ESP_LOGW(TAG, "No play history on the card");
+    }
+
+    // Without the journal the ring goes back as it was, still unsaved
+    int first = ok ? count - (int)unsaved : 0;
+    lock_state();
+    for (int i = first; i < count; i++) {
+        push_played(all[i]);
+    }
+    history_open = ok;
+    unlock_state();
+    for (int i = first; ok && i < count; i++) {
+        journal.append(JOURNAL_PLAYED, &all[i], sizeof(all[i]));
+    }
+    return ok;
+}
+
+/* Up to max tracks started most recently, newest first */
+static int history(uint32_t *tracks, int max) {
+    uint32_t all[PLAYBACK_HISTORY_LEN];
+
+    lock_state();
+    int count = copy_played(all);
+    unlock_state();
+    for (int i = 0; i < count && i < max; i++) {
+        tracks[i] = all[count - 1 - i];
+    }
+    return count < max ? count : max;
+}
+
+static void take_stats(playback_state_stats_t *out) {
+    lock_state();
+    *out = stats;
+    unlock_state();
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct PlaybackState playback_state = {
+    .init = init,
+    .resume = resume,
+    .update = update,
+    .commit = commit,
+    .open_history = open_history,
+    .history = history,
+    .take_stats = take_stats
+};
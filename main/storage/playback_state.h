@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "system_config.h"
+
+typedef struct {
+    uint32_t track;             /* library index */
+    uint32_t duration_ms;
+    uint32_t position_ms;
+    bool paused;
+    char title[PLAYER_MAX_TEXT + 1];
+    char artist[PLAYER_MAX_TEXT + 1];
+} playback_state_t;
+
+typedef enum {
+    PLAYBACK_SAVE_POSITION = 0, /* seek; kept in RTC memory, reaches NVS with the next commit */
+    PLAYBACK_SAVE_PAUSE,        /* pause, resume or stop; committed */
+    PLAYBACK_SAVE_TRACK,        /* new track; committed */
+} playback_save_t;
+
+typedef enum {
+    PLAYBACK_RESUME_NONE = 0,
+    PLAYBACK_RESUME_RTC,
+    PLAYBACK_RESUME_NVS,
+} playback_resume_t;
+
+typedef struct {
+    uint32_t updates;
+    uint32_t commits;           /* NVS commits that changed something */
+    uint32_t skipped;           /* commit points where NVS already matched */
+    playback_resume_t resumed_from;
+    uint32_t resume_us;         /* time since boot when resume() returned */
+} playback_state_stats_t;
+
+/* Fills in the state to persist, false while there is none; called from the persistence task */
+typedef bool (*playback_snapshot_cb_t)(playback_state_t *state);
+
+/*
+ * Where playback was, kept across resets without wearing the flash.
+ * Every update goes to a CRC-checked copy in RTC memory that survives soft
+ * resets, and the RTC copy follows the position once a second. NVS only
+ * sees commits: on a track change, a pause, an explicit commit() (low
+ * battery, power-down) and otherwise every PLAYBACK_STATE_COMMIT_MS, and
+ * only the keys that changed are written.
+ *
+ * resume() needs nothing but NVS, so it can run before the card is
+ * mounted or the library loaded: RTC memory if its CRC holds, NVS
+ * otherwise. The host build keeps nothing across runs.
+ *
+ * Once the card is up, open_history() keeps the last PLAYBACK_HISTORY_LEN
+ * tracks started in a journal on it: every track change is one record,
+ * buffered in RAM and written with the journal's next unit, and commit()
+ * flushes it along with NVS.
+ */
+struct PlaybackState {
+    void (*init)(playback_snapshot_cb_t snapshot);
+    bool (*resume)(playback_state_t *state);
+    void (*update)(const playback_state_t *state, playback_save_t reason);
+    void (*commit)(void);
+    bool (*open_history)(const char *path);
+    int (*history)(uint32_t *tracks, int max);
+    void (*take_stats)(playback_state_stats_t *stats);
+};
+
+extern const struct PlaybackState playback_state;
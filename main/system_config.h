@@ -13,9 +13,35 @@
 #define UART_FLOW_CTRL UART_HW_FLOWCTRL_DISABLE
 #define UART_SOURCE_CLK UART_SCLK_DEFAULT
 
-#define UART_RX_BUF_SIZE 256
+#define UART_RX_BUF_SIZE 1024
 #define UART_TX_BUF_SIZE 0
 
+/* Bytes pulled from the UART per read; bounds time spent in one input poll */
+#define INPUT_RX_CHUNK 64
+/* Pending keys from typing and scripted batches; must exceed chunk + batch */
+#define INPUT_KEY_QUEUE_LEN 128
+/* Scripted batches that can be in flight waiting for their ack */
+#define INPUT_ACK_SLOTS 4
+
+/*********************************************************************
+ * Console Settings
+ *********************************************************************/
+
+/* A line starting with this byte on the keypad UART is a console command */
+#define CONSOLE_CMD_PREFIX ':'
+#define CONSOLE_MAX_LINE 64
+#define CONSOLE_QUEUE_DEPTH 2
+
+#define CONSOLE_TASK_STACK_SIZE 6 * 1024
+#define CONSOLE_TASK_PRIORITY 1
+
+/*********************************************************************
+ * Trace Settings
+ *********************************************************************/
+
+/* Events kept per core before the oldest are overwritten; power of two */
+#define TRACE_RING_EVENTS 256
+
 /*********************************************************************
  * LCD Settings
  *********************************************************************/
@@ -37,6 +63,12 @@
 #define LCD_BK_LIGHT_ON_LVL 1
 #define LCD_BK_LIGHT_OFF_LVL !LCD_BK_LIGHT_ON_LVL
 
+/* Backlight PWM; fades run in the LEDC hardware */
+#define LCD_BK_LEDC_TIMER LEDC_TIMER_0
+#define LCD_BK_LEDC_CHANNEL LEDC_CHANNEL_0
+#define LCD_BK_LEDC_FREQ_HZ 5000
+#define LCD_BK_LEDC_RESOLUTION LEDC_TIMER_10_BIT
+
 #define LCD_RST_GPIO_NUM 16
 
 #define LCD_H_RES 240
@@ -56,6 +88,60 @@
 
 #define LVGL_TASK_PRIORITY 2
 
+/* Screens built on demand; cached ones are dropped past this much LVGL heap */
+#define SCREEN_STACK_DEPTH 8
+#define SCREEN_CACHE_MAX_BYTES (12 * 1024)
+
+/* Characters the search page cycles through with left/right */
+#define SEARCH_PAGE_CHARSET "abcdefghijklmnopqrstuvwxyz0123456789 "
+#define SEARCH_PAGE_RESULTS 8
+
+/* Share of LCD_SPI_PCLK_HZ a static screen may use, reported by the "flush" command */
+#define GUI_SPI_BUDGET_PCT 2
+
+/* Orientation at boot, a gui_orientation_t; "rotate" changes it at run time */
+#define GUI_ORIENTATION_DEFAULT GUI_ORIENTATION_PORTRAIT
+
+/* Now-playing screen layout and refresh */
+#define PLAYER_SCREEN_UPDATE_MS 250
+#define PLAYER_SCREEN_MARGIN 10
+#define PLAYER_TITLE_Y 60
+#define PLAYER_LINE_SPACING 24
+#define PLAYER_BAR_Y 200
+#define PLAYER_BAR_HEIGHT 6
+#define PLAYER_TIME_CELLS 6             /* "-99:59" */
+#define PLAYER_PREV_RESTART_MS 3000     /* further into a track than this, left restarts it */
+#define PLAYER_SPECTRUM_Y 110
+#define PLAYER_SPECTRUM_HEIGHT 72
+#define PLAYER_SPECTRUM_GAP 2
+#define PLAYER_LANDSCAPE_RAISE 40       /* every row moves up this much when the display is wider than tall */
+
+/*********************************************************************
+ * Display Power Settings
+ *********************************************************************/
+
+/* Keypad idle time before the backlight fades to DIM_PCT, and before the panel and LVGL stop */
+#define DISPLAY_DIM_AFTER_MS (15 * 1000)
+#define DISPLAY_OFF_AFTER_MS (30 * 1000)
+#define DISPLAY_DIM_PCT 20
+#define DISPLAY_FADE_MS 400
+/* How often the stopped LVGL task looks for keypad bytes; bounds the wake latency */
+#define DISPLAY_WAKE_POLL_MS 20
+
+/*********************************************************************
+ * Buffer Pool Settings
+ *********************************************************************/
+
+/* Cache-line alignment on the chips that cache DMA memory, harmless on the esp32 */
+#define BUF_POOL_ALIGN 32
+
+#define BUF_POOL_SMALL_SIZE 512
+#define BUF_POOL_SMALL_COUNT 8
+#define BUF_POOL_SECTOR_SIZE 4096
+#define BUF_POOL_SECTOR_COUNT 4
+#define BUF_POOL_DRAW_SIZE (LCD_H_RES * LVGL_DRAW_BUF_LINES * 2)
+#define BUF_POOL_DRAW_COUNT 2
+
 /*********************************************************************
  * SD Settings
  *********************************************************************/
@@ -66,4 +152,251 @@
 #define SD_SPI_MISO_GPIO_NUM 14
 #define SD_SPI_MOSI_GPIO_NUM 27
 #define SD_SPI_CLK_GPIO_NUM 26
-#define SD_SPI_CS_GPIO_NUM 25
\ No newline at end of file
+#define SD_SPI_CS_GPIO_NUM 25
+
+/* LVGL drive over the card, "S:/music/cover.png"; its reads go through the block cache */
+#define SD_FS_LETTER 'S'
+
+/* One FATFS sector per block; a sequential miss brings the next READ_AHEAD blocks in the same read */
+#define BLOCK_CACHE_BLOCK_SIZE 4096
+#define BLOCK_CACHE_BLOCKS 8
+#define BLOCK_CACHE_READ_AHEAD 2
+/* Files whose blocks are found again when reopened; one per block is the most that can hold any */
+#define BLOCK_CACHE_FILES BLOCK_CACHE_BLOCKS
+
+/*********************************************************************
+ * Library Settings
+ *********************************************************************/
+
+/* Index files the library keeps on the card */
+#define LIBRARY_DB_DIR SD_MOUNT_POINT "/.beatbyte"
+#define LIBRARY_PATHS_FILE LIBRARY_DB_DIR "/tracks.txt"
+#define LIBRARY_INDEX_FILE LIBRARY_DB_DIR "/tracks.idx"
+
+#define LIBRARY_MAX_PATH 256
+#define LIBRARY_MAX_DEPTH 6
+
+#define PLAYER_NVS_NAMESPACE "player"
+#define PLAYER_MAX_TEXT 63
+
+/* Type-ahead search table, built off-device by tools/build_search_index.py */
+#define SEARCH_INDEX_NAME "search.idx"
+#define SEARCH_INDEX_FILE LIBRARY_DB_DIR "/" SEARCH_INDEX_NAME
+#define SEARCH_BLOCK_SIZE 4096
+#define SEARCH_MAX_KEY 63
+#define SEARCH_MAX_BLOCK_READS 2
+#define SEARCH_CACHE_BLOCKS 2
+
+/* Track tags, one fixed-size record per track in scan order */
+#define LIBRARY_META_FILE LIBRARY_DB_DIR "/meta.bin"
+/* One FATFS sector per read, the same as BUF_POOL_SECTOR_SIZE; a tag gets at most two */
+#define TAG_READ_SIZE 4096
+#define TAG_MAX_READS 2
+#define TAG_MAX_TEXT PLAYER_MAX_TEXT
+
+/* The scanner keeps off the audio core and backs off while the output ring runs low */
+#define META_SCAN_CORE 1
+#define META_SCAN_MIN_HEADROOM_PCT 50
+#define META_SCAN_BACKOFF_MS 50
+#define META_SCAN_TASK_STACK_SIZE 4 * 1024
+#define META_SCAN_TASK_PRIORITY 1
+
+/*********************************************************************
+ * Spectrum Settings
+ *********************************************************************/
+
+/* Radix-4 transform, so a power of four */
+#define FFT_SIZE 256
+#define FFT_LOG4_SIZE 4
+
+#define SPECTRUM_BARS 16
+#define SPECTRUM_DEFAULT_FPS 15
+#define SPECTRUM_MAX_FPS 30
+/* Samples the audio tap downmixes per ring write */
+#define SPECTRUM_TAP_CHUNK 64
+/* Bars rise at once and fall this many of 255 levels per frame */
+#define SPECTRUM_FALL_PER_FRAME 24
+/* Off once less than this share of the output buffer is queued, on again after it stays above resume */
+#define SPECTRUM_MIN_HEADROOM_PCT 25
+#define SPECTRUM_RESUME_HEADROOM_PCT 50
+#define SPECTRUM_RESUME_MS 5000
+
+/*********************************************************************
+ * Bluetooth Scan Settings
+ *********************************************************************/
+
+/* Inquiry time per discovery, the 10 x 1.28 s the GAP example used in one go */
+#define SCAN_SCHED_BUDGET_MS 12800
+/* While streaming: one inquiry length per window, and the streaming time between windows */
+#define SCAN_SCHED_WINDOW_MS 1280
+#define SCAN_SCHED_GAP_MS 640
+/* Audio queue against the jitter buffer's target: cut a window below PAUSE, open one at RESUME */
+#define SCAN_SCHED_PAUSE_PCT 50
+#define SCAN_SCHED_RESUME_PCT 90
+#define SCAN_SCHED_TICK_MS 20
+
+/*********************************************************************
+ * A2DP Sink Settings
+ *********************************************************************/
+
+/* Until the source's codec configuration says otherwise */
+#define A2DP_SINK_DEFAULT_RATE 44100
+/* AVRCP metadata goes to the player this long after the last attribute when some never came */
+#define A2DP_META_SETTLE_MS 100
+
+/* Stereo int16 frames; a power of two, 8192 is about 185 ms at 44.1 kHz */
+#define JITTER_BUF_FRAMES 8192
+/* Target depth is the measured arrival spread plus the margin, within min and max */
+#define JITTER_MIN_MS 40
+#define JITTER_MAX_MS 120
+#define JITTER_MARGIN_MS 20
+/* Resampling correction limit, and the time a depth error is corrected over */
+#define JITTER_MAX_PPM 2000
+#define JITTER_CORRECT_S 10
+/* Depth smoothing per read and spread decay per packet, as shifts; the spread takes tens of seconds to shrink */
+#define JITTER_AVG_SHIFT 6
+#define JITTER_DECAY_SHIFT 12
+/* A longer silence from the source starts a new stream */
+#define JITTER_STREAM_GAP_MS 500
+#define JITTER_MAX_READ_FRAMES 512
+
+#define A2DP_OUTPUT_TASK_STACK_SIZE 4 * 1024
+#define A2DP_OUTPUT_TASK_PRIORITY 5
+/* Next to Bluedroid, CONFIG_BT_BLUEDROID_PINNED_TO_CORE */
+#define A2DP_OUTPUT_TASK_CORE 0
+
+/*********************************************************************
+ * Audio Output Settings
+ *********************************************************************/
+
+/* One DMA descriptor and one write per period; the ring holds enough periods for the latency */
+#define OUTPUT_PERIOD_FRAMES 256
+#define OUTPUT_LATENCY_MS 24
+/* Without a write for this long the output counts as idle rather than starved */
+#define OUTPUT_IDLE_MS 100
+
+/* Frames the DAC's interpolation filter holds after the I2S ring, heard that much later */
+#define OUTPUT_I2S_DELAY_FRAMES 32
+
+/* Presentation clock: how it follows the frames the output has heard, see play_clock.h */
+#define PLAY_CLOCK_SLEW_MS 500
+#define PLAY_CLOCK_MAX_TRIM_PCT 5
+#define PLAY_CLOCK_RESYNC_MS 100
+#define PLAY_CLOCK_IDLE_MS 500
+
+#define I2S_BCK_GPIO_NUM 32
+#define I2S_WS_GPIO_NUM 33
+#define I2S_DOUT_GPIO_NUM 22
+
+/* Consumption log of the file sink */
+#define OUTPUT_FILE_PATH SD_MOUNT_POINT "/output.log"
+
+/*********************************************************************
+ * Storage Settings
+ *********************************************************************/
+
+/* One FATFS sector (CONFIG_FATFS_SECTOR_4096), so unit writes never read-modify-write */
+#define JOURNAL_UNIT_SIZE 4096
+#define JOURNAL_FLUSH_INTERVAL_MS 5000
+#define JOURNAL_COMPACT_BYTES (64 * 1024)
+/* Compaction's new file, next to the journal; keeps 8.3 names valid */
+#define JOURNAL_TMP_EXT ".tmp"
+
+#define JOURNAL_TASK_STACK_SIZE 3 * 1024
+#define JOURNAL_TASK_PRIORITY 1
+
+/* Position follows into RTC memory every period; NVS is written on commit points or after the interval */
+#define PLAYBACK_STATE_RTC_PERIOD_MS 1000
+#define PLAYBACK_STATE_COMMIT_MS (5 * 60 * 1000)
+/* Tracks started, journalled on the card; "history.jnl" keeps to 8.3 */
+#define PLAYBACK_HISTORY_FILE LIBRARY_DB_DIR "/history.jnl"
+#define PLAYBACK_HISTORY_LEN 32
+
+#define PLAYBACK_STATE_TASK_STACK_SIZE 3 * 1024
+#define PLAYBACK_STATE_TASK_PRIORITY 1
+
+/*********************************************************************
+ * Host (Linux target) Settings
+ *********************************************************************/
+
+#define HOST_SCRIPT_ENV "BEAT_BYTE_SCRIPT"
+#define HOST_DUMP_DIR_ENV "BEAT_BYTE_DUMP_DIR"
+#define HOST_BENCH_ENV "BEAT_BYTE_BENCH"
+#define HOST_SD_ROOT_ENV "BEAT_BYTE_SD_ROOT"
+#define HOST_BENCH_BASELINE_ENV "BEAT_BYTE_BENCH_BASELINE"
+/* Packet arrivals ("<arrival_us> <frames>" lines, tools/trace_decode.py --arrivals) to replay through the jitter buffer */
+#define HOST_JITTER_TRACE_ENV "BEAT_BYTE_JITTER_TRACE"
+#define HOST_OUTPUT_FILE_ENV "BEAT_BYTE_OUTPUT_FILE"
+
+#define HOST_FRAME_PERIOD_MS 33
+#define HOST_SCRIPT_MAX_LINE 128
+
+
+/*********************************************************************
+ * Benchmark Settings
+ *********************************************************************/
+
+/* Allowed slowdown against the checked-in baseline before a kernel fails */
+#define BENCH_TOLERANCE_PCT 15
+#define BENCH_REPEATS 5
+
+#define BENCH_SD_FILE_NAME "bench.bin"
+#define BENCH_SD_FILE_SIZE (1024 * 1024)
+#define BENCH_SD_CHUNK_SIZE 4096
+/* LVGL drive kernels: an odd size so the last block is short, read a glyph or image row at a time */
+#define BENCH_LV_FS_FILE_NAME "lvfs.bin"
+#define BENCH_LV_FS_FILE_SIZE (64 * 1024 + 100)
+#define BENCH_LV_FS_READ_SIZE 8
+
+#define BENCH_PCM_BLOCK_SIZE 512
+#define BENCH_RING_SIZE 4096
+
+#define BENCH_SHUFFLE_TRACKS 20000
+#define BENCH_SEARCH_RESULTS 8
+/* Album series whose names all tie on the sparse keys of the bench's own index */
+#define BENCH_SEARCH_TIED 3000
+#define BENCH_SEARCH_TIED_KEY_LEN 12
+#define BENCH_SEARCH_TIED_NAME "tied.idx"
+
+/* Synthetic tagged files: audio after the tag, and cover art pushing later frames past the first read */
+#define BENCH_TAG_DIR_NAME "tags"
+/* Nested tree the library walk runs over */
+#define BENCH_WALK_DIR_NAME "walk"
+#define BENCH_TAG_AUDIO_SIZE (32 * 1024)
+#define BENCH_TAG_ART_SIZE (20 * 1024)
+
+/* Simulated A2DP link for the scan scheduler: a burst per period of up to twice its audio, one in STARVE getting through an inquiry */
+#define BENCH_SCAN_SIM_MS (60 * 1000)
+#define BENCH_SCAN_STEP_MS 10
+#define BENCH_SCAN_BURST_MS 20
+#define BENCH_SCAN_STARVE 3
+#define BENCH_SCAN_TARGET_MS 80
+
+/* Synthetic DAC for the presentation clock: crystal off by PPM, feeder waking up to JITTER late, then an underrun and an idle gap */
+#define BENCH_CLOCK_SIM_MS (40 * 1000)
+#define BENCH_CLOCK_SETTLE_MS 2000
+#define BENCH_CLOCK_STEP_US 100
+#define BENCH_CLOCK_PPM 300
+#define BENCH_CLOCK_PPM_SLACK 50
+#define BENCH_CLOCK_JITTER_US 2000
+#define BENCH_CLOCK_UNDERRUN_AT_MS 30000
+#define BENCH_CLOCK_UNDERRUN_MS 200
+#define BENCH_CLOCK_IDLE_AT_MS 35000
+#define BENCH_CLOCK_IDLE_GAP_MS 2000
+
+/* Files the block cache check writes: a short one grown past its end, and one the same size */
+#define BENCH_CACHE_GROW_NAME "grow.bin"
+#define BENCH_CACHE_OTHER_NAME "other.bin"
+#define BENCH_CACHE_SHORT_LEN 100
+#define BENCH_CACHE_GROW_AT (BLOCK_CACHE_BLOCK_SIZE + 904)
+#define BENCH_CACHE_GROW_LEN 50
+#define BENCH_JOURNAL_FILE_NAME "journal.bin"
+#define BENCH_JOURNAL_CRASH_NAME "crash.bin"
+#define BENCH_JOURNAL_RECORD_SIZE 32
+
+/* Synthetic A2DP streams: packet size, simulated length and the sine the glitch detector follows */
+#define BENCH_JITTER_PACKET_FRAMES 512
+#define BENCH_JITTER_SIM_S 60
+#define BENCH_JITTER_SETTLE_MS 1000
+#define BENCH_JITTER_SINE_PERIOD 441
+#define BENCH_JITTER_MAX_TRACE 65536
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "system_config.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#define TRACE_NUM_CORES 1
+#else
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "console.h"
+#define TRACE_NUM_CORES portNUM_PROCESSORS
+#endif
+
+/*********************************************************************
+ * STATIC VARS
+ *********************************************************************/
+
+static const char *TAG = "TRACE";
+
+/*
+ * One flight-recorder ring per core. A writer claims a slot with an atomic
+ * increment, so tasks and ISRs that preempt each other on the same core
+ * never share a slot and never take a lock. The oldest events are
+ * overwritten when a ring wraps.
+ */
+typedef struct {
+    atomic_uint head;       /* total slots claimed */
+    uint32_t dumped;        /* head at the last dump */
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+static trace_ring_t rings[TRACE_NUM_CORES];
+
+/*********************************************************************
+ * PRIVATE FUNCTIONS
+ *********************************************************************/
+
+static inline uint32_t timestamp_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return (uint32_t)esp_timer_get_time();
+#endif
+}
+
+static inline int core_id(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 0;
+#else
+    return esp_cpu_get_core_id();
+#endif
+}
+
+/* Print one ring as hex records for tools/trace_decode.py */
+static void dump_ring(int core)
+{
+    trace_ring_t *ring = &rings[core];
+    uint32_t head = atomic_load(&ring->head);
+    uint32_t start = ring->dumped;
+
+    if (head - start > TRACE_RING_EVENTS) {
+        printf("TRACE_LOST %d %" PRIu32 "\n", core, head - start - TRACE_RING_EVENTS);
+        start = head - TRACE_RING_EVENTS;
+    }
+
+    for (uint32_t i = start; i != head; i++) {
+        const trace_event_t *ev = &ring->events[i % TRACE_RING_EVENTS];
+        // A slot still being written by a preempted task has a stale seq
+        if (ev->seq != (uint16_t)i) {
+            continue;
+        }
+        const uint8_t *raw = (const uint8_t *)ev;
+        printf("TRACE %d ", core);
+        for (size_t b = 0; b < sizeof(*ev); b++) {
+            printf("%02x", raw[b]);
+        }
+        printf("\n");
+    }
+    ring->dumped = head;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static int trace_cmd(int argc, char **argv)
+{
+    trace.dump();
+    return 0;
+}
+#endif
+
+/*********************************************************************
+ * PUBLIC FUNCTIONS
+ *********************************************************************/
+
+/* Register the "trace" console command that drains the rings */
+static void init() {
+#if !CONFIG_IDF_TARGET_LINUX
+    const esp_console_cmd_t cmd = {
+        .command = "trace",
+        .help = "Dump trace events recorded since the last dump",
+        .hint = NULL,
+        .func = trace_cmd,
+    };
+    console.register_cmd(&cmd);
+#endif
+    ESP_LOGI(TAG, "Trace buffer ready (%d events per core)", TRACE_RING_EVENTS);
+}
+
+/* Record an event on the calling core's ring. Safe from tasks and ISRs. */
+static void record(uint16_t id, uint32_t arg0, uint32_t arg1) {
+    trace_ring_t *ring = &rings[core_id()];
+    uint32_t slot = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    trace_event_t *ev = &ring->events[slot % TRACE_RING_EVENTS];
+
+    ev->timestamp_us = timestamp_us();
+    ev->id = id;
+    ev->arg[0] = arg0;
+    ev->arg[1] = arg1;
+    atomic_thread_fence(memory_order_release);
+    ev->seq = (uint16_t)slot;
+}
+
+/* Write everything recorded since the last dump to the console */
+static void dump(void) {
+    printf("TRACE_BEGIN %" PRIu32 "\n", timestamp_us());
+    for (int core = 0; core < TRACE_NUM_CORES; core++) {
+        dump_ring(core);
+    }
+    printf("TRACE_END\n");
+}
+
+/*********************************************************************
+ * PUBLIC INTERFACE
+ *********************************************************************/
+
+const struct Trace trace = {
+    .init = init,
+    .record = record,
+    .dump = dump
+};
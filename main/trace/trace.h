@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Event ids. tools/trace_decode.py reads the names and values straight
+ * from this enum, so give every entry an explicit value and never reuse
+ * one.
+ */
+typedef enum {
+    TRACE_EV_NONE = 0,
+    TRACE_EV_KEY = 1,               /* arg0: UART byte, arg1: LV_KEY_* reported */
+    TRACE_EV_BT_DEVICE_FOUND = 2,   /* arg0: bda[0..3], arg1: bda[4..5] << 16 | property count */
+    TRACE_EV_BT_COD = 3,            /* arg0: class of device */
+    TRACE_EV_BT_RSSI = 4,           /* arg0: rssi (signed) */
+    TRACE_EV_A2DP_PACKET = 5,       /* arg0: frames received, arg1: frames buffered after it */
+} trace_event_id_t;
+
+typedef struct {
+    uint32_t timestamp_us;
+    uint16_t id;
+    uint16_t seq;                   /* low bits of the slot index, written last */
+    uint32_t arg[2];
+} trace_event_t;
+
+struct Trace {
+    void (*init)(void);
+    void (*record)(uint16_t id, uint32_t arg0, uint32_t arg1);
+    void (*dump)(void);
+};
+
+extern const struct Trace trace;
+
+#define TRACE(id, arg0, arg1) trace.record((id), (uint32_t)(arg0), (uint32_t)(arg1))
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Build the on-card type-ahead search index (search.idx) for main/library/search.c.
+
+Sources, pick one:
+  --tracks tracks.txt   the library list written by the device scan; titles come
+                        from file names, artist and album from the two parent
+                        directories (Artist/Album/Title.ext)
+  --tsv FILE            track<TAB>title<TAB>artist<TAB>album per line
+  --synthetic N         N generated tracks, for benchmarking
+
+Copy the result to /sdcard/.beatbyte/search.idx.
+
+File layout (little-endian), 4096-byte blocks to match CONFIG_FATFS_SECTOR_4096:
+  block 0   header: "BBSI", u16 version, u16 block_size, u32 block_count,
+            u32 entry_count, u32 sparse_offset, u8 sparse_key_len
+  block 1+  u16 entry count, then entries sorted by key:
+            u8 shared prefix len, u8 suffix len, suffix, u8 field, u32 track
+            The first entry of every block has no shared prefix.
+  sparse    block_count keys of sparse_key_len bytes (first key of each block,
+            zero padded), loaded into RAM on the device for the binary search
+"""
+
+import argparse
+import os
+import random
+import struct
+import sys
+
+MAGIC = b"BBSI"
+VERSION = 1
+BLOCK_SIZE = 4096
+SPARSE_KEY_LEN = 12
+MAX_KEY = 63
+FIELDS = {"title": 0, "artist": 1, "album": 2}
+
+
+def normalize(text):
+    """Lower-case ASCII only, matching the device's query normalisation."""
+    return text.encode("utf-8").lstrip(b" ").lower()[:MAX_KEY]
+
+
+def from_tracks(path):
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for track, line in enumerate(f):
+            parts = line.rstrip("\n").split("/")
+            title = os.path.splitext(parts[-1])[0]
+            album = parts[-2] if len(parts) >= 4 else ""
+            artist = parts[-3] if len(parts) >= 5 else ""
+            yield track, title, artist, album
+
+
+def from_tsv(path):
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            fields = line.rstrip("\n").split("\t")
+            fields += [""] * (4 - len(fields))
+            yield int(fields[0]), fields[1], fields[2], fields[3]
+
+
+def synthetic(count, seed):
+    rng = random.Random(seed)
+    syllables = ["ka", "lo", "mi", "ra", "ne", "to", "su", "vi", "de", "an", "or", "el", "ba", "zu", "qui", "ph"]
+
+    def word():
+        return "".join(rng.choice(syllables) for _ in range(rng.randint(1, 4)))
+
+    artists = [" ".join(word() for _ in range(rng.randint(1, 2))).title() for _ in range(max(1, count // 40))]
+    albums = [" ".join(word() for _ in range(rng.randint(1, 3))).title() for _ in range(max(1, count // 12))]
+    for track in range(count):
+        title = " ".join(word() for _ in range(rng.randint(1, 5))).title()
+        yield track, title, rng.choice(artists), rng.choice(albums)
+
+
+def entries(source):
+    seen = set()
+    for track, title, artist, album in source:
+        for field, text in (("title", title), ("artist", artist), ("album", album)):
+            key = normalize(text)
+            if not key:
+                continue
+            # Artists and albums repeat across tracks; one entry per name is
+            # enough to find them, the first track stands for the rest
+            if field != "title":
+                if (field, key) in seen:
+                    continue
+                seen.add((field, key))
+            yield key, FIELDS[field], track
+
+
+def encode_blocks(sorted_entries):
+    blocks = []
+    body = bytearray()
+    count = 0
+    prev = b""
+    first_keys = []
+
+    for key, field, track in sorted_entries:
+        shared = 0
+        if count:
+            limit = min(len(prev), len(key), 255)
+            while shared < limit and prev[shared] == key[shared]:
+                shared += 1
+        record = bytes([shared, len(key) - shared]) + key[shared:] + struct.pack("<BI", field, track)
+
+        if 2 + len(body) + len(record) > BLOCK_SIZE:
+            blocks.append(struct.pack("<H", count) + body)
+            body, count, shared = bytearray(), 0, 0
+            record = bytes([0, len(key)]) + key + struct.pack("<BI", field, track)
+        if count == 0:
+            first_keys.append(key)
+        body += record
+        count += 1
+        prev = key
+
+    if count:
+        blocks.append(struct.pack("<H", count) + body)
+    return [b.ljust(BLOCK_SIZE, b"\0") for b in blocks], first_keys
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--tracks")
+    source.add_argument("--tsv")
+    source.add_argument("--synthetic", type=int)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    if args.tracks:
+        rows = from_tracks(args.tracks)
+    elif args.tsv:
+        rows = from_tsv(args.tsv)
+    else:
+        rows = synthetic(args.synthetic, args.seed)
+
+    sorted_entries = sorted(entries(rows))
+    blocks, first_keys = encode_blocks(sorted_entries)
+    sparse_offset = BLOCK_SIZE * (1 + len(blocks))
+    header = MAGIC + struct.pack("<HHIIIB", VERSION, BLOCK_SIZE, len(blocks), len(sorted_entries),
+                                 sparse_offset, SPARSE_KEY_LEN)
+
+    with open(args.output, "wb") as f:
+        f.write(header.ljust(BLOCK_SIZE, b"\0"))
+        for block in blocks:
+            f.write(block)
+        for key in first_keys:
+            f.write(key[:SPARSE_KEY_LEN].ljust(SPARSE_KEY_LEN, b"\0"))
+
+    print(f"{len(sorted_entries)} entries in {len(blocks)} blocks, "
+          f"{len(blocks) * SPARSE_KEY_LEN} bytes of sparse index", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
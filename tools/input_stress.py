@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Drive the UI with scripted key batches over the keypad UART and report latency.
+
+Usage: input_stress.py PORT [--batches N] [--steps N] [--keys wsad] [--window N]
+
+Each batch is a framed packet (see main/gui/input_proto.h). The device acks
+a batch once its last key has been rendered, with the time spent feeding the
+keys and the time until the next refresh completed. Up to --window batches
+are kept in flight, matching INPUT_ACK_SLOTS on the device. Requires pyserial.
+"""
+
+import argparse
+import random
+import statistics
+import struct
+import sys
+import time
+
+import serial
+
+SYNC = 0xA5
+TYPE_BATCH = 0x5A
+TYPE_ACK = 0x5B
+ACK_BODY = struct.Struct("<BBHII")
+STATUS = {0: "ok", 1: "bad_crc", 2: "busy"}
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def encode_batch(seq, steps):
+    body = bytes([seq, len(steps)])
+    for key, repeat, delay_ms in steps:
+        body += struct.pack("<BBH", ord(key), repeat, delay_ms)
+    return bytes([SYNC, TYPE_BATCH]) + body + bytes([crc8(body)])
+
+
+class AckReader:
+    """Pick ack frames out of a byte stream that also carries log output."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buf = bytearray()
+
+    def read(self):
+        self.buf += self.port.read(self.port.in_waiting or 1)
+        acks = []
+        while True:
+            start = self.buf.find(bytes([SYNC, TYPE_ACK]))
+            if start < 0:
+                del self.buf[:-1]
+                return acks
+            frame = self.buf[start + 2:start + 2 + ACK_BODY.size + 1]
+            if len(frame) < ACK_BODY.size + 1:
+                del self.buf[:start]
+                return acks
+            body, crc = frame[:-1], frame[-1]
+            if crc8(body) == crc:
+                acks.append(ACK_BODY.unpack(body))
+                del self.buf[:start + 2 + len(frame)]
+            else:
+                del self.buf[:start + 1]
+
+
+def percentile(values, pct):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--batches", type=int, default=200)
+    parser.add_argument("--steps", type=int, default=16, help="steps per batch (max 32)")
+    parser.add_argument("--keys", default="ws", help="keys to pick from; avoid enter/esc to stay on one page")
+    parser.add_argument("--window", type=int, default=4)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    port = serial.Serial(args.port, args.baud, timeout=0.05)
+    reader = AckReader(port)
+
+    in_flight = {}
+    process_us, render_us, round_trip_ms = [], [], []
+    statuses = {}
+    keys_total = 0
+    next_seq = 0
+    sent = 0
+    start = time.monotonic()
+
+    while sent < args.batches or in_flight:
+        while sent < args.batches and len(in_flight) < args.window:
+            steps = [(rng.choice(args.keys), 1, 0) for _ in range(args.steps)]
+            seq = next_seq
+            next_seq = (next_seq + 1) & 0xFF
+            port.write(encode_batch(seq, steps))
+            in_flight[seq] = time.monotonic()
+            sent += 1
+
+        for seq, status, keys, proc, rend in reader.read():
+            sent_at = in_flight.pop(seq, None)
+            if sent_at is None:
+                continue
+            statuses[STATUS.get(status, status)] = statuses.get(STATUS.get(status, status), 0) + 1
+            if status != 0:
+                continue
+            keys_total += keys
+            process_us.append(proc)
+            render_us.append(rend)
+            round_trip_ms.append((time.monotonic() - sent_at) * 1000)
+
+        if in_flight and time.monotonic() - min(in_flight.values()) > 5:
+            print(f"timeout waiting for {len(in_flight)} ack(s)", file=sys.stderr)
+            return 1
+
+    elapsed = time.monotonic() - start
+    print(f"batches: {statuses}  keys: {keys_total}  rate: {keys_total / elapsed * 60:.0f} steps/min")
+    for name, values in (("process_us", process_us), ("render_us", render_us), ("round_trip_ms", round_trip_ms)):
+        if values:
+            print(f"{name:>14}: p50 {percentile(values, 50):8.1f}  p90 {percentile(values, 90):8.1f}  "
+                  f"p99 {percentile(values, 99):8.1f}  max {max(values):8.1f}  mean {statistics.mean(values):8.1f}")
+    return 0 if statuses.get("ok", 0) == args.batches else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
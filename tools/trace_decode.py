@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Turn a serial log containing a `:trace` dump into a readable timeline.
+
+Usage: trace_decode.py LOG [--header main/trace/trace.h] [--arrivals]
+
+Event names come from the trace_event_id_t enum in trace.h, so new events
+decode without touching this script. Events from all cores are merged and
+sorted by timestamp; the 32-bit microsecond timestamp wraps every ~71
+minutes, which is unwrapped relative to the newest event.
+
+--arrivals prints only the A2DP packets as "<arrival_us> <frames>" lines,
+the format the host bench replays through the jitter buffer when
+BEAT_BYTE_JITTER_TRACE names the file.
+"""
+
+import argparse
+import pathlib
+import re
+import struct
+import sys
+
+EVENT = struct.Struct("<IHHII")
+DEFAULT_HEADER = pathlib.Path(__file__).resolve().parent.parent / "main" / "trace" / "trace.h"
+
+LV_KEYS = {
+    9: "NEXT", 10: "ENTER", 11: "PREV", 17: "UP", 18: "DOWN",
+    19: "RIGHT", 20: "LEFT", 27: "ESC",
+}
+
+
+def load_event_names(header):
+    names = {}
+    for name, value in re.findall(r"TRACE_EV_(\w+)\s*=\s*(\d+)", header.read_text()):
+        names[int(value)] = name
+    return names
+
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def format_args(name, arg0, arg1):
+    if name == "KEY":
+        char = chr(arg0) if 32 <= arg0 < 127 else f"0x{arg0:02x}"
+        return f"byte={char!r} key={LV_KEYS.get(arg1, arg1)}"
+    if name == "BT_DEVICE_FOUND":
+        bda = arg0.to_bytes(4, "big") + (arg1 >> 16).to_bytes(2, "big")
+        return f"bda={':'.join(f'{b:02x}' for b in bda)} props={arg1 & 0xFFFF}"
+    if name == "BT_COD":
+        return f"cod=0x{arg0:06x}"
+    if name == "BT_RSSI":
+        return f"rssi={signed32(arg0)}"
+    if name == "A2DP_PACKET":
+        return f"frames={arg0} buffered={arg1}"
+    return f"arg0=0x{arg0:08x} arg1=0x{arg1:08x}"
+
+
+def parse(lines):
+    events = []
+    for line in lines:
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] == "TRACE_LOST":
+            print(f"warning: core {fields[1]} overwrote {fields[2]} events", file=sys.stderr)
+        if len(fields) != 3 or fields[0] != "TRACE":
+            continue
+        try:
+            raw = bytes.fromhex(fields[2])
+        except ValueError:
+            continue
+        if len(raw) != EVENT.size:
+            continue
+        timestamp, event_id, _seq, arg0, arg1 = EVENT.unpack(raw)
+        events.append((timestamp, int(fields[1]), event_id, arg0, arg1))
+    return events
+
+
+def unwrap(events):
+    """Timestamps more than half a wrap behind the newest one belong to the next lap."""
+    if not events:
+        return events
+    newest = max(e[0] for e in events)
+    out = []
+    for timestamp, *rest in events:
+        if newest - timestamp > (1 << 31):
+            timestamp += 1 << 32
+        out.append((timestamp, *rest))
+    return sorted(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", type=argparse.FileType("r"))
+    parser.add_argument("--header", type=pathlib.Path, default=DEFAULT_HEADER)
+    parser.add_argument("--arrivals", action="store_true", help="print A2DP packet arrivals for the bench")
+    args = parser.parse_args()
+
+    names = load_event_names(args.header)
+    events = unwrap(parse(args.log))
+    if not events:
+        print("no trace events found", file=sys.stderr)
+        return 1
+
+    if args.arrivals:
+        for timestamp, _core, event_id, arg0, _arg1 in events:
+            if names.get(event_id) == "A2DP_PACKET":
+                print(timestamp, arg0)
+        return 0
+
+    start = events[0][0]
+    previous = start
+    for timestamp, core, event_id, arg0, arg1 in events:
+        name = names.get(event_id, f"EVENT_{event_id}")
+        print(f"{(timestamp - start) / 1000:12.3f} ms  +{timestamp - previous:8d} us  "
+              f"core{core}  {name:<16} {format_args(name, arg0, arg1)}")
+        previous = timestamp
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())